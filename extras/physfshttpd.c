@@ -1,7 +1,8 @@
 /*
- * This is a quick and dirty HTTP server that uses PhysicsFS to retrieve
- *  files. It is not robust at all, probably buggy, and definitely poorly
- *  designed. It's just meant to show that it can be done.
+ * This is a small HTTP server that uses PhysicsFS to retrieve files. It was
+ *  originally a quick and dirty demo; these days it's good enough to serve
+ *  assets to a build farm on a local network, but it is still not meant to
+ *  face the open internet.
  *
  * Basically, you compile this code, and run it:
  *   ./physfshttpd archive1.zip archive2.zip /path/to/a/real/dir etc...
@@ -9,12 +10,23 @@
  * The files are appended in order to the PhysicsFS search path, and when
  *  a client request comes in, it looks for the file in said search path.
  *
- * My goal was to make this work in less than 300 lines of C, so again, it's
- *  not to be used for any serious purpose. Patches to make this application
- *  suck less will be readily and gratefully accepted.
+ * It's built around Linux's epoll: a fixed number of worker threads (one per
+ *  CPU by default) each run an event loop and share the listen socket. It
+ *  speaks enough HTTP/1.1 for keep-alive, GET and HEAD, single byte ranges,
+ *  ETags and If-None-Match. Files are sent with PHYSFS_sendToFd(), so data
+ *  that's stored uncompressed never passes through this program.
+ *
+ * Options:
+ *   -p <port>     port to listen on (default 8080).
+ *   -t <threads>  number of worker threads (default: number of CPUs).
+ *   -v            log every request.
+ *   -b <path>     benchmark: serve on a free loopback port and hammer (path)
+ *                 with keep-alive GET requests, then report requests/second.
+ *   -c <clients>  benchmark: number of client connections (default 8).
+ *   -s <seconds>  benchmark: how long to run (default 5).
  *
  * Command line I used to build this on Linux:
- *  gcc -Wall -Werror -g -o bin/physfshttpd extras/physfshttpd.c -lphysfs
+ *  gcc -Wall -Werror -g -o bin/physfshttpd extras/physfshttpd.c -lphysfs -lpthread
  *
  * License: this code is public domain. I make no warranty that it is useful,
  *  correct, harmless, or environmentally safe.
@@ -36,12 +48,19 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <errno.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 #ifndef LACKING_SIGNALS
@@ -56,234 +75,985 @@
 
 
 #define DEFAULT_PORTNUM 8080
+#define MAX_EVENTS 64
+#define MAX_REQUEST_SIZE 8192
+#define MAX_HEADER_SIZE 1024
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+typedef enum
+{
+    CONN_READING,   /* waiting for a complete request. */
+    CONN_WRITING    /* sending a response. */
+} ConnState;
 
 typedef struct
 {
     int sock;
-    struct sockaddr *addr;
-    socklen_t addrlen;
-} http_args;
+    char ipstr[64];
+    ConnState state;
+    int wantwrite;  /* non-zero if epoll is waiting for EPOLLOUT. */
+    int keepalive;
+    char request[MAX_REQUEST_SIZE + 1];
+    size_t requestlen;  /* bytes in request[]. */
+    size_t requestend;  /* end of the current request's headers, or 0. */
+    char header[MAX_HEADER_SIZE];
+    size_t headerlen;
+    size_t headersent;
+    char *body;  /* generated body (dir listing, errors), or NULL. */
+    size_t bodylen;
+    size_t bodyalloc;
+    size_t bodysent;
+    PHYSFS_File *file;  /* file being served, or NULL. */
+    PHYSFS_uint64 fileofs;  /* next byte of file to send. */
+    PHYSFS_uint64 fileend;  /* stop sending file here. */
+} Connection;
 
+typedef struct
+{
+    pthread_t thread;
+    int epollfd;
+} Worker;
 
-#define txt404 \
-    "HTTP/1.0 404 Not Found\n" \
-    "Connection: close\n" \
-    "Content-Type: text/html; charset=utf-8\n" \
-    "\n" \
-    "<html><head><title>404 Not Found</title></head>\n" \
-    "<body>Can't find '%s'.</body></html>\n\n" \
+static const struct { const char *ext; const char *mimetype; } mimetypes[] =
+{
+    { "html", "text/html; charset=utf-8" },
+    { "htm", "text/html; charset=utf-8" },
+    { "txt", "text/plain; charset=utf-8" },
+    { "css", "text/css; charset=utf-8" },
+    { "js", "text/javascript; charset=utf-8" },
+    { "json", "application/json" },
+    { "xml", "application/xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "bmp", "image/bmp" },
+    { "svg", "image/svg+xml" },
+    { "webp", "image/webp" },
+    { "ico", "image/vnd.microsoft.icon" },
+    { "tga", "image/x-tga" },
+    { "dds", "image/vnd-ms.dds" },
+    { "ktx", "image/ktx" },
+    { "wav", "audio/wav" },
+    { "ogg", "audio/ogg" },
+    { "mp3", "audio/mpeg" },
+    { "flac", "audio/flac" },
+    { "mp4", "video/mp4" },
+    { "webm", "video/webm" },
+    { "ttf", "font/ttf" },
+    { "otf", "font/otf" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "wasm", "application/wasm" },
+    { "pdf", "application/pdf" },
+    { "zip", "application/zip" },
+    { "gz", "application/gzip" },
+    { "7z", "application/x-7z-compressed" },
+};
+
+static volatile sig_atomic_t quitting = 0;
+static int verbose = 0;
+static int listensocket = -1;
 
-#define txt200 \
-    "HTTP/1.0 200 OK\n" \
-    "Connection: close\n" \
-    "Content-Type: %s\n" \
-    "\n"
 
 static const char *lastError(void)
 {
     return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
 } /* lastError */
 
-static int writeAll(const char *ipstr, const int sock, void *buf, const size_t len)
+
+static const char *mimetype(const char *fname)
 {
-    if (write(sock, buf, len) != len)
+    const char *ext = strrchr(fname, '.');
+    size_t i;
+
+    if ((ext != NULL) && (strchr(ext, '/') == NULL))
     {
-        printf("%s: Write error to socket.\n", ipstr);
+        ext++;
+        for (i = 0; i < sizeof (mimetypes) / sizeof (mimetypes[0]); i++)
+        {
+            if (strcasecmp(ext, mimetypes[i].ext) == 0)
+                return mimetypes[i].mimetype;
+        } /* for */
+    } /* if */
+
+    return "application/octet-stream";
+} /* mimetype */
+
+
+static int appendBody(Connection *conn, const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (len < 0)
         return 0;
+
+    if (conn->bodylen + len + 1 > conn->bodyalloc)
+    {
+        size_t newalloc = conn->bodyalloc ? conn->bodyalloc * 2 : 1024;
+        char *ptr;
+        while (newalloc < conn->bodylen + len + 1)
+            newalloc *= 2;
+        ptr = (char *) realloc(conn->body, newalloc);
+        if (ptr == NULL)
+            return 0;
+        conn->body = ptr;
+        conn->bodyalloc = newalloc;
     } /* if */
 
+    va_start(ap, fmt);
+    vsnprintf(conn->body + conn->bodylen, len + 1, fmt, ap);
+    va_end(ap);
+    conn->bodylen += len;
     return 1;
-} /* writeAll */
+} /* appendBody */
+
 
-static int writeString(const char *ipstr, const int sock, const char *fmt, ...)
+/* Append (str) to the body with HTML's special characters escaped. */
+static int appendBodyEscaped(Connection *conn, const char *str)
+{
+    for (; *str; str++)
+    {
+        int rc;
+        switch (*str)
+        {
+            case '&': rc = appendBody(conn, "&amp;"); break;
+            case '<': rc = appendBody(conn, "&lt;"); break;
+            case '>': rc = appendBody(conn, "&gt;"); break;
+            case '"': rc = appendBody(conn, "&quot;"); break;
+            case '\'': rc = appendBody(conn, "&#39;"); break;
+            default: rc = appendBody(conn, "%c", *str); break;
+        } /* switch */
+
+        if (!rc)
+            return 0;
+    } /* for */
+
+    return 1;
+} /* appendBodyEscaped */
+
+
+static void setHeader(Connection *conn, int status, const char *statustxt,
+                      const char *fmt, ...)
 {
-    /* none of this is robust against large strings or HTML escaping. */
-    char buffer[1024];
-    int len;
     va_list ap;
+    int len;
+
+    len = snprintf(conn->header, sizeof (conn->header),
+                   "HTTP/1.1 %d %s\r\n"
+                   "Server: physfshttpd\r\n"
+                   "Connection: %s\r\n",
+                   status, statustxt, conn->keepalive ? "keep-alive" : "close");
+
     va_start(ap, fmt);
-    len = vsnprintf(buffer, sizeof (buffer), fmt, ap);
+    len += vsnprintf(conn->header + len, sizeof (conn->header) - len, fmt, ap);
     va_end(ap);
-    if (len < 0)
+
+    len += snprintf(conn->header + len, sizeof (conn->header) - len, "\r\n");
+    if (len >= (int) sizeof (conn->header))
+        len = sizeof (conn->header) - 1;  /* shouldn't happen. */
+
+    conn->headerlen = (size_t) len;
+    conn->headersent = 0;
+} /* setHeader */
+
+
+/* Respond with a little HTML page and no file. */
+static void respondWithPage(Connection *conn, int status,
+                            const char *statustxt, const char *fname,
+                            const int head)
+{
+    conn->bodylen = 0;
+    appendBody(conn, "<html><head><title>%d %s</title></head><body>",
+               status, statustxt);
+    if (fname != NULL)
     {
-        printf("uhoh, vsnprintf() failed!\n");
-        return 0;
+        appendBody(conn, "Can't serve '");
+        appendBodyEscaped(conn, fname);
+        appendBody(conn, "'.");
     } /* if */
+    appendBody(conn, "</body></html>\n");
+
+    setHeader(conn, status, statustxt,
+              "Content-Type: text/html; charset=utf-8\r\n"
+              "Content-Length: %lu\r\n", (unsigned long) conn->bodylen);
 
-    return writeAll(ipstr, sock, buffer, len);
-} /* writeString */
+    if (head)
+        conn->bodylen = 0;
+} /* respondWithPage */
 
 
-static void feed_file_http(const char *ipstr, int sock, const char *fname)
+static void respondWithDirList(Connection *conn, const char *dname,
+                               const int head)
 {
-    PHYSFS_File *in = PHYSFS_openRead(fname);
+    char **list = PHYSFS_enumerateFiles(dname);
+    char **i;
 
-    if (in == NULL)
+    if (list == NULL)
     {
-        printf("%s: Can't open [%s]: %s.\n", ipstr, fname, lastError());
-        writeString(ipstr, sock, txt404, fname);
+        if (verbose)
+        {
+            printf("%s: Can't enumerate directory [%s]: %s.\n",
+                   conn->ipstr, dname, lastError());
+        } /* if */
+        respondWithPage(conn, 404, "Not Found", dname, head);
         return;
     } /* if */
 
-    /* !!! FIXME: mimetype */
-    if (writeString(ipstr, sock, txt200, "text/plain; charset=utf-8"))
+    conn->bodylen = 0;
+    appendBody(conn, "<html><head><title>Directory ");
+    appendBodyEscaped(conn, dname);
+    appendBody(conn, "</title></head><body><p><h1>Directory ");
+    appendBodyEscaped(conn, dname);
+    appendBody(conn, "</h1></p><p><ul>\n");
+
+    if (strcmp(dname, "/") == 0)
+        dname = "";
+
+    for (i = list; *i != NULL; i++)
     {
-        do
-        {
-            char buffer[1024];
-            PHYSFS_sint64 br = PHYSFS_readBytes(in, buffer, sizeof (buffer));
-            if (br == -1)
-            {
-                printf("%s: Read error: %s.\n", ipstr, lastError());
-                break;
-            } /* if */
+        appendBody(conn, "<li><a href='");
+        appendBodyEscaped(conn, dname);
+        appendBody(conn, "/");
+        appendBodyEscaped(conn, *i);
+        appendBody(conn, "'>");
+        appendBodyEscaped(conn, *i);
+        appendBody(conn, "</a></li>\n");
+    } /* for */
 
-            else if (!writeAll(ipstr, sock, buffer, (size_t) br))
-            {
-                break;
-            } /* else if */
-        } while (!PHYSFS_eof(in));
-    } /* if */
+    appendBody(conn, "</ul></body></html>\n");
+    PHYSFS_freeList(list);
+
+    setHeader(conn, 200, "OK",
+              "Content-Type: text/html; charset=utf-8\r\n"
+              "Content-Length: %lu\r\n", (unsigned long) conn->bodylen);
 
-    PHYSFS_close(in);
-} /* feed_file_http */
+    if (head)
+        conn->bodylen = 0;
+} /* respondWithDirList */
 
 
-static void feed_dirlist_http(const char *ipstr, int sock,
-                              const char *dname, char **list)
+/*
+ * Build an ETag from the entry's size and modtime, plus the modtime of the
+ *  archive it lives in, so replacing an archive wholesale changes every tag.
+ *  (Directories in the physical filesystem change their modtime whenever a
+ *  file is added, so we don't count those.)
+ */
+static void makeETag(const char *fname, const PHYSFS_Stat *statbuf,
+                     char *etag, const size_t etaglen)
 {
-    int i;
+    const char *realdir = PHYSFS_getRealDir(fname);
+    unsigned long long arctime = 0;
+    struct stat st;
 
-    if (!writeString(ipstr, sock, txt200, "text/html; charset=utf-8"))
-        return;
+    if ((realdir != NULL) && (stat(realdir, &st) == 0) && (!S_ISDIR(st.st_mode)))
+        arctime = (unsigned long long) st.st_mtime;
 
-    else if (!writeString(ipstr, sock,
-                    "<html><head><title>Directory %s</title></head>"
-                    "<body><p><h1>Directory %s</h1></p><p><ul>\n",
-                    dname, dname))
-        return;
+    snprintf(etag, etaglen, "\"%llx-%llx-%llx\"", arctime,
+             (unsigned long long) statbuf->modtime,
+             (unsigned long long) statbuf->filesize);
+} /* makeETag */
 
-    if (strcmp(dname, "/") == 0)
-        dname = "";
 
-    for (i = 0; list[i]; i++)
+/* Does an If-None-Match header value match (etag)? */
+static int etagMatches(const char *value, const size_t valuelen,
+                       const char *etag)
+{
+    const size_t etaglen = strlen(etag);
+    size_t i;
+
+    if ((valuelen == 1) && (*value == '*'))
+        return 1;
+
+    for (i = 0; i + etaglen <= valuelen; i++)
     {
-        const char *fname = list[i];
-        if (!writeString(ipstr, sock,
-            "<li><a href='%s/%s'>%s</a></li>\n", dname, fname, fname))
-            break;
+        if (memcmp(value + i, etag, etaglen) == 0)
+            return 1;
     } /* for */
 
-    writeString(ipstr, sock, "</ul></body></html>\n");
-} /* feed_dirlist_http */
+    return 0;
+} /* etagMatches */
+
 
-static void feed_dir_http(const char *ipstr, int sock, const char *dname)
+/*
+ * Parse a Range header against a file of (len) bytes. Returns 1 and sets
+ *  (*start) and (*end) (exclusive) for a single satisfiable range, 0 if the
+ *  header should be ignored (we don't do multiple ranges), or -1 if the
+ *  range can't be satisfied.
+ */
+static int parseRange(const char *value, const size_t valuelen,
+                      const PHYSFS_uint64 len, PHYSFS_uint64 *start,
+                      PHYSFS_uint64 *end)
 {
-    char **list = PHYSFS_enumerateFiles(dname);
-    if (list == NULL)
+    char buf[64];
+    char *dash;
+    char *endptr;
+
+    if ((valuelen >= sizeof (buf)) || (strncasecmp(value, "bytes=", 6) != 0))
+        return 0;
+
+    memcpy(buf, value + 6, valuelen - 6);
+    buf[valuelen - 6] = '\0';
+    if (strchr(buf, ',') != NULL)
+        return 0;  /* multiple ranges; just send the whole thing. */
+
+    dash = strchr(buf, '-');
+    if (dash == NULL)
+        return 0;
+    *dash = '\0';
+
+    if (buf[0] == '\0')  /* "-n" means the last n bytes. */
     {
-        printf("%s: Can't enumerate directory [%s]: %s.\n",
-               ipstr, dname, lastError());
-        writeString(ipstr, sock, txt404, dname);
-        return;
+        const unsigned long long n = strtoull(dash + 1, &endptr, 10);
+        if ((*endptr != '\0') || (dash[1] == '\0'))
+            return 0;
+        else if ((n == 0) || (len == 0))
+            return -1;
+        *start = (n >= len) ? 0 : len - n;
+        *end = len;
+        return 1;
     } /* if */
 
-    feed_dirlist_http(ipstr, sock, dname, list);
-    PHYSFS_freeList(list);
-} /* feed_dir_http */
+    *start = strtoull(buf, &endptr, 10);
+    if (*endptr != '\0')
+        return 0;
+    else if (*start >= len)
+        return -1;
+
+    if (dash[1] == '\0')  /* "n-" means from n to the end. */
+        *end = len;
+    else
+    {
+        const unsigned long long last = strtoull(dash + 1, &endptr, 10);
+        if ((*endptr != '\0') || (last < *start))
+            return 0;
+        *end = (last >= len) ? len : last + 1;
+    } /* else */
+
+    return 1;
+} /* parseRange */
+
 
-static void feed_http_request(const char *ipstr, int sock, const char *fname)
+static void respondWithFile(Connection *conn, const char *fname,
+                            const PHYSFS_Stat *statbuf, const int head,
+                            const char *range, const size_t rangelen,
+                            const char *inm, const size_t inmlen)
 {
-    PHYSFS_Stat statbuf;
+    PHYSFS_uint64 len;
+    PHYSFS_uint64 start = 0;
+    PHYSFS_uint64 end;
+    char etag[64];
+    int rc = 0;
+
+    conn->file = PHYSFS_openRead(fname);
+    if (conn->file == NULL)
+    {
+        if (verbose)
+            printf("%s: Can't open [%s]: %s.\n", conn->ipstr, fname, lastError());
+        respondWithPage(conn, 404, "Not Found", fname, head);
+        return;
+    } /* if */
 
-    printf("%s: requested [%s].\n", ipstr, fname);
+    len = (PHYSFS_uint64) PHYSFS_fileLength(conn->file);
+    end = len;
+    makeETag(fname, statbuf, etag, sizeof (etag));
 
-    if (!PHYSFS_stat(fname, &statbuf))
+    if ((inm != NULL) && (etagMatches(inm, inmlen, etag)))
     {
-        printf("%s: Can't stat [%s]: %s.\n", ipstr, fname, lastError());
-        writeString(ipstr, sock, txt404, fname);
+        PHYSFS_close(conn->file);
+        conn->file = NULL;
+        setHeader(conn, 304, "Not Modified", "ETag: %s\r\n", etag);
         return;
     } /* if */
 
-    if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
-        feed_dir_http(ipstr, sock, fname);
-    else
-        feed_file_http(ipstr, sock, fname);
-} /* feed_http_request */
-
-
-static void *do_http(void *_args)
-{
-    http_args *args = (http_args *) _args;
-    char ipstr[128];
-    char buffer[512];
-    char *ptr;
-    strncpy(ipstr, inet_ntoa(((struct sockaddr_in *) args->addr)->sin_addr),
-            sizeof (ipstr));
-    ipstr[sizeof (ipstr) - 1] = '\0';
-
-    printf("%s: connected.\n", ipstr);
-    read(args->sock, buffer, sizeof (buffer));
-    buffer[sizeof (buffer) - 1] = '\0';
-    ptr = strchr(buffer, '\n');
-    if (!ptr)
-        printf("%s: potentially bogus request.\n", ipstr);
+    if (range != NULL)
+        rc = parseRange(range, rangelen, len, &start, &end);
+
+    if (rc < 0)
+    {
+        PHYSFS_close(conn->file);
+        conn->file = NULL;
+        respondWithPage(conn, 416, "Range Not Satisfiable", NULL, head);
+        /* tack the required Content-Range onto the header. */
+        conn->headerlen -= 2;
+        conn->headerlen += snprintf(conn->header + conn->headerlen,
+                                    sizeof (conn->header) - conn->headerlen,
+                                    "Content-Range: bytes */%llu\r\n\r\n",
+                                    (unsigned long long) len);
+        return;
+    } /* if */
+
+    else if (rc > 0)
+    {
+        setHeader(conn, 206, "Partial Content",
+                  "Content-Type: %s\r\n"
+                  "Content-Length: %llu\r\n"
+                  "Content-Range: bytes %llu-%llu/%llu\r\n"
+                  "Accept-Ranges: bytes\r\n"
+                  "ETag: %s\r\n",
+                  mimetype(fname), (unsigned long long) (end - start),
+                  (unsigned long long) start, (unsigned long long) (end - 1),
+                  (unsigned long long) len, etag);
+    } /* else if */
+
     else
     {
-        *ptr = '\0';
-        ptr = strchr(buffer, '\r');
-        if (ptr != NULL)
-            *ptr = '\0';
+        setHeader(conn, 200, "OK",
+                  "Content-Type: %s\r\n"
+                  "Content-Length: %llu\r\n"
+                  "Accept-Ranges: bytes\r\n"
+                  "ETag: %s\r\n",
+                  mimetype(fname), (unsigned long long) len, etag);
+    } /* else */
+
+    if (head)
+    {
+        PHYSFS_close(conn->file);
+        conn->file = NULL;
+        return;
+    } /* if */
+
+    conn->fileofs = start;
+    conn->fileend = end;
+} /* respondWithFile */
+
+
+/* Find header (name) in the request; returns its trimmed value or NULL. */
+static const char *findHeader(const char *headers, const char *name,
+                              size_t *valuelen)
+{
+    const size_t namelen = strlen(name);
+    const char *line = headers;
+
+    while ((line = strchr(line, '\n')) != NULL)
+    {
+        const char *end;
+        line++;
+        if ((strncasecmp(line, name, namelen) != 0) || (line[namelen] != ':'))
+            continue;
+
+        line += namelen + 1;
+        while ((*line == ' ') || (*line == '\t'))
+            line++;
+        end = line;
+        while ((*end != '\r') && (*end != '\n') && (*end != '\0'))
+            end++;
+        while ((end > line) && ((end[-1] == ' ') || (end[-1] == '\t')))
+            end--;
+        *valuelen = (size_t) (end - line);
+        return line;
+    } /* while */
+
+    return NULL;
+} /* findHeader */
+
 
-        if ((toupper(buffer[0]) == 'G') &&
-            (toupper(buffer[1]) == 'E') &&
-            (toupper(buffer[2]) == 'T') &&
-            (toupper(buffer[3]) == ' ') &&
-            (toupper(buffer[4]) == '/'))
+/* Decode %XX escapes in place and drop any query string. */
+static int decodeUrl(char *url)
+{
+    char *src = url;
+    char *dst = url;
+
+    while ((*src != '\0') && (*src != '?') && (*src != '#'))
+    {
+        if (*src == '%')
         {
-            ptr = strchr(buffer + 5, ' ');
-            if (ptr != NULL)
-                *ptr = '\0';
-            feed_http_request(ipstr, args->sock, buffer + 4);
+            char hex[3];
+            if (!isxdigit((unsigned char) src[1]) ||
+                !isxdigit((unsigned char) src[2]))
+                return 0;
+            hex[0] = src[1];
+            hex[1] = src[2];
+            hex[2] = '\0';
+            *(dst++) = (char) strtol(hex, NULL, 16);
+            if (dst[-1] == '\0')
+                return 0;
+            src += 3;
         } /* if */
-    } /* else */
+        else
+        {
+            *(dst++) = *(src++);
+        } /* else */
+    } /* while */
 
-    /* !!! FIXME: Time the transfer. */
-    printf("%s: closing connection.\n", ipstr);
-    close(args->sock);
-    free(args->addr);
-    free(args);
-    return NULL;
-} /* do_http */
+    *dst = '\0';
+    return 1;
+} /* decodeUrl */
 
 
-static void serve_http_request(int sock, struct sockaddr *addr,
-                               socklen_t addrlen)
+/* Parse the request in conn->request[0..requestend] and set up a response. */
+static void handleRequest(Connection *conn)
 {
-    http_args *args = (http_args *) malloc(sizeof (http_args));
-    if (args == NULL)
+    char *req = conn->request;
+    char *method = req;
+    char *target;
+    char *version;
+    char *eol;
+    const char *value;
+    const char *range = NULL;
+    const char *inm = NULL;
+    size_t rangelen = 0;
+    size_t inmlen = 0;
+    size_t valuelen;
+    PHYSFS_Stat statbuf;
+    int head = 0;
+
+    conn->state = CONN_WRITING;
+    conn->bodylen = 0;
+    conn->bodysent = 0;
+    conn->keepalive = 0;  /* until we know better. */
+
+    eol = strchr(req, '\n');  /* requestend guarantees there is one. */
+    *eol = '\0';
+    if ((eol > req) && (eol[-1] == '\r'))
+        eol[-1] = '\0';
+
+    target = strchr(method, ' ');
+    version = target ? strchr(target + 1, ' ') : NULL;
+    if ((target == NULL) || (version == NULL))
     {
-        printf("out of memory.\n");
+        respondWithPage(conn, 400, "Bad Request", NULL, 0);
         return;
     } /* if */
-    args->addr = (struct sockaddr *) malloc(addrlen);
-    if (args->addr == NULL)
+
+    *(target++) = '\0';
+    *(version++) = '\0';
+
+    /* the headers start after the request line; findHeader wants a '\n'. */
+    *eol = '\n';
+
+    if (strcmp(version, "HTTP/1.1") == 0)
+        conn->keepalive = 1;
+    else if (strcmp(version, "HTTP/1.0") != 0)
     {
-        free(args);
-        printf("out of memory.\n");
+        respondWithPage(conn, 505, "HTTP Version Not Supported", NULL, 0);
+        return;
+    } /* else if */
+
+    value = findHeader(eol, "Connection", &valuelen);
+    if (value != NULL)
+    {
+        if ((valuelen == 5) && (strncasecmp(value, "close", 5) == 0))
+            conn->keepalive = 0;
+        else if ((valuelen == 10) && (strncasecmp(value, "keep-alive", 10) == 0))
+            conn->keepalive = 1;
+    } /* if */
+
+    if (strcmp(method, "HEAD") == 0)
+        head = 1;
+    else if (strcmp(method, "GET") != 0)
+    {
+        conn->keepalive = 0;  /* there might be a body we won't read. */
+        respondWithPage(conn, 501, "Not Implemented", NULL, 0);
+        return;
+    } /* else if */
+
+    if ((*target != '/') || (!decodeUrl(target)))
+    {
+        respondWithPage(conn, 400, "Bad Request", NULL, head);
+        return;
+    } /* if */
+
+    range = findHeader(eol, "Range", &rangelen);
+    inm = findHeader(eol, "If-None-Match", &inmlen);
+
+    if (verbose)
+        printf("%s: %s [%s].\n", conn->ipstr, method, target);
+
+    if (!PHYSFS_stat(target, &statbuf))
+    {
+        if (verbose)
+            printf("%s: Can't stat [%s]: %s.\n", conn->ipstr, target, lastError());
+        respondWithPage(conn, 404, "Not Found", target, head);
+    } /* if */
+
+    else if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        respondWithDirList(conn, target, head);
+
+    else
+    {
+        respondWithFile(conn, target, &statbuf, head,
+                        range, rangelen, inm, inmlen);
+    } /* else */
+} /* handleRequest */
+
+
+/* Returns -1 to close the connection, 0 if it would block, 1 when done. */
+static int sendResponse(Connection *conn, const int wokeForWrite)
+{
+    int sentsomething = 0;
+
+    while (conn->headersent < conn->headerlen)
+    {
+        const int more = ((conn->file != NULL) || (conn->bodylen > 0));
+        const ssize_t rc = send(conn->sock, conn->header + conn->headersent,
+                                conn->headerlen - conn->headersent,
+                                MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (rc > 0)
+        {
+            conn->headersent += (size_t) rc;
+            sentsomething = 1;
+        } /* if */
+        else if ((rc == -1) && (errno == EINTR))
+            continue;
+        else if ((rc == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            return 0;
+        else
+            return -1;
+    } /* while */
+
+    while (conn->bodysent < conn->bodylen)
+    {
+        const ssize_t rc = send(conn->sock, conn->body + conn->bodysent,
+                                conn->bodylen - conn->bodysent, MSG_NOSIGNAL);
+        if (rc > 0)
+        {
+            conn->bodysent += (size_t) rc;
+            sentsomething = 1;
+        } /* if */
+        else if ((rc == -1) && (errno == EINTR))
+            continue;
+        else if ((rc == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            return 0;
+        else
+            return -1;
+    } /* while */
+
+    while ((conn->file != NULL) && (conn->fileofs < conn->fileend))
+    {
+        const PHYSFS_sint64 rc = PHYSFS_sendToFd(conn->file, conn->sock,
+                                      conn->fileofs,
+                                      conn->fileend - conn->fileofs);
+        if (rc < 0)
+        {
+            if (verbose)
+                printf("%s: Send error: %s.\n", conn->ipstr, lastError());
+            return -1;
+        } /* if */
+
+        else if (rc == 0)
+        {
+            /* writable, but nothing went out? The file must have shrunk. */
+            if ((wokeForWrite) && (!sentsomething))
+                return -1;
+            return 0;
+        } /* else if */
+
+        conn->fileofs += (PHYSFS_uint64) rc;
+        sentsomething = 1;
+    } /* while */
+
+    return 1;
+} /* sendResponse */
+
+
+static void closeConnection(Connection *conn)
+{
+    if (verbose)
+        printf("%s: closing connection.\n", conn->ipstr);
+    if (conn->file != NULL)
+        PHYSFS_close(conn->file);
+    close(conn->sock);
+    free(conn->body);
+    free(conn);
+} /* closeConnection */
+
+
+static int setInterest(Worker *worker, Connection *conn, const int wantwrite)
+{
+    struct epoll_event ev;
+
+    if (conn->wantwrite == wantwrite)
+        return 1;
+
+    memset(&ev, '\0', sizeof (ev));
+    ev.events = wantwrite ? EPOLLOUT : EPOLLIN;
+    ev.data.ptr = conn;
+    if (epoll_ctl(worker->epollfd, EPOLL_CTL_MOD, conn->sock, &ev) == -1)
+        return 0;
+
+    conn->wantwrite = wantwrite;
+    return 1;
+} /* setInterest */
+
+
+/* Returns -1 on error/EOF, 0 if it would block. */
+static int readMore(Connection *conn)
+{
+    while (conn->requestlen < MAX_REQUEST_SIZE)
+    {
+        const ssize_t br = read(conn->sock, conn->request + conn->requestlen,
+                                MAX_REQUEST_SIZE - conn->requestlen);
+        if (br > 0)
+            conn->requestlen += (size_t) br;
+        else if (br == 0)
+            return -1;  /* client hung up. */
+        else if (errno == EINTR)
+            continue;
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            return 0;
+        else
+            return -1;
+    } /* while */
+
+    return 0;
+} /* readMore */
+
+
+/* If a whole request is buffered, note where it ends. */
+static int haveRequest(Connection *conn)
+{
+    char *end;
+
+    conn->request[conn->requestlen] = '\0';
+    end = strstr(conn->request, "\r\n\r\n");
+    if (end != NULL)
+        conn->requestend = (size_t) (end - conn->request) + 4;
+    else if ((end = strstr(conn->request, "\n\n")) != NULL)
+        conn->requestend = (size_t) (end - conn->request) + 2;
+    else
+        return 0;
+
+    return 1;
+} /* haveRequest */
+
+
+static void serviceConnection(Worker *worker, Connection *conn,
+                              const PHYSFS_uint32 events)
+{
+    int wokeForWrite = ((events & EPOLLOUT) != 0);
+
+    if (events & (EPOLLERR | EPOLLHUP))
+    {
+        closeConnection(conn);
         return;
     } /* if */
 
-    args->sock = sock;
-    args->addrlen = addrlen;
-    memcpy(args->addr, addr, addrlen);
+    while (1)
+    {
+        int rc;
+
+        if (conn->state == CONN_READING)
+        {
+            if (!haveRequest(conn))
+            {
+                if (readMore(conn) < 0)
+                {
+                    closeConnection(conn);
+                    return;
+                } /* if */
+
+                if (!haveRequest(conn))
+                {
+                    if (conn->requestlen >= MAX_REQUEST_SIZE)
+                    {
+                        /* too big. Say so and hang up. */
+                        conn->state = CONN_WRITING;
+                        conn->keepalive = 0;
+                        conn->requestend = conn->requestlen;
+                        respondWithPage(conn, 431,
+                                        "Request Header Fields Too Large",
+                                        NULL, 0);
+                    } /* if */
+                    else
+                    {
+                        if (!setInterest(worker, conn, 0))
+                            closeConnection(conn);
+                        return;  /* wait for more. */
+                    } /* else */
+                } /* if */
+            } /* if */
+
+            if (conn->state == CONN_READING)
+            {
+                /* hide any pipelined requests from the header parsing. */
+                const char saved = conn->request[conn->requestend];
+                conn->request[conn->requestend] = '\0';
+                handleRequest(conn);
+                conn->request[conn->requestend] = saved;
+            } /* if */
+        } /* if */
+
+        rc = sendResponse(conn, wokeForWrite);
+        wokeForWrite = 0;
+        if (rc < 0)
+        {
+            closeConnection(conn);
+            return;
+        } /* if */
+
+        else if (rc == 0)
+        {
+            if (!setInterest(worker, conn, 1))
+                closeConnection(conn);
+            return;
+        } /* else if */
+
+        /* response is done. */
+        if (conn->file != NULL)
+        {
+            PHYSFS_close(conn->file);
+            conn->file = NULL;
+        } /* if */
+
+        if (!conn->keepalive)
+        {
+            closeConnection(conn);
+            return;
+        } /* if */
+
+        /* keep any pipelined requests, and go around again. */
+        conn->requestlen -= conn->requestend;
+        memmove(conn->request, conn->request + conn->requestend,
+                conn->requestlen);
+        conn->requestend = 0;
+        conn->bodylen = 0;
+        conn->state = CONN_READING;
+    } /* while */
+} /* serviceConnection */
+
+
+static void acceptConnections(Worker *worker)
+{
+    while (1)
+    {
+        struct sockaddr_in addr;
+        socklen_t addrlen = sizeof (addr);
+        struct epoll_event ev;
+        Connection *conn;
+        const int one = 1;
+        int sock;
+
+        sock = accept(listensocket, (struct sockaddr *) &addr, &addrlen);
+        if (sock < 0)
+        {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+                printf("accept() failed: %s\n", strerror(errno));
+            return;  /* another worker got it, or nothing left to accept. */
+        } /* if */
+
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+        conn = (Connection *) calloc(1, sizeof (Connection));
+        if (conn == NULL)
+        {
+            printf("out of memory.\n");
+            close(sock);
+            continue;
+        } /* if */
+
+        conn->sock = sock;
+        conn->state = CONN_READING;
+        inet_ntop(AF_INET, &addr.sin_addr, conn->ipstr, sizeof (conn->ipstr));
+        if (verbose)
+            printf("%s: connected.\n", conn->ipstr);
+
+        memset(&ev, '\0', sizeof (ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(worker->epollfd, EPOLL_CTL_ADD, sock, &ev) == -1)
+        {
+            printf("epoll_ctl() failed: %s\n", strerror(errno));
+            closeConnection(conn);
+        } /* if */
+    } /* while */
+} /* acceptConnections */
+
+
+static void *workerThread(void *arg)
+{
+    Worker *worker = (Worker *) arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!quitting)
+    {
+        /* time out now and then to notice (quitting). */
+        const int n = epoll_wait(worker->epollfd, events, MAX_EVENTS, 250);
+        int i;
+
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == NULL)  /* the listen socket. */
+                acceptConnections(worker);
+            else
+            {
+                serviceConnection(worker, (Connection *) events[i].data.ptr,
+                                  events[i].events);
+            } /* else */
+        } /* for */
+    } /* while */
+
+    /* !!! FIXME: this leaks connections that are still open. */
+    return NULL;
+} /* workerThread */
+
+
+/* Returns the number of workers that started; stop that many later. */
+static int startWorkers(Worker *workers, const int numworkers)
+{
+    int i;
+
+    for (i = 0; i < numworkers; i++)
+    {
+        struct epoll_event ev;
+
+        workers[i].epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (workers[i].epollfd == -1)
+        {
+            printf("epoll_create1() failed: %s\n", strerror(errno));
+            return i;
+        } /* if */
+
+        /* every worker listens; EPOLLEXCLUSIVE wakes just one per client. */
+        memset(&ev, '\0', sizeof (ev));
+        ev.events = EPOLLIN;
+        #ifdef EPOLLEXCLUSIVE
+        ev.events |= EPOLLEXCLUSIVE;
+        #endif
+        ev.data.ptr = NULL;
+        if (epoll_ctl(workers[i].epollfd, EPOLL_CTL_ADD, listensocket, &ev) == -1)
+        {
+            printf("epoll_ctl() failed: %s\n", strerror(errno));
+            close(workers[i].epollfd);
+            return i;
+        } /* if */
+
+        if (pthread_create(&workers[i].thread, NULL, workerThread, &workers[i]) != 0)
+        {
+            printf("pthread_create() failed.\n");
+            close(workers[i].epollfd);
+            return i;
+        } /* if */
+    } /* for */
 
-    /* !!! FIXME: optionally spin a thread... */
-    do_http((void *) args);
-} /* server_http_request */
+    return numworkers;
+} /* startWorkers */
+
+
+static void stopWorkers(Worker *workers, const int numworkers)
+{
+    int i;
+    quitting = 1;
+    for (i = 0; i < numworkers; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].epollfd);
+    } /* for */
+} /* stopWorkers */
 
 
-static int create_listen_socket(short portnum)
+static int create_listen_socket(short portnum, const int loopback)
 {
     int retval = -1;
     int protocol = 0;  /* pray this is right. */
@@ -300,11 +1070,15 @@ static int create_listen_socket(short portnum)
     if (retval >= 0)
     {
         struct sockaddr_in addr;
+        const int one = 1;
+        setsockopt(retval, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+        memset(&addr, '\0', sizeof (addr));
         addr.sin_family = AF_INET;
         addr.sin_port = htons(portnum);
-        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_addr.s_addr = htonl(loopback ? INADDR_LOOPBACK : INADDR_ANY);
         if ((bind(retval, (struct sockaddr *) &addr, (socklen_t) sizeof (addr)) == -1) ||
-            (listen(retval, 5) == -1))
+            (listen(retval, SOMAXCONN) == -1) ||
+            (fcntl(retval, F_SETFL, fcntl(retval, F_GETFL, 0) | O_NONBLOCK) == -1))
         {
             close(retval);
             retval = -1;
@@ -315,85 +1089,276 @@ static int create_listen_socket(short portnum)
 } /* create_listen_socket */
 
 
-static int listensocket = -1;
+/* Benchmark client stuff... */
 
-void at_exit_cleanup(void)
+typedef struct
+{
+    pthread_t thread;
+    unsigned short port;
+    const char *path;
+    double seconds;
+    unsigned long requests;
+    unsigned long long bytes;
+    int failed;
+} BenchClient;
+
+static double now(void)
 {
-    /*
-     * !!! FIXME: If thread support, signal threads to terminate and
-     * !!! FIXME:  wait for them to clean up.
-     */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+} /* now */
 
-    if (listensocket >= 0)
-        close(listensocket);
+static void *benchClientThread(void *arg)
+{
+    BenchClient *client = (BenchClient *) arg;
+    const double end = now() + client->seconds;
+    static char buf[64 * 1024];  /* contents are thrown away; share it. */
+    char req[512];
+    char hdr[2048];
+    struct sockaddr_in addr;
+    const int one = 1;
+    int reqlen;
+    int sock;
 
-    if (!PHYSFS_deinit())
-        printf("PHYSFS_deinit() failed: %s\n", lastError());
-} /* at_exit_cleanup */
+    sock = socket(PF_INET, SOCK_STREAM, 0);
+    memset(&addr, '\0', sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(client->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((sock < 0) || (connect(sock, (struct sockaddr *) &addr, sizeof (addr)) == -1))
+    {
+        client->failed = 1;
+        if (sock >= 0)
+            close(sock);
+        return NULL;
+    } /* if */
 
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+    reqlen = snprintf(req, sizeof (req),
+                      "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", client->path);
 
-int main(int argc, char **argv)
+    while (now() < end)
+    {
+        unsigned long long contentlen = 0;
+        size_t hdrlen = 0;
+        char *body;
+        char *cl;
+        size_t have;
+
+        if (write(sock, req, reqlen) != reqlen)
+            break;
+
+        /* read until the end of the headers. */
+        body = NULL;
+        while (body == NULL)
+        {
+            const ssize_t br = read(sock, hdr + hdrlen, sizeof (hdr) - hdrlen - 1);
+            if (br <= 0)
+                break;
+            hdrlen += (size_t) br;
+            hdr[hdrlen] = '\0';
+            body = strstr(hdr, "\r\n\r\n");
+        } /* while */
+
+        if ((body == NULL) || (strncmp(hdr, "HTTP/1.1 200 ", 13) != 0))
+        {
+            client->failed = 1;
+            break;
+        } /* if */
+
+        body += 4;
+        cl = strstr(hdr, "Content-Length: ");
+        if (cl != NULL)
+            contentlen = strtoull(cl + 16, NULL, 10);
+
+        have = hdrlen - (size_t) (body - hdr);
+        while (have < contentlen)
+        {
+            size_t want = (size_t) (contentlen - have);
+            ssize_t br;
+            if (want > sizeof (buf))
+                want = sizeof (buf);
+            br = read(sock, buf, want);
+            if (br <= 0)
+                break;
+            have += (size_t) br;
+        } /* while */
+
+        if (have != contentlen)
+        {
+            client->failed = 1;
+            break;
+        } /* if */
+
+        client->requests++;
+        client->bytes += contentlen;
+    } /* while */
+
+    close(sock);
+    return NULL;
+} /* benchClientThread */
+
+
+static int runBenchmark(const char *path, const int numclients,
+                        const double seconds)
 {
+    BenchClient *clients = (BenchClient *) calloc(numclients, sizeof (BenchClient));
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof (addr);
+    unsigned long long bytes = 0;
+    unsigned long requests = 0;
+    double start, elapsed;
+    int failed = 0;
     int i;
+
+    if (clients == NULL)
+    {
+        printf("out of memory.\n");
+        return 0;
+    } /* if */
+
+    getsockname(listensocket, (struct sockaddr *) &addr, &addrlen);
+    printf("Benchmarking GET %s with %d clients for %.1f seconds...\n",
+           path, numclients, seconds);
+
+    start = now();
+    for (i = 0; i < numclients; i++)
+    {
+        clients[i].port = ntohs(addr.sin_port);
+        clients[i].path = path;
+        clients[i].seconds = seconds;
+        pthread_create(&clients[i].thread, NULL, benchClientThread, &clients[i]);
+    } /* for */
+
+    for (i = 0; i < numclients; i++)
+    {
+        pthread_join(clients[i].thread, NULL);
+        requests += clients[i].requests;
+        bytes += clients[i].bytes;
+        failed |= clients[i].failed;
+    } /* for */
+    elapsed = now() - start;
+
+    printf("%lu requests in %.2f seconds: %.0f requests/sec, %.1f MiB/sec.\n",
+           requests, elapsed, ((double) requests) / elapsed,
+           (((double) bytes) / (1024.0 * 1024.0)) / elapsed);
+    if (failed)
+        printf("WARNING: some requests failed.\n");
+
+    free(clients);
+    return !failed;
+} /* runBenchmark */
+
+
+#ifndef LACKING_SIGNALS
+static void handleQuitSignal(int sig)
+{
+    quitting = 1;
+} /* handleQuitSignal */
+#endif
+
+
+int main(int argc, char **argv)
+{
+    const char *benchpath = NULL;
+    double benchseconds = 5.0;
+    int benchclients = 8;
     int portnum = DEFAULT_PORTNUM;
+    int numworkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    Worker *workers = NULL;
+    int started = 0;
+    int retval = 0;
+    int i;
 
     setbuf(stdout, NULL);
     setbuf(stderr, NULL);
 
 #ifndef LACKING_SIGNALS
-    /* I'm not sure if this qualifies as a cheap trick... */
-    signal(SIGTERM, exit);
-    signal(SIGINT, exit);
-    signal(SIGFPE, exit);
-    signal(SIGSEGV, exit);
-    signal(SIGPIPE, exit);
-    signal(SIGILL, exit);
+    signal(SIGTERM, handleQuitSignal);
+    signal(SIGINT, handleQuitSignal);
+    signal(SIGPIPE, SIG_IGN);  /* we'll see EPIPE from send() instead. */
 #endif
 
-    if (argc == 1)
+    for (i = 1; (i < argc) && (argv[i][0] == '-'); i++)
+    {
+        const char *arg = argv[i];
+        if ((strcmp(arg, "-v") == 0))
+            verbose = 1;
+        else if ((strcmp(arg, "-p") == 0) && (i + 1 < argc))
+            portnum = atoi(argv[++i]);
+        else if ((strcmp(arg, "-t") == 0) && (i + 1 < argc))
+            numworkers = atoi(argv[++i]);
+        else if ((strcmp(arg, "-b") == 0) && (i + 1 < argc))
+            benchpath = argv[++i];
+        else if ((strcmp(arg, "-c") == 0) && (i + 1 < argc))
+            benchclients = atoi(argv[++i]);
+        else if ((strcmp(arg, "-s") == 0) && (i + 1 < argc))
+            benchseconds = atof(argv[++i]);
+        else
+        {
+            i = argc;  /* force the usage message. */
+            break;
+        } /* else */
+    } /* for */
+
+    if (i >= argc)
     {
-        printf("USAGE: %s <archive1> [archive2 [... archiveN]]\n", argv[0]);
+        printf("USAGE: %s [-p port] [-t threads] [-v] [-b path [-c clients] [-s seconds]] <archive1> [archive2 [... archiveN]]\n", argv[0]);
         return 42;
     } /* if */
 
+    if (numworkers < 1)
+        numworkers = 1;
+    if (benchclients < 1)
+        benchclients = 1;
+
     if (!PHYSFS_init(argv[0]))
     {
         printf("PHYSFS_init() failed: %s\n", lastError());
         return 42;
     } /* if */
 
-    /* normally, this is bad practice, but oh well. */
-    atexit(at_exit_cleanup);
-
-    for (i = 1; i < argc; i++)
+    for (; i < argc; i++)
     {
         if (!PHYSFS_mount(argv[i], NULL, 1))
             printf(" WARNING: failed to add [%s] to search path.\n", argv[i]);
-    } /* else */
+    } /* for */
 
-    listensocket = create_listen_socket(portnum);
+    /* the benchmark listens on a free loopback port. */
+    listensocket = create_listen_socket(benchpath ? 0 : portnum, benchpath != NULL);
     if (listensocket < 0)
     {
         printf("listen socket failed to create.\n");
+        PHYSFS_deinit();
         return 42;
     } /* if */
 
-    while (1)  /* infinite loop for now. */
+    workers = (Worker *) calloc(numworkers, sizeof (Worker));
+    if (workers != NULL)
+        started = startWorkers(workers, numworkers);
+
+    if (started < numworkers)
+        retval = 42;
+
+    else if (benchpath != NULL)
+        retval = runBenchmark(benchpath, benchclients, benchseconds) ? 0 : 42;
+
+    else
     {
-        struct sockaddr addr;
-        socklen_t len;
-        int s = accept(listensocket, &addr, &len);
-        if (s < 0)
-        {
-            printf("accept() failed: %s\n", strerror(errno));
-            close(listensocket);
-            return 42;
-        } /* if */
+        printf("Serving on port %d with %d threads.\n", portnum, numworkers);
+        while (!quitting)
+            pause();  /* signal handler sets (quitting). */
+    } /* else */
 
-        serve_http_request(s, &addr, len);
-    } /* while */
+    stopWorkers(workers, started);
+    free(workers);
+    close(listensocket);
 
-    return 0;
+    if (!PHYSFS_deinit())
+        printf("PHYSFS_deinit() failed: %s\n", lastError());
+
+    return retval;
 } /* main */
 
 /* end of physfshttpd.c ... */
@@ -2,11 +2,80 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 
 #include "physfs.h"
 
+/*
+ * Threads and restoring modification times need POSIX. Elsewhere we unpack
+ *  one file at a time and leave the times alone.
+ */
+#if defined(__unix__) || defined(__unix) || \
+    (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#if defined(_POSIX_THREADS) && (_POSIX_THREADS > 0)
+#define UNPACK_THREADS 1
+#include <pthread.h>
+#else
+#define UNPACK_THREADS 0
+#endif
+
+#if defined(_POSIX_VERSION)
+#define UNPACK_MODTIMES 1
+#include <sys/time.h>
+#else
+#define UNPACK_MODTIMES 0
+#endif
+
+#if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0) && defined(CLOCK_MONOTONIC)
+#define UNPACK_MONOTONIC 1
+#else
+#define UNPACK_MONOTONIC 0
+#endif
+
+/*
+ * We collect every entry in the archive first, then a pool of threads
+ *  extracts the files in the order PhysicsFS enumerated them. Neighbouring
+ *  files in a 7zip archive usually share a solid folder, and we let the 7zip
+ *  archiver hold on to decompressed folders until all their files have been
+ *  opened (see PHYSFS_setSolidCacheLimit()), so each folder gets
+ *  decompressed about once no matter how many threads are pulling files out
+ *  of it.
+ */
+
+/* decompressed solid folders the archive may keep while we unpack. */
+#define UNPACK_SOLID_CACHE_LIMIT (256 * 1024 * 1024)
+
+/* each thread copies files through a buffer this big. */
+#define UNPACK_BUFFER_SIZE (256 * 1024)
+
+typedef struct
+{
+    char *fname;
+    PHYSFS_sint64 filesize;
+    PHYSFS_sint64 modtime;
+    int isdir;
+} UnpackEntry;
 
 static int failure = 0;
+static UnpackEntry *entries = NULL;
+static size_t numentries = 0;
+static size_t allocentries = 0;
+static size_t nextentry = 0;  /* next entry a worker should take. */
+static PHYSFS_uint64 totalfiles = 0;
+static PHYSFS_uint64 totalbytes = 0;
+
+#if UNPACK_THREADS
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
 
 static void modTimeToStr(PHYSFS_sint64 modtime, char *modstr, size_t strsize)
 {
@@ -34,51 +103,102 @@ static void fail(const char *what, const char *why)
 } /* fail */
 
 
-static void dumpFile(const char *fname)
+#if UNPACK_MODTIMES
+static char *nativePath(const char *fname)
+{
+    const char *writedir = PHYSFS_getWriteDir();
+    const char *dirsep = PHYSFS_getDirSeparator();
+    const size_t len = strlen(writedir) + (strlen(fname) * strlen(dirsep)) + 1;
+    char *retval = (char *) malloc(len);
+    char *ptr;
+
+    if (retval == NULL)
+        return NULL;
+
+    strcpy(retval, writedir);
+    ptr = retval + strlen(retval);
+    for (; *fname; fname++)
+    {
+        if (*fname != '/')
+            *(ptr++) = *fname;
+        else
+        {
+            strcpy(ptr, dirsep);
+            ptr += strlen(dirsep);
+        } /* else */
+    } /* for */
+    *ptr = '\0';
+
+    return retval;
+} /* nativePath */
+
+
+static void setModTime(const char *fname, const PHYSFS_sint64 modtime)
+{
+    if (modtime != -1)
+    {
+        char *path = nativePath(fname);
+        struct timeval tv[2];
+        tv[0].tv_sec = tv[1].tv_sec = (time_t) modtime;
+        tv[0].tv_usec = tv[1].tv_usec = 0;
+        if (path == NULL)
+            fail("malloc", "Out of memory!");
+        else if (utimes(path, tv) == -1)
+            fail("utimes", strerror(errno));
+        free(path);
+    } /* if */
+} /* setModTime */
+#else
+static void setModTime(const char *fname, const PHYSFS_sint64 modtime)
 {
-    const int origfailure = failure;
+    /* no portable way to do this; the files keep the time we wrote them. */
+} /* setModTime */
+#endif
+
+
+static void dumpFile(const UnpackEntry *entry, char *buf)
+{
+    const char *fname = entry->fname;
+    const PHYSFS_uint64 size = (PHYSFS_uint64) entry->filesize;
+    PHYSFS_uint64 total = 0;
     PHYSFS_File *out = NULL;
     PHYSFS_File *in = NULL;
-
-    failure = 0;
+    int ok = 0;
 
     if ((in = PHYSFS_openRead(fname)) == NULL)
-        fail("\nPHYSFS_openRead", NULL);
+        fail("PHYSFS_openRead", NULL);
     else if ((out = PHYSFS_openWrite(fname)) == NULL)
-        fail("\nPHYSFS_openWrite", NULL);
+        fail("PHYSFS_openWrite", NULL);
     else
     {
-        char modstr[64];
-        PHYSFS_sint64 size = PHYSFS_fileLength(in);
-
-        printf("(");
-        if (size == -1)
-            printf("?");
-        else
-            printf("%lld", (long long) size);
-        printf(" bytes");
-
-        modTimeToStr(PHYSFS_getLastModTime(fname), modstr, sizeof (modstr));
-        printf(", %s)\n", modstr);
-
-        while ( (!failure) && (!PHYSFS_eof(in)) )
+        ok = 1;
+        while (ok)
         {
-            static char buf[64 * 1024];
-            PHYSFS_sint64 br = PHYSFS_read(in, buf, 1, sizeof (buf));
-            if (br == -1)
-                fail("PHYSFS_read", NULL);
+            const PHYSFS_sint64 br = PHYSFS_readBytes(in, buf,
+                                                      UNPACK_BUFFER_SIZE);
+            if (br == 0)
+                break;
+            else if (br < 0)
+            {
+                fail("PHYSFS_readBytes", NULL);
+                ok = 0;
+            } /* else if */
+            else if (PHYSFS_writeBytes(out, buf, (PHYSFS_uint64) br) != br)
+            {
+                fail("PHYSFS_writeBytes", NULL);
+                ok = 0;
+            } /* else if */
             else
             {
-                PHYSFS_sint64 bw = PHYSFS_write(out, buf, 1, br);
-                if (bw != br)
-                    fail("PHYSFS_write", NULL);
-                else
-                    size -= bw;
+                total += (PHYSFS_uint64) br;
             } /* else */
         } /* while */
 
-        if ((!failure) && (size != 0))
-            fail("PHYSFS_eof", "BUG! eof != PHYSFS_fileLength bytes!");
+        if ((ok) && (total != size))
+        {
+            fail("PHYSFS_readBytes", "BUG! eof != PHYSFS_fileLength bytes!");
+            ok = 0;
+        } /* if */
     } /* else */
 
     if (in != NULL)
@@ -87,64 +207,238 @@ static void dumpFile(const char *fname)
     if (out != NULL)
     {
         if (!PHYSFS_close(out))
+        {
             fail("PHYSFS_close", NULL);
+            ok = 0;
+        } /* if */
+
+        if (!ok)
+            PHYSFS_delete(fname);
+        else
+            setModTime(fname, entry->modtime);
     } /* if */
 
-    if (failure)
-        PHYSFS_delete(fname);
-    else
-        failure = origfailure;
+    if (ok)
+    {
+        char modstr[64];
+        LOCK();
+        modTimeToStr(entry->modtime, modstr, sizeof (modstr));
+        printf("%s (%lld bytes, %s)\n", fname, (long long) size, modstr);
+        totalfiles++;
+        totalbytes += size;
+        UNLOCK();
+    } /* if */
 } /* dumpFile */
 
 
+static void *unpackThread(void *unused)
+{
+    char *buf = (char *) malloc(UNPACK_BUFFER_SIZE);
+
+    if (buf == NULL)
+    {
+        fail("malloc", "Out of memory!");
+        return NULL;
+    } /* if */
+
+    while (1)
+    {
+        UnpackEntry *entry;
+
+        LOCK();
+        if (nextentry == numentries)
+        {
+            UNLOCK();
+            break;
+        } /* if */
+        entry = &entries[nextentry++];
+        UNLOCK();
+
+        if (!entry->isdir)
+            dumpFile(entry, buf);
+    } /* while */
+
+    free(buf);
+    return NULL;
+} /* unpackThread */
+
+
+/* Unpack everything with (jobs) threads, this one included. */
+static void runThreads(const int jobs)
+{
+#if UNPACK_THREADS
+    pthread_t *threads = NULL;
+    int i = 0;
+
+    if (jobs > 1)
+    {
+        threads = (pthread_t *) malloc(sizeof (pthread_t) * (jobs - 1));
+        if (threads == NULL)
+            fail("malloc", "Out of memory!");
+        else
+        {
+            for (i = 0; i < jobs - 1; i++)
+            {
+                const int rc = pthread_create(&threads[i], NULL,
+                                              unpackThread, NULL);
+                if (rc != 0)
+                {
+                    fail("pthread_create", strerror(rc));
+                    break;
+                } /* if */
+            } /* for */
+        } /* else */
+    } /* if */
+
+    unpackThread(NULL);  /* whatever threads we got, we pitch in, too. */
+
+    while (i > 0)
+        pthread_join(threads[--i], NULL);
+    free(threads);
+#else
+    unpackThread(NULL);
+#endif
+} /* runThreads */
+
+
+static UnpackEntry *addEntry(char *fname, const PHYSFS_Stat *statbuf)
+{
+    UnpackEntry *entry;
+
+    if (numentries == allocentries)
+    {
+        const size_t newalloc = allocentries ? allocentries * 2 : 256;
+        void *ptr = realloc(entries, newalloc * sizeof (UnpackEntry));
+        if (ptr == NULL)
+            return NULL;
+        entries = (UnpackEntry *) ptr;
+        allocentries = newalloc;
+    } /* if */
+
+    entry = &entries[numentries++];
+    entry->fname = fname;
+    entry->filesize = statbuf->filesize;
+    entry->modtime = statbuf->modtime;
+    entry->isdir = (statbuf->filetype == PHYSFS_FILETYPE_DIRECTORY);
+    return entry;
+} /* addEntry */
+
+
 static void unpackCallback(void *_depth, const char *origdir, const char *str)
 {
     int depth = *((int *) _depth);
     const int len = strlen(origdir) + strlen(str) + 2;
     char *fname = (char *) malloc(len);
+    PHYSFS_Stat statbuf;
+
     if (fname == NULL)
+    {
         fail("malloc", "Out of memory!");
-    else
+        return;
+    } /* if */
+
+    if (strcmp(origdir, "/") == 0)
+        origdir = "";
+
+    snprintf(fname, len, "%s/%s", origdir, str);
+
+    if (!PHYSFS_stat(fname, &statbuf))
     {
-        if (strcmp(origdir, "/") == 0)
-            origdir = "";
+        fprintf(stderr, "%s ", fname);
+        fail("PHYSFS_stat", NULL);
+        free(fname);
+    } /* if */
 
-        snprintf(fname, len, "%s/%s", origdir, str);
+    else if (statbuf.filetype == PHYSFS_FILETYPE_SYMLINK)
+    {
+        printf("%s (symlink)\n", fname);
+        /* !!! FIXME: ?  if (!symlink(fname, */
+        free(fname);
+    } /* else if */
 
-        printf("%s ", fname);
-        if (PHYSFS_isDirectory(fname))
+    else if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+    {
+        depth++;
+        printf("%s (directory)\n", fname);
+        if (!PHYSFS_mkdir(fname))
         {
-            depth++;
-            printf("(directory)\n");
-            if (!PHYSFS_mkdir(fname))
-                fail("PHYSFS_mkdir", NULL);
-            else
-                PHYSFS_enumerateFilesCallback(fname, unpackCallback, &depth);
+            fail("PHYSFS_mkdir", NULL);
+            free(fname);
         } /* if */
-
-        else if (PHYSFS_isSymbolicLink(fname))
+        else if (addEntry(fname, &statbuf) == NULL)
         {
-            printf("(symlink)\n");
-            /* !!! FIXME: ?  if (!symlink(fname, */
+            fail("malloc", "Out of memory!");
+            free(fname);
         } /* else if */
-
-        else  /* ...file. */
+        else
         {
-            dumpFile(fname);
+            PHYSFS_enumerateFilesCallback(fname, unpackCallback, &depth);
         } /* else */
+    } /* else if */
 
-        free(fname);
+    else  /* ...file. */
+    {
+        if (statbuf.filesize < 0)
+        {
+            fprintf(stderr, "%s ", fname);
+            fail("PHYSFS_stat", "unknown file size");
+            free(fname);
+        } /* if */
+        else if (addEntry(fname, &statbuf) == NULL)
+        {
+            fail("malloc", "Out of memory!");
+            free(fname);
+        } /* else if */
     } /* else */
 } /* unpackCallback */
 
 
+static double now(void)
+{
+#if UNPACK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+#else
+    return (double) time(NULL);
+#endif
+} /* now */
+
+
 int main(int argc, char **argv)
 {
     int zero = 0;
+    int jobs = 1;
+    int argi = 1;
+    double starttime, elapsed;
+    size_t i;
 
-    if (argc != 3)
+    if ((argc >= 2) && (strncmp(argv[1], "-j", 2) == 0))
     {
-        fprintf(stderr, "USAGE: %s <archive> <unpackDirectory>\n", argv[0]);
+        if (argv[1][2] != '\0')
+            jobs = atoi(argv[1] + 2);
+        else if (argc >= 3)
+            jobs = atoi(argv[++argi]);
+        argi++;
+
+        #if UNPACK_THREADS && defined(_SC_NPROCESSORS_ONLN)
+        if (jobs < 1)  /* "-j0" means one per CPU. */
+            jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        #elif !UNPACK_THREADS
+        if (jobs != 1)
+        {
+            fprintf(stderr, "No threads on this platform; using one.\n");
+            jobs = 1;
+        } /* if */
+        #endif
+
+        if (jobs < 1)
+            jobs = 1;
+    } /* if */
+
+    if (argc - argi != 2)
+    {
+        fprintf(stderr, "USAGE: %s [-j threads] <archive> <unpackDirectory>\n", argv[0]);
         return 1;
     } /* if */
 
@@ -154,22 +448,51 @@ int main(int argc, char **argv)
         return 2;
     } /* if */
 
-    if (!PHYSFS_setWriteDir(argv[2]))
+    if (!PHYSFS_setWriteDir(argv[argi + 1]))
     {
         fprintf(stderr, "PHYSFS_setWriteDir('%s') failed: %s\n",
-                argv[2], PHYSFS_getLastError());
+                argv[argi + 1], PHYSFS_getLastError());
         return 3;
     } /* if */
 
-    if (!PHYSFS_mount(argv[1], NULL, 1))
+    if (!PHYSFS_mount(argv[argi], NULL, 1))
     {
         fprintf(stderr, "PHYSFS_mount('%s') failed: %s\n",
-                argv[1], PHYSFS_getLastError());
+                argv[argi], PHYSFS_getLastError());
         return 4;
     } /* if */
 
+    starttime = now();
+
+    /* we're reading the whole thing, so solid blocks are worth keeping. */
+    PHYSFS_setSolidCacheLimit(UNPACK_SOLID_CACHE_LIMIT);
     PHYSFS_permitSymbolicLinks(1);
     PHYSFS_enumerateFilesCallback("/", unpackCallback, &zero);
+
+    runThreads(jobs);
+
+    /* do directories last (deepest first), as unpacking touched them all. */
+    for (i = numentries; i > 0; i--)
+    {
+        UnpackEntry *entry = &entries[i - 1];
+        if (entry->isdir)
+            setModTime(entry->fname, entry->modtime);
+        free(entry->fname);
+    } /* for */
+    free(entries);
+
+    elapsed = now() - starttime;
+    printf("Unpacked %llu files (%.1f MiB) in %.2f seconds with %d thread%s",
+           (unsigned long long) totalfiles,
+           ((double) totalbytes) / (1024.0 * 1024.0), elapsed, jobs,
+           (jobs == 1) ? "" : "s");
+    if (elapsed > 0.0)
+    {
+        printf(": %.1f MiB/s",
+               (((double) totalbytes) / (1024.0 * 1024.0)) / elapsed);
+    } /* if */
+    printf(".\n");
+
     PHYSFS_deinit();
     if (failure)
         return 5;
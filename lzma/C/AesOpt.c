@@ -8,13 +8,20 @@
 #ifdef MY_CPU_X86_OR_AMD64
 #if (_MSC_VER > 1500) || (_MSC_FULL_VER >= 150030729)
 #define USE_INTEL_AES
+#define ATTRIB_AES
+#elif defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))))
+/* PhysicsFS: GCC and Clang only allow the intrinsics in functions marked for them. */
+#define USE_INTEL_AES
+#define ATTRIB_AES __attribute__((target("sse2,aes")))
 #endif
 #endif
 
 #ifdef USE_INTEL_AES
 
+#include <emmintrin.h>
 #include <wmmintrin.h>
 
+ATTRIB_AES
 void MY_FAST_CALL AesCbc_Encode_Intel(__m128i *p, __m128i *data, size_t numBlocks)
 {
   __m128i m = *p;
@@ -52,6 +59,7 @@ void MY_FAST_CALL AesCbc_Encode_Intel(__m128i *p, __m128i *data, size_t numBlock
 #define AES_ENC(n) AES_OP_W(_mm_aesenc_si128, n)
 #define AES_ENC_LAST(n) AES_OP_W(_mm_aesenclast_si128, n)
 
+ATTRIB_AES
 void MY_FAST_CALL AesCbc_Decode_Intel(__m128i *p, __m128i *data, size_t numBlocks)
 {
   __m128i iv = *p;
@@ -107,12 +115,12 @@ void MY_FAST_CALL AesCbc_Decode_Intel(__m128i *p, __m128i *data, size_t numBlock
   *p = iv;
 }
 
+ATTRIB_AES
 void MY_FAST_CALL AesCtr_Code_Intel(__m128i *p, __m128i *data, size_t numBlocks)
 {
   __m128i ctr = *p;
   __m128i one;
-  one.m128i_u64[0] = 1;
-  one.m128i_u64[1] = 0;
+  one = _mm_set_epi32(0, 0, 0, 1);
   for (; numBlocks >= NUM_WAYS; numBlocks -= NUM_WAYS, data += NUM_WAYS)
   {
     UInt32 numRounds2 = *(const UInt32 *)(p + 1) - 1;
@@ -15,8 +15,13 @@ DEFINES += PHYSFS_SUPPORTS_QPAK=1
 DEFINES += PHYSFS_SUPPORTS_SLB=1
 DEFINES += PHYSFS_SUPPORTS_ISO9660=1
 DEFINES += PHYSFS_SUPPORTS_VDF=1
+DEFINES += PHYSFS_ZIP_LZMA=1
+DEFINES += PHYSFS_ZIP_AES=1
+DEFINES += PHYSFS_ZIP_ZSTD=1
+DEFINES += ZSTD_DISABLE_ASM=1
 
 INCLUDEPATH += $$PWD/lzma/C
+INCLUDEPATH += $$PWD/zstd/lib
 INCLUDEPATH += $$PWD/src 
 
 SOURCES += \
@@ -35,6 +40,18 @@ SOURCES += \
     lzma/C/Bra86.c \
     lzma/C/BraIA64.c \
     lzma/C/Bcj2.c \
+    lzma/C/Aes.c \
+    lzma/C/AesOpt.c \
+    zstd/lib/common/debug.c \
+    zstd/lib/common/entropy_common.c \
+    zstd/lib/common/error_private.c \
+    zstd/lib/common/fse_decompress.c \
+    zstd/lib/common/xxhash.c \
+    zstd/lib/common/zstd_common.c \
+    zstd/lib/decompress/huf_decompress.c \
+    zstd/lib/decompress/zstd_ddict.c \
+    zstd/lib/decompress/zstd_decompress.c \
+    zstd/lib/decompress/zstd_decompress_block.c \
     src/physfs_archiver_7z_upstream.c \
     src/physfs_archiver_dir.c \
     src/physfs_archiver_grp.c \
@@ -47,6 +64,7 @@ SOURCES += \
     src/physfs_archiver_vdf.c \
     src/physfs_archiver_wad.c \
     src/physfs_archiver_zip.c \
+    src/physfs_zipwriter.c \
     src/physfs.c \
     src/physfs_byteorder.c \
     src/physfs_unicode.c \
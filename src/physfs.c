@@ -11,6 +11,9 @@
 #define __PHYSICSFS_INTERNAL__
 #include "physfs_internal.h"
 
+#include <stddef.h>  /* offsetof */
+#include <time.h>
+
 #if defined(_MSC_VER)
 #include <stdarg.h>
 
@@ -47,6 +50,10 @@ typedef struct __PHYSFS_DIRHANDLE__
     char *dirName;  /* Path to archive in platform-dependent notation. */
     char *mountPoint; /* Mountpoint in virtual file tree. */
     const PHYSFS_Archiver *funcs;  /* Ptr to archiver info for this handle. */
+    const __PHYSFS_ArchiverHooks *hooks;  /* Archiver's internal hooks, or NULL. */
+    PHYSFS_uint32 refcount;  /* Users outside stateLock; no unmount while >0. */
+    __PHYSFS_DirTree linkcache;  /* dirs verifyPath() found aren't symlinks. */
+    int haslinkcache;  /* non-zero if (linkcache) is initialized. */
     struct __PHYSFS_DIRHANDLE__ *next;  /* linked list stuff. */
 } DirHandle;
 
@@ -60,9 +67,28 @@ typedef struct __PHYSFS_FILEHANDLE__
     size_t bufsize;  /* Bufsize, if set (0 otherwise). Don't touch! */
     size_t buffill;  /* Buffer fill size. Don't touch! */
     size_t bufpos;  /* Buffer position. Don't touch! */
+    size_t minbufsize;  /* Adaptive read buffering: smallest bufsize. */
+    size_t maxbufsize;  /* Adaptive read buffering: largest (0 == off). */
+    int writebehind;  /* non-zero if PHYSFS_setWriteBehind() is active. */
+    PHYSFS_Io *sendio;  /* PHYSFS_sendToFd()'s own duplicate of (io). */
+    PHYSFS_uint8 *sendbuf;  /* data sendio read that the fd didn't take. */
+    size_t sendbufpos;  /* start of unsent data in sendbuf. */
+    size_t sendbuflen;  /* bytes of unsent data in sendbuf. */
+    PHYSFS_uint64 sendofs;  /* file offset of sendbuf[sendbufpos]. */
     struct __PHYSFS_FILEHANDLE__ *next;  /* linked list stuff. */
 } FileHandle;
 
+/*
+ * Default adaptive read buffering. Reading a file sequentially doubles the
+ *  readahead from the min to the max size, seeking out of the buffer drops
+ *  it back to the min size.
+ */
+#define ADAPTIVE_MINBUFSIZE (4 * 1024)
+#define ADAPTIVE_MAXBUFSIZE (1024 * 1024)
+
+/* Closed handles each archive keeps for reuse (PHYSFS_setDecoderPoolSize). */
+#define DEFAULT_DECODER_POOL_SIZE 4
+
 
 typedef struct __PHYSFS_ERRSTATETYPE__
 {
@@ -83,7 +109,17 @@ static char *baseDir = NULL;
 static char *userDir = NULL;
 static char *prefDir = NULL;
 static int allowSymLinks = 0;
+static char *indexCacheDir = NULL;
+static int indexDirectories = 0;
+static int mapArchives = 1;
+static int symlinkCheckCacheTTL = 0;
+static int decoderPoolSize = DEFAULT_DECODER_POOL_SIZE;
+static PHYSFS_uint64 solidCacheLimit = 0;
+static int checksumVerification = 0;
+static int resolveOnMount = 0;
+static int lazyMounting = 0;
 static PHYSFS_Archiver **archivers = NULL;
+static const __PHYSFS_ArchiverHooks **archiverHooks = NULL;
 static PHYSFS_ArchiveInfo **archiveInfo = NULL;
 static volatile size_t numArchivers = 0;
 
@@ -101,8 +137,8 @@ static inline int __PHYSFS_atomicAdd(int *ptrval, const int val)
 {
     int retval;
     __PHYSFS_platformGrabMutex(stateLock);
+    *ptrval += val;
     retval = *ptrval;
-    *ptrval = retval + val;
     __PHYSFS_platformReleaseMutex(stateLock);
     return retval;
 } /* __PHYSFS_atomicAdd */
@@ -122,66 +158,427 @@ int __PHYSFS_ATOMIC_DECR(int *ptrval)
 
 /* PHYSFS_Io implementation for i/o to physical filesystem... */
 
+/*
+ * Write-behind for native files: writes are copied into chunks, and a
+ *  background thread drains full chunks to disk with
+ *  __PHYSFS_platformWriteAt(), in order. Anything that needs the file's
+ *  real state (flush, seek, length, close) waits for the queue to empty.
+ */
+#define WRITEBEHIND_MAXQUEUED 4  /* block the app past this many chunks. */
+
+typedef struct __PHYSFS_WriteChunk
+{
+    struct __PHYSFS_WriteChunk *next;
+    PHYSFS_uint64 offset;
+    size_t len;
+    PHYSFS_uint8 data[1];  /* actually (chunksize) bytes. */
+} WriteChunk;
+
+typedef struct
+{
+    void *handle;  /* platform file handle, shared with the NativeIoInfo. */
+    size_t chunksize;
+    PHYSFS_uint64 pos;  /* where the app's next write lands. */
+    WriteChunk *fill;  /* chunk the app is writing into. Not locked. */
+    void *thread;
+    void *lock;  /* protects everything below this. */
+    void *workready;  /* posted once per queued chunk, and once to quit. */
+    void *idle;  /* posted when (waiting) and (queued <= waitfor). */
+    WriteChunk *head;  /* queued chunks, oldest first. */
+    WriteChunk *tail;
+    WriteChunk *spare;  /* one drained chunk kept for reuse. */
+    size_t queued;  /* chunks queued or being written right now. */
+    size_t waitfor;
+    int waiting;
+    PHYSFS_ErrorCode error;  /* first failure, reported on the app's side. */
+} WriteBehind;
+
 /* !!! FIXME: maybe refcount the paths in a string pool? */
 typedef struct __PHYSFS_NativeIoInfo
 {
     void *handle;
     const char *path;
     int mode;   /* 'r', 'w', or 'a' */
+    int positional;  /* non-zero: reads use pos and platformReadAt. */
+    PHYSFS_uint64 pos;  /* only used if (positional). */
+    PHYSFS_Io *parent;  /* if non-NULL, we share parent's handle. */
+    int refcount;
+    WriteBehind *wb;  /* non-NULL if write-behind is enabled. */
 } NativeIoInfo;
 
+static void writeBehindThread(void *arg)
+{
+    WriteBehind *wb = (WriteBehind *) arg;
+
+    while (1)
+    {
+        PHYSFS_ErrorCode err = PHYSFS_ERR_OK;
+        WriteChunk *chunk;
+        size_t written = 0;
+
+        __PHYSFS_platformWaitSemaphore(wb->workready);
+        __PHYSFS_platformGrabMutex(wb->lock);
+        chunk = wb->head;
+        if (chunk != NULL)
+        {
+            wb->head = chunk->next;
+            if (wb->head == NULL)
+                wb->tail = NULL;
+        } /* if */
+        __PHYSFS_platformReleaseMutex(wb->lock);
+
+        if (chunk == NULL)
+            break;  /* woken up with nothing queued: time to quit. */
+
+        while (written < chunk->len)
+        {
+            const PHYSFS_sint64 rc = __PHYSFS_platformWriteAt(wb->handle,
+                                        chunk->data + written,
+                                        chunk->len - written,
+                                        chunk->offset + written);
+            if (rc <= 0)
+            {
+                err = (rc == 0) ? PHYSFS_ERR_IO : PHYSFS_getLastErrorCode();
+                break;
+            } /* if */
+            written += (size_t) rc;
+        } /* while */
+
+        __PHYSFS_platformGrabMutex(wb->lock);
+        if ((err != PHYSFS_ERR_OK) && (wb->error == PHYSFS_ERR_OK))
+            wb->error = err;
+
+        if (wb->spare == NULL)
+            wb->spare = chunk;
+        else
+            allocator.Free(chunk);
+
+        wb->queued--;
+        if ((wb->waiting) && (wb->queued <= wb->waitfor))
+        {
+            wb->waiting = 0;
+            __PHYSFS_platformPostSemaphore(wb->idle);
+        } /* if */
+        __PHYSFS_platformReleaseMutex(wb->lock);
+    } /* while */
+} /* writeBehindThread */
+
+/* block until the background thread has (waitfor) or fewer chunks left. */
+static void writeBehindWait(WriteBehind *wb, const size_t waitfor)
+{
+    int mustwait = 0;
+    __PHYSFS_platformGrabMutex(wb->lock);
+    if (wb->queued > waitfor)
+    {
+        wb->waitfor = waitfor;
+        wb->waiting = mustwait = 1;
+    } /* if */
+    __PHYSFS_platformReleaseMutex(wb->lock);
+
+    if (mustwait)
+        __PHYSFS_platformWaitSemaphore(wb->idle);
+} /* writeBehindWait */
+
+/* report (and forget) a failure from the background thread. */
+static int writeBehindCheckError(WriteBehind *wb)
+{
+    PHYSFS_ErrorCode err;
+    __PHYSFS_platformGrabMutex(wb->lock);
+    err = wb->error;
+    wb->error = PHYSFS_ERR_OK;
+    __PHYSFS_platformReleaseMutex(wb->lock);
+    BAIL_IF(err != PHYSFS_ERR_OK, err, 0);
+    return 1;
+} /* writeBehindCheckError */
+
+static void writeBehindQueueFill(WriteBehind *wb)
+{
+    WriteChunk *chunk = wb->fill;
+    if ((chunk == NULL) || (chunk->len == 0))
+        return;
+
+    writeBehindWait(wb, WRITEBEHIND_MAXQUEUED - 1);
+
+    wb->fill = NULL;
+    chunk->next = NULL;
+    __PHYSFS_platformGrabMutex(wb->lock);
+    if (wb->tail == NULL)
+        wb->head = chunk;
+    else
+        wb->tail->next = chunk;
+    wb->tail = chunk;
+    wb->queued++;
+    __PHYSFS_platformReleaseMutex(wb->lock);
+    __PHYSFS_platformPostSemaphore(wb->workready);
+} /* writeBehindQueueFill */
+
+/* push everything to the OS and wait for it. Doesn't fsync(). */
+static int writeBehindDrain(WriteBehind *wb)
+{
+    writeBehindQueueFill(wb);
+    writeBehindWait(wb, 0);
+    return writeBehindCheckError(wb);
+} /* writeBehindDrain */
+
+static PHYSFS_sint64 writeBehindWrite(WriteBehind *wb, const void *_buf,
+                                      PHYSFS_uint64 len)
+{
+    const PHYSFS_uint8 *buf = (const PHYSFS_uint8 *) _buf;
+    PHYSFS_uint64 remaining = len;
+
+    BAIL_IF_ERRPASS(!writeBehindCheckError(wb), -1);
+
+    while (remaining > 0)
+    {
+        WriteChunk *chunk = wb->fill;
+        size_t cpy;
+
+        if (chunk == NULL)
+        {
+            __PHYSFS_platformGrabMutex(wb->lock);
+            chunk = wb->spare;
+            wb->spare = NULL;
+            __PHYSFS_platformReleaseMutex(wb->lock);
+
+            if (chunk == NULL)
+            {
+                chunk = (WriteChunk *) allocator.Malloc(sizeof (WriteChunk) +
+                                                        wb->chunksize - 1);
+                if (chunk == NULL)
+                {
+                    PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+                    break;
+                } /* if */
+            } /* if */
+
+            chunk->offset = wb->pos;
+            chunk->len = 0;
+            wb->fill = chunk;
+        } /* if */
+
+        cpy = wb->chunksize - chunk->len;
+        if (cpy > remaining)
+            cpy = (size_t) remaining;
+        memcpy(chunk->data + chunk->len, buf, cpy);
+        chunk->len += cpy;
+        buf += cpy;
+        remaining -= cpy;
+        wb->pos += cpy;
+
+        if (chunk->len == wb->chunksize)
+            writeBehindQueueFill(wb);
+    } /* while */
+
+    return (remaining == len) ? -1 : (PHYSFS_sint64) (len - remaining);
+} /* writeBehindWrite */
+
+/* stop the thread and free everything. Drain (and check errors) first! */
+static void writeBehindDestroy(WriteBehind *wb)
+{
+    if (wb->thread != NULL)
+    {
+        assert(wb->queued == 0);
+        __PHYSFS_platformPostSemaphore(wb->workready);  /* empty == quit. */
+        __PHYSFS_platformWaitThread(wb->thread);
+    } /* if */
+
+    if (wb->idle) __PHYSFS_platformDestroySemaphore(wb->idle);
+    if (wb->workready) __PHYSFS_platformDestroySemaphore(wb->workready);
+    if (wb->lock) __PHYSFS_platformDestroyMutex(wb->lock);
+    if (wb->spare) allocator.Free(wb->spare);
+    if (wb->fill) allocator.Free(wb->fill);
+    allocator.Free(wb);
+} /* writeBehindDestroy */
+
+static WriteBehind *writeBehindCreate(NativeIoInfo *info, size_t chunksize,
+                                      PHYSFS_uint64 sizehint)
+{
+    PHYSFS_sint64 pos;
+    WriteBehind *wb;
+
+    /* a zero-byte write tells us if the platform can write positionally. */
+    BAIL_IF_ERRPASS(__PHYSFS_platformWriteAt(info->handle, info, 0, 0) != 0,
+                    NULL);
+
+    pos = __PHYSFS_platformTell(info->handle);
+    BAIL_IF_ERRPASS(pos < 0, NULL);
+
+    wb = (WriteBehind *) allocator.Malloc(sizeof (WriteBehind));
+    BAIL_IF(!wb, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(wb, '\0', sizeof (*wb));
+    wb->handle = info->handle;
+    wb->chunksize = chunksize;
+    wb->pos = (PHYSFS_uint64) pos;
+
+    wb->lock = __PHYSFS_platformCreateMutex();
+    GOTO_IF_ERRPASS(!wb->lock, createWriteBehind_failed);
+    wb->workready = __PHYSFS_platformCreateSemaphore();
+    GOTO_IF_ERRPASS(!wb->workready, createWriteBehind_failed);
+    wb->idle = __PHYSFS_platformCreateSemaphore();
+    GOTO_IF_ERRPASS(!wb->idle, createWriteBehind_failed);
+    wb->thread = __PHYSFS_platformCreateThread(writeBehindThread, wb);
+    GOTO_IF_ERRPASS(!wb->thread, createWriteBehind_failed);
+
+    if (sizehint > 0)  /* this can fail; that's okay. */
+        __PHYSFS_platformPreallocate(info->handle, wb->pos + sizehint);
+
+    return wb;
+
+createWriteBehind_failed:
+    writeBehindDestroy(wb);
+    return NULL;
+} /* writeBehindCreate */
+
 static PHYSFS_sint64 nativeIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformRead(info->handle, buf, len);
+    PHYSFS_sint64 rc;
+
+    if (!info->positional)
+        return __PHYSFS_platformRead(info->handle, buf, len);
+
+    rc = __PHYSFS_platformReadAt(info->handle, buf, len, info->pos);
+    if (rc > 0)
+        info->pos += (PHYSFS_uint64) rc;
+    return rc;
 } /* nativeIo_read */
 
 static PHYSFS_sint64 nativeIo_write(PHYSFS_Io *io, const void *buffer,
                                     PHYSFS_uint64 len)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    if (info->wb != NULL)
+        return writeBehindWrite(info->wb, buffer, len);
     return __PHYSFS_platformWrite(info->handle, buffer, len);
 } /* nativeIo_write */
 
 static int nativeIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformSeek(info->handle, offset);
+
+    if (info->wb != NULL)
+    {
+        BAIL_IF_ERRPASS(!writeBehindDrain(info->wb), 0);
+        BAIL_IF_ERRPASS(!__PHYSFS_platformSeek(info->handle, offset), 0);
+        info->wb->pos = offset;
+        return 1;
+    } /* if */
+
+    if (!info->positional)
+        return __PHYSFS_platformSeek(info->handle, offset);
+
+    info->pos = offset;
+    return 1;
 } /* nativeIo_seek */
 
 static PHYSFS_sint64 nativeIo_tell(PHYSFS_Io *io)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformTell(info->handle);
+    if (info->wb != NULL)
+        return (PHYSFS_sint64) info->wb->pos;
+    else if (!info->positional)
+        return __PHYSFS_platformTell(info->handle);
+    return (PHYSFS_sint64) info->pos;
 } /* nativeIo_tell */
 
 static PHYSFS_sint64 nativeIo_length(PHYSFS_Io *io)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    if (info->wb != NULL)
+        BAIL_IF_ERRPASS(!writeBehindDrain(info->wb), -1);
     return __PHYSFS_platformFileLength(info->handle);
 } /* nativeIo_length */
 
 static PHYSFS_Io *nativeIo_duplicate(PHYSFS_Io *io)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_createNativeIo(info->path, info->mode);
+    NativeIoInfo *newinfo = NULL;
+    PHYSFS_Io *parent = info->parent;
+    PHYSFS_Io *retval = NULL;
+
+    /* can't share the handle? Open the file again. */
+    if (!info->positional)
+    {
+        BAIL_IF(!info->path, PHYSFS_ERR_UNSUPPORTED, NULL);
+        return __PHYSFS_createNativeIo(info->path, info->mode);
+    } /* if */
+
+    /* share the handle between duplicates. */
+    if (parent != NULL)  /* dup the parent, increment its refcount. */
+        return parent->duplicate(parent);
+
+    /* we're the parent. */
+
+    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    newinfo = (NativeIoInfo *) allocator.Malloc(sizeof (NativeIoInfo));
+    if (!newinfo)
+    {
+        allocator.Free(retval);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    __PHYSFS_ATOMIC_INCR(&info->refcount);
+
+    memcpy(newinfo, info, sizeof (*info));
+    newinfo->pos = 0;
+    newinfo->parent = io;
+    newinfo->refcount = 0;
+
+    memcpy(retval, io, sizeof (*retval));
+    retval->opaque = newinfo;
+    return retval;
 } /* nativeIo_duplicate */
 
 static int nativeIo_flush(PHYSFS_Io *io)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    if (info->wb != NULL)
+        BAIL_IF_ERRPASS(!writeBehindDrain(info->wb), 0);
     return __PHYSFS_platformFlush(info->handle);
 } /* nativeIo_flush */
 
 static void nativeIo_destroy(PHYSFS_Io *io)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    __PHYSFS_platformClose(info->handle);
-    allocator.Free((void *) info->path);
-    allocator.Free(info);
-    allocator.Free(io);
+    PHYSFS_Io *parent = info->parent;
+
+    if (parent != NULL)
+    {
+        assert(info->handle == ((NativeIoInfo *) parent->opaque)->handle);
+        assert(info->refcount == 0);
+        allocator.Free(info);
+        allocator.Free(io);
+        parent->destroy(parent);  /* decrements refcount. */
+        return;
+    } /* if */
+
+    /* we _are_ the parent. */
+    assert(info->refcount > 0);  /* even in a race, we hold a reference. */
+
+    if (__PHYSFS_ATOMIC_DECR(&info->refcount) == 0)
+    {
+        io->opaque = NULL;  /* kill this here in case of race. */
+        if (info->wb != NULL)
+        {
+            writeBehindDrain(info->wb);  /* too late to report errors. */
+            writeBehindDestroy(info->wb);
+        } /* if */
+        __PHYSFS_platformClose(info->handle);
+        if (info->path != NULL)
+            allocator.Free((void *) info->path);
+        allocator.Free(info);
+        allocator.Free(io);
+    } /* if */
 } /* nativeIo_destroy */
 
+static PHYSFS_sint64 nativeIo_readAt(PHYSFS_Io *io, void *buf,
+                                     PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    return __PHYSFS_platformReadAt(info->handle, buf, len, offset);
+} /* nativeIo_readAt */
+
 static const PHYSFS_Io __PHYSFS_nativeIoInterface =
 {
     CURRENT_PHYSFS_IO_API_VERSION, NULL,
@@ -192,14 +589,59 @@ static const PHYSFS_Io __PHYSFS_nativeIoInterface =
     nativeIo_length,
     nativeIo_duplicate,
     nativeIo_flush,
-    nativeIo_destroy
+    nativeIo_destroy,
+    nativeIo_readAt
 };
 
-PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode)
+/* (chunksize) of zero turns write-behind off again. */
+static int nativeIo_setWriteBehind(PHYSFS_Io *io, const size_t chunksize,
+                                   const PHYSFS_uint64 sizehint)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    WriteBehind *wb = info->wb;
+
+    assert(info->mode != 'r');
+
+    if (wb != NULL)
+    {
+        BAIL_IF_ERRPASS(!writeBehindDrain(wb), 0);
+        if (chunksize == 0)
+        {
+            /* the file pointer didn't follow our writes; put it back. */
+            BAIL_IF_ERRPASS(!__PHYSFS_platformSeek(info->handle, wb->pos), 0);
+            info->wb = NULL;
+            writeBehindDestroy(wb);
+            return 1;
+        } /* if */
+
+        assert(wb->fill == NULL);  /* drained, so this is safe to change. */
+        if (wb->chunksize != chunksize)
+        {
+            __PHYSFS_platformGrabMutex(wb->lock);
+            if (wb->spare)
+                allocator.Free(wb->spare);
+            wb->spare = NULL;
+            wb->chunksize = chunksize;
+            __PHYSFS_platformReleaseMutex(wb->lock);
+        } /* if */
+
+        if (sizehint > 0)  /* this can fail; that's okay. */
+            __PHYSFS_platformPreallocate(info->handle, wb->pos + sizehint);
+        return 1;
+    } /* if */
+
+    if (chunksize == 0)
+        return 1;  /* already off. */
+
+    info->wb = writeBehindCreate(info, chunksize, sizehint);
+    return (info->wb != NULL);
+} /* nativeIo_setWriteBehind */
+
+PHYSFS_Io *__PHYSFS_createNativeIoFromHandle(void *handle, const char *path,
+                                             const int mode)
 {
     PHYSFS_Io *io = NULL;
     NativeIoInfo *info = NULL;
-    void *handle = NULL;
     char *pathdup = NULL;
 
     assert((mode == 'r') || (mode == 'w') || (mode == 'a'));
@@ -208,32 +650,54 @@ PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode)
     GOTO_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
     info = (NativeIoInfo *) allocator.Malloc(sizeof (NativeIoInfo));
     GOTO_IF(!info, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
-    pathdup = (char *) allocator.Malloc(strlen(path) + 1);
-    GOTO_IF(!pathdup, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
-
-    if (mode == 'r')
-        handle = __PHYSFS_platformOpenRead(path);
-    else if (mode == 'w')
-        handle = __PHYSFS_platformOpenWrite(path);
-    else if (mode == 'a')
-        handle = __PHYSFS_platformOpenAppend(path);
-
-    GOTO_IF_ERRPASS(!handle, createNativeIo_failed);
+    if (path != NULL)
+    {
+        pathdup = (char *) allocator.Malloc(strlen(path) + 1);
+        GOTO_IF(!pathdup, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
+        strcpy(pathdup, path);
+    } /* if */
 
-    strcpy(pathdup, path);
+    memset(info, '\0', sizeof (*info));
     info->handle = handle;
     info->path = pathdup;
     info->mode = mode;
+    info->refcount = 1;
     memcpy(io, &__PHYSFS_nativeIoInterface, sizeof (*io));
     io->opaque = info;
+
+    /* Read-only files can share one handle between all their duplicates
+       if the platform can do positional reads (a zero-byte read tells us). */
+    if (mode == 'r')
+        info->positional = (__PHYSFS_platformReadAt(handle, info, 0, 0) == 0);
+    if (!info->positional)
+        io->readAt = NULL;
+
     return io;
 
 createNativeIo_failed:
-    if (handle != NULL) __PHYSFS_platformClose(handle);
+    __PHYSFS_platformClose(handle);
     if (pathdup != NULL) allocator.Free(pathdup);
     if (info != NULL) allocator.Free(info);
     if (io != NULL) allocator.Free(io);
     return NULL;
+} /* __PHYSFS_createNativeIoFromHandle */
+
+
+PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode)
+{
+    void *handle = NULL;
+
+    assert((mode == 'r') || (mode == 'w') || (mode == 'a'));
+
+    if (mode == 'r')
+        handle = __PHYSFS_platformOpenRead(path);
+    else if (mode == 'w')
+        handle = __PHYSFS_platformOpenWrite(path);
+    else if (mode == 'a')
+        handle = __PHYSFS_platformOpenAppend(path);
+
+    BAIL_IF_ERRPASS(!handle, NULL);
+    return __PHYSFS_createNativeIoFromHandle(handle, path, mode);
 } /* __PHYSFS_createNativeIo */
 
 
@@ -334,6 +798,21 @@ static PHYSFS_Io *memoryIo_duplicate(PHYSFS_Io *io)
 
 static int memoryIo_flush(PHYSFS_Io *io) { return 1;  /* it's read-only. */ }
 
+static PHYSFS_sint64 memoryIo_readAt(PHYSFS_Io *io, void *buf,
+                                     PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    const MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
+
+    if (offset >= info->len)
+        return 0;  /* at (or past) EOF; nothing to do. */
+
+    if (len > (info->len - offset))
+        len = info->len - offset;
+
+    memcpy(buf, info->buf + offset, (size_t) len);
+    return (PHYSFS_sint64) len;
+} /* memoryIo_readAt */
+
 static void memoryIo_destroy(PHYSFS_Io *io)
 {
     MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
@@ -377,7 +856,8 @@ static const PHYSFS_Io __PHYSFS_memoryIoInterface =
     memoryIo_length,
     memoryIo_duplicate,
     memoryIo_flush,
-    memoryIo_destroy
+    memoryIo_destroy,
+    memoryIo_readAt
 };
 
 PHYSFS_Io *__PHYSFS_createMemoryIo(const void *buf, PHYSFS_uint64 len,
@@ -410,72 +890,357 @@ createMemoryIo_failed:
 } /* __PHYSFS_createMemoryIo */
 
 
-/* PHYSFS_Io implementation for i/o to a PHYSFS_File... */
-
-static PHYSFS_sint64 handleIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
-{
-    return PHYSFS_readBytes((PHYSFS_File *) io->opaque, buf, len);
-} /* handleIo_read */
-
-static PHYSFS_sint64 handleIo_write(PHYSFS_Io *io, const void *buffer,
-                                    PHYSFS_uint64 len)
-{
-    return PHYSFS_writeBytes((PHYSFS_File *) io->opaque, buffer, len);
-} /* handleIo_write */
+/* PHYSFS_Io implementation for read-only, memory-mapped native files... */
 
-static int handleIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
-{
-    return PHYSFS_seek((PHYSFS_File *) io->opaque, offset);
-} /* handleIo_seek */
+/*
+ * On 64-bit systems, we map the whole file once and every duplicate shares
+ *  that mapping. On 32-bit systems, address space is precious, so big files
+ *  are mapped a window at a time (each Io gets its own window, but they all
+ *  share the parent's file handle).
+ */
+#define MAPPEDIO_WINDOWSIZE (16 * 1024 * 1024)
 
-static PHYSFS_sint64 handleIo_tell(PHYSFS_Io *io)
+typedef struct __PHYSFS_MappedIoInfo
 {
-    return PHYSFS_tell((PHYSFS_File *) io->opaque);
-} /* handleIo_tell */
+    void *handle;                /* native file handle, owned by parent.   */
+    const PHYSFS_uint8 *window;  /* mapped data (NULL if nothing mapped).  */
+    PHYSFS_uint64 winofs;        /* file offset of window[0].              */
+    size_t winlen;               /* number of bytes mapped at window.      */
+    int ownswindow;              /* non-zero if we unmap window ourselves. */
+    PHYSFS_uint64 len;
+    PHYSFS_uint64 pos;
+    PHYSFS_Io *parent;
+    int refcount;
+} MappedIoInfo;
 
-static PHYSFS_sint64 handleIo_length(PHYSFS_Io *io)
+static int mappedIo_wholeFile(const PHYSFS_uint64 len)
 {
-    return PHYSFS_fileLength((PHYSFS_File *) io->opaque);
-} /* handleIo_length */
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        return 0;
+    return ((sizeof (void *) >= 8) || (len <= (4 * MAPPEDIO_WINDOWSIZE)));
+} /* mappedIo_wholeFile */
 
-static PHYSFS_Io *handleIo_duplicate(PHYSFS_Io *io)
+static int mappedIo_mapWindow(MappedIoInfo *info, const PHYSFS_uint64 pos)
 {
-    /*
-     * There's no duplicate at the PHYSFS_File level, so we break the
-     *  abstraction. We're allowed to: we're physfs.c!
-     */
-    FileHandle *origfh = (FileHandle *) io->opaque;
-    FileHandle *newfh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
-    PHYSFS_Io *retval = NULL;
+    PHYSFS_uint64 winofs;
+    PHYSFS_uint64 winlen;
 
-    GOTO_IF(!newfh, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
-    memset(newfh, '\0', sizeof (*newfh));
+    if ((info->window) && (pos >= info->winofs) &&
+        (pos < (info->winofs + info->winlen)))
+        return 1;  /* already mapped. */
 
-    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+    assert(info->ownswindow);  /* whole-file mappings always cover (pos). */
+    assert(pos < info->len);
 
-#if 0  /* we don't buffer the duplicate, at least not at the moment. */
-    if (origfh->buffer != NULL)
+    if (info->window != NULL)
     {
-        newfh->buffer = (PHYSFS_uint8 *) allocator.Malloc(origfh->bufsize);
-        if (!newfh->buffer)
-            GOTO(PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
-        newfh->bufsize = origfh->bufsize;
+        __PHYSFS_platformUnmap(info->window, info->winofs, info->winlen);
+        info->window = NULL;
     } /* if */
-#endif
 
-    newfh->io = origfh->io->duplicate(origfh->io);
-    GOTO_IF_ERRPASS(!newfh->io, handleIo_dupe_failed);
+    winofs = pos - (pos % MAPPEDIO_WINDOWSIZE);
+    winlen = info->len - winofs;
+    if (winlen > MAPPEDIO_WINDOWSIZE)
+        winlen = MAPPEDIO_WINDOWSIZE;
 
-    newfh->forReading = origfh->forReading;
-    newfh->dirHandle = origfh->dirHandle;
+    info->window = (const PHYSFS_uint8 *)
+        __PHYSFS_platformMap(info->handle, winofs, (size_t) winlen);
+    BAIL_IF_ERRPASS(!info->window, 0);
+    info->winofs = winofs;
+    info->winlen = (size_t) winlen;
+    return 1;
+} /* mappedIo_mapWindow */
 
-    __PHYSFS_platformGrabMutex(stateLock);
-    if (newfh->forReading)
-    {
-        newfh->next = openReadList;
-        openReadList = newfh;
-    } /* if */
+static PHYSFS_sint64 mappedIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+{
+    MappedIoInfo *info = (MappedIoInfo *) io->opaque;
+    const PHYSFS_uint64 avail = info->len - info->pos;
+    PHYSFS_uint8 *ptr = (PHYSFS_uint8 *) buf;
+    PHYSFS_sint64 retval = 0;
+
+    if (len > avail)
+        len = avail;
+
+    while (len > 0)
+    {
+        size_t ofs, cpy;
+
+        if (!mappedIo_mapWindow(info, info->pos))
+            return (retval > 0) ? retval : -1;
+
+        ofs = (size_t) (info->pos - info->winofs);
+        cpy = info->winlen - ofs;
+        if (cpy > len)
+            cpy = (size_t) len;
+
+        memcpy(ptr, info->window + ofs, cpy);
+        ptr += cpy;
+        len -= cpy;
+        info->pos += cpy;
+        retval += (PHYSFS_sint64) cpy;
+    } /* while */
+
+    return retval;
+} /* mappedIo_read */
+
+static PHYSFS_sint64 mappedIo_write(PHYSFS_Io *io, const void *buffer,
+                                    PHYSFS_uint64 len)
+{
+    BAIL(PHYSFS_ERR_OPEN_FOR_READING, -1);
+} /* mappedIo_write */
+
+static int mappedIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+{
+    MappedIoInfo *info = (MappedIoInfo *) io->opaque;
+    BAIL_IF(offset > info->len, PHYSFS_ERR_PAST_EOF, 0);
+    info->pos = offset;
+    return 1;
+} /* mappedIo_seek */
+
+static PHYSFS_sint64 mappedIo_tell(PHYSFS_Io *io)
+{
+    const MappedIoInfo *info = (MappedIoInfo *) io->opaque;
+    return (PHYSFS_sint64) info->pos;
+} /* mappedIo_tell */
+
+static PHYSFS_sint64 mappedIo_length(PHYSFS_Io *io)
+{
+    const MappedIoInfo *info = (MappedIoInfo *) io->opaque;
+    return (PHYSFS_sint64) info->len;
+} /* mappedIo_length */
+
+static PHYSFS_Io *mappedIo_duplicate(PHYSFS_Io *io)
+{
+    MappedIoInfo *info = (MappedIoInfo *) io->opaque;
+    MappedIoInfo *newinfo = NULL;
+    PHYSFS_Io *parent = info->parent;
+    PHYSFS_Io *retval = NULL;
+
+    /* share the handle (and maybe the mapping) between duplicates. */
+    if (parent != NULL)  /* dup the parent, increment its refcount. */
+        return parent->duplicate(parent);
+
+    /* we're the parent. */
+
+    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    newinfo = (MappedIoInfo *) allocator.Malloc(sizeof (MappedIoInfo));
+    if (!newinfo)
+    {
+        allocator.Free(retval);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    __PHYSFS_ATOMIC_INCR(&info->refcount);
+
+    memset(newinfo, '\0', sizeof (*info));
+    newinfo->handle = info->handle;
+    newinfo->len = info->len;
+    newinfo->pos = 0;
+    newinfo->parent = io;
+    newinfo->refcount = 0;
+    newinfo->ownswindow = info->ownswindow;
+    if (!info->ownswindow)  /* whole file is mapped; just share it. */
+    {
+        newinfo->window = info->window;
+        newinfo->winofs = info->winofs;
+        newinfo->winlen = info->winlen;
+    } /* if */
+
+    memcpy(retval, io, sizeof (*retval));
+    retval->opaque = newinfo;
+    return retval;
+} /* mappedIo_duplicate */
+
+static int mappedIo_flush(PHYSFS_Io *io) { return 1;  /* it's read-only. */ }
+
+static PHYSFS_sint64 mappedIo_readAt(PHYSFS_Io *io, void *buf,
+                                     PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    const MappedIoInfo *info = (MappedIoInfo *) io->opaque;
+
+    /* windows belong to one Io and aren't thread safe; go to the handle. */
+    if (info->ownswindow)
+        return __PHYSFS_platformReadAt(info->handle, buf, len, offset);
+
+    if (offset >= info->len)
+        return 0;  /* at (or past) EOF; nothing to do. */
+
+    if (len > (info->len - offset))
+        len = info->len - offset;
+
+    memcpy(buf, info->window + offset, (size_t) len);
+    return (PHYSFS_sint64) len;
+} /* mappedIo_readAt */
+
+static void mappedIo_destroy(PHYSFS_Io *io)
+{
+    MappedIoInfo *info = (MappedIoInfo *) io->opaque;
+    PHYSFS_Io *parent = info->parent;
+
+    if (parent != NULL)
+    {
+        assert(info->handle == ((MappedIoInfo *) parent->opaque)->handle);
+        assert(info->refcount == 0);
+        if ((info->ownswindow) && (info->window != NULL))
+            __PHYSFS_platformUnmap(info->window, info->winofs, info->winlen);
+        allocator.Free(info);
+        allocator.Free(io);
+        parent->destroy(parent);  /* decrements refcount. */
+        return;
+    } /* if */
+
+    /* we _are_ the parent. */
+    assert(info->refcount > 0);  /* even in a race, we hold a reference. */
+
+    if (__PHYSFS_ATOMIC_DECR(&info->refcount) == 0)
+    {
+        io->opaque = NULL;  /* kill this here in case of race. */
+        if (info->window != NULL)
+            __PHYSFS_platformUnmap(info->window, info->winofs, info->winlen);
+        __PHYSFS_platformClose(info->handle);
+        allocator.Free(info);
+        allocator.Free(io);
+    } /* if */
+} /* mappedIo_destroy */
+
+
+static const PHYSFS_Io __PHYSFS_mappedIoInterface =
+{
+    CURRENT_PHYSFS_IO_API_VERSION, NULL,
+    mappedIo_read,
+    mappedIo_write,
+    mappedIo_seek,
+    mappedIo_tell,
+    mappedIo_length,
+    mappedIo_duplicate,
+    mappedIo_flush,
+    mappedIo_destroy,
+    mappedIo_readAt
+};
+
+PHYSFS_Io *__PHYSFS_createMappedIo(const char *path)
+{
+    PHYSFS_Io *io = NULL;
+    MappedIoInfo *info = NULL;
+    void *handle = NULL;
+    PHYSFS_sint64 len;
+
+    handle = __PHYSFS_platformOpenRead(path);
+    BAIL_IF_ERRPASS(!handle, NULL);
+
+    len = __PHYSFS_platformFileLength(handle);
+    GOTO_IF_ERRPASS(len < 0, createMappedIo_failed);
+    /* can't map an empty file, but there's nothing to gain there anyhow. */
+    GOTO_IF(len == 0, PHYSFS_ERR_UNSUPPORTED, createMappedIo_failed);
+
+    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    GOTO_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, createMappedIo_failed);
+    info = (MappedIoInfo *) allocator.Malloc(sizeof (MappedIoInfo));
+    GOTO_IF(!info, PHYSFS_ERR_OUT_OF_MEMORY, createMappedIo_failed);
+
+    memset(info, '\0', sizeof (*info));
+    info->handle = handle;
+    info->len = (PHYSFS_uint64) len;
+    info->pos = 0;
+    info->parent = NULL;
+    info->refcount = 1;
+
+    if (mappedIo_wholeFile(info->len))
+    {
+        info->window = (const PHYSFS_uint8 *)
+            __PHYSFS_platformMap(handle, 0, (size_t) info->len);
+        info->winofs = 0;
+        info->winlen = (size_t) info->len;
+        info->ownswindow = 0;
+    } /* if */
+    else
+    {
+        /* map the first window now, so we know mapping works at all. */
+        info->ownswindow = 1;
+        mappedIo_mapWindow(info, 0);
+    } /* else */
+
+    GOTO_IF_ERRPASS(!info->window, createMappedIo_failed);
+
+    memcpy(io, &__PHYSFS_mappedIoInterface, sizeof (*io));
+    io->opaque = info;
+    return io;
+
+createMappedIo_failed:
+    if (info != NULL) allocator.Free(info);
+    if (io != NULL) allocator.Free(io);
+    __PHYSFS_platformClose(handle);
+    return NULL;
+} /* __PHYSFS_createMappedIo */
+
+
+/* PHYSFS_Io implementation for i/o to a PHYSFS_File... */
+
+static PHYSFS_sint64 handleIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+{
+    return PHYSFS_readBytes((PHYSFS_File *) io->opaque, buf, len);
+} /* handleIo_read */
+
+static PHYSFS_sint64 handleIo_write(PHYSFS_Io *io, const void *buffer,
+                                    PHYSFS_uint64 len)
+{
+    return PHYSFS_writeBytes((PHYSFS_File *) io->opaque, buffer, len);
+} /* handleIo_write */
+
+static int handleIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+{
+    return PHYSFS_seek((PHYSFS_File *) io->opaque, offset);
+} /* handleIo_seek */
+
+static PHYSFS_sint64 handleIo_tell(PHYSFS_Io *io)
+{
+    return PHYSFS_tell((PHYSFS_File *) io->opaque);
+} /* handleIo_tell */
+
+static PHYSFS_sint64 handleIo_length(PHYSFS_Io *io)
+{
+    return PHYSFS_fileLength((PHYSFS_File *) io->opaque);
+} /* handleIo_length */
+
+static PHYSFS_Io *handleIo_duplicate(PHYSFS_Io *io)
+{
+    /*
+     * There's no duplicate at the PHYSFS_File level, so we break the
+     *  abstraction. We're allowed to: we're physfs.c!
+     */
+    FileHandle *origfh = (FileHandle *) io->opaque;
+    FileHandle *newfh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
+    PHYSFS_Io *retval = NULL;
+
+    GOTO_IF(!newfh, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+    memset(newfh, '\0', sizeof (*newfh));
+
+    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    GOTO_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+
+#if 0  /* we don't buffer the duplicate, at least not at the moment. */
+    if (origfh->buffer != NULL)
+    {
+        newfh->buffer = (PHYSFS_uint8 *) allocator.Malloc(origfh->bufsize);
+        if (!newfh->buffer)
+            GOTO(PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+        newfh->bufsize = origfh->bufsize;
+    } /* if */
+#endif
+
+    newfh->io = origfh->io->duplicate(origfh->io);
+    GOTO_IF_ERRPASS(!newfh->io, handleIo_dupe_failed);
+
+    newfh->forReading = origfh->forReading;
+    newfh->dirHandle = origfh->dirHandle;
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    if (newfh->forReading)
+    {
+        newfh->next = openReadList;
+        openReadList = newfh;
+    } /* if */
     else
     {
         newfh->next = openWriteList;
@@ -520,7 +1285,8 @@ static const PHYSFS_Io __PHYSFS_handleIoInterface =
     handleIo_length,
     handleIo_duplicate,
     handleIo_flush,
-    handleIo_destroy
+    handleIo_destroy,
+    NULL  /* readAt: PHYSFS_File has its own position and buffer. */
 };
 
 static PHYSFS_Io *__PHYSFS_createHandleIo(PHYSFS_File *f)
@@ -838,6 +1604,19 @@ static const char *find_filename_extension(const char *fname)
 } /* find_filename_extension */
 
 
+/* Call with stateLock held. NULL for the DIR archiver and external ones. */
+static const __PHYSFS_ArchiverHooks *findHooks(const PHYSFS_Archiver *arc)
+{
+    size_t i;
+    for (i = 0; i < numArchivers; i++)
+    {
+        if (archivers[i] == arc)
+            return archiverHooks[i];
+    } /* for */
+    return NULL;
+} /* findHooks */
+
+
 static DirHandle *tryOpenDir(PHYSFS_Io *io, const PHYSFS_Archiver *funcs,
                              const char *d, int forWriting, int *_claimed)
 {
@@ -858,6 +1637,7 @@ static DirHandle *tryOpenDir(PHYSFS_Io *io, const PHYSFS_Archiver *funcs,
             memset(retval, '\0', sizeof (DirHandle));
             retval->mountPoint = NULL;
             retval->funcs = funcs;
+            retval->hooks = findHooks(funcs);
             retval->opaque = opaque;
         } /* else */
     } /* if */
@@ -884,7 +1664,14 @@ static DirHandle *openDirectory(PHYSFS_Io *io, const char *d, int forWriting)
         if (retval || claimed)
             return retval;
 
-        io = __PHYSFS_createNativeIo(d, forWriting ? 'w' : 'r');
+        #ifndef PHYSFS_NO_MMAP
+        /* try to map read-only archives into memory. */
+        if ((!forWriting) && (mapArchives))
+            io = __PHYSFS_createMappedIo(d);
+        #endif
+
+        if (io == NULL)
+            io = __PHYSFS_createNativeIo(d, forWriting ? 'w' : 'r');
         BAIL_IF_ERRPASS(!io, 0);
         created_io = 1;
     } /* if */
@@ -1069,10 +1856,13 @@ static int freeDirHandle(DirHandle *dh, FileHandle *openList)
     if (dh == NULL)
         return 1;
 
+    BAIL_IF(dh->refcount > 0, PHYSFS_ERR_FILES_STILL_OPEN, 0);
     for (i = openList; i != NULL; i = i->next)
         BAIL_IF(i->dirHandle == dh, PHYSFS_ERR_FILES_STILL_OPEN, 0);
 
     dh->funcs->closeArchive(dh->opaque);
+    if (dh->haslinkcache)
+        __PHYSFS_DirTreeDeinit(&dh->linkcache);
     allocator.Free(dh->dirName);
     allocator.Free(dh->mountPoint);
     allocator.Free(dh);
@@ -1134,46 +1924,48 @@ initializeMutexes_failed:
 } /* initializeMutexes */
 
 
-static int doRegisterArchiver(const PHYSFS_Archiver *_archiver);
+static int doRegisterArchiver(const PHYSFS_Archiver *_archiver,
+                              const __PHYSFS_ArchiverHooks *hooks);
 
 static int initStaticArchivers(void)
 {
-    #define REGISTER_STATIC_ARCHIVER(arc) { \
-        if (!doRegisterArchiver(&__PHYSFS_Archiver_##arc)) { \
+    #define REGISTER_STATIC_ARCHIVER(arc, hooks) { \
+        if (!doRegisterArchiver(&__PHYSFS_Archiver_##arc, hooks)) { \
             return 0; \
         } \
     }
 
     #if PHYSFS_SUPPORTS_ZIP
-        REGISTER_STATIC_ARCHIVER(ZIP);
+        ZIP_global_init();
+        REGISTER_STATIC_ARCHIVER(ZIP, &__PHYSFS_ArchiverHooks_ZIP);
     #endif
     #if PHYSFS_SUPPORTS_7Z
         SZIP_global_init();
-        REGISTER_STATIC_ARCHIVER(7Z);
+        REGISTER_STATIC_ARCHIVER(7Z, NULL);
     #endif
     #if PHYSFS_SUPPORTS_GRP
-        REGISTER_STATIC_ARCHIVER(GRP);
+        REGISTER_STATIC_ARCHIVER(GRP, &__PHYSFS_ArchiverHooks_UNPK);
     #endif
     #if PHYSFS_SUPPORTS_QPAK
-        REGISTER_STATIC_ARCHIVER(QPAK);
+        REGISTER_STATIC_ARCHIVER(QPAK, &__PHYSFS_ArchiverHooks_UNPK);
     #endif
     #if PHYSFS_SUPPORTS_HOG
-        REGISTER_STATIC_ARCHIVER(HOG);
+        REGISTER_STATIC_ARCHIVER(HOG, &__PHYSFS_ArchiverHooks_UNPK);
     #endif
     #if PHYSFS_SUPPORTS_MVL
-        REGISTER_STATIC_ARCHIVER(MVL);
+        REGISTER_STATIC_ARCHIVER(MVL, &__PHYSFS_ArchiverHooks_UNPK);
     #endif
     #if PHYSFS_SUPPORTS_WAD
-        REGISTER_STATIC_ARCHIVER(WAD);
+        REGISTER_STATIC_ARCHIVER(WAD, &__PHYSFS_ArchiverHooks_UNPK);
     #endif
     #if PHYSFS_SUPPORTS_SLB
-        REGISTER_STATIC_ARCHIVER(SLB);
+        REGISTER_STATIC_ARCHIVER(SLB, &__PHYSFS_ArchiverHooks_UNPK);
     #endif
     #if PHYSFS_SUPPORTS_ISO9660
-        REGISTER_STATIC_ARCHIVER(ISO9660);
+        REGISTER_STATIC_ARCHIVER(ISO9660, &__PHYSFS_ArchiverHooks_UNPK);
     #endif
     #if PHYSFS_SUPPORTS_VDF
-        REGISTER_STATIC_ARCHIVER(VDF)
+        REGISTER_STATIC_ARCHIVER(VDF, &__PHYSFS_ArchiverHooks_UNPK)
     #endif
 
     #undef REGISTER_STATIC_ARCHIVER
@@ -1230,6 +2022,17 @@ initFailed:
 
 
 /* MAKE SURE you hold stateLock before calling this! */
+static void freeSendState(FileHandle *fh)
+{
+    if (fh->sendio != NULL)
+        fh->sendio->destroy(fh->sendio);
+    allocator.Free(fh->sendbuf);
+    fh->sendio = NULL;
+    fh->sendbuf = NULL;
+    fh->sendbuflen = 0;
+} /* freeSendState */
+
+
 static int closeFileHandleList(FileHandle **list)
 {
     FileHandle *i;
@@ -1240,13 +2043,16 @@ static int closeFileHandleList(FileHandle **list)
         PHYSFS_Io *io = i->io;
         next = i->next;
 
-        if (io->flush && !io->flush(io))
+        if (!PHYSFS_flush((PHYSFS_File *) i))  /* also drains write buffer. */
         {
             *list = i;
             return 0;
         } /* if */
 
         io->destroy(io);
+        if (i->buffer != NULL)
+            allocator.Free(i->buffer);
+        freeSendState(i);
         allocator.Free(i);
     } /* for */
 
@@ -1308,6 +2114,7 @@ static int doDeregisterArchiver(const size_t idx)
 
     memmove(&archiveInfo[idx], &archiveInfo[idx+1], len);
     memmove(&archivers[idx], &archivers[idx+1], len);
+    memmove(&archiverHooks[idx], &archiverHooks[idx+1], len);
 
     assert(numArchivers > 0);
     numArchivers--;
@@ -1327,8 +2134,10 @@ static void freeArchivers(void)
 
     allocator.Free(archivers);
     allocator.Free(archiveInfo);
+    allocator.Free((void *) archiverHooks);
     archivers = NULL;
     archiveInfo = NULL;
+    archiverHooks = NULL;
 } /* freeArchivers */
 
 
@@ -1371,7 +2180,21 @@ static int doDeinit(void)
         archivers = NULL;
     } /* if */
 
+    if (indexCacheDir != NULL)
+    {
+        allocator.Free(indexCacheDir);
+        indexCacheDir = NULL;
+    } /* if */
+
     allowSymLinks = 0;
+    indexDirectories = 0;
+    mapArchives = 1;
+    symlinkCheckCacheTTL = 0;
+    decoderPoolSize = DEFAULT_DECODER_POOL_SIZE;
+    solidCacheLimit = 0;
+    checksumVerification = 0;
+    resolveOnMount = 0;
+    lazyMounting = 0;
     initialized = 0;
 
     if (errorLock) __PHYSFS_platformDestroyMutex(errorLock);
@@ -1420,7 +2243,8 @@ PHYSFS_uint32 __PHYSFS_hashString(const char *str, size_t len)
 
 
 /* MAKE SURE you hold stateLock before calling this! */
-static int doRegisterArchiver(const PHYSFS_Archiver *_archiver)
+static int doRegisterArchiver(const PHYSFS_Archiver *_archiver,
+                              const __PHYSFS_ArchiverHooks *hooks)
 {
     const PHYSFS_uint32 maxver = CURRENT_PHYSFS_ARCHIVER_API_VERSION;
     const size_t len = (numArchivers + 2) * sizeof (void *);
@@ -1458,7 +2282,15 @@ static int doRegisterArchiver(const PHYSFS_Archiver *_archiver)
     GOTO_IF(!archiver, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
 
     /* Must copy sizeof (OLD_VERSION_OF_STRUCT) when version changes! */
-    memcpy(archiver, _archiver, sizeof (*archiver));
+    if (_archiver->version == 0)
+    {
+        memcpy(archiver, _archiver, offsetof(PHYSFS_Archiver, enumerateTyped));
+        archiver->enumerateTyped = NULL;
+    } /* if */
+    else
+    {
+        memcpy(archiver, _archiver, sizeof (*archiver));
+    } /* else */
 
     info = (PHYSFS_ArchiveInfo *) &archiver->info;
     memset(info, '\0', sizeof (*info));  /* NULL in case an alloc fails. */
@@ -1480,12 +2312,19 @@ static int doRegisterArchiver(const PHYSFS_Archiver *_archiver)
     GOTO_IF(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
     archivers = (PHYSFS_Archiver **) ptr;
 
+    ptr = allocator.Realloc((void *) archiverHooks, len);
+    GOTO_IF(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
+    archiverHooks = (const __PHYSFS_ArchiverHooks **) ptr;
+
     archiveInfo[numArchivers] = info;
     archiveInfo[numArchivers + 1] = NULL;
 
     archivers[numArchivers] = archiver;
     archivers[numArchivers + 1] = NULL;
 
+    archiverHooks[numArchivers] = hooks;
+    archiverHooks[numArchivers + 1] = NULL;
+
     numArchivers++;
 
     return 1;
@@ -1509,7 +2348,7 @@ int PHYSFS_registerArchiver(const PHYSFS_Archiver *archiver)
     int retval;
     BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
     __PHYSFS_platformGrabMutex(stateLock);
-    retval = doRegisterArchiver(archiver);
+    retval = doRegisterArchiver(archiver, NULL);
     __PHYSFS_platformReleaseMutex(stateLock);
     return retval;
 } /* PHYSFS_registerArchiver */
@@ -1652,53 +2491,240 @@ const char *PHYSFS_getWriteDir(void)
 } /* PHYSFS_getWriteDir */
 
 
-int PHYSFS_setWriteDir(const char *newDir)
+int PHYSFS_setIndexCacheDir(const char *dir)
 {
-    int retval = 1;
-
-    __PHYSFS_platformGrabMutex(stateLock);
+    char *ptr = NULL;
 
-    if (writeDir != NULL)
-    {
-        BAIL_IF_MUTEX_ERRPASS(!freeDirHandle(writeDir, openWriteList),
-                            stateLock, 0);
-        writeDir = NULL;
-    } /* if */
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
 
-    if (newDir != NULL)
+    if (dir != NULL)
     {
-        writeDir = createDirHandle(NULL, newDir, NULL, 1);
-        retval = (writeDir != NULL);
+        ptr = __PHYSFS_strdup(dir);
+        BAIL_IF(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
     } /* if */
 
+    __PHYSFS_platformGrabMutex(stateLock);
+    if (indexCacheDir != NULL)
+        allocator.Free(indexCacheDir);
+    indexCacheDir = ptr;
     __PHYSFS_platformReleaseMutex(stateLock);
 
-    return retval;
-} /* PHYSFS_setWriteDir */
+    return 1;
+} /* PHYSFS_setIndexCacheDir */
 
 
-static int doMount(PHYSFS_Io *io, const char *fname,
-                   const char *mountPoint, int appendToPath)
+const char *PHYSFS_getIndexCacheDir(void)
 {
-    DirHandle *dh;
-    DirHandle *prev = NULL;
-    DirHandle *i;
+    const char *retval;
 
-    BAIL_IF(!fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    __PHYSFS_platformGrabMutex(stateLock);
+    retval = indexCacheDir;
+    __PHYSFS_platformReleaseMutex(stateLock);
 
-    if (mountPoint == NULL)
-        mountPoint = "/";
+    return retval;
+} /* PHYSFS_getIndexCacheDir */
+
+
+/* Path of the index cache file for (arcname), or NULL if there's no cache. */
+static char *indexCachePath(const char *arcname, const char *ext)
+{
+    const char sepstr[2] = { __PHYSFS_platformDirSeparator, '\0' };
+    char *retval = NULL;
+    size_t dirlen;
+    size_t len;
 
     __PHYSFS_platformGrabMutex(stateLock);
 
-    for (i = searchPath; i != NULL; i = i->next)
+    if (indexCacheDir == NULL)
     {
-        /* already in search path? */
-        if ((i->dirName != NULL) && (strcmp(fname, i->dirName) == 0))
-            BAIL_MUTEX_ERRPASS(stateLock, 1);
-        prev = i;
-    } /* for */
-
+        __PHYSFS_platformReleaseMutex(stateLock);
+        return NULL;  /* cache is disabled; not an error. */
+    } /* if */
+
+    /* room for a ".xxxxxxxx.tmp" on the end, too. */
+    dirlen = strlen(indexCacheDir);
+    len = dirlen + strlen(ext) + 32;
+    retval = (char *) allocator.Malloc(len);
+    if (retval == NULL)
+    {
+        __PHYSFS_platformReleaseMutex(stateLock);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    snprintf(retval, len, "%s%s%08x.%s", indexCacheDir,
+             ((dirlen > 0) && (indexCacheDir[dirlen-1] != sepstr[0])) ?
+                sepstr : "",
+             (unsigned int) __PHYSFS_hashString(arcname, strlen(arcname)),
+             ext);
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return retval;
+} /* indexCachePath */
+
+
+PHYSFS_Io *__PHYSFS_openIndexCache(const char *arcname, const char *ext)
+{
+    PHYSFS_Io *retval = NULL;
+    char *path = indexCachePath(arcname, ext);
+
+    if (path == NULL)
+        return NULL;
+
+    #ifndef PHYSFS_NO_MMAP
+    /* map it if we can, so archivers can use it in place. */
+    if (mapArchives)
+        retval = __PHYSFS_createMappedIo(path);
+    #endif
+
+    if (retval == NULL)
+        retval = __PHYSFS_createNativeIo(path, 'r');
+    allocator.Free(path);
+    return retval;
+} /* __PHYSFS_openIndexCache */
+
+
+int __PHYSFS_saveIndexCache(const char *arcname, const char *ext,
+                            const void *buf, const size_t len)
+{
+    static PHYSFS_uint32 counter = 0;
+    char *path = indexCachePath(arcname, ext);
+    PHYSFS_Io *io = NULL;
+    PHYSFS_uint32 seed;
+    size_t pathlen;
+    char *tmp = NULL;
+    int tries;
+    int ok;
+
+    if (path == NULL)
+        return 0;
+
+    pathlen = strlen(path);
+    tmp = (char *) __PHYSFS_smallAlloc(pathlen + 16);
+    if (tmp == NULL)
+    {
+        allocator.Free(path);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    } /* if */
+
+    /*
+     * Other mounts, in this process or others, might have the old file
+     *  mapped and be reading it right now, so it's never rewritten in
+     *  place: this writes a new file next to it, and renames that over it.
+     *  The seed only needs to make clashes unlikely; opening with
+     *  __PHYSFS_platformOpenNew() is what keeps writers apart.
+     */
+    seed = (PHYSFS_uint32) (size_t) __PHYSFS_platformGetThreadID();
+    seed ^= (PHYSFS_uint32) (size_t) &seed;
+    seed ^= (PHYSFS_uint32) time(NULL);
+    seed = __PHYSFS_hashString((const char *) &seed, sizeof (seed));
+
+    for (tries = 0; (io == NULL) && (tries < 8); tries++)
+    {
+        void *handle;
+        __PHYSFS_platformGrabMutex(stateLock);
+        seed += ++counter;
+        __PHYSFS_platformReleaseMutex(stateLock);
+        snprintf(tmp, pathlen + 16, "%s.%08x.tmp", path, (unsigned int) seed);
+        handle = __PHYSFS_platformOpenNew(tmp);
+        if (handle != NULL)
+        {
+            io = __PHYSFS_createNativeIoFromHandle(handle, tmp, 'w');
+            if (io == NULL)  /* that closed (handle) already. */
+            {
+                __PHYSFS_platformDelete(tmp);
+                break;
+            } /* if */
+        } /* if */
+    } /* for */
+
+    ok = (io != NULL);
+    if (ok)
+    {
+        ok = (io->write(io, buf, len) == (PHYSFS_sint64) len);
+        ok = io->flush(io) && ok;
+        io->destroy(io);
+        ok = ok && __PHYSFS_platformRename(tmp, path);
+        if (!ok)
+            __PHYSFS_platformDelete(tmp);
+    } /* if */
+
+    __PHYSFS_smallFree(tmp);
+    allocator.Free(path);
+    return ok;
+} /* __PHYSFS_saveIndexCache */
+
+
+void PHYSFS_setDirectoryIndexing(int enable)
+{
+    indexDirectories = enable;
+} /* PHYSFS_setDirectoryIndexing */
+
+
+int PHYSFS_getDirectoryIndexing(void)
+{
+    return indexDirectories;
+} /* PHYSFS_getDirectoryIndexing */
+
+
+void PHYSFS_setArchiveMapping(int enable)
+{
+    mapArchives = enable;
+} /* PHYSFS_setArchiveMapping */
+
+
+int PHYSFS_getArchiveMapping(void)
+{
+    return mapArchives;
+} /* PHYSFS_getArchiveMapping */
+
+
+int PHYSFS_setWriteDir(const char *newDir)
+{
+    int retval = 1;
+
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    if (writeDir != NULL)
+    {
+        BAIL_IF_MUTEX_ERRPASS(!freeDirHandle(writeDir, openWriteList),
+                            stateLock, 0);
+        writeDir = NULL;
+    } /* if */
+
+    if (newDir != NULL)
+    {
+        writeDir = createDirHandle(NULL, newDir, NULL, 1);
+        retval = (writeDir != NULL);
+    } /* if */
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    return retval;
+} /* PHYSFS_setWriteDir */
+
+
+static int doMount(PHYSFS_Io *io, const char *fname,
+                   const char *mountPoint, int appendToPath)
+{
+    DirHandle *dh;
+    DirHandle *prev = NULL;
+    DirHandle *i;
+
+    BAIL_IF(!fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    if (mountPoint == NULL)
+        mountPoint = "/";
+
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        /* already in search path? */
+        if ((i->dirName != NULL) && (strcmp(fname, i->dirName) == 0))
+            BAIL_MUTEX_ERRPASS(stateLock, 1);
+        prev = i;
+    } /* for */
+
     dh = createDirHandle(io, fname, mountPoint, 0);
     BAIL_IF_MUTEX_ERRPASS(!dh, stateLock, 0);
 
@@ -1725,7 +2751,8 @@ int PHYSFS_mountIo(PHYSFS_Io *io, const char *fname,
 {
     BAIL_IF(!io, PHYSFS_ERR_INVALID_ARGUMENT, 0);
     BAIL_IF(!fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF(io->version != 0, PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF(io->version > CURRENT_PHYSFS_IO_API_VERSION,
+            PHYSFS_ERR_UNSUPPORTED, 0);
     return doMount(io, fname, mountPoint, appendToPath);
 } /* PHYSFS_mountIo */
 
@@ -1979,6 +3006,158 @@ int PHYSFS_symbolicLinksPermitted(void)
 } /* PHYSFS_symbolicLinksPermitted */
 
 
+/*
+ * verifyPath() remembers which directories it already checked, per
+ *  DirHandle, so deep paths don't cost a stat() per element on every open.
+ */
+typedef struct
+{
+    __PHYSFS_DirTreeEntry tree;  /* manages directory tree. */
+    int verified;  /* non-zero if we stat()'d this and it's not a symlink. */
+    time_t when;  /* time(NULL) when (verified) was set. */
+} LinkCacheEntry;
+
+/* MAKE SURE you hold the stateLock before calling this! */
+static void flushSymlinkCheckCaches(void)
+{
+    DirHandle *i;
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (i->haslinkcache)
+        {
+            __PHYSFS_DirTreeDeinit(&i->linkcache);
+            i->haslinkcache = 0;
+        } /* if */
+    } /* for */
+
+    if ((writeDir != NULL) && (writeDir->haslinkcache))
+    {
+        __PHYSFS_DirTreeDeinit(&writeDir->linkcache);
+        writeDir->haslinkcache = 0;
+    } /* if */
+} /* flushSymlinkCheckCaches */
+
+
+static int symlinkCheckCached(DirHandle *h, const char *path)
+{
+    LinkCacheEntry *entry;
+
+    if (!h->haslinkcache)
+        return 0;
+
+    entry = (LinkCacheEntry *) __PHYSFS_DirTreeFind(&h->linkcache, path);
+    if ((entry == NULL) || (!entry->verified))
+        return 0;
+
+    if (symlinkCheckCacheTTL > 0)
+    {
+        const time_t now = time(NULL);
+        if ((now < entry->when) || ((now - entry->when) >= symlinkCheckCacheTTL))
+        {
+            entry->verified = 0;  /* stale (or the clock moved); check again. */
+            return 0;
+        } /* if */
+    } /* if */
+
+    return 1;
+} /* symlinkCheckCached */
+
+
+/* (path) is a real directory, not a symlink. Failure here is harmless. */
+static void cacheSymlinkCheck(DirHandle *h, char *path)
+{
+    LinkCacheEntry *entry;
+
+    if (symlinkCheckCacheTTL == 0)
+        return;  /* caching is disabled. */
+
+    if (!h->haslinkcache)
+    {
+        if (!__PHYSFS_DirTreeInit(&h->linkcache, sizeof (LinkCacheEntry)))
+        {
+            __PHYSFS_DirTreeDeinit(&h->linkcache);
+            return;
+        } /* if */
+        h->haslinkcache = 1;
+    } /* if */
+
+    entry = (LinkCacheEntry *) __PHYSFS_DirTreeAdd(&h->linkcache, path, 1);
+    if (entry != NULL)
+    {
+        entry->verified = 1;
+        entry->when = time(NULL);
+    } /* if */
+} /* cacheSymlinkCheck */
+
+
+void PHYSFS_setSymlinkCheckCache(int ttl)
+{
+    if (initialized)
+    {
+        __PHYSFS_platformGrabMutex(stateLock);
+        symlinkCheckCacheTTL = ttl;
+        flushSymlinkCheckCaches();
+        __PHYSFS_platformReleaseMutex(stateLock);
+    } /* if */
+    else
+    {
+        symlinkCheckCacheTTL = ttl;
+    } /* else */
+} /* PHYSFS_setSymlinkCheckCache */
+
+
+int PHYSFS_getSymlinkCheckCache(void)
+{
+    int retval;
+
+    if (!initialized)
+        return symlinkCheckCacheTTL;
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    retval = symlinkCheckCacheTTL;
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return retval;
+} /* PHYSFS_getSymlinkCheckCache */
+
+
+int PHYSFS_setDecoderPoolSize(int count)
+{
+    BAIL_IF(count < 0, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    decoderPoolSize = count;
+    return 1;
+} /* PHYSFS_setDecoderPoolSize */
+
+
+int PHYSFS_getDecoderPoolSize(void)
+{
+    return decoderPoolSize;
+} /* PHYSFS_getDecoderPoolSize */
+
+
+void PHYSFS_setSolidCacheLimit(PHYSFS_uint64 bytes)
+{
+    solidCacheLimit = bytes;
+} /* PHYSFS_setSolidCacheLimit */
+
+
+PHYSFS_uint64 PHYSFS_getSolidCacheLimit(void)
+{
+    return solidCacheLimit;
+} /* PHYSFS_getSolidCacheLimit */
+
+
+void PHYSFS_setChecksumVerification(int enable)
+{
+    checksumVerification = enable ? 1 : 0;
+} /* PHYSFS_setChecksumVerification */
+
+
+int PHYSFS_getChecksumVerification(void)
+{
+    return checksumVerification;
+} /* PHYSFS_getChecksumVerification */
+
+
 /*
  * Verify that (fname) (in platform-independent notation), in relation
  *  to (h) is secure. That means that each element of fname is checked
@@ -2039,11 +3218,20 @@ static int verifyPath(DirHandle *h, char **_fname, int allowMissing)
             end = strchr(start, '/');
 
             if (end != NULL) *end = '\0';
-            rc = h->funcs->stat(h->opaque, fname, &statbuf);
-            if (rc)
-                rc = (statbuf.filetype == PHYSFS_FILETYPE_SYMLINK);
-            else if (currentErrorCode() == PHYSFS_ERR_NOT_FOUND)
-                retval = 0;
+            if (symlinkCheckCached(h, fname))
+                rc = 0;  /* checked this one before; it's a real dir. */
+            else
+            {
+                rc = h->funcs->stat(h->opaque, fname, &statbuf);
+                if (rc)
+                {
+                    rc = (statbuf.filetype == PHYSFS_FILETYPE_SYMLINK);
+                    if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+                        cacheSymlinkCheck(h, fname);
+                } /* if */
+                else if (currentErrorCode() == PHYSFS_ERR_NOT_FOUND)
+                    retval = 0;
+            } /* else */
 
             if (end != NULL) *end = '/';
 
@@ -2119,6 +3307,9 @@ static int doMkdir(const char *_dname, char *dname)
         start = end + 1;
     } /* while */
 
+    if (!exists)  /* we made something; don't trust what we knew before. */
+        flushSymlinkCheckCaches();
+
     __PHYSFS_platformReleaseMutex(stateLock);
     return retval;
 } /* doMkdir */
@@ -2152,6 +3343,8 @@ static int doDelete(const char *_fname, char *fname)
     h = writeDir;
     BAIL_IF_MUTEX_ERRPASS(!verifyPath(h, &fname, 0), stateLock, 0);
     retval = h->funcs->remove(h->opaque, fname);
+    if (retval)  /* might have been a dir that other mounts checked. */
+        flushSymlinkCheckCaches();
 
     __PHYSFS_platformReleaseMutex(stateLock);
     return retval;
@@ -2400,6 +3593,28 @@ static PHYSFS_EnumerateCallbackResult enumCallbackFilterSymLinks(void *_data,
 } /* enumCallbackFilterSymLinks */
 
 
+/* Same as above, but no stat() needed if the archiver knew the type. */
+static PHYSFS_EnumerateCallbackResult enumCallbackFilterSymLinksTyped(
+                                    void *_data, const char *origdir,
+                                    const char *fname, int filetype)
+{
+    SymlinkFilterData *data = (SymlinkFilterData *) _data;
+    PHYSFS_EnumerateCallbackResult retval = PHYSFS_ENUM_OK;
+
+    if (filetype < 0)  /* archiver doesn't know; look it up the slow way. */
+        return enumCallbackFilterSymLinks(_data, origdir, fname);
+
+    else if (filetype != PHYSFS_FILETYPE_SYMLINK)
+    {
+        retval = data->callback(data->callbackData, origdir, fname);
+        if (retval == PHYSFS_ENUM_ERROR)
+            data->errcode = PHYSFS_ERR_APP_CALLBACK;
+    } /* else if */
+
+    return retval;
+} /* enumCallbackFilterSymLinksTyped */
+
+
 int PHYSFS_enumerate(const char *_fn, PHYSFS_EnumerateCallback cb, void *data)
 {
     PHYSFS_EnumerateCallbackResult retval = PHYSFS_ENUM_OK;
@@ -2453,9 +3668,18 @@ int PHYSFS_enumerate(const char *_fn, PHYSFS_EnumerateCallback cb, void *data)
                     filterdata.dirhandle = i;
                     filterdata.arcfname = arcfname;
                     filterdata.errcode = PHYSFS_ERR_OK;
-                    retval = i->funcs->enumerate(i->opaque, arcfname,
+                    if (i->funcs->enumerateTyped != NULL)
+                    {
+                        retval = i->funcs->enumerateTyped(i->opaque, arcfname,
+                                             enumCallbackFilterSymLinksTyped,
+                                             _fn, &filterdata);
+                    } /* if */
+                    else
+                    {
+                        retval = i->funcs->enumerate(i->opaque, arcfname,
                                                  enumCallbackFilterSymLinks,
                                                  _fn, &filterdata);
+                    } /* else */
                     if (retval == PHYSFS_ENUM_ERROR)
                     {
                         if (currentErrorCode() == PHYSFS_ERR_APP_CALLBACK)
@@ -2602,6 +3826,33 @@ PHYSFS_File *PHYSFS_openAppend(const char *filename)
 } /* PHYSFS_openAppend */
 
 
+/*
+ * Files read directly from the physical filesystem pay a syscall per read,
+ *  and compressed ZIP entries pay an inflate() call per read, so they get
+ *  adaptive read buffering unless the app says otherwise. Everything else
+ *  is served from memory (or a memory-mapped archive) already, where a
+ *  buffer would just be an extra copy. That includes stored ZIP entries
+ *  when the archive itself is in memory or mapped.
+ */
+static int wantsReadBufferByDefault(const DirHandle *h, PHYSFS_Io *io)
+{
+    const char *ext = h->funcs->info.extension;
+    PHYSFS_uint64 pos, len;
+
+    if ((*ext != '\0') && (PHYSFS_utf8stricmp(ext, "ZIP") != 0))
+        return 0;
+
+    if ((h->hooks != NULL) && (h->hooks->rawRegion != NULL))
+    {
+        PHYSFS_Io *parent = h->hooks->rawRegion(io, &pos, &len);
+        if (parent != NULL)
+            io = parent;
+    } /* if */
+
+    return ((io->read != memoryIo_read) && (io->read != mappedIo_read));
+} /* wantsReadBufferByDefault */
+
+
 PHYSFS_File *PHYSFS_openRead(const char *_fname)
 {
     FileHandle *fh = NULL;
@@ -2649,6 +3900,12 @@ PHYSFS_File *PHYSFS_openRead(const char *_fname)
         fh->next = openReadList;
         openReadList = fh;
 
+        if (wantsReadBufferByDefault(i, io))  /* this can fail; that's okay. */
+        {
+            PHYSFS_setAdaptiveBuffer((PHYSFS_File *) fh, ADAPTIVE_MINBUFSIZE,
+                                     ADAPTIVE_MAXBUFSIZE);
+        } /* if */
+
         openReadEnd:
         __PHYSFS_platformReleaseMutex(stateLock);
     } /* if */
@@ -2658,61 +3915,594 @@ PHYSFS_File *PHYSFS_openRead(const char *_fname)
 } /* PHYSFS_openRead */
 
 
-static int closeHandleInOpenList(FileHandle **list, FileHandle *handle)
+static int closeHandleInOpenList(FileHandle **list, FileHandle *handle)
+{
+    FileHandle *prev = NULL;
+    FileHandle *i;
+    int rc = 1;
+
+    for (i = *list; i != NULL; i = i->next)
+    {
+        if (i == handle)  /* handle is in this list? */
+        {
+            PHYSFS_Io *io = handle->io;
+            PHYSFS_uint8 *tmp = handle->buffer;
+            rc = PHYSFS_flush((PHYSFS_File *) handle);
+            if (!rc)
+                return -1;
+            io->destroy(io);
+
+            if (tmp != NULL)  /* free any associated buffer. */
+                allocator.Free(tmp);
+            freeSendState(handle);
+
+            if (prev == NULL)
+                *list = handle->next;
+            else
+                prev->next = handle->next;
+
+            allocator.Free(handle);
+            return 1;
+        } /* if */
+        prev = i;
+    } /* for */
+
+    return 0;
+} /* closeHandleInOpenList */
+
+
+int PHYSFS_close(PHYSFS_File *_handle)
+{
+    FileHandle *handle = (FileHandle *) _handle;
+    int rc;
+
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    /* -1 == close failure. 0 == not found. 1 == success. */
+    rc = closeHandleInOpenList(&openReadList, handle);
+    BAIL_IF_MUTEX_ERRPASS(rc == -1, stateLock, 0);
+    if (!rc)
+    {
+        rc = closeHandleInOpenList(&openWriteList, handle);
+        BAIL_IF_MUTEX_ERRPASS(rc == -1, stateLock, 0);
+    } /* if */
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+    BAIL_IF(!rc, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    return 1;
+} /* PHYSFS_close */
+
+
+/*
+ * PHYSFS_verifyArchive() lists every file in the archive up front, then
+ *  the calling thread and (threads - 1) helpers take names off the list,
+ *  open them straight from the archiver and read them to the end, with
+ *  CRC checking forced on where the archiver has one. The archive's
+ *  DirHandle is retained (refcount) for the whole run, so it can't be
+ *  unmounted until we're done, and the open files sit in openReadList like
+ *  any others.
+ */
+#define VERIFY_BUFSIZE (256 * 1024)
+
+typedef struct
+{
+    DirHandle *dirhandle;
+    EnumStringListCallbackData files;  /* regular files to check. */
+    EnumStringListCallbackData dirs;  /* directories left to list. */
+    PHYSFS_uint32 nextfile;  /* index in files.list of the next to check. */
+    void *lock;  /* protects nextfile and errcode while threads run. */
+    PHYSFS_ErrorCode errcode;  /* first failure, or PHYSFS_ERR_OK. */
+} VerifyArchiveData;
+
+
+static PHYSFS_EnumerateCallbackResult verifyArchiveListCallback(void *_data,
+                                    const char *origdir, const char *fname)
+{
+    VerifyArchiveData *data = (VerifyArchiveData *) _data;
+    const DirHandle *dh = data->dirhandle;
+    const size_t slen = strlen(origdir) + strlen(fname) + 2;
+    char *path = (char *) __PHYSFS_smallAlloc(slen);
+    PHYSFS_Stat statbuf;
+
+    if (path == NULL)
+    {
+        data->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+        return PHYSFS_ENUM_ERROR;
+    } /* if */
+
+    snprintf(path, slen, "%s%s%s", origdir, *origdir ? "/" : "", fname);
+
+    if (!dh->funcs->stat(dh->opaque, path, &statbuf))
+        data->errcode = currentErrorCode();
+    else if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        enumStringListCallback(&data->dirs, path);
+    else if (statbuf.filetype == PHYSFS_FILETYPE_REGULAR)
+        enumStringListCallback(&data->files, path);
+
+    __PHYSFS_smallFree(path);
+
+    if ((data->files.errcode) || (data->dirs.errcode))
+        data->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+
+    return data->errcode ? PHYSFS_ENUM_ERROR : PHYSFS_ENUM_OK;
+} /* verifyArchiveListCallback */
+
+
+/* Undo PHYSFS_verifyArchive()'s refcount++. (dh) can be NULL. */
+static void releaseDirHandle(DirHandle *dh)
+{
+    if (dh != NULL)
+    {
+        __PHYSFS_platformGrabMutex(stateLock);
+        assert(dh->refcount > 0);
+        dh->refcount--;
+        __PHYSFS_platformReleaseMutex(stateLock);
+    } /* if */
+} /* releaseDirHandle */
+
+
+static int verifyArchiveFile(VerifyArchiveData *data, const char *fname,
+                             PHYSFS_uint8 *buf)
+{
+    DirHandle *dh = data->dirhandle;
+    FileHandle *fh;
+    PHYSFS_Io *io;
+    PHYSFS_sint64 br;
+    int retval;
+
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    io = dh->funcs->openRead(dh->opaque, fname);
+    BAIL_IF_MUTEX_ERRPASS(!io, stateLock, 0);
+
+    fh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
+    if (fh == NULL)
+    {
+        io->destroy(io);
+        BAIL_MUTEX(PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
+    } /* if */
+
+    memset(fh, '\0', sizeof (FileHandle));
+    fh->io = io;
+    fh->forReading = 1;
+    fh->dirHandle = dh;
+    fh->next = openReadList;
+    openReadList = fh;
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    if ((dh->hooks != NULL) && (dh->hooks->verifyIo != NULL))
+        dh->hooks->verifyIo(io);
+
+    do
+    {
+        br = io->read(io, buf, VERIFY_BUFSIZE);
+    } while (br > 0);
+
+    retval = (br == 0);
+    if (!PHYSFS_close((PHYSFS_File *) fh))
+        retval = 0;
+
+    return retval;
+} /* verifyArchiveFile */
+
+
+static void verifyArchiveThread(void *_data)
+{
+    VerifyArchiveData *data = (VerifyArchiveData *) _data;
+    PHYSFS_ErrorCode err = PHYSFS_ERR_OK;
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) allocator.Malloc(VERIFY_BUFSIZE);
+
+    if (buf == NULL)
+        err = PHYSFS_ERR_OUT_OF_MEMORY;
+
+    while (err == PHYSFS_ERR_OK)
+    {
+        const char *fname = NULL;
+
+        __PHYSFS_platformGrabMutex(data->lock);
+        if ((data->errcode == PHYSFS_ERR_OK) &&
+            (data->nextfile < data->files.size))
+            fname = data->files.list[data->nextfile++];
+        __PHYSFS_platformReleaseMutex(data->lock);
+
+        if (fname == NULL)
+            break;  /* all done, or someone else failed. */
+        else if (!verifyArchiveFile(data, fname, buf))
+        {
+            err = currentErrorCode();
+            if (err == PHYSFS_ERR_OK)
+                err = PHYSFS_ERR_OTHER_ERROR;  /* shouldn't happen. */
+        } /* else if */
+    } /* while */
+
+    if (err != PHYSFS_ERR_OK)
+    {
+        __PHYSFS_platformGrabMutex(data->lock);
+        if (data->errcode == PHYSFS_ERR_OK)
+            data->errcode = err;
+        __PHYSFS_platformReleaseMutex(data->lock);
+    } /* if */
+
+    if (buf != NULL)
+        allocator.Free(buf);
+} /* verifyArchiveThread */
+
+
+int PHYSFS_verifyArchive(const char *archive, int threads)
+{
+    VerifyArchiveData data;
+    void **workers = NULL;
+    PHYSFS_uint32 i;
+    int numworkers = 0;
+    int t;
+
+    BAIL_IF(archive == NULL, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    memset(&data, '\0', sizeof (data));
+    data.files.list = (char **) allocator.Malloc(sizeof (char *));
+    data.dirs.list = (char **) allocator.Malloc(sizeof (char *));
+    GOTO_IF(!data.files.list || !data.dirs.list, PHYSFS_ERR_OUT_OF_MEMORY,
+            verifyArchive_failed);
+    data.lock = __PHYSFS_platformCreateMutex();
+    GOTO_IF_ERRPASS(!data.lock, verifyArchive_failed);
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    for (data.dirhandle = searchPath; data.dirhandle != NULL;
+         data.dirhandle = data.dirhandle->next)
+    {
+        if (strcmp(data.dirhandle->dirName, archive) == 0)
+            break;
+    } /* for */
+
+    if (data.dirhandle == NULL)
+        data.errcode = PHYSFS_ERR_NOT_MOUNTED;
+    else
+    {
+        data.dirhandle->refcount++;  /* released when we're done. */
+
+        /* start at the root; this appends the subdirs as it finds them. */
+        enumStringListCallback(&data.dirs, "");
+        data.errcode = data.dirs.errcode;
+        for (i = 0; (i < data.dirs.size) && (!data.errcode); i++)
+        {
+            const DirHandle *dh = data.dirhandle;
+            const char *dname = data.dirs.list[i];
+            if (dh->funcs->enumerate(dh->opaque, dname,
+                                     verifyArchiveListCallback, dname,
+                                     &data) == PHYSFS_ENUM_ERROR)
+            {
+                if (data.errcode == PHYSFS_ERR_OK)
+                    data.errcode = currentErrorCode();
+                if (data.errcode == PHYSFS_ERR_OK)
+                    data.errcode = PHYSFS_ERR_OTHER_ERROR;
+            } /* if */
+        } /* for */
+    } /* else */
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    GOTO_IF(data.errcode, data.errcode, verifyArchive_failed);
+
+    if ((threads > 1) && ((PHYSFS_uint32) threads > data.files.size))
+        threads = (int) data.files.size;
+
+    if (threads > 1)
+    {
+        /* if we can't get helpers, we'll just do more of the work here. */
+        workers = (void **) allocator.Malloc(sizeof (void *) * (threads - 1));
+        for (t = 0; (workers != NULL) && (t < threads - 1); t++)
+        {
+            workers[numworkers] = __PHYSFS_platformCreateThread(
+                                              verifyArchiveThread, &data);
+            if (workers[numworkers] == NULL)
+                break;
+            numworkers++;
+        } /* for */
+    } /* if */
+
+    verifyArchiveThread(&data);
+
+    for (t = 0; t < numworkers; t++)
+        __PHYSFS_platformWaitThread(workers[t]);
+
+    GOTO_IF(data.errcode, data.errcode, verifyArchive_failed);
+
+    releaseDirHandle(data.dirhandle);
+    if (workers != NULL)
+        allocator.Free(workers);
+    __PHYSFS_platformDestroyMutex(data.lock);
+    data.files.list[data.files.size] = NULL;
+    PHYSFS_freeList(data.files.list);
+    data.dirs.list[data.dirs.size] = NULL;
+    PHYSFS_freeList(data.dirs.list);
+    return 1;
+
+verifyArchive_failed:
+    releaseDirHandle(data.dirhandle);
+    if (workers != NULL)
+        allocator.Free(workers);
+    if (data.lock != NULL)
+        __PHYSFS_platformDestroyMutex(data.lock);
+
+    /* enumStringListCallback() already freed a list it failed to grow. */
+    if ((data.files.list != NULL) && (!data.files.errcode))
+    {
+        data.files.list[data.files.size] = NULL;
+        PHYSFS_freeList(data.files.list);
+    } /* if */
+
+    if ((data.dirs.list != NULL) && (!data.dirs.errcode))
+    {
+        data.dirs.list[data.dirs.size] = NULL;
+        PHYSFS_freeList(data.dirs.list);
+    } /* if */
+
+    return 0;
+} /* PHYSFS_verifyArchive */
+
+
+int PHYSFS_setDecoderDictionary(const char *archive, const void *dict,
+                                PHYSFS_uint64 len)
+{
+    DirHandle *i;
+    int retval = 0;
+
+    BAIL_IF(archive == NULL, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (strcmp(i->dirName, archive) == 0)
+            break;
+    } /* for */
+
+    if (i == NULL)
+        PHYSFS_setErrorCode(PHYSFS_ERR_NOT_MOUNTED);
+    else if ((i->hooks == NULL) || (i->hooks->setDictionary == NULL))
+        PHYSFS_setErrorCode(PHYSFS_ERR_UNSUPPORTED);
+    else
+        retval = i->hooks->setDictionary(i->opaque, dict, len);
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    return retval;
+} /* PHYSFS_setDecoderDictionary */
+
+
+void PHYSFS_setResolveOnMount(int enable)
+{
+    resolveOnMount = enable ? 1 : 0;
+} /* PHYSFS_setResolveOnMount */
+
+
+int PHYSFS_getResolveOnMount(void)
+{
+    return resolveOnMount;
+} /* PHYSFS_getResolveOnMount */
+
+
+int PHYSFS_resolveArchive(const char *archive)
+{
+    DirHandle *i;
+    int retval = 0;
+
+    BAIL_IF(archive == NULL, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (strcmp(i->dirName, archive) == 0)
+            break;
+    } /* for */
+
+    if (i == NULL)
+        PHYSFS_setErrorCode(PHYSFS_ERR_NOT_MOUNTED);
+    else if ((i->hooks == NULL) || (i->hooks->resolveAll == NULL))
+        retval = 1;  /* nothing to resolve. */
+    else
+        retval = i->hooks->resolveAll(i->opaque);
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    return retval;
+} /* PHYSFS_resolveArchive */
+
+
+void PHYSFS_setLazyMounting(int enable)
+{
+    lazyMounting = enable ? 1 : 0;
+} /* PHYSFS_setLazyMounting */
+
+
+int PHYSFS_getLazyMounting(void)
+{
+    return lazyMounting;
+} /* PHYSFS_getLazyMounting */
+
+
+PHYSFS_ZipWriter *PHYSFS_openZipWriter(const char *filename, int threads,
+                                       PHYSFS_uint32 alignment)
+{
+    #if !PHYSFS_SUPPORTS_ZIP
+    (void) filename;
+    (void) threads;
+    (void) alignment;
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+    #else
+    PHYSFS_ZipWriter *retval;
+    PHYSFS_File *out;
+
+    BAIL_IF(!filename, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF(alignment > 32768, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF(alignment & (alignment - 1), PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+
+    retval = (PHYSFS_ZipWriter *) allocator.Malloc(sizeof (PHYSFS_ZipWriter));
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+
+    out = PHYSFS_openWrite(filename);
+    GOTO_IF_ERRPASS(!out, openZipWriter_failed);
+
+    retval->opaque = __PHYSFS_zipWriterCreate(out, threads, alignment);
+    if (!retval->opaque)
+    {
+        PHYSFS_close(out);
+        goto openZipWriter_failed;
+    } /* if */
+
+    return retval;
+
+openZipWriter_failed:
+    allocator.Free(retval);
+    return NULL;
+    #endif
+} /* PHYSFS_openZipWriter */
+
+
+#if PHYSFS_SUPPORTS_ZIP
+static int doAddZipEntry(PHYSFS_ZipWriter *zw, const char *_name,
+                         const void *buf, PHYSFS_File *in,
+                         const PHYSFS_uint64 len, const PHYSFS_sint64 modtime,
+                         int level)
+{
+    size_t namelen;
+    char *name;
+    int retval = 0;
+
+    BAIL_IF(!zw, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!_name, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF((level < -1) || (level > 9), PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    if (level == -1)
+        level = 6;
+
+    namelen = strlen(_name) + 1;
+    name = (char *) __PHYSFS_smallAlloc(namelen);
+    BAIL_IF(!name, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    if (sanitizePlatformIndependentPath(_name, name))
+    {
+        if (*name == '\0')
+            PHYSFS_setErrorCode(PHYSFS_ERR_BAD_FILENAME);
+        else
+        {
+            retval = __PHYSFS_zipWriterAdd(zw->opaque, name, buf, in, len,
+                                           modtime, level);
+        } /* else */
+    } /* if */
+
+    __PHYSFS_smallFree(name);
+    return retval;
+} /* doAddZipEntry */
+#endif
+
+
+int PHYSFS_addZipEntry(PHYSFS_ZipWriter *zw, const char *name,
+                       const void *buf, PHYSFS_uint64 len,
+                       PHYSFS_sint64 modtime, int level)
+{
+    #if !PHYSFS_SUPPORTS_ZIP
+    (void) zw;
+    (void) name;
+    (void) buf;
+    (void) len;
+    (void) modtime;
+    (void) level;
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+    #else
+    BAIL_IF((!buf) && (len > 0), PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    return doAddZipEntry(zw, name, buf ? buf : "", NULL, len, modtime, level);
+    #endif
+} /* PHYSFS_addZipEntry */
+
+
+int PHYSFS_addZipEntryFromFile(PHYSFS_ZipWriter *zw, const char *name,
+                               const char *srcname, int level)
+{
+    #if !PHYSFS_SUPPORTS_ZIP
+    (void) zw;
+    (void) name;
+    (void) srcname;
+    (void) level;
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+    #else
+    PHYSFS_Stat statbuf;
+    PHYSFS_File *in;
+    PHYSFS_sint64 len;
+    int retval;
+
+    BAIL_IF(!srcname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_ERRPASS(!PHYSFS_stat(srcname, &statbuf), 0);
+    BAIL_IF(statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY,
+            PHYSFS_ERR_NOT_A_FILE, 0);
+
+    in = PHYSFS_openRead(srcname);
+    BAIL_IF_ERRPASS(!in, 0);
+
+    len = PHYSFS_fileLength(in);
+    if (len < 0)
+    {
+        PHYSFS_close(in);
+        BAIL(PHYSFS_ERR_UNSUPPORTED, 0);  /* can't tell how big it is. */
+    } /* if */
+
+    retval = doAddZipEntry(zw, name, NULL, in, (PHYSFS_uint64) len,
+                           statbuf.modtime, level);
+    PHYSFS_close(in);
+    return retval;
+    #endif
+} /* PHYSFS_addZipEntryFromFile */
+
+
+int PHYSFS_closeZipWriter(PHYSFS_ZipWriter *zw)
 {
-    FileHandle *prev = NULL;
-    FileHandle *i;
-    int rc = 1;
-
-    for (i = *list; i != NULL; i = i->next)
-    {
-        if (i == handle)  /* handle is in this list? */
-        {
-            PHYSFS_Io *io = handle->io;
-            PHYSFS_uint8 *tmp = handle->buffer;
-            rc = PHYSFS_flush((PHYSFS_File *) handle);
-            if (!rc)
-                return -1;
-            io->destroy(io);
+    #if !PHYSFS_SUPPORTS_ZIP
+    (void) zw;
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+    #else
+    int retval;
+    BAIL_IF(!zw, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    retval = __PHYSFS_zipWriterClose(zw->opaque);
+    allocator.Free(zw);
+    return retval;
+    #endif
+} /* PHYSFS_closeZipWriter */
 
-            if (tmp != NULL)  /* free any associated buffer. */
-                allocator.Free(tmp);
 
-            if (prev == NULL)
-                *list = handle->next;
-            else
-                prev->next = handle->next;
+/* Sequential reads double the buffer, up to fh->maxbufsize. */
+static void growReadBuffer(FileHandle *fh)
+{
+    PHYSFS_uint8 *newbuf;
+    size_t newsize = fh->bufsize * 2;
 
-            allocator.Free(handle);
-            return 1;
-        } /* if */
-        prev = i;
-    } /* for */
+    if (fh->bufsize >= fh->maxbufsize)
+        return;
+    else if ((newsize > fh->maxbufsize) || (newsize < fh->bufsize))
+        newsize = fh->maxbufsize;
 
-    return 0;
-} /* closeHandleInOpenList */
+    assert(fh->bufpos == fh->buffill);  /* only grow an empty buffer! */
+    newbuf = (PHYSFS_uint8 *) allocator.Realloc(fh->buffer, newsize);
+    if (newbuf != NULL)  /* if this fails, keep going with what we have. */
+    {
+        fh->buffer = newbuf;
+        fh->bufsize = newsize;
+    } /* if */
+} /* growReadBuffer */
 
 
-int PHYSFS_close(PHYSFS_File *_handle)
+/* Random access drops the buffer back to fh->minbufsize. */
+static void shrinkReadBuffer(FileHandle *fh)
 {
-    FileHandle *handle = (FileHandle *) _handle;
-    int rc;
+    PHYSFS_uint8 *newbuf;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    if (fh->bufsize <= fh->minbufsize)
+        return;
 
-    /* -1 == close failure. 0 == not found. 1 == success. */
-    rc = closeHandleInOpenList(&openReadList, handle);
-    BAIL_IF_MUTEX_ERRPASS(rc == -1, stateLock, 0);
-    if (!rc)
+    assert(fh->bufpos == fh->buffill);  /* only shrink an empty buffer! */
+    newbuf = (PHYSFS_uint8 *) allocator.Realloc(fh->buffer, fh->minbufsize);
+    if (newbuf != NULL)
     {
-        rc = closeHandleInOpenList(&openWriteList, handle);
-        BAIL_IF_MUTEX_ERRPASS(rc == -1, stateLock, 0);
+        fh->buffer = newbuf;
+        fh->bufsize = fh->minbufsize;
     } /* if */
-
-    __PHYSFS_platformReleaseMutex(stateLock);
-    BAIL_IF(!rc, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    return 1;
-} /* PHYSFS_close */
+} /* shrinkReadBuffer */
 
 
 static PHYSFS_sint64 doBufferedRead(FileHandle *fh, void *_buffer, size_t len)
@@ -2734,10 +4524,28 @@ static PHYSFS_sint64 doBufferedRead(FileHandle *fh, void *_buffer, size_t len)
             retval += cpy;
         } /* if */
 
+        else if (len >= fh->bufsize)  /* buffer wouldn't help; skip it. */
+        {
+            PHYSFS_Io *io = fh->io;
+            const PHYSFS_sint64 rc = io->read(io, buffer, len);
+            fh->bufpos = fh->buffill = 0;
+            if (rc > 0)
+                retval += rc;
+            else if (retval == 0)  /* report already-read data, or failure. */
+                retval = rc;
+            break;
+        } /* else if */
+
         else   /* buffer is empty, refill it. */
         {
             PHYSFS_Io *io = fh->io;
-            const PHYSFS_sint64 rc = io->read(io, fh->buffer, fh->bufsize);
+            PHYSFS_sint64 rc;
+
+            /* we read a whole buffer's worth without seeking? Read more. */
+            if ((fh->maxbufsize) && (fh->buffill == fh->bufsize))
+                growReadBuffer(fh);
+
+            rc = io->read(io, fh->buffer, fh->bufsize);
             fh->bufpos = 0;
             if (rc > 0)
                 fh->buffill = (size_t) rc;
@@ -2898,6 +4706,8 @@ int PHYSFS_seek(PHYSFS_File *handle, PHYSFS_uint64 pos)
 
     /* we have to fall back to a 'raw' seek. */
     fh->buffill = fh->bufpos = 0;
+    if ((fh->buffer) && (fh->maxbufsize))
+        shrinkReadBuffer(fh);  /* random access; don't read ahead so far. */
     return fh->io->seek(fh->io, pos);
 } /* PHYSFS_seek */
 
@@ -2952,24 +4762,226 @@ int PHYSFS_setBuffer(PHYSFS_File *handle, PHYSFS_uint64 _bufsize)
 
     fh->bufsize = bufsize;
     fh->buffill = fh->bufpos = 0;
+    fh->minbufsize = fh->maxbufsize = 0;  /* fixed size now. */
     return 1;
 } /* PHYSFS_setBuffer */
 
 
+int PHYSFS_setAdaptiveBuffer(PHYSFS_File *handle, PHYSFS_uint64 minsize,
+                             PHYSFS_uint64 maxsize)
+{
+    FileHandle *fh = (FileHandle *) handle;
+
+    if ((minsize == 0) && (maxsize == 0))
+        return PHYSFS_setBuffer(handle, 0);
+
+    BAIL_IF(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, 0);
+    BAIL_IF(minsize == 0, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(minsize > maxsize, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!__PHYSFS_ui64FitsAddressSpace(maxsize),
+            PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    BAIL_IF_ERRPASS(!PHYSFS_setBuffer(handle, minsize), 0);
+    fh->minbufsize = (size_t) minsize;
+    fh->maxbufsize = (size_t) maxsize;
+    return 1;
+} /* PHYSFS_setAdaptiveBuffer */
+
+
+int PHYSFS_setWriteBehind(PHYSFS_File *handle, PHYSFS_uint64 bufsize,
+                          PHYSFS_uint64 sizehint)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_Io *io = fh->io;
+
+    BAIL_IF(fh->forReading, PHYSFS_ERR_OPEN_FOR_READING, 0);
+    BAIL_IF(!__PHYSFS_ui64FitsAddressSpace(bufsize),
+            PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    /* only files in the physical filesystem can do this. */
+    BAIL_IF(io->write != nativeIo_write, PHYSFS_ERR_UNSUPPORTED, 0);
+
+    BAIL_IF_ERRPASS(!PHYSFS_flush(handle), 0);  /* keep writes in order. */
+    BAIL_IF_ERRPASS(!nativeIo_setWriteBehind(io, (size_t) bufsize, sizehint), 0);
+    fh->writebehind = (bufsize != 0);
+    return 1;
+} /* PHYSFS_setWriteBehind */
+
+
+/* big enough that the syscall overhead of each pass doesn't matter much. */
+#define SENDTOFD_BUFSIZE (256 * 1024)
+
+/*
+ * PHYSFS_sendToFd() for files the OS can't copy from directly. This reads
+ *  through its own duplicate of the Io, so the handle's position is left
+ *  alone and a compressed stream is only seeked when the caller jumps
+ *  around. Whatever a non-blocking fd didn't take stays in sendbuf, so a
+ *  caller that resumes where the last call stopped doesn't make us read
+ *  (or decompress) it again.
+ */
+static PHYSFS_sint64 sendToFdThroughBuffer(FileHandle *fh, int fd,
+                                           PHYSFS_uint64 offset,
+                                           PHYSFS_uint64 len)
+{
+    PHYSFS_sint64 retval = 0;
+
+    if ((fh->sendbuflen > 0) && (fh->sendofs != offset))
+        fh->sendbuflen = 0;  /* caller moved on; throw out what we had. */
+
+    if (fh->sendio == NULL)
+    {
+        fh->sendio = fh->io->duplicate(fh->io);
+        BAIL_IF_ERRPASS(!fh->sendio, -1);
+    } /* if */
+
+    if (fh->sendbuf == NULL)
+    {
+        fh->sendbuf = (PHYSFS_uint8 *) allocator.Malloc(SENDTOFD_BUFSIZE);
+        BAIL_IF(!fh->sendbuf, PHYSFS_ERR_OUT_OF_MEMORY, -1);
+    } /* if */
+
+    while (len > 0)
+    {
+        PHYSFS_uint64 avail;
+        PHYSFS_sint64 rc;
+
+        if (fh->sendbuflen == 0)
+        {
+            PHYSFS_Io *io = fh->sendio;
+            const PHYSFS_uint64 want = (len < SENDTOFD_BUFSIZE) ?
+                                            len : SENDTOFD_BUFSIZE;
+            PHYSFS_sint64 br;
+
+            if (io->tell(io) != (PHYSFS_sint64) offset)
+                GOTO_IF_ERRPASS(!io->seek(io, offset), sendToFdFailed);
+
+            br = io->read(io, fh->sendbuf, want);
+            GOTO_IF_ERRPASS(br < 0, sendToFdFailed);
+            if (br == 0)
+                break;  /* file got shorter? */
+
+            fh->sendbufpos = 0;
+            fh->sendbuflen = (size_t) br;
+            fh->sendofs = offset;
+        } /* if */
+
+        avail = (PHYSFS_uint64) fh->sendbuflen;
+        if (avail > len)
+            avail = len;
+
+        rc = __PHYSFS_platformWriteFd(fd, fh->sendbuf + fh->sendbufpos, avail);
+        if (rc < 0)  /* keep sendbuf; the caller might try again. */
+            return (retval > 0) ? retval : -1;
+        else if (rc == 0)
+            break;  /* non-blocking fd is full. */
+
+        fh->sendbufpos += (size_t) rc;
+        fh->sendbuflen -= (size_t) rc;
+        fh->sendofs += (PHYSFS_uint64) rc;
+        offset += (PHYSFS_uint64) rc;
+        len -= (PHYSFS_uint64) rc;
+        retval += rc;
+    } /* while */
+
+    return retval;
+
+sendToFdFailed:
+    fh->sendbuflen = 0;
+    return (retval > 0) ? retval : -1;
+} /* sendToFdThroughBuffer */
+
+
+/*
+ * Like __PHYSFS_ioNativeRegion(), but for an open file: if the archiver
+ *  says its Io is just a piece of the archive, and the archive is a native
+ *  file, find that piece.
+ */
+static PHYSFS_sint64 fileNativeRegion(const FileHandle *fh, void **handle,
+                                      PHYSFS_uint64 *offset)
+{
+    const __PHYSFS_ArchiverHooks *hooks = fh->dirHandle->hooks;
+    PHYSFS_Io *io = fh->io;
+    PHYSFS_uint64 pos = 0;
+    PHYSFS_uint64 len = 0;
+    PHYSFS_sint64 avail;
+
+    if ((hooks != NULL) && (hooks->rawRegion != NULL))
+    {
+        io = hooks->rawRegion(io, &pos, &len);
+        if (io == NULL)
+            return -1;
+    } /* if */
+
+    avail = __PHYSFS_ioNativeRegion(io, handle, offset);
+    if (avail < 0)
+        return -1;
+    else if (io == fh->io)
+        return avail;  /* the whole native file. */
+    else if (pos + len > (PHYSFS_uint64) avail)
+        return -1;  /* truncated archive? Don't trust it. */
+
+    *offset += pos;
+    return (PHYSFS_sint64) len;
+} /* fileNativeRegion */
+
+
+PHYSFS_sint64 PHYSFS_sendToFd(PHYSFS_File *handle, int fd,
+                              PHYSFS_uint64 offset, PHYSFS_uint64 len)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_Io *io;
+    PHYSFS_sint64 filelen;
+    PHYSFS_sint64 avail;
+    PHYSFS_uint64 nativeofs = 0;
+    void *nativefh = NULL;
+
+    BAIL_IF(!handle, PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF(fd < 0, PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, -1);
+
+    io = fh->io;
+    filelen = io->length(io);
+    BAIL_IF_ERRPASS(filelen < 0, -1);
+    if (offset >= (PHYSFS_uint64) filelen)
+        return 0;
+    else if (len > ((PHYSFS_uint64) filelen) - offset)
+        len = ((PHYSFS_uint64) filelen) - offset;
+
+    if (len == 0)
+        return 0;
+
+    avail = fileNativeRegion(fh, &nativefh, &nativeofs);
+    if ((avail >= 0) && (offset + len <= (PHYSFS_uint64) avail))
+    {
+        const PHYSFS_sint64 rc = __PHYSFS_platformSendFile(fd, nativefh,
+                                                  nativeofs + offset, len);
+        if ((rc >= 0) || (currentErrorCode() != PHYSFS_ERR_UNSUPPORTED))
+            return rc;
+    } /* if */
+
+    return sendToFdThroughBuffer(fh, fd, offset, len);
+} /* PHYSFS_sendToFd */
+
+
 int PHYSFS_flush(PHYSFS_File *handle)
 {
     FileHandle *fh = (FileHandle *) handle;
     PHYSFS_Io *io;
     PHYSFS_sint64 rc;
 
-    if ((fh->forReading) || (fh->bufpos == fh->buffill))
-        return 1;  /* open for read or buffer empty are successful no-ops. */
+    if (fh->forReading)
+        return 1;  /* open for read is a successful no-op. */
+    else if ((fh->bufpos == fh->buffill) && (!fh->writebehind))
+        return 1;  /* so is an empty buffer, unless data is queued. */
 
     /* dump buffer to disk. */
     io = fh->io;
-    rc = io->write(io, fh->buffer + fh->bufpos, fh->buffill - fh->bufpos);
-    BAIL_IF_ERRPASS(rc <= 0, 0);
-    fh->bufpos = fh->buffill = 0;
+    if (fh->bufpos != fh->buffill)
+    {
+        rc = io->write(io, fh->buffer + fh->bufpos, fh->buffill - fh->bufpos);
+        BAIL_IF_ERRPASS(rc <= 0, 0);
+        fh->bufpos = fh->buffill = 0;
+    } /* if */
     return io->flush ? io->flush(io) : 1;
 } /* PHYSFS_flush */
 
@@ -3033,6 +5045,83 @@ int PHYSFS_stat(const char *_fname, PHYSFS_Stat *stat)
 } /* PHYSFS_stat */
 
 
+PHYSFS_sint64 __PHYSFS_readAt(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len,
+                              PHYSFS_uint64 offset)
+{
+    PHYSFS_sint64 retval;
+    PHYSFS_sint64 pos;
+
+    if (__PHYSFS_ioHasReadAt(io))
+        return io->readAt(io, buf, len, offset);
+
+    pos = io->tell(io);
+    BAIL_IF_ERRPASS(pos < 0, -1);
+    BAIL_IF_ERRPASS(!io->seek(io, offset), -1);
+    retval = io->read(io, buf, len);
+    if (!io->seek(io, (PHYSFS_uint64) pos))
+        return -1;
+    return retval;
+} /* __PHYSFS_readAt */
+
+
+int __PHYSFS_ioHasReadAt(const PHYSFS_Io *io)
+{
+    return ((io->version >= 1) && (io->readAt != NULL));
+} /* __PHYSFS_ioHasReadAt */
+
+
+PHYSFS_sint64 __PHYSFS_ioNativeRegion(PHYSFS_Io *io, void **handle,
+                                      PHYSFS_uint64 *offset)
+{
+    if (io->read == nativeIo_read)
+    {
+        const NativeIoInfo *info = (const NativeIoInfo *) io->opaque;
+        if (info->mode != 'r')
+            return -1;
+        *handle = info->handle;
+        *offset = 0;
+        return __PHYSFS_platformFileLength(info->handle);
+    } /* if */
+
+    else if (io->read == mappedIo_read)
+    {
+        const MappedIoInfo *info = (const MappedIoInfo *) io->opaque;
+        *handle = info->handle;
+        *offset = 0;
+        return (PHYSFS_sint64) info->len;
+    } /* else if */
+
+    return -1;
+} /* __PHYSFS_ioNativeRegion */
+
+
+const void *__PHYSFS_ioMemoryRegion(PHYSFS_Io *io, const PHYSFS_uint64 pos,
+                                    const PHYSFS_uint64 len)
+{
+    if (io->read == memoryIo_read)
+    {
+        const MemoryIoInfo *info = (const MemoryIoInfo *) io->opaque;
+        if ((pos > info->len) || (len > (info->len - pos)))
+            return NULL;
+        return info->buf + pos;
+    } /* if */
+
+    else if (io->read == mappedIo_read)
+    {
+        MappedIoInfo *info = (MappedIoInfo *) io->opaque;
+        if ((len == 0) || (pos > info->len) || (len > (info->len - pos)))
+            return NULL;
+        else if (!mappedIo_mapWindow(info, pos))
+            return NULL;
+        else if ((pos + len) > (info->winofs + info->winlen))
+            return NULL;  /* straddles a window on a 32-bit system. */
+        return info->window + (size_t) (pos - info->winofs);
+    } /* else if */
+
+    return NULL;
+} /* __PHYSFS_ioMemoryRegion */
+
+
 int __PHYSFS_readAll(PHYSFS_Io *io, void *buf, const size_t _len)
 {
     const PHYSFS_uint64 len = (PHYSFS_uint64) _len;
@@ -3160,6 +5249,86 @@ static inline PHYSFS_uint32 hashPathName(__PHYSFS_DirTree *dt, const char *name)
 } /* hashPathName */
 
 
+/* Rehash into (newbuckets) buckets. Failure is harmless. */
+static void resizeDirTreeHash(__PHYSFS_DirTree *dt, const size_t newbuckets)
+{
+    const size_t alloclen = newbuckets * sizeof (__PHYSFS_DirTreeEntry *);
+    __PHYSFS_DirTreeEntry **oldhash = dt->hash;
+    const size_t oldbuckets = dt->hashBuckets;
+    __PHYSFS_DirTreeEntry **newhash;
+    size_t i;
+
+    newhash = (__PHYSFS_DirTreeEntry **) allocator.Malloc(alloclen);
+    if (!newhash)
+        return;  /* oh well, lookups will just be slower. */
+
+    memset(newhash, '\0', alloclen);
+    dt->hash = newhash;
+    dt->hashBuckets = newbuckets;
+
+    for (i = 0; i < oldbuckets; i++)
+    {
+        __PHYSFS_DirTreeEntry *entry;
+        __PHYSFS_DirTreeEntry *next;
+        for (entry = oldhash[i]; entry; entry = next)
+        {
+            const PHYSFS_uint32 hashval = hashPathName(dt, entry->name);
+            next = entry->hashnext;
+            entry->hashnext = newhash[hashval];
+            newhash[hashval] = entry;
+        } /* for */
+    } /* for */
+
+    allocator.Free(oldhash);
+} /* resizeDirTreeHash */
+
+
+void __PHYSFS_DirTreeReserve(__PHYSFS_DirTree *dt, const size_t count)
+{
+    size_t buckets = dt->hashBuckets;
+    while ((buckets < count) && (buckets < (((size_t) -1) / 2) / sizeof (void *)))
+        buckets *= 2;
+    if (buckets != dt->hashBuckets)
+        resizeDirTreeHash(dt, buckets);
+} /* __PHYSFS_DirTreeReserve */
+
+
+/*
+ * __PHYSFS_DirTreeFind() without the error state, for when a miss is
+ *  expected. (hash) is __PHYSFS_hashString() of all of (path).
+ */
+static __PHYSFS_DirTreeEntry *findDirTreeEntry(__PHYSFS_DirTree *dt,
+                                               const char *path,
+                                               const PHYSFS_uint32 hash)
+{
+    const PHYSFS_uint32 hashval = (PHYSFS_uint32) (hash % dt->hashBuckets);
+    __PHYSFS_DirTreeEntry *prev = NULL;
+    __PHYSFS_DirTreeEntry *retval;
+
+    if (*path == '\0')
+        return dt->root;
+
+    for (retval = dt->hash[hashval]; retval; retval = retval->hashnext)
+    {
+        if (strcmp(retval->name, path) == 0)
+        {
+            if (prev != NULL)  /* move this to the front of the list */
+            {
+                prev->hashnext = retval->hashnext;
+                retval->hashnext = dt->hash[hashval];
+                dt->hash[hashval] = retval;
+            } /* if */
+
+            return retval;
+        } /* if */
+
+        prev = retval;
+    } /* for */
+
+    return NULL;
+} /* findDirTreeEntry */
+
+
 /* Fill in missing parent directories. */
 static __PHYSFS_DirTreeEntry *addAncestors(__PHYSFS_DirTree *dt, char *name)
 {
@@ -3169,7 +5338,7 @@ static __PHYSFS_DirTreeEntry *addAncestors(__PHYSFS_DirTree *dt, char *name)
     if (sep)
     {
         *sep = '\0';  /* chop off last piece. */
-        retval = (__PHYSFS_DirTreeEntry *) __PHYSFS_DirTreeFind(dt, name);
+        retval = findDirTreeEntry(dt, name, __PHYSFS_hashString(name, sep - name));
 
         if (retval != NULL)
         {
@@ -3189,10 +5358,13 @@ static __PHYSFS_DirTreeEntry *addAncestors(__PHYSFS_DirTree *dt, char *name)
 
 void *__PHYSFS_DirTreeAdd(__PHYSFS_DirTree *dt, char *name, const int isdir)
 {
-    __PHYSFS_DirTreeEntry *retval = __PHYSFS_DirTreeFind(dt, name);
+    /* hash it once, for the lookup and the insert. */
+    const size_t namelen = strlen(name);
+    const PHYSFS_uint32 hash = __PHYSFS_hashString(name, namelen);
+    __PHYSFS_DirTreeEntry *retval = findDirTreeEntry(dt, name, hash);
     if (!retval)
     {
-        const size_t alloclen = strlen(name) + 1 + dt->entrylen;
+        const size_t alloclen = namelen + 1 + dt->entrylen;
         PHYSFS_uint32 hashval;
         __PHYSFS_DirTreeEntry *parent = addAncestors(dt, name);
         BAIL_IF_ERRPASS(!parent, NULL);
@@ -3201,13 +5373,16 @@ void *__PHYSFS_DirTreeAdd(__PHYSFS_DirTree *dt, char *name, const int isdir)
         BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
         memset(retval, '\0', dt->entrylen);
         retval->name = ((char *) retval) + dt->entrylen;
-        strcpy(retval->name, name);
-        hashval = hashPathName(dt, name);
+        memcpy(retval->name, name, namelen + 1);
+        hashval = (PHYSFS_uint32) (hash % dt->hashBuckets);  /* after addAncestors() grows it! */
         retval->hashnext = dt->hash[hashval];
         dt->hash[hashval] = retval;
         retval->sibling = parent->children;
         retval->isdir = isdir;
         parent->children = retval;
+
+        if (++dt->entrycount > (dt->hashBuckets * 4))
+            resizeDirTreeHash(dt, dt->hashBuckets * 2);
     } /* if */
 
     return retval;
@@ -3217,33 +5392,64 @@ void *__PHYSFS_DirTreeAdd(__PHYSFS_DirTree *dt, char *name, const int isdir)
 /* Find the __PHYSFS_DirTreeEntry for a path in platform-independent notation. */
 void *__PHYSFS_DirTreeFind(__PHYSFS_DirTree *dt, const char *path)
 {
-    PHYSFS_uint32 hashval;
-    __PHYSFS_DirTreeEntry *prev = NULL;
     __PHYSFS_DirTreeEntry *retval;
+    retval = findDirTreeEntry(dt, path, __PHYSFS_hashString(path, strlen(path)));
+    BAIL_IF(!retval, PHYSFS_ERR_NOT_FOUND, NULL);
+    return retval;
+} /* __PHYSFS_DirTreeFind */
 
-    if (*path == '\0')
-        return dt->root;
 
-    hashval = hashPathName(dt, path);
-    for (retval = dt->hash[hashval]; retval; retval = retval->hashnext)
+static void removeDirTreeSubtree(__PHYSFS_DirTree *dt,
+                                 __PHYSFS_DirTreeEntry *entry)
+{
+    const PHYSFS_uint32 hashval = hashPathName(dt, entry->name);
+    __PHYSFS_DirTreeEntry **ptr = &dt->hash[hashval];
+    __PHYSFS_DirTreeEntry *child;
+    __PHYSFS_DirTreeEntry *next;
+
+    for (child = entry->children; child; child = next)
     {
-        if (strcmp(retval->name, path) == 0)
-        {
-            if (prev != NULL)  /* move this to the front of the list */
-            {
-                prev->hashnext = retval->hashnext;
-                retval->hashnext = dt->hash[hashval];
-                dt->hash[hashval] = retval;
-            } /* if */
+        next = child->sibling;
+        removeDirTreeSubtree(dt, child);
+    } /* for */
 
-            return retval;
-        } /* if */
+    while (*ptr != entry)
+    {
+        assert(*ptr != NULL);
+        ptr = &(*ptr)->hashnext;
+    } /* while */
+    *ptr = entry->hashnext;
 
-        prev = retval;
-    } /* for */
+    dt->entrycount--;
+    allocator.Free(entry);
+} /* removeDirTreeSubtree */
+
+
+/* Remove an entry (and everything under it, if it's a dir) from the tree. */
+void __PHYSFS_DirTreeRemove(__PHYSFS_DirTree *dt, void *_entry)
+{
+    __PHYSFS_DirTreeEntry *entry = (__PHYSFS_DirTreeEntry *) _entry;
+    __PHYSFS_DirTreeEntry *parent = dt->root;
+    __PHYSFS_DirTreeEntry **ptr;
+    char *sep = strrchr(entry->name, '/');
+
+    assert(entry != dt->root);
+
+    if (sep != NULL)
+    {
+        *sep = '\0';
+        parent = (__PHYSFS_DirTreeEntry *) __PHYSFS_DirTreeFind(dt, entry->name);
+        *sep = '/';
+        assert(parent != NULL);
+    } /* if */
+
+    for (ptr = &parent->children; *ptr != entry; ptr = &(*ptr)->sibling)
+        assert(*ptr != NULL);
+    *ptr = entry->sibling;
+
+    removeDirTreeSubtree(dt, entry);
+} /* __PHYSFS_DirTreeRemove */
 
-    BAIL(PHYSFS_ERR_NOT_FOUND, NULL);
-} /* __PHYSFS_DirTreeFind */
 
 PHYSFS_EnumerateCallbackResult __PHYSFS_DirTreeEnumerate(void *opaque,
                               const char *dname, PHYSFS_EnumerateCallback cb,
@@ -3269,6 +5475,41 @@ PHYSFS_EnumerateCallbackResult __PHYSFS_DirTreeEnumerate(void *opaque,
 } /* __PHYSFS_DirTreeEnumerate */
 
 
+/* (filetype) reports an entry's PHYSFS_FileType; if NULL, we use isdir. */
+PHYSFS_EnumerateCallbackResult __PHYSFS_DirTreeEnumerateTyped(
+                              __PHYSFS_DirTree *dt, const char *dname,
+                              PHYSFS_EnumerateTypedCallback cb,
+                              const char *origdir, void *callbackdata,
+                              int (*filetype)(const void *entry))
+{
+    PHYSFS_EnumerateCallbackResult retval = PHYSFS_ENUM_OK;
+    const __PHYSFS_DirTreeEntry *entry = __PHYSFS_DirTreeFind(dt, dname);
+    BAIL_IF(!entry, PHYSFS_ERR_NOT_FOUND, PHYSFS_ENUM_ERROR);
+
+    entry = entry->children;
+
+    while (entry && (retval == PHYSFS_ENUM_OK))
+    {
+        const char *name = entry->name;
+        const char *ptr = strrchr(name, '/');
+        int type;
+
+        if (filetype != NULL)
+            type = filetype(entry);
+        else if (entry->isdir)
+            type = PHYSFS_FILETYPE_DIRECTORY;
+        else
+            type = PHYSFS_FILETYPE_REGULAR;
+
+        retval = cb(callbackdata, origdir, ptr ? ptr + 1 : name, type);
+        BAIL_IF(retval == PHYSFS_ENUM_ERROR, PHYSFS_ERR_APP_CALLBACK, retval);
+        entry = entry->sibling;
+    } /* while */
+
+    return retval;
+} /* __PHYSFS_DirTreeEnumerateTyped */
+
+
 void __PHYSFS_DirTreeDeinit(__PHYSFS_DirTree *dt)
 {
     if (!dt)
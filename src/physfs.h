@@ -1456,7 +1456,14 @@ PHYSFS_DECL PHYSFS_sint64 PHYSFS_fileLength(PHYSFS_File *handle);
  *  on the same file. Setting the buffer size to zero will free an existing
  *  buffer.
  *
- * PhysicsFS file handles are unbuffered by default.
+ * PhysicsFS file handles are unbuffered by default, except for files opened
+ *  for reading from a directory in the physical filesystem or from a .zip
+ *  archive, which get adaptive read buffering (see
+ *  PHYSFS_setAdaptiveBuffer()). Calling this function replaces that with a
+ *  fixed-size buffer, or turns buffering off if (bufsize) is zero.
+ *
+ * A single read that is at least as big as the buffer skips the buffer and
+ *  goes straight into your memory, once anything already buffered is used.
  *
  * Please check the return value of this function! Failures can include
  *  not being able to seek backwards in a read-only file when removing the
@@ -3042,7 +3049,9 @@ typedef struct PHYSFS_Io
     /**
      * \brief Binary compatibility information.
      *
-     * This must be set to zero at this time. Future versions of this
+     * This must be set to zero or one at this time. Version 1 added the
+     *  readAt() method at the end of this struct; if you set this to zero,
+     *  PhysicsFS will never look past destroy(). Future versions of this
      *  struct will increment this field, so we know what a given
      *  implementation supports. We'll presumably keep supporting older
      *  versions as we offer new features, though.
@@ -3150,7 +3159,10 @@ typedef struct PHYSFS_Io
      *  completely independently. The copy needs to be able to perform all
      *  its operations without altering the original, including either object
      *  being destroyed separately (so, for example: they can't share a file
-     *  handle; they each need their own).
+     *  handle; they each need their own). The exception is a handle that is
+     *  only ever used for positional reads, like readAt(): PhysicsFS's own
+     *  read-only file i/o shares one reference-counted handle between all
+     *  duplicates, each of which just tracks its own position.
      *
      * If you can't duplicate a handle, it's legal to return NULL, but you
      *  almost certainly need this functionality if you want to use this to
@@ -3194,6 +3206,31 @@ typedef struct PHYSFS_Io
      *   \param s The i/o instance to destroy.
      */
     void (*destroy)(struct PHYSFS_Io *io);
+
+    /**
+     * \brief Read data from a specific position. (version 1 and later.)
+     *
+     * Read (len) bytes from the interface, starting at byte (offset), and
+     *  store them in (buffer). Unlike read(), this does not use or change the
+     *  current i/o position, so many readers can share one instance without
+     *  stepping on each other; PhysicsFS may call this on the same instance
+     *  from several threads at once, so it must be safe to do so. POSIX
+     *  pread() is the model here.
+     *
+     * This is optional, even in version 1; set it to NULL if you can't do
+     *  positional reads cheaply, and PhysicsFS will seek() and read()
+     *  instead. It is ignored if (version) is zero.
+     *
+     *   \param io The i/o instance to read from.
+     *   \param buf The buffer to store data into. It must be at least
+     *                 (len) bytes long and can't be NULL.
+     *   \param len The number of bytes to read from the interface.
+     *   \param offset The byte offset to start reading at.
+     *  \return number of bytes read from file, 0 on EOF, -1 if complete
+     *          failure.
+     */
+    PHYSFS_sint64 (*readAt)(struct PHYSFS_Io *io, void *buf,
+                            PHYSFS_uint64 len, PHYSFS_uint64 offset);
 } PHYSFS_Io;
 
 
@@ -3558,6 +3595,25 @@ PHYSFS_DECL void PHYSFS_setErrorCode(PHYSFS_ErrorCode code);
 PHYSFS_DECL const char *PHYSFS_getPrefDir(const char *org, const char *app);
 
 
+/**
+ * \typedef PHYSFS_EnumerateTypedCallback
+ * \brief Archiver callback for directory entries whose type may be known.
+ *
+ * This is the same as PHYSFS_EnumerateCallback, but it also gets the
+ *  PHYSFS_FileType of the entry in (filetype), if the archiver knew it
+ *  without doing extra work, or -1 if it didn't. PhysicsFS uses this to avoid
+ *  stat()ing every entry when filtering symlinks out of a listing.
+ *
+ * Applications don't see this; it's only used by PHYSFS_Archiver's
+ *  enumerateTyped method.
+ *
+ * \sa PHYSFS_EnumerateCallback
+ * \sa PHYSFS_Archiver
+ */
+typedef PHYSFS_EnumerateCallbackResult (*PHYSFS_EnumerateTypedCallback)(
+                                       void *data, const char *origdir,
+                                       const char *fname, int filetype);
+
 /**
  * \struct PHYSFS_Archiver
  * \brief Abstract interface to provide support for user-defined archives.
@@ -3619,10 +3675,12 @@ typedef struct PHYSFS_Archiver
     /**
      * \brief Binary compatibility information.
      *
-     * This must be set to zero at this time. Future versions of this
-     *  struct will increment this field, so we know what a given
-     *  implementation supports. We'll presumably keep supporting older
-     *  versions as we offer new features, though.
+     * Set this to one if you provide the enumerateTyped() method at the
+     *  end of this struct; if you set this to zero, PhysicsFS will never
+     *  look past closeArchive(). Future versions of this struct will
+     *  increment this field, so we know what a given implementation
+     *  supports. We'll presumably keep supporting older versions as we
+     *  offer new features, though.
      */
     PHYSFS_uint32 version;
 
@@ -3777,6 +3835,23 @@ typedef struct PHYSFS_Archiver
      *  there are still files open from this archive.
      */
     void (*closeArchive)(void *opaque);
+
+    /**
+     * \brief List all files in (dirname), with types. (version 1 and later.)
+     *
+     * This follows all the rules of enumerate(), but (cb) also gets each
+     *  entry's PHYSFS_FileType, or -1 if you don't know it without extra
+     *  work. If you can report types cheaply (a directory listing from the
+     *  OS, or a table of contents you already have in memory), PhysicsFS can
+     *  skip a stat() per entry when it has to filter out symlinks.
+     *
+     * This is optional, even in version 1; set it to NULL and PhysicsFS will
+     *  use enumerate(). It is ignored if (version) is zero, and is only
+     *  interesting if your archive supports symlinks at all.
+     */
+    PHYSFS_EnumerateCallbackResult (*enumerateTyped)(void *opaque,
+                     const char *dirname, PHYSFS_EnumerateTypedCallback cb,
+                     const char *origdir, void *callbackdata);
 } PHYSFS_Archiver;
 
 /**
@@ -3844,6 +3919,758 @@ PHYSFS_DECL int PHYSFS_deregisterArchiver(const char *ext);
 
 /* Everything above this line is part of the PhysicsFS 2.1 API. */
 
+/**
+ * \fn int PHYSFS_setIndexCacheDir(const char *dir)
+ * \brief Enable (or disable) the on-disk archive index cache.
+ *
+ * Mounting a large archive means reading and parsing its whole table of
+ *  contents, which can take a noticeable amount of time for archives with
+ *  hundreds of thousands of entries. If you mount the same, unchanged
+ *  archives over and over (every time your program starts, for example),
+ *  PhysicsFS can remember what it learned the last time.
+ *
+ * When a cache directory is set, archivers that support it will write a
+ *  compact index file to (dir) after successfully mounting an archive from
+ *  the physical filesystem. Later mounts of the same archive will check that
+ *  its size, modification time, and the tail end of its table of contents
+ *  still match, and if so, use the index instead of parsing the archive.
+ *  The index is memory-mapped when archive mapping is enabled (see
+ *  PHYSFS_setArchiveMapping()), and files are looked up in it directly as
+ *  they're needed, so even an enormous archive mounts almost instantly.
+ *  If anything doesn't match, the index is ignored and replaced. New
+ *  indexes are written under a temporary name and renamed into place, so
+ *  other mounts (or other processes) still using the old one aren't
+ *  disturbed. A truncated index file is ignored, and lookups are
+ *  bounds-checked, so it's always safe to delete the contents of this
+ *  directory.
+ *
+ * Currently only the .zip archiver uses this cache.
+ *
+ * (dir) must already exist and be writable; PhysicsFS won't create it. It
+ *  is specified in platform-dependent notation, just like
+ *  PHYSFS_setWriteDir(). Failing to read or write index files is not an
+ *  error; mounting just falls back to parsing the archive.
+ *
+ * This is disabled by default. PHYSFS_deinit() disables it again.
+ *
+ *   \param dir Directory to keep index files in, in platform-dependent
+ *               notation. NULL disables the cache.
+ *  \return non-zero on success, zero on failure. Call
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_getIndexCacheDir
+ */
+PHYSFS_DECL int PHYSFS_setIndexCacheDir(const char *dir);
+
+
+/**
+ * \fn const char *PHYSFS_getIndexCacheDir(void)
+ * \brief Get the current archive index cache directory.
+ *
+ *  \return the directory set with PHYSFS_setIndexCacheDir(), or NULL if the
+ *          cache is disabled. Do not free or modify this string.
+ *
+ * \sa PHYSFS_setIndexCacheDir
+ */
+PHYSFS_DECL const char *PHYSFS_getIndexCacheDir(void);
+
+
+/**
+ * \fn void PHYSFS_setArchiveMapping(int enable)
+ * \brief Control whether archive files are mapped into memory.
+ *
+ * When you mount an archive file (a .zip, .7z, etc) from the physical
+ *  filesystem, PhysicsFS normally maps the file into the process's address
+ *  space instead of reading it with system calls. Archivers do lots of
+ *  small reads and seeks, and this turns each of them into a memcpy. This
+ *  is on by default, on platforms that support it. Directories and the
+ *  write directory are never mapped.
+ *
+ * There is a catch: the mapping is shared with the file on disk. If some
+ *  other program truncates or replaces-in-place an archive file while it
+ *  is mounted, touching the missing part of the mapping doesn't fail with
+ *  a PhysicsFS error; the operating system kills your program (SIGBUS on
+ *  Unix, an in-page exception on Windows). If your archives might change
+ *  under you (a game that patches its own data files while running, for
+ *  example), turn this off.
+ *
+ * This only affects archives mounted after the call; archives that are
+ *  already mounted keep whatever they were opened with. PHYSFS_deinit()
+ *  sets it back to the default. Building PhysicsFS with PHYSFS_NO_MMAP
+ *  defined disables mapping entirely.
+ *
+ *   \param enable nonzero to map archive files mounted from now on, zero to
+ *                 read them with regular file i/o.
+ *
+ * \sa PHYSFS_getArchiveMapping
+ */
+PHYSFS_DECL void PHYSFS_setArchiveMapping(int enable);
+
+
+/**
+ * \fn int PHYSFS_getArchiveMapping(void)
+ * \brief Determine if new archive mounts will be mapped into memory.
+ *
+ *  \return nonzero if archive files mounted from now on will be mapped.
+ *
+ * \sa PHYSFS_setArchiveMapping
+ */
+PHYSFS_DECL int PHYSFS_getArchiveMapping(void);
+
+
+/**
+ * \fn int PHYSFS_setAdaptiveBuffer(PHYSFS_File *handle, PHYSFS_uint64 minsize, PHYSFS_uint64 maxsize)
+ * \brief Set up self-tuning read buffering for a PhysicsFS file handle.
+ *
+ * This is like PHYSFS_setBuffer(), but the buffer size adjusts itself to
+ *  how you read the file. It starts at (minsize) bytes. Every time you read
+ *  through a full buffer without seeking elsewhere, the next refill reads
+ *  twice as much, up to (maxsize) bytes, so streaming through a file
+ *  quickly settles into large reads. Seeking outside the buffer drops it
+ *  back to (minsize), so random access doesn't drag in data you don't want.
+ *
+ * As with PHYSFS_setBuffer(), a read of at least the current buffer size
+ *  bypasses the buffer entirely.
+ *
+ * Files opened for reading from the physical filesystem or from a .zip
+ *  archive use this by default, with a 4 kilobyte minimum and 1 megabyte
+ *  maximum. The exception is uncompressed .zip entries when the archive is
+ *  already in memory (PHYSFS_mountMemory(), or a file mapped into memory;
+ *  see PHYSFS_setArchiveMapping()), since a buffer would only add a copy.
+ *  Passing zero for both sizes turns buffering off.
+ *
+ * This only applies to files opened for reading.
+ *
+ *   \param handle handle returned from PHYSFS_openRead().
+ *   \param minsize smallest buffer size, in bytes. Must not be zero.
+ *   \param maxsize largest buffer size, in bytes. Must be >= (minsize).
+ *  \return nonzero if successful, zero on error.
+ *
+ * \sa PHYSFS_setBuffer
+ */
+PHYSFS_DECL int PHYSFS_setAdaptiveBuffer(PHYSFS_File *handle,
+                                         PHYSFS_uint64 minsize,
+                                         PHYSFS_uint64 maxsize);
+
+
+/**
+ * \fn int PHYSFS_setWriteBehind(PHYSFS_File *handle, PHYSFS_uint64 bufsize, PHYSFS_uint64 sizehint)
+ * \brief Let a background thread do the disk writes for a file.
+ *
+ * Normally, writing to a file blocks until the operating system accepts the
+ *  data (or, with PHYSFS_setBuffer(), every time the buffer fills up). With
+ *  write-behind, PHYSFS_writeBytes() copies your data into (bufsize)-byte
+ *  chunks and returns; a background thread writes full chunks to disk in
+ *  order while you carry on. Only a few chunks may be waiting at once, so
+ *  if the disk can't keep up, writes will eventually block anyhow.
+ *
+ * PHYSFS_flush() and PHYSFS_close() wait for everything to be written, and
+ *  are where you'll find out if a background write failed (a later
+ *  PHYSFS_writeBytes() might report it, too). Seeking and asking for the
+ *  file's length also wait for the queue to drain, so they're slower than
+ *  usual; write-behind is meant for files written front to back, like logs
+ *  and save games.
+ *
+ * If you know roughly how much you'll write, pass it in (sizehint) and the
+ *  platform may reserve that much disk space up front, where supported. It
+ *  doesn't change the file's size. Pass zero if you don't know.
+ *
+ * Passing zero for (bufsize) turns write-behind off again, after writing
+ *  anything queued. This only works for files opened for writing or
+ *  appending in the physical filesystem, and on platforms that have
+ *  threads; otherwise this fails with PHYSFS_ERR_UNSUPPORTED and the file
+ *  keeps working as before.
+ *
+ *   \param handle handle returned from PHYSFS_openWrite() or
+ *                 PHYSFS_openAppend().
+ *   \param bufsize size, in bytes, of each chunk. Zero to disable.
+ *   \param sizehint expected number of bytes still to be written, or zero.
+ *  \return nonzero if successful, zero on error.
+ *
+ * \sa PHYSFS_setBuffer
+ * \sa PHYSFS_flush
+ */
+PHYSFS_DECL int PHYSFS_setWriteBehind(PHYSFS_File *handle,
+                                      PHYSFS_uint64 bufsize,
+                                      PHYSFS_uint64 sizehint);
+
+
+/**
+ * \fn void PHYSFS_setDirectoryIndexing(int enable)
+ * \brief Keep an in-memory index of mounted directories.
+ *
+ * Every time you stat, enumerate or open something in a mounted directory
+ *  of the physical filesystem, PhysicsFS normally asks the operating system
+ *  about it. For big trees of loose files that are queried constantly, that
+ *  adds up. With indexing enabled, directories mounted after this call are
+ *  scanned once, and PHYSFS_stat(), PHYSFS_exists(), PHYSFS_enumerate() and
+ *  failed PHYSFS_openRead() calls are answered from memory. The operating
+ *  system tells PhysicsFS about changes to the tree, so the index stays
+ *  current, including changes made by other programs.
+ *
+ * The initial scan makes mounting slower, and the index costs memory for
+ *  every file in the tree, so this is off by default.
+ *
+ * This needs a platform that can watch directories for changes (currently
+ *  Linux, via inotify). Elsewhere, or if the system runs out of watches,
+ *  the directory is mounted without an index and works as usual. The write
+ *  directory is never indexed, but mounted directories notice changes made
+ *  through it.
+ *
+ *   \param enable nonzero to index directories mounted from now on, zero to
+ *                 stop. Directories that are already mounted don't change.
+ *
+ * \sa PHYSFS_getDirectoryIndexing
+ */
+PHYSFS_DECL void PHYSFS_setDirectoryIndexing(int enable);
+
+
+/**
+ * \fn int PHYSFS_getDirectoryIndexing(void)
+ * \brief Determine if new directory mounts will be indexed.
+ *
+ *  \return nonzero if PHYSFS_setDirectoryIndexing() enabled indexing.
+ *
+ * \sa PHYSFS_setDirectoryIndexing
+ */
+PHYSFS_DECL int PHYSFS_getDirectoryIndexing(void);
+
+
+/**
+ * \fn void PHYSFS_setSymlinkCheckCache(int ttl)
+ * \brief Control how long PhysicsFS trusts its symlink checks.
+ *
+ * When symlinks aren't permitted (see PHYSFS_permitSymbolicLinks()),
+ *  PhysicsFS checks every element of a path before it opens, stats or
+ *  enumerates it, so "a/b/c/d.png" means a stat of "a", "a/b", "a/b/c" and
+ *  "a/b/c/d.png" in each archive or directory it tries. By default, it does
+ *  all of that, every time.
+ *
+ * With this, it remembers which directories it has already found to be
+ *  real directories, so usually only the last element needs checking. That
+ *  is a lot fewer stat calls, but it's also a hole: if another program
+ *  replaces one of those directories with a symlink while PhysicsFS still
+ *  trusts the old check, PhysicsFS will follow the symlink. Only turn this
+ *  on if nothing else can change the directories you mount, or pick a
+ *  (ttl) short enough that you can live with the window.
+ *
+ * Checks are trusted for (ttl) seconds, or until the archive is unmounted,
+ *  or something is deleted or created through PHYSFS_delete() or
+ *  PHYSFS_mkdir(). Changing this forgets everything PhysicsFS has remembered
+ *  so far. This has no effect while symlinks are permitted, and
+ *  PHYSFS_deinit() sets it back to zero.
+ *
+ *   \param ttl seconds to trust a check for, -1 to trust it until the
+ *               archive is unmounted, or 0 to not remember checks at all
+ *               (the default).
+ *
+ * \sa PHYSFS_getSymlinkCheckCache
+ * \sa PHYSFS_permitSymbolicLinks
+ */
+PHYSFS_DECL void PHYSFS_setSymlinkCheckCache(int ttl);
+
+
+/**
+ * \fn int PHYSFS_getSymlinkCheckCache(void)
+ * \brief Determine how long PhysicsFS trusts its symlink checks.
+ *
+ *  \return the value last passed to PHYSFS_setSymlinkCheckCache(), or 0
+ *           if it was never called.
+ *
+ * \sa PHYSFS_setSymlinkCheckCache
+ */
+PHYSFS_DECL int PHYSFS_getSymlinkCheckCache(void);
+
+
+/**
+ * \fn PHYSFS_sint64 PHYSFS_sendToFd(PHYSFS_File *handle, int fd, PHYSFS_uint64 offset, PHYSFS_uint64 len)
+ * \brief Copy part of a file to a file descriptor, such as a socket.
+ *
+ * This copies (len) bytes, starting at byte (offset) of the file opened
+ *  with (handle), to the POSIX file descriptor (fd). It's meant for servers
+ *  that hand files out over the network: when the data sits uncompressed in
+ *  the physical filesystem, whether as a loose file or as a stored entry in
+ *  an archive, PhysicsFS asks the operating system to copy it straight to
+ *  (fd) (with sendfile() on Linux), so it never passes through the
+ *  application or PhysicsFS. Compressed or encrypted data is decoded through
+ *  a large buffer instead.
+ *
+ * This doesn't use or change (handle)'s file position, and ignores any
+ *  buffer set up with PHYSFS_setBuffer(). Requests past the end of the file
+ *  are clipped to the end of the file.
+ *
+ * If (fd) is non-blocking, this may copy less than requested, possibly
+ *  nothing at all; call it again with an updated (offset) when (fd) is
+ *  writable. Write errors after some data was copied are also reported as
+ *  a short copy, and the next call will report the error.
+ *
+ * File descriptors are a POSIX thing; on Windows and OS/2 this currently
+ *  always fails with PHYSFS_ERR_UNSUPPORTED.
+ *
+ *   \param handle handle opened with PHYSFS_openRead().
+ *   \param fd file descriptor to write to.
+ *   \param offset byte offset in the file to start copying from.
+ *   \param len number of bytes to copy.
+ *  \return number of bytes copied, or -1 on error. Use
+ *          PHYSFS_getLastErrorCode() to find out why it failed.
+ *
+ * \sa PHYSFS_readBytes
+ */
+PHYSFS_DECL PHYSFS_sint64 PHYSFS_sendToFd(PHYSFS_File *handle, int fd,
+                                          PHYSFS_uint64 offset,
+                                          PHYSFS_uint64 len);
+
+
+/**
+ * \fn int PHYSFS_setDecoderPoolSize(int count)
+ * \brief Control how many closed file handles each archive keeps for reuse.
+ *
+ * Opening a compressed file in an archive needs a fair amount of memory for
+ *  the decompressor, which is allocated and thrown away again every time.
+ *  To avoid this, archives that support it keep up to (count) closed handles
+ *  around, decompressor and all, and reuse them for the next files you open.
+ *  This helps a lot when you open and close many small files.
+ *
+ * Each kept handle costs roughly 100 kilobytes per archive, but only if that
+ *  many files from the archive were ever open at the same time. The handles
+ *  are freed when the archive is unmounted. If you lower this, pools shrink
+ *  to the new size as files are closed.
+ *
+ * Currently only the .zip archiver pools its handles. The default is 4.
+ *  PHYSFS_deinit() restores the default.
+ *
+ *   \param count maximum closed handles to keep per archive. Zero disables
+ *                 pooling.
+ *  \return non-zero on success, zero if (count) is negative. Call
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_getDecoderPoolSize
+ */
+PHYSFS_DECL int PHYSFS_setDecoderPoolSize(int count);
+
+
+/**
+ * \fn int PHYSFS_getDecoderPoolSize(void)
+ * \brief Determine how many closed file handles each archive keeps.
+ *
+ *  \return the value last passed to PHYSFS_setDecoderPoolSize(), or the
+ *           default if it was never called.
+ *
+ * \sa PHYSFS_setDecoderPoolSize
+ */
+PHYSFS_DECL int PHYSFS_getDecoderPoolSize(void);
+
+
+/**
+ * \fn void PHYSFS_setSolidCacheLimit(PHYSFS_uint64 bytes)
+ * \brief Let archives keep decompressed solid blocks between file opens.
+ *
+ * Some archive formats, like 7zip, compress many files together as one
+ *  "solid" block, and reading any one of those files means decompressing
+ *  the whole block up to it. If you read every file in such an archive, one
+ *  after another, each block is decompressed once per file, which can be
+ *  dreadfully slow.
+ *
+ * With a limit set, an archive holds on to a decompressed block after the
+ *  last file using it is closed, as long as some of the block's files
+ *  haven't been opened yet and the blocks it's holding this way don't add
+ *  up to more than (bytes). Blocks are freed as soon as their last file has
+ *  been opened, or when the archive is unmounted.
+ *
+ * This is useful when you're about to read most of an archive, like an
+ *  unpacking tool would, and wasteful when you're only after a few files,
+ *  so it's disabled (zero) by default. PHYSFS_deinit() disables it again.
+ *  Changing it only affects blocks released after the change.
+ *
+ * Currently only the 7zip archiver uses this.
+ *
+ *   \param bytes most decompressed data to keep idle per archive. Zero
+ *                 disables this.
+ *
+ * \sa PHYSFS_getSolidCacheLimit
+ */
+PHYSFS_DECL void PHYSFS_setSolidCacheLimit(PHYSFS_uint64 bytes);
+
+
+/**
+ * \fn PHYSFS_uint64 PHYSFS_getSolidCacheLimit(void)
+ * \brief Determine how much decompressed data archives may keep idle.
+ *
+ *  \return the value last passed to PHYSFS_setSolidCacheLimit(), or zero if
+ *           it was never called.
+ *
+ * \sa PHYSFS_setSolidCacheLimit
+ */
+PHYSFS_DECL PHYSFS_uint64 PHYSFS_getSolidCacheLimit(void);
+
+
+/**
+ * \fn void PHYSFS_setChecksumVerification(int enable)
+ * \brief Check file contents against the archive's checksums as you read.
+ *
+ * Archives like .zip files store a CRC-32 for every file, but normally
+ *  PhysicsFS doesn't look at it; decompression catches most damage, and
+ *  stored files aren't checked at all. With verification enabled, files
+ *  opened after this call keep a running CRC of what they've read, and
+ *  the read that reaches the end of the file fails with PHYSFS_ERR_CORRUPT
+ *  if it doesn't match. That file keeps failing reads after that.
+ *
+ * The CRC uses the CPU's carry-less multiply or CRC-32 instructions where
+ *  it can, so this is cheap next to decompression, but it does stop
+ *  PhysicsFS from handing stored files to the operating system directly
+ *  (see PHYSFS_sendToFd()). Only bytes read in order are counted: if you
+ *  seek forward past data you never read, that file can't be checked.
+ *
+ * Currently only the .zip archiver has checksums to verify. This is off by
+ *  default, and PHYSFS_deinit() turns it off again.
+ *
+ *   \param enable nonzero to verify files opened from now on, zero to stop.
+ *                 Files that are already open don't change.
+ *
+ * \sa PHYSFS_getChecksumVerification
+ * \sa PHYSFS_verifyArchive
+ */
+PHYSFS_DECL void PHYSFS_setChecksumVerification(int enable);
+
+
+/**
+ * \fn int PHYSFS_getChecksumVerification(void)
+ * \brief Determine if newly opened files will be verified.
+ *
+ *  \return nonzero if PHYSFS_setChecksumVerification() enabled verification.
+ *
+ * \sa PHYSFS_setChecksumVerification
+ */
+PHYSFS_DECL int PHYSFS_getChecksumVerification(void);
+
+
+/**
+ * \fn int PHYSFS_verifyArchive(const char *archive, int threads)
+ * \brief Read every file in a mounted archive to check it for damage.
+ *
+ * This decompresses every file in (archive) and, where the archive stores
+ *  checksums, compares them, whether or not PHYSFS_setChecksumVerification()
+ *  is enabled. It's meant for a quick "is my install intact?" check at
+ *  startup or from a repair option, and it stops at the first bad file.
+ *
+ * (archive) is the name you passed to PHYSFS_mount(), just like
+ *  PHYSFS_unmount() wants. Up to (threads) threads do the work, the calling
+ *  thread being one of them; anything less than 2 does it all on the calling
+ *  thread, as does a platform without threads. Other threads can keep using
+ *  the archive meanwhile, but can't unmount it until this returns;
+ *  PHYSFS_unmount() fails with PHYSFS_ERR_FILES_STILL_OPEN, as if a file were
+ *  open. Files that need a password can't be opened from here, so an
+ *  archive with any of those fails with PHYSFS_ERR_BAD_PASSWORD.
+ *
+ *   \param archive the mounted archive to check.
+ *   \param threads how many threads may read files at once.
+ *  \return nonzero if every file read back fine, zero on error. A damaged
+ *          file reports PHYSFS_ERR_CORRUPT. Call PHYSFS_getLastErrorCode()
+ *          to obtain the specific error.
+ *
+ * \sa PHYSFS_setChecksumVerification
+ */
+PHYSFS_DECL int PHYSFS_verifyArchive(const char *archive, int threads);
+
+
+/**
+ * \fn int PHYSFS_setDecoderDictionary(const char *archive, const void *dict, PHYSFS_uint64 len)
+ * \brief Give a mounted archive a dictionary for its compressed files.
+ *
+ * Zstandard-compressed .zip entries can be packed against a shared
+ *  dictionary, which helps a lot when an archive is full of small, similar
+ *  files. The dictionary isn't stored in the .zip, so the app has to supply
+ *  it before reading those files: usually you'd ship it next to the archive
+ *  (or in a different archive) and load it with PHYSFS_readBytes().
+ *
+ * (archive) is the name you passed to PHYSFS_mount(), just like
+ *  PHYSFS_unmount() wants. The dictionary is copied, so you can free (dict)
+ *  when this returns. Files opened after this call use it, files already
+ *  open keep the dictionary they started with. Pass a NULL (dict) to go back
+ *  to no dictionary. Replaced dictionaries stay in memory until the archive
+ *  is unmounted, since files still open might be using them.
+ *
+ * Reading an entry that needs a dictionary you didn't supply (or a
+ *  different one) fails with PHYSFS_ERR_UNSUPPORTED.
+ *
+ *   \param archive the mounted archive to set a dictionary on.
+ *   \param dict the dictionary's bytes, or NULL to remove it.
+ *   \param len number of bytes at (dict).
+ *  \return nonzero on success, zero on error. Archive types without
+ *          dictionary support, and builds without Zstandard support, report
+ *          PHYSFS_ERR_UNSUPPORTED. Call PHYSFS_getLastErrorCode() to obtain
+ *          the specific error.
+ */
+PHYSFS_DECL int PHYSFS_setDecoderDictionary(const char *archive,
+                                            const void *dict,
+                                            PHYSFS_uint64 len);
+
+
+/**
+ * \fn void PHYSFS_setResolveOnMount(int enable)
+ * \brief Check every file's header in a .zip when it's mounted.
+ *
+ * Each file in a .zip has a small header in front of its data that the
+ *  central directory doesn't repeat, so the first time you open a file,
+ *  PhysicsFS has to seek back and read that header. One seek per file is
+ *  nothing on an SSD, but it adds up on a hard drive, a disc, or a network
+ *  filesystem. With this enabled, archives mounted afterwards read all of
+ *  those headers in one pass, from the start of the archive to the end, in
+ *  large reads. Opening a file after that doesn't touch the disk until you
+ *  read from it.
+ *
+ * This makes mounting slower, since it reads a little of every file, so
+ *  it's a win when you're going to open most of the archive anyhow. Damaged
+ *  headers don't make the mount fail; those files fail to open later, just
+ *  like they would without this. Lazily mounted archives (see
+ *  PHYSFS_setLazyMounting()) only look at files when they're first needed,
+ *  and this doesn't change that; use PHYSFS_resolveArchive() on them once
+ *  you know which directories you'll use.
+ *
+ * This is off by default, and PHYSFS_deinit() turns it off again.
+ *
+ *   \param enable nonzero to resolve archives mounted from now on, zero to
+ *                 stop.
+ *
+ * \sa PHYSFS_getResolveOnMount
+ * \sa PHYSFS_resolveArchive
+ */
+PHYSFS_DECL void PHYSFS_setResolveOnMount(int enable);
+
+
+/**
+ * \fn int PHYSFS_getResolveOnMount(void)
+ * \brief Determine if newly mounted archives will be resolved.
+ *
+ *  \return nonzero if PHYSFS_setResolveOnMount() enabled it.
+ *
+ * \sa PHYSFS_setResolveOnMount
+ */
+PHYSFS_DECL int PHYSFS_getResolveOnMount(void);
+
+
+/**
+ * \fn int PHYSFS_resolveArchive(const char *archive)
+ * \brief Check every file's header in a mounted archive now.
+ *
+ * This does what PHYSFS_setResolveOnMount() would have done at mount time,
+ *  for an archive that's already mounted: every file that hasn't been
+ *  opened yet gets its header read and checked, in one pass through the
+ *  archive. You might call this from a loading screen, or on a background
+ *  thread, so that opening files later doesn't have to seek around.
+ *
+ * (archive) is the name you passed to PHYSFS_mount(), just like
+ *  PHYSFS_unmount() wants. Symlinks are still resolved when they're first
+ *  opened, and in a lazily-mounted archive, only files that something has
+ *  already looked up or enumerated are covered. Files that are already open
+ *  can still be read while this runs, but other threads that want to open
+ *  files, or mount and unmount things, will wait for it to finish.
+ *
+ *   \param archive the mounted archive to resolve.
+ *  \return nonzero on success, zero on error. If some files had damaged
+ *          headers, this reports PHYSFS_ERR_CORRUPT, but the rest are still
+ *          resolved, and those files will fail to open. Archive types that
+ *          don't need this succeed without doing anything. Call
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_setResolveOnMount
+ */
+PHYSFS_DECL int PHYSFS_resolveArchive(const char *archive);
+
+
+/**
+ * \fn void PHYSFS_setLazyMounting(int enable)
+ * \brief Mount huge .zip files without looking at every file up front.
+ *
+ * Mounting a .zip normally builds a complete tree of its files, which
+ *  takes a while and a fair amount of memory when there are millions of
+ *  them, and is mostly wasted if you only ever use a few thousand. With
+ *  this enabled, archives mounted afterwards only build their directories
+ *  at mount time. Each file is just remembered by a hash of its name until
+ *  something looks it up, and a directory's files are only gathered when
+ *  it's first enumerated.
+ *
+ * Lazy mounts accept exactly the archives normal ones do: a .zip with two
+ *  files of the same name still fails to mount with PHYSFS_ERR_CORRUPT.
+ *  Lookups in a lazily mounted archive may have to read its central
+ *  directory again, so this is a loss for small archives, and for ones you
+ *  are going to read most of anyhow.
+ *
+ * Currently only the .zip archiver does this. This is off by default, and
+ *  PHYSFS_deinit() turns it off again.
+ *
+ *   \param enable nonzero to mount archives lazily from now on, zero to
+ *                 stop. Archives that are already mounted don't change.
+ *
+ * \sa PHYSFS_getLazyMounting
+ */
+PHYSFS_DECL void PHYSFS_setLazyMounting(int enable);
+
+
+/**
+ * \fn int PHYSFS_getLazyMounting(void)
+ * \brief Determine if newly mounted archives will be mounted lazily.
+ *
+ *  \return nonzero if PHYSFS_setLazyMounting() enabled it.
+ *
+ * \sa PHYSFS_setLazyMounting
+ */
+PHYSFS_DECL int PHYSFS_getLazyMounting(void);
+
+
+/**
+ * \struct PHYSFS_ZipWriter
+ * \brief A .zip file being built by PHYSFS_openZipWriter().
+ *
+ * Like PHYSFS_File, this is just a handle; pass it around, but don't
+ *  touch what's inside.
+ *
+ * \sa PHYSFS_openZipWriter
+ * \sa PHYSFS_addZipEntry
+ * \sa PHYSFS_addZipEntryFromFile
+ * \sa PHYSFS_closeZipWriter
+ */
+typedef struct PHYSFS_ZipWriter
+{
+    void *opaque;  /**< That's all you get. Don't touch. */
+} PHYSFS_ZipWriter;
+
+
+/**
+ * \fn PHYSFS_ZipWriter *PHYSFS_openZipWriter(const char *filename, int threads, PHYSFS_uint32 alignment)
+ * \brief Start building a new .zip file in the write directory.
+ *
+ * PhysicsFS can't write into archives it has mounted, but it can build new
+ *  ones from scratch, which is handy for packing up game data or save
+ *  files without a separate tool. (filename) is created in the write
+ *  directory, just like PHYSFS_openWrite() would, and you add files to it
+ *  one at a time with PHYSFS_addZipEntry() or PHYSFS_addZipEntryFromFile().
+ *  Nothing is usable until PHYSFS_closeZipWriter() writes the archive's
+ *  table of contents at the end.
+ *
+ * Files are compressed with deflate, the method every .zip reader supports,
+ *  in chunks of a megabyte or so, on (threads) threads: the one that adds
+ *  files, and (threads - 1) more that this starts up. With more than one,
+ *  compressing one file overlaps with reading the next, and large files are
+ *  spread across all of them, so packing goes roughly as many times faster
+ *  as you have CPU cores. The chunks cost a few bytes each in the finished
+ *  archive. If threads aren't available, everything happens on the calling
+ *  thread instead. Files over 4 gigabytes, and archives with more than 65535
+ *  files or over 4 gigabytes total, are written in the Zip64 format.
+ *
+ * If (alignment) isn't zero, the data of every file that is stored without
+ *  compression starts at a multiple of (alignment) bytes from the start of
+ *  the archive, padded out with an extra field in the file's header, the
+ *  same way Android's zipalign tool does it. Use 4096 (the usual page size)
+ *  and those files can be used straight out of a memory-mapped archive.
+ *
+ * Don't call PHYSFS_deinit() with a writer still open; close it first.
+ *  One writer shouldn't be used from more than one thread at a time, but
+ *  separate writers can run at the same time.
+ *
+ *   \param filename the new archive's name, in platform-independent notation,
+ *                   relative to the write directory.
+ *   \param threads number of threads to compress with. Less than one is
+ *                  treated as one.
+ *   \param alignment zero, or a power of two no bigger than 32768 to align
+ *                    stored files' data to.
+ *  \return a new writer on success, NULL on error. Call
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_addZipEntry
+ * \sa PHYSFS_addZipEntryFromFile
+ * \sa PHYSFS_closeZipWriter
+ */
+PHYSFS_DECL PHYSFS_ZipWriter *PHYSFS_openZipWriter(const char *filename,
+                                                   int threads,
+                                                   PHYSFS_uint32 alignment);
+
+
+/**
+ * \fn int PHYSFS_addZipEntry(PHYSFS_ZipWriter *zw, const char *name, const void *buf, PHYSFS_uint64 len, PHYSFS_sint64 modtime, int level)
+ * \brief Add a file to a .zip being built, from memory.
+ *
+ * The file's contents are copied before this returns, so you can reuse
+ *  (buf) right away, but they might not be compressed or written to disk
+ *  until later calls, or PHYSFS_closeZipWriter().
+ *
+ * Files are written to the archive in the order you add them. (level) is
+ *  zlib's scale: 1 is fastest, 9 compresses best, and 0 stores the file
+ *  as-is, which is the right choice for things that are already compressed
+ *  (PNG, JPEG, Ogg, etc), where deflate would just burn time. A small file
+ *  that doesn't get any smaller is stored, too. Directories are implied by
+ *  the names of the files in them, so there's no need to add them.
+ *
+ * Adding a name that was already added, or a file where an earlier name
+ *  needs a directory (or a directory where there's already a file), fails
+ *  with PHYSFS_ERR_DUPLICATE, and the writer is still usable afterwards.
+ *  Most other failures, like running out of disk space, leave a partial
+ *  archive behind: every call after that fails with the same error, and all
+ *  that's left to do is PHYSFS_closeZipWriter() and PHYSFS_delete().
+ *
+ *   \param zw the writer from PHYSFS_openZipWriter().
+ *   \param name the file's name in the archive, in platform-independent
+ *               notation.
+ *   \param buf the file's contents.
+ *   \param len number of bytes at (buf).
+ *   \param modtime the file's modification time, in the same format as
+ *                  PHYSFS_Stat::modtime, or -1 for right now.
+ *   \param level compression level from 0 to 9, or -1 for the default (6).
+ *  \return nonzero on success, zero on error. Call
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_openZipWriter
+ * \sa PHYSFS_addZipEntryFromFile
+ */
+PHYSFS_DECL int PHYSFS_addZipEntry(PHYSFS_ZipWriter *zw, const char *name,
+                                   const void *buf, PHYSFS_uint64 len,
+                                   PHYSFS_sint64 modtime, int level);
+
+
+/**
+ * \fn int PHYSFS_addZipEntryFromFile(PHYSFS_ZipWriter *zw, const char *name, const char *srcname, int level)
+ * \brief Add a file to a .zip being built, from the search path.
+ *
+ * This is PHYSFS_addZipEntry(), with the contents read from (srcname) in
+ *  the search path, a chunk at a time, so even huge files don't need to
+ *  fit in memory. The file keeps the modification time PHYSFS_stat()
+ *  reports for it.
+ *
+ *   \param zw the writer from PHYSFS_openZipWriter().
+ *   \param name the file's name in the archive, in platform-independent
+ *               notation.
+ *   \param srcname the file to read, in platform-independent notation.
+ *   \param level compression level from 0 to 9, or -1 for the default (6).
+ *  \return nonzero on success, zero on error. Call
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_addZipEntry
+ */
+PHYSFS_DECL int PHYSFS_addZipEntryFromFile(PHYSFS_ZipWriter *zw,
+                                           const char *name,
+                                           const char *srcname, int level);
+
+
+/**
+ * \fn int PHYSFS_closeZipWriter(PHYSFS_ZipWriter *zw)
+ * \brief Finish a .zip being built.
+ *
+ * This waits for everything still being compressed, writes it out, and
+ *  then writes the archive's central directory, which is what makes it a
+ *  usable .zip. The writer and its threads are gone after this, even if it
+ *  fails; a failure means the archive is incomplete.
+ *
+ *   \param zw the writer from PHYSFS_openZipWriter().
+ *  \return nonzero on success, zero on error. Call
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_openZipWriter
+ */
+PHYSFS_DECL int PHYSFS_closeZipWriter(PHYSFS_ZipWriter *zw);
+
+
+/* Everything above this line is part of the PhysicsFS 3.1 API. */
+
 #ifdef __cplusplus
 }
 #endif
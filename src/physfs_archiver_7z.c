@@ -33,6 +33,10 @@ typedef struct
     __PHYSFS_DirTree tree;    /* manages directory tree.           */
     PHYSFS_Io *io;            /* physfs i/o interface for this archive. */
     CSzArEx db;               /* lzma sdk archive database object. */
+    UInt32 cachedFolder;      /* solid folder held in (cache).    */
+    Byte *cache;              /* last solid folder we decompressed. */
+    size_t cacheSize;         /* bytes in (cache).                 */
+    PHYSFS_uint32 cacheUsesLeft; /* files in (cache) not opened yet. */
 } SZIPinfo;
 
 
@@ -198,11 +202,44 @@ static int szipLoadEntries(SZIPinfo *info)
 } /* szipLoadEntries */
 
 
+static void szipFreeCache(SZIPinfo *info)
+{
+    if (info->cache != NULL)
+        SZIP_SzAlloc.Free(&SZIP_SzAlloc, info->cache);
+    info->cache = NULL;
+    info->cacheSize = 0;
+    info->cachedFolder = 0xFFFFFFFF;
+    info->cacheUsesLeft = 0;
+} /* szipFreeCache */
+
+
+/* How many files have their data in solid folder (folder)? */
+static PHYSFS_uint32 szipFolderFileCount(const SZIPinfo *info,
+                                         const UInt32 folder)
+{
+    const CSzArEx *db = &info->db;
+    PHYSFS_uint32 retval = 0;
+    UInt32 i;
+
+    /* directories and empty files in this range aren't part of the folder. */
+    for (i = db->FolderToFile[folder]; i < db->FolderToFile[folder + 1]; i++)
+    {
+        if (db->FileToFolder[i] == folder)
+            retval++;
+    } /* for */
+
+    return retval;
+} /* szipFolderFileCount */
+
+
 static void SZIP_closeArchive(void *opaque)
 {
     SZIPinfo *info = (SZIPinfo *) opaque;
     if (info)
     {
+        szipFreeCache(info);
+        if (info->io != NULL)
+            info->io->destroy(info->io);
         SzArEx_Free(&info->db, &SZIP_SzAlloc);
         __PHYSFS_DirTreeDeinit(&info->tree);
         allocator.Free(info);
@@ -235,6 +272,7 @@ static void *SZIP_openArchive(PHYSFS_Io *io, const char *name,
     SzArEx_Init(&info->db);
 
     info->io = io;
+    info->cachedFolder = 0xFFFFFFFF;
 
     szipInitStream(&stream, io);
     rc = SzArEx_Open(&info->db, &stream.lookStream.s, alloc, alloc);
@@ -257,42 +295,62 @@ static PHYSFS_Io *SZIP_openRead(void *opaque, const char *path)
        !!! FIXME:  the entire file at once, which isn't ideal. Fix this in the
        !!! FIXME:  SDK and then convert this all to a streaming interface. */
 
+    /*
+     * Every file in a solid folder needs the whole folder decompressed, so
+     *  if the app allows it (PHYSFS_setSolidCacheLimit()), we hold on to the
+     *  last folder until each of its files has been opened once. Unpacking
+     *  an archive then decompresses each folder one time instead of once per
+     *  file. (The caller holds the state lock, so this is safe.)
+     */
+
     SZIPinfo *info = (SZIPinfo *) opaque;
     SZIPentry *entry = (SZIPentry *) __PHYSFS_DirTreeFind(&info->tree, path);
     ISzAlloc *alloc = &SZIP_SzAlloc;
     SZIPLookToRead stream;
     PHYSFS_Io *retval = NULL;
     PHYSFS_Io *io = NULL;
-    UInt32 blockIndex = 0xFFFFFFFF;
-    Byte *outBuffer = NULL;
-    size_t outBufferSize = 0;
     size_t offset = 0;
     size_t outSizeProcessed = 0;
     void *buf = NULL;
+    UInt32 folder;
+    int cached;
     SRes rc;
 
     BAIL_IF_ERRPASS(!entry, NULL);
     BAIL_IF(entry->tree.isdir, PHYSFS_ERR_NOT_A_FILE, NULL);
 
+    /* empty files don't live in a folder; don't let them flush the cache. */
+    folder = info->db.FileToFolder[entry->dbidx];
+    if (folder == 0xFFFFFFFF)
+        return __PHYSFS_createMemoryIo("", 0, NULL);
+
+    cached = ((info->cache != NULL) && (info->cachedFolder == folder));
+
     io = info->io->duplicate(info->io);
     GOTO_IF_ERRPASS(!io, SZIP_openRead_failed);
 
     szipInitStream(&stream, io);
 
     rc = SzArEx_Extract(&info->db, &stream.lookStream.s, entry->dbidx,
-                        &blockIndex, &outBuffer, &outBufferSize, &offset,
-                        &outSizeProcessed, alloc, alloc);
+                        &info->cachedFolder, &info->cache, &info->cacheSize,
+                        &offset, &outSizeProcessed, alloc, alloc);
     GOTO_IF(rc != SZ_OK, szipErrorCode(rc), SZIP_openRead_failed);
 
     io->destroy(io);
     io = NULL;
 
-    buf = allocator.Malloc(outSizeProcessed);
-    GOTO_IF(rc != SZ_OK, PHYSFS_ERR_OUT_OF_MEMORY, SZIP_openRead_failed);
-    memcpy(buf, outBuffer + offset, outSizeProcessed);
+    if (!cached)
+        info->cacheUsesLeft = szipFolderFileCount(info, folder);
+
+    buf = allocator.Malloc(outSizeProcessed ? outSizeProcessed : 1);
+    GOTO_IF(!buf, PHYSFS_ERR_OUT_OF_MEMORY, SZIP_openRead_failed);
+    memcpy(buf, info->cache + offset, outSizeProcessed);
 
-    alloc->Free(alloc, outBuffer);
-    outBuffer = NULL;
+    /* opening the same file twice can end this early; that's just slower. */
+    if ((info->cacheUsesLeft == 0) || (--info->cacheUsesLeft == 0))
+        szipFreeCache(info);
+    else if (info->cacheSize > PHYSFS_getSolidCacheLimit())
+        szipFreeCache(info);
 
     retval = __PHYSFS_createMemoryIo(buf, outSizeProcessed, allocator.Free);
     GOTO_IF_ERRPASS(!retval, SZIP_openRead_failed);
@@ -306,8 +364,8 @@ SZIP_openRead_failed:
     if (buf)
         allocator.Free(buf);
 
-    if (outBuffer)
-        alloc->Free(alloc, outBuffer);
+    /* a failed extract can leave half a folder behind; don't trust it. */
+    szipFreeCache(info);
 
     return NULL;
 } /* SZIP_openRead */
@@ -419,7 +477,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_7Z =
     SZIP_remove,
     SZIP_mkdir,
     SZIP_stat,
-    SZIP_closeArchive
+    SZIP_closeArchive,
+    NULL  /* enumerateTyped */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_7Z */
@@ -35,8 +35,10 @@ typedef struct _SZfolder
 {
     PHYSFS_uint32 index; /* Index of folder in archive */
     PHYSFS_uint32 references; /* Number of files using this block */
+    PHYSFS_uint32 unopened; /* Files in this block not opened since caching */
     PHYSFS_uint8 *cache; /* Cached folder */
     size_t size; /* Size of folder */
+    void *lock; /* Held while decompressing into cache */
 } SZfolder;
 
 /*
@@ -52,6 +54,8 @@ typedef struct _SZarchive
     SZfileinstream inStream; /* Input stream with read callbacks, used by 7z */
     struct _SZfile *files; /* Array of files, size == archive->db.Database.NumFiles */
     SZfolder *folders; /* Array of folders, size == archive->db.Database.NumFolders */
+    void *lock; /* Guards folder refcounts and the shared input stream */
+    size_t idleCacheSize; /* Bytes of cached folders with no open files */
 } SZarchive;
 
 /*
@@ -71,7 +75,7 @@ typedef struct
   //Byte AttribDefined;
 } CSzFileItem;
 
-/* Set by SZ_openArchive(), except offset which is set by SZ_read() */
+/* Set by SZ_openArchive() */
 typedef struct _SZfile
 {
     PHYSFS_uint32 index; /* Index of file in archive */
@@ -79,10 +83,16 @@ typedef struct _SZfile
     SZfolder *folder; /* Link to corresponding folder */
     CSzFileItem *item; /* For 7z: File info, eg. name, size */
     size_t offset; /* Offset in folder */
-    size_t position; /* Current "virtual" position in file */
     const char *name; /* Name of file */
 } SZfile;
 
+/* One of these per PHYSFS_Io, so a file can be open more than once */
+typedef struct _SZhandle
+{
+    SZfile *file; /* The file this handle reads */
+    size_t position; /* Current "virtual" position in file */
+} SZhandle;
+
 
 /* Memory management implementations to be passed to 7z */
 
@@ -112,8 +122,15 @@ static SRes sz_file_read(const ISeekInStream *object, void *buffer, size_t *size
     BAIL_IF(size == NULL, PHYSFS_ERR_INVALID_ARGUMENT, SZ_ERROR_PARAM);
 
     SZfileinstream *s = (SZfileinstream *)object; /* Safe, as long as ISzInStream *s is the first field in SZfileinstream */
+    const PHYSFS_sint64 rc = s->io->read(s->io, buffer, *size);
+
+    if (rc < 0)
+    {
+        *size = 0;
+        return SZ_ERROR_READ;
+    } /* if */
 
-    *size = s->io->read(s->io, buffer, *size);
+    *size = (size_t) rc;
 
     return SZ_OK;
 } /* sz_file_read */
@@ -238,8 +255,12 @@ static int sz_file_init(SZarchive *archive, PHYSFS_uint32 fileIndex)
 
     file->item = n_item;
     //file->item = &archive->db.db.Files[fileIndex]; /* Holds crucial data and is often referenced -> Store link */
-    file->position = 0;
-    file->offset = -1; /* Offset will be set by SZ_read() */
+    file->offset = 0;
+    if (file->folder != NULL)
+    {
+        const UInt64 *pos = archive->db.UnpackPositions;
+        file->offset = (size_t) (pos[fileIndex] - pos[archive->db.FolderToFile[folderIndex]]);
+    } /* if */
 
     size_t len = SzArEx_GetFileNameUtf16(&file->archive->db, file->index, NULL);
 
@@ -319,6 +340,12 @@ static void sz_archive_exit(SZarchive *archive)
         allocator.Free(archive->files[fileIndex].item);
     } /* for */
 
+    if (archive->lock != NULL)
+        __PHYSFS_platformDestroyMutex(archive->lock);
+
+    if (archive->lookStream.buf != NULL)
+        ISzAlloc_Free(archive->allocImp, archive->lookStream.buf);
+
     /* Free arrays */
     allocator.Free(archive->folders);
     allocator.Free(archive->files);
@@ -384,12 +411,107 @@ static int sz_err(SRes rc)
 } /* sz_err */
 
 
+/*
+ * Count the files whose data lives in the given folder
+ */
+static PHYSFS_uint32 sz_folder_file_count(const SZarchive *archive,
+                                          const PHYSFS_uint32 folderIndex)
+{
+    const CSzArEx *db = &archive->db;
+    PHYSFS_uint32 retval = 0;
+    UInt32 i;
+
+    /* Directories and empty files in this range aren't part of the folder */
+    for (i = db->FolderToFile[folderIndex]; i < db->FolderToFile[folderIndex + 1]; i++)
+    {
+        if (db->FileToFolder[i] == folderIndex)
+            retval++;
+    } /* for */
+
+    return retval;
+} /* sz_folder_file_count */
+
+
+/*
+ * Decompress the folder holding 'file' into its cache.
+ * The caller holds file->folder->lock; the folder's cache is NULL.
+ */
+static int sz_folder_decode(SZfile *file)
+{
+    SZarchive *archive = file->archive;
+    SZfolder *folder = file->folder;
+    PHYSFS_Io *io = archive->inStream.io->duplicate(archive->inStream.io);
+    size_t offset = 0;
+    size_t fileSize = 0;
+    PHYSFS_uint32 count;
+    SRes rc;
+
+    if (io != NULL)
+    {
+        /* Our own stream, so other folders can decompress at the same time */
+        SZfileinstream inStream;
+        CLookToRead2 lookStream;
+
+        inStream.s.Read = sz_file_read;
+        inStream.s.Seek = sz_file_seek;
+        inStream.io = io;
+
+        LookToRead2_CreateVTable(&lookStream, False);
+        lookStream.buf = ISzAlloc_Alloc(archive->allocImp, kInputBufSize);
+        if (lookStream.buf == NULL)
+        {
+            io->destroy(io);
+            BAIL(PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        } /* if */
+        lookStream.bufSize = kInputBufSize;
+        lookStream.realStream = &inStream.s;
+        LookToRead2_Init(&lookStream);
+
+        rc = SzArEx_Extract(&archive->db, &lookStream.vt, file->index,
+                            &folder->index, &folder->cache, &folder->size,
+                            &offset, &fileSize,
+                            archive->allocImp, archive->allocTempImp);
+
+        ISzAlloc_Free(archive->allocImp, lookStream.buf);
+        io->destroy(io);
+    } /* if */
+    else
+    {
+        /* Can't duplicate the archive's i/o; take turns with the shared one */
+        __PHYSFS_platformGrabMutex(archive->lock);
+        rc = SzArEx_Extract(&archive->db, &archive->lookStream.vt, file->index,
+                            &folder->index, &folder->cache, &folder->size,
+                            &offset, &fileSize,
+                            archive->allocImp, archive->allocTempImp);
+        __PHYSFS_platformReleaseMutex(archive->lock);
+    } /* else */
+
+    if ((sz_err(rc) != SZ_OK) || (file->item->Size != fileSize) || (file->offset != offset))
+    {
+        if (rc == SZ_OK)
+            PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+        /* A failed extract can leave half a folder behind; don't trust it */
+        ISzAlloc_Free(archive->allocImp, folder->cache);
+        folder->cache = NULL;
+        return 0;
+    } /* if */
+
+    count = sz_folder_file_count(archive, file->folder - archive->folders);
+    __PHYSFS_platformGrabMutex(archive->lock);
+    folder->unopened = (count > folder->references) ? count - folder->references : 0;
+    __PHYSFS_platformReleaseMutex(archive->lock);
+
+    return 1;
+} /* sz_folder_decode */
+
+
 static PHYSFS_sint64 SZ_read(PHYSFS_Io *io, void *outBuf, PHYSFS_uint64 len)
 {
-    SZfile *file = (SZfile *) io->opaque;
+    SZhandle *handle = (SZhandle *) io->opaque;
+    SZfile *file = handle->file;
 
     size_t wantedSize = (size_t) len;
-    const size_t remainingSize = file->item->Size - file->position;
+    const size_t remainingSize = file->item->Size - handle->position;
 
     BAIL_IF_ERRPASS(wantedSize == 0, 0); /* quick rejection. */
     BAIL_IF(remainingSize == 0, PHYSFS_ERR_PAST_EOF, 0);
@@ -398,37 +520,18 @@ static PHYSFS_sint64 SZ_read(PHYSFS_Io *io, void *outBuf, PHYSFS_uint64 len)
         wantedSize = remainingSize;
 
     /* Only decompress the folder if it is not already cached */
-    if (file->folder->cache == NULL)
+    __PHYSFS_platformGrabMutex(file->folder->lock);
+    if ((file->folder->cache == NULL) && (!sz_folder_decode(file)))
     {
-        size_t fileSize = 0;
-        const int rc = sz_err(SzArEx_Extract(
-            &file->archive->db, /* 7z's database, containing everything */
-            &file->archive->lookStream.vt, /* compressed data */
-            file->index, /* Index into database arrays */
-            /* Index of cached folder, will be changed by SzExtract */
-            &file->folder->index,
-            /* Cache for decompressed folder, allocated/freed by SzExtract */
-            &file->folder->cache,
-            /* Size of cache, will be changed by SzExtract */
-            &file->folder->size,
-            /* Offset of this file inside the cache, set by SzExtract */
-            &file->offset,
-            /* Size of this file, set by SzExtract */
-            &fileSize,
-            file->archive->allocImp,
-            file->archive->allocTempImp));
-
-        if (rc != SZ_OK)
-            return -1;
-
-        BAIL_IF(wantedSize > fileSize, PHYSFS_ERR_OTHER_ERROR, -1);
-        BAIL_IF(file->item->Size != fileSize, PHYSFS_ERR_OTHER_ERROR, -1);
+        __PHYSFS_platformReleaseMutex(file->folder->lock);
+        return -1;
     } /* if */
+    __PHYSFS_platformReleaseMutex(file->folder->lock);
 
     /* Copy wanted bytes over from cache to outBuf */
-    memcpy(outBuf, (file->folder->cache + file->offset + file->position),
+    memcpy(outBuf, (file->folder->cache + file->offset + handle->position),
             wantedSize);
-    file->position += wantedSize; /* Increase virtual position */
+    handle->position += wantedSize; /* Increase virtual position */
 
     return wantedSize;
 } /* SZ_read */
@@ -442,18 +545,18 @@ static PHYSFS_sint64 SZ_write(PHYSFS_Io *io, const void *b, PHYSFS_uint64 len)
 
 static PHYSFS_sint64 SZ_tell(PHYSFS_Io *io)
 {
-    SZfile *file = (SZfile *) io->opaque;
-    return file->position;
+    SZhandle *handle = (SZhandle *) io->opaque;
+    return handle->position;
 } /* SZ_tell */
 
 
 static int SZ_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
 {
-    SZfile *file = (SZfile *) io->opaque;
+    SZhandle *handle = (SZhandle *) io->opaque;
 
-    BAIL_IF(offset > file->item->Size, PHYSFS_ERR_PAST_EOF, 0);
+    BAIL_IF(offset > handle->file->item->Size, PHYSFS_ERR_PAST_EOF, 0);
 
-    file->position = offset; /* We only use a virtual position... */
+    handle->position = (size_t) offset; /* We only use a virtual position... */
 
     return 1;
 } /* SZ_seek */
@@ -461,16 +564,17 @@ static int SZ_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
 
 static PHYSFS_sint64 SZ_length(PHYSFS_Io *io)
 {
-    const SZfile *file = (SZfile *) io->opaque;
-    return (file->item->Size);
+    const SZhandle *handle = (SZhandle *) io->opaque;
+    return (handle->file->item->Size);
 } /* SZ_length */
 
 
+static PHYSFS_Io *sz_open_handle(SZfile *file);
+
 static PHYSFS_Io *SZ_duplicate(PHYSFS_Io *_io)
 {
-    /* !!! FIXME: this archiver needs to be reworked to allow multiple
-     * !!! FIXME:  opens before we worry about duplication. */
-    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+    const SZhandle *handle = (SZhandle *) _io->opaque;
+    return sz_open_handle(handle->file);
 } /* SZ_duplicate */
 
 
@@ -479,22 +583,46 @@ static int SZ_flush(PHYSFS_Io *io) { return 1;  /* no write support. */ }
 
 static void SZ_destroy(PHYSFS_Io *io)
 {
-    SZfile *file = (SZfile *) io->opaque;
+    SZhandle *handle = (SZhandle *) io->opaque;
+    SZarchive *archive = handle->file->archive;
+    SZfolder *folder = handle->file->folder;
 
-    if (file->folder != NULL)
+    if (folder != NULL)
     {
+        __PHYSFS_platformGrabMutex(archive->lock);
+
         /* Only decrease refcount if someone actually requested this file... Prevents from overflows and close-on-open... */
-        if (file->folder->references > 0)
-            file->folder->references--;
-        if (file->folder->references == 0)
+        if (folder->references > 0)
+            folder->references--;
+
+        if ((folder->references == 0) && (folder->cache != NULL))
         {
-            /* Free the cache which might have been allocated by SZ_read() */
-            allocator.Free(file->folder->cache);
-            file->folder->cache = NULL;
-        }
+            /*
+             * Keep the cache if more of its files are coming and the app
+             *  allows it (PHYSFS_setSolidCacheLimit()). Unpacking a whole
+             *  archive then decompresses each folder once, not once per file.
+             */
+            const PHYSFS_uint64 idle = (PHYSFS_uint64) archive->idleCacheSize;
+            if ((folder->unopened > 0) &&
+                (idle + folder->size <= PHYSFS_getSolidCacheLimit()))
+            {
+                archive->idleCacheSize += folder->size;
+            } /* if */
+            else
+            {
+                /* Free the cache which might have been allocated by SZ_read() */
+                allocator.Free(folder->cache);
+                folder->cache = NULL;
+            } /* else */
+        } /* if */
+
+        __PHYSFS_platformReleaseMutex(archive->lock);
 
         /* file and folder are static parts of the archive - keep them around */
     } /* if */
+
+    allocator.Free(handle);
+    allocator.Free(io);
 } /* SZ_destroy */
 
 
@@ -508,7 +636,8 @@ static const PHYSFS_Io SZ_Io =
     SZ_length,
     SZ_duplicate,
     SZ_flush,
-    SZ_destroy
+    SZ_destroy,
+    NULL  /* readAt */
 };
 
 
@@ -526,6 +655,13 @@ static void *SZ_openArchive(PHYSFS_Io *io, const char *name, int forWriting, int
     sz_archive_init(archive);
     archive->inStream.io = io;
 
+    archive->lock = __PHYSFS_platformCreateMutex();
+    if (archive->lock == NULL)
+    {
+        sz_archive_exit(archive);
+        return NULL;  /* Error is set by the platform layer */
+    } /* if */
+
     SzArEx_Init(&archive->db);
 
     SRes res = SzArEx_Open(&archive->db,
@@ -657,24 +793,72 @@ static PHYSFS_EnumerateCallbackResult SZ_enumerateFiles(void *opaque,
 } /* SZ_enumerateFiles */
 
 
-static PHYSFS_Io *SZ_openRead(void *opaque, const char *path)
+/*
+ * Make a new PHYSFS_Io for 'file' and take a reference on its folder
+ */
+static PHYSFS_Io *sz_open_handle(SZfile *file)
 {
-    SZarchive *archive = (SZarchive *) opaque;
-    SZfile *file = sz_find_file(archive, path);
+    SZarchive *archive = file->archive;
+    SZfolder *folder = file->folder;  /* Empty files don't have one */
+    SZhandle *handle = NULL;
     PHYSFS_Io *io = NULL;
 
-    BAIL_IF(file == NULL, PHYSFS_ERR_NOT_FOUND, NULL);
-    BAIL_IF(file->folder == NULL, PHYSFS_ERR_NOT_A_FILE, NULL);
+    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    GOTO_IF(io == NULL, PHYSFS_ERR_OUT_OF_MEMORY, open_handle_failed);
+    handle = (SZhandle *) allocator.Malloc(sizeof (SZhandle));
+    GOTO_IF(handle == NULL, PHYSFS_ERR_OUT_OF_MEMORY, open_handle_failed);
 
-    file->position = 0;
-    file->folder->references++; /* Increase refcount for automatic cleanup... */
+    if (folder != NULL)
+    {
+        __PHYSFS_platformGrabMutex(archive->lock);
 
-    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    BAIL_IF(io == NULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        if (folder->lock == NULL)
+            folder->lock = __PHYSFS_platformCreateMutex();
+
+        if (folder->lock == NULL)
+        {
+            __PHYSFS_platformReleaseMutex(archive->lock);
+            goto open_handle_failed;  /* Error is set by the platform layer */
+        } /* if */
+
+        if (folder->cache != NULL)
+        {
+            if (folder->references == 0)  /* It's not idle anymore */
+                archive->idleCacheSize -= folder->size;
+            if (folder->unopened > 0)
+                folder->unopened--;
+        } /* if */
+
+        folder->references++; /* Increase refcount for automatic cleanup... */
+
+        __PHYSFS_platformReleaseMutex(archive->lock);
+    } /* if */
+
+    handle->file = file;
+    handle->position = 0;
     memcpy(io, &SZ_Io, sizeof (*io));
-    io->opaque = file;
+    io->opaque = handle;
 
     return io;
+
+open_handle_failed:
+    if (handle != NULL)
+        allocator.Free(handle);
+    if (io != NULL)
+        allocator.Free(io);
+    return NULL;
+} /* sz_open_handle */
+
+
+static PHYSFS_Io *SZ_openRead(void *opaque, const char *path)
+{
+    SZarchive *archive = (SZarchive *) opaque;
+    SZfile *file = sz_find_file(archive, path);
+
+    BAIL_IF(file == NULL, PHYSFS_ERR_NOT_FOUND, NULL);
+    BAIL_IF(file->item->IsDir, PHYSFS_ERR_NOT_A_FILE, NULL);
+
+    return sz_open_handle(file);
 } /* SZ_openRead */
 
 
@@ -699,12 +883,23 @@ static void SZ_closeArchive(void *opaque)
 
     PHYSFS_uint32 fileIndex = 0, numFiles = archive->db.NumFiles;
 
+    PHYSFS_uint32 folderIndex = 0, numFolders = archive->db.db.NumFolders;
+
     for (fileIndex = 0; fileIndex < numFiles; fileIndex++)
     {
         allocator.Free((char*)archive->files[fileIndex].name);
         allocator.Free(archive->files[fileIndex].item);
     }
 
+    /* Drop any folders we kept around */
+    for (folderIndex = 0; folderIndex < numFolders; folderIndex++)
+    {
+        if (archive->folders[folderIndex].cache != NULL)
+            allocator.Free(archive->folders[folderIndex].cache);
+        if (archive->folders[folderIndex].lock != NULL)
+            __PHYSFS_platformDestroyMutex(archive->folders[folderIndex].lock);
+    }
+
     SzArEx_Free(&archive->db, archive->allocImp);
     archive->inStream.io->destroy(archive->inStream.io);
     sz_archive_exit(archive);
@@ -725,8 +920,18 @@ static int SZ_mkdir(void *opaque, const char *name)
 static int SZ_stat(void *opaque, const char *path, PHYSFS_Stat *stat)
 {
     const SZarchive *archive = (const SZarchive *) opaque;
-    const SZfile *file = sz_find_file(archive, path);
+    const SZfile *file;
+
+    if (*path == '\0')  /* The root isn't in the archive's file list */
+    {
+        stat->filesize = 0;
+        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+        stat->modtime = stat->createtime = stat->accesstime = -1;
+        stat->readonly = 1;
+        return 1;
+    } /* if */
 
+    file = sz_find_file(archive, path);
     if (!file)
         return 0;
 
@@ -786,7 +991,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_7Z =
     SZ_remove,
     SZ_mkdir,
     SZ_stat,
-    SZ_closeArchive
+    SZ_closeArchive,
+    NULL  /* enumerateTyped */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_7Z */
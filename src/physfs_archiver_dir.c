@@ -38,13 +38,427 @@ static char *cvtToDependent(const char *prepend, const char *path,
 }
 
 
+/*
+ * Optional in-memory index of the whole tree (see
+ *  PHYSFS_setDirectoryIndexing()). It's built when the directory is mounted
+ *  and then patched up from the platform's change notifications, which we
+ *  collect before every query. If anything goes wrong (we run out of
+ *  watches, say), the index is thrown away and we go to disk like always.
+ */
+typedef struct
+{
+    __PHYSFS_DirTreeEntry tree;  /* manages directory tree */
+    PHYSFS_Stat stat;  /* as __PHYSFS_platformStat() saw it, not following. */
+    int watchid;  /* -1 unless this is a watched directory. */
+} DIRindexEntry;
+
+typedef struct
+{
+    __PHYSFS_DirTree tree;
+    void *watch;
+    DIRindexEntry **watched;  /* watch ids to entries. */
+    size_t numwatched;
+    int rebuild;  /* events were lost; scan everything again. */
+    int failed;  /* couldn't keep up; give up on the index. */
+} DIRindex;
+
+typedef struct
+{
+    char *base;  /* native path to mount point, ends with a dir separator. */
+    void *dirhandle;  /* platform handle for (base), NULL if unsupported. */
+    DIRindex *index;  /* NULL unless we're indexing. */
+} DIRinfo;
+
+
+/*
+ * If the platform gave us a handle to the mount point, we work relative to
+ *  it and let the OS skip resolving (base) over and over. Otherwise, we glue
+ *  (base) onto the front of every path, like we always did.
+ */
+static int dirStat(DIRinfo *info, const char *name, PHYSFS_Stat *st)
+{
+    int retval;
+    char *d;
+
+    if (info->dirhandle != NULL)
+        return __PHYSFS_platformStatAt(info->dirhandle, name, st, 0);
+
+    CVT_TO_DEPENDENT(d, info->base, name);
+    BAIL_IF_ERRPASS(!d, 0);
+    retval = __PHYSFS_platformStat(d, st, 0);
+    __PHYSFS_smallFree(d);
+    return retval;
+} /* dirStat */
+
+
+static PHYSFS_EnumerateCallbackResult dirEnumerate(DIRinfo *info,
+                         const char *dname, PHYSFS_EnumerateTypedCallback cb,
+                         const char *origdir, void *callbackdata)
+{
+    PHYSFS_EnumerateCallbackResult retval;
+    char *d;
+
+    if (info->dirhandle != NULL)
+    {
+        return __PHYSFS_platformEnumerateAt(info->dirhandle, dname, cb,
+                                            origdir, callbackdata);
+    } /* if */
+
+    CVT_TO_DEPENDENT(d, info->base, dname);
+    BAIL_IF_ERRPASS(!d, PHYSFS_ENUM_ERROR);
+    retval = __PHYSFS_platformEnumerate(d, cb, origdir, callbackdata);
+    __PHYSFS_smallFree(d);
+    return retval;
+} /* dirEnumerate */
+
+
+static char *dirIndexPath(const DIRindexEntry *parent, const char *name)
+{
+    const char *pname = parent->tree.name;
+    const int isroot = ((pname[0] == '/') && (pname[1] == '\0'));
+    const size_t len = (isroot ? 0 : strlen(pname) + 1) + strlen(name) + 1;
+    char *retval = (char *) allocator.Malloc(len);
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    if (isroot)
+        strcpy(retval, name);
+    else
+        snprintf(retval, len, "%s/%s", pname, name);
+    return retval;
+} /* dirIndexPath */
+
+
+static int dirIndexStatEntry(DIRinfo *info, DIRindexEntry *entry)
+{
+    const char *name = entry->tree.name;
+    if ((name[0] == '/') && (name[1] == '\0'))
+        name = "";  /* the root. */
+    return dirStat(info, name, &entry->stat);
+} /* dirIndexStatEntry */
+
+
+static int dirIndexWatch(DIRinfo *info, DIRindexEntry *entry)
+{
+    DIRindex *idx = info->index;
+    const char *name = entry->tree.name;
+    int id;
+    char *d;
+
+    if ((name[0] == '/') && (name[1] == '\0'))
+        name = "";  /* the root. */
+
+    CVT_TO_DEPENDENT(d, info->base, name);
+    BAIL_IF_ERRPASS(!d, 0);
+    id = __PHYSFS_platformAddDirWatch(idx->watch, d);
+    __PHYSFS_smallFree(d);
+    BAIL_IF_ERRPASS(id < 0, 0);
+
+    if (((size_t) id) >= idx->numwatched)
+    {
+        const size_t newnum = ((size_t) id) * 2 + 16;
+        void *ptr = allocator.Realloc(idx->watched, newnum * sizeof (void *));
+        if (!ptr)
+        {
+            __PHYSFS_platformRemoveDirWatch(idx->watch, id);
+            BAIL(PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        } /* if */
+        idx->watched = (DIRindexEntry **) ptr;
+        memset(idx->watched + idx->numwatched, '\0',
+               (newnum - idx->numwatched) * sizeof (void *));
+        idx->numwatched = newnum;
+    } /* if */
+
+    idx->watched[id] = entry;
+    entry->watchid = id;
+    return 1;
+} /* dirIndexWatch */
+
+
+static int dirIndexScan(DIRinfo *info, DIRindexEntry *dir);
+
+typedef struct
+{
+    DIRinfo *info;
+    DIRindexEntry *dir;
+} DIRindexScanData;
+
+static DIRindexEntry *dirIndexAdd(DIRinfo *info, DIRindexEntry *parent,
+                                  const char *name)
+{
+    DIRindex *idx = info->index;
+    DIRindexEntry *retval = NULL;
+    PHYSFS_Stat st;
+    char *path;
+
+    path = dirIndexPath(parent, name);
+    if (!path)
+    {
+        idx->failed = 1;
+        return NULL;
+    } /* if */
+
+    if (!dirStat(info, path, &st))
+    {
+        /* gone already? Not an error; we'll hear about it. */
+        PHYSFS_setErrorCode(PHYSFS_ERR_NOT_FOUND);
+        goto dirIndexAdd_done;
+    } /* if */
+
+    retval = (DIRindexEntry *) __PHYSFS_DirTreeAdd(&idx->tree, path,
+                                  st.filetype == PHYSFS_FILETYPE_DIRECTORY);
+    if (!retval)
+    {
+        idx->failed = 1;  /* a hole in the index would be a lie. */
+        goto dirIndexAdd_done;
+    } /* if */
+    memcpy(&retval->stat, &st, sizeof (st));
+    retval->watchid = -1;
+
+    if (retval->tree.isdir && !dirIndexScan(info, retval))
+        idx->failed = 1;
+
+dirIndexAdd_done:
+    allocator.Free(path);
+    return retval;
+} /* dirIndexAdd */
+
+
+static PHYSFS_EnumerateCallbackResult dirIndexScanCallback(void *data,
+                                        const char *origdir, const char *fname,
+                                        int filetype)
+{
+    /* (filetype) isn't enough; we stat everything for the index anyhow. */
+    DIRindexScanData *scan = (DIRindexScanData *) data;
+    dirIndexAdd(scan->info, scan->dir, fname);
+    return scan->info->index->failed ? PHYSFS_ENUM_STOP : PHYSFS_ENUM_OK;
+} /* dirIndexScanCallback */
+
+
+static int dirIndexScan(DIRinfo *info, DIRindexEntry *dir)
+{
+    const char *name = dir->tree.name;
+    PHYSFS_EnumerateCallbackResult rc;
+    DIRindexScanData scan;
+
+    /* watch first, so nothing created during the scan gets missed. */
+    BAIL_IF_ERRPASS(!dirIndexWatch(info, dir), 0);
+
+    if ((name[0] == '/') && (name[1] == '\0'))
+        name = "";  /* the root. */
+
+    scan.info = info;
+    scan.dir = dir;
+    rc = dirEnumerate(info, name, dirIndexScanCallback, "", &scan);
+
+    return ((rc != PHYSFS_ENUM_ERROR) && (!info->index->failed));
+} /* dirIndexScan */
+
+
+static void dirIndexForgetWatches(DIRindex *idx, DIRindexEntry *entry)
+{
+    __PHYSFS_DirTreeEntry *child;
+
+    if (entry->watchid >= 0)
+    {
+        __PHYSFS_platformRemoveDirWatch(idx->watch, entry->watchid);
+        idx->watched[entry->watchid] = NULL;
+        entry->watchid = -1;
+    } /* if */
+
+    for (child = entry->tree.children; child; child = child->sibling)
+        dirIndexForgetWatches(idx, (DIRindexEntry *) child);
+} /* dirIndexForgetWatches */
+
+
+static void dirIndexRemove(DIRindex *idx, DIRindexEntry *entry)
+{
+    dirIndexForgetWatches(idx, entry);
+    __PHYSFS_DirTreeRemove(&idx->tree, entry);
+} /* dirIndexRemove */
+
+
+static void dirIndexEvent(void *data, int id, const char *name)
+{
+    DIRinfo *info = (DIRinfo *) data;
+    DIRindex *idx = info->index;
+    DIRindexEntry *dir;
+    DIRindexEntry *entry;
+    PHYSFS_Stat st;
+    char *path;
+    int rc;
+
+    if (idx->rebuild || idx->failed)
+        return;  /* we're starting over anyhow. */
+    else if (id < 0)
+    {
+        idx->rebuild = 1;  /* lost events. */
+        return;
+    } /* else if */
+    else if ((((size_t) id) >= idx->numwatched) || (!idx->watched[id]))
+        return;  /* stale event for something we already forgot. */
+
+    dir = idx->watched[id];
+
+    if (name == NULL)  /* watched dir moved or deleted. */
+    {
+        if (dir == (DIRindexEntry *) idx->tree.root)
+            idx->failed = 1;  /* the mount point itself is gone. */
+        else  /* parent dir's watch tells us what happened to the entry. */
+        {
+            __PHYSFS_platformRemoveDirWatch(idx->watch, id);
+            idx->watched[id] = NULL;
+            dir->watchid = -1;
+        } /* else */
+        return;
+    } /* if */
+
+    /* something changed in (dir), so (dir) itself has a new mtime, etc. */
+    if (!dirIndexStatEntry(info, dir))
+        return;  /* deleted? Its parent's watch will tell us. */
+
+    if (*name == '\0')
+        return;  /* just the directory itself changed. */
+
+    path = dirIndexPath(dir, name);
+    if (!path)
+    {
+        idx->failed = 1;
+        return;
+    } /* if */
+
+    entry = (DIRindexEntry *) __PHYSFS_DirTreeFind(&idx->tree, path);
+    rc = dirStat(info, path, &st);
+    allocator.Free(path);
+
+    /* a file turned into a directory (or vice versa) is a remove + add. */
+    if ((entry != NULL) && ((!rc) || (entry->tree.isdir !=
+                            (st.filetype == PHYSFS_FILETYPE_DIRECTORY))))
+    {
+        dirIndexRemove(idx, entry);
+        entry = NULL;
+    } /* if */
+
+    if (!rc)
+        return;  /* deleted or renamed away. */
+    else if (entry != NULL)
+        memcpy(&entry->stat, &st, sizeof (st));
+    else
+        dirIndexAdd(info, dir, name);  /* new (scans new dirs, too). */
+} /* dirIndexEvent */
+
+
+static void dirIndexDestroy(DIRindex *idx)
+{
+    if (idx->watch)
+        __PHYSFS_platformDestroyDirWatch(idx->watch);
+    if (idx->watched)
+        allocator.Free(idx->watched);
+    __PHYSFS_DirTreeDeinit(&idx->tree);
+    allocator.Free(idx);
+} /* dirIndexDestroy */
+
+
+static DIRindex *dirIndexCreate(DIRinfo *info)
+{
+    DIRindex *idx = (DIRindex *) allocator.Malloc(sizeof (DIRindex));
+    BAIL_IF(!idx, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(idx, '\0', sizeof (*idx));
+
+    assert(info->index == NULL);
+    info->index = idx;
+
+    if (!__PHYSFS_DirTreeInit(&idx->tree, sizeof (DIRindexEntry)))
+        goto dirIndexCreate_failed;
+    else if ((idx->watch = __PHYSFS_platformCreateDirWatch()) == NULL)
+        goto dirIndexCreate_failed;
+
+    ((DIRindexEntry *) idx->tree.root)->watchid = -1;
+    if (!dirIndexStatEntry(info, (DIRindexEntry *) idx->tree.root))
+        goto dirIndexCreate_failed;
+    else if (!dirIndexScan(info, (DIRindexEntry *) idx->tree.root))
+        goto dirIndexCreate_failed;
+
+    return idx;
+
+dirIndexCreate_failed:
+    info->index = NULL;
+    dirIndexDestroy(idx);
+    return NULL;
+} /* dirIndexCreate */
+
+
+/* Catch up on changes. Returns NULL if there's no (usable) index. */
+static DIRindex *dirIndexUpdate(DIRinfo *info)
+{
+    DIRindex *idx = info->index;
+    if (idx == NULL)
+        return NULL;
+
+    if (!__PHYSFS_platformPollDirWatch(idx->watch, dirIndexEvent, info))
+        idx->rebuild = 1;
+
+    if ((idx->rebuild) && (!idx->failed))
+    {
+        info->index = NULL;
+        dirIndexDestroy(idx);
+        idx = dirIndexCreate(info);  /* NULL if this fails, and that's okay. */
+    } /* if */
+
+    else if (idx->failed)
+    {
+        info->index = NULL;
+        dirIndexDestroy(idx);
+        idx = NULL;
+    } /* else if */
+
+    return idx;
+} /* dirIndexUpdate */
+
+
+/*
+ * Returns 1 and sets (*_entry) if (name) is in the index, 0 if we're sure
+ *  it doesn't exist, and -1 if we can't tell (it's under a symlink).
+ */
+static int dirIndexLookup(DIRindex *idx, const char *name,
+                          DIRindexEntry **_entry)
+{
+    DIRindexEntry *entry;
+    char *path;
+    char *sep;
+    int retval = 0;
+
+    *_entry = entry = (DIRindexEntry *) __PHYSFS_DirTreeFind(&idx->tree, name);
+    if (entry != NULL)
+        return 1;
+
+    /* not in the tree. Does it hang off something we didn't descend into? */
+    path = (char *) __PHYSFS_smallAlloc(strlen(name) + 1);
+    BAIL_IF(!path, PHYSFS_ERR_OUT_OF_MEMORY, -1);
+    strcpy(path, name);
+    while ((sep = strrchr(path, '/')) != NULL)
+    {
+        *sep = '\0';
+        entry = (DIRindexEntry *) __PHYSFS_DirTreeFind(&idx->tree, path);
+        if (entry != NULL)
+        {
+            if (entry->stat.filetype == PHYSFS_FILETYPE_SYMLINK)
+                retval = -1;
+            break;
+        } /* if */
+    } /* while */
+    __PHYSFS_smallFree(path);
+
+    return retval;
+} /* dirIndexLookup */
+
+
 
 static void *DIR_openArchive(PHYSFS_Io *io, const char *name,
                              int forWriting, int *claimed)
 {
     PHYSFS_Stat st;
     const char dirsep = __PHYSFS_platformDirSeparator;
-    char *retval = NULL;
+    DIRinfo *info = NULL;
+    char *base = NULL;
     const size_t namelen = strlen(name);
     const size_t seplen = 1;
 
@@ -55,42 +469,117 @@ static void *DIR_openArchive(PHYSFS_Io *io, const char *name,
         BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
 
     *claimed = 1;
-    retval = allocator.Malloc(namelen + seplen + 1);
-    BAIL_IF(retval == NULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    info = (DIRinfo *) allocator.Malloc(sizeof (DIRinfo));
+    BAIL_IF(info == NULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    base = allocator.Malloc(namelen + seplen + 1);
+    if (base == NULL)
+    {
+        allocator.Free(info);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
 
-    strcpy(retval, name);
+    strcpy(base, name);
 
     /* make sure there's a dir separator at the end of the string */
-    if (retval[namelen - 1] != dirsep)
+    if (base[namelen - 1] != dirsep)
     {
-        retval[namelen] = dirsep;
-        retval[namelen + 1] = '\0';
+        base[namelen] = dirsep;
+        base[namelen + 1] = '\0';
     } /* if */
 
-    return retval;
+    info->base = base;
+    info->index = NULL;
+    info->dirhandle = __PHYSFS_platformOpenDirHandle(name);  /* can fail. */
+
+    if ((!forWriting) && (PHYSFS_getDirectoryIndexing()))
+        dirIndexCreate(info);  /* this can fail; that's okay. */
+
+    return info;
 } /* DIR_openArchive */
 
 
+static int dirIndexEntryFileType(const void *entry)
+{
+    return (int) ((const DIRindexEntry *) entry)->stat.filetype;
+} /* dirIndexEntryFileType */
+
+
+static PHYSFS_EnumerateCallbackResult DIR_enumerateTyped(void *opaque,
+                         const char *dname, PHYSFS_EnumerateTypedCallback cb,
+                         const char *origdir, void *callbackdata)
+{
+    DIRinfo *info = (DIRinfo *) opaque;
+    DIRindex *idx = dirIndexUpdate(info);
+
+    if (idx != NULL)
+    {
+        DIRindexEntry *entry;
+        const int rc = dirIndexLookup(idx, dname, &entry);
+        BAIL_IF(rc == 0, PHYSFS_ERR_NOT_FOUND, PHYSFS_ENUM_ERROR);
+        if ((rc == 1) && (entry->tree.isdir))
+        {
+            return __PHYSFS_DirTreeEnumerateTyped(&idx->tree, dname, cb,
+                                                  origdir, callbackdata,
+                                                  dirIndexEntryFileType);
+        } /* if */
+    } /* if */
+
+    return dirEnumerate(info, dname, cb, origdir, callbackdata);
+} /* DIR_enumerateTyped */
+
+
+typedef struct
+{
+    PHYSFS_EnumerateCallback cb;
+    void *callbackdata;
+} DIRuntypedData;
+
+static PHYSFS_EnumerateCallbackResult dirUntypedCallback(void *data,
+                                        const char *origdir, const char *fname,
+                                        int filetype)
+{
+    DIRuntypedData *u = (DIRuntypedData *) data;
+    return u->cb(u->callbackdata, origdir, fname);
+} /* dirUntypedCallback */
+
+
 static PHYSFS_EnumerateCallbackResult DIR_enumerate(void *opaque,
                          const char *dname, PHYSFS_EnumerateCallback cb,
                          const char *origdir, void *callbackdata)
 {
-    char *d;
-    PHYSFS_EnumerateCallbackResult retval;
-    CVT_TO_DEPENDENT(d, opaque, dname);
-    BAIL_IF_ERRPASS(!d, PHYSFS_ENUM_ERROR);
-    retval = __PHYSFS_platformEnumerate(d, cb, origdir, callbackdata);
-    __PHYSFS_smallFree(d);
-    return retval;
+    DIRuntypedData u;
+    u.cb = cb;
+    u.callbackdata = callbackdata;
+    return DIR_enumerateTyped(opaque, dname, dirUntypedCallback, origdir, &u);
 } /* DIR_enumerate */
 
 
 static PHYSFS_Io *doOpen(void *opaque, const char *name, const int mode)
 {
+    DIRinfo *info = (DIRinfo *) opaque;
     PHYSFS_Io *io = NULL;
     char *f = NULL;
 
-    CVT_TO_DEPENDENT(f, opaque, name);
+    if (mode == 'r')
+    {
+        DIRindex *idx = dirIndexUpdate(info);
+        if (idx != NULL)
+        {
+            DIRindexEntry *entry;
+            BAIL_IF(dirIndexLookup(idx, name, &entry) == 0,
+                    PHYSFS_ERR_NOT_FOUND, NULL);
+        } /* if */
+    } /* if */
+
+    if (info->dirhandle != NULL)
+    {
+        const int confine = !PHYSFS_symbolicLinksPermitted();
+        void *h = __PHYSFS_platformOpenAt(info->dirhandle, name, mode, confine);
+        BAIL_IF_ERRPASS(!h, NULL);
+        return __PHYSFS_createNativeIoFromHandle(h, NULL, mode);
+    } /* if */
+
+    CVT_TO_DEPENDENT(f, info->base, name);
     BAIL_IF_ERRPASS(!f, NULL);
 
     io = __PHYSFS_createNativeIo(f, mode);
@@ -128,10 +617,14 @@ static PHYSFS_Io *DIR_openAppend(void *opaque, const char *filename)
 
 static int DIR_remove(void *opaque, const char *name)
 {
+    DIRinfo *info = (DIRinfo *) opaque;
     int retval;
     char *f;
 
-    CVT_TO_DEPENDENT(f, opaque, name);
+    if (info->dirhandle != NULL)
+        return __PHYSFS_platformDeleteAt(info->dirhandle, name);
+
+    CVT_TO_DEPENDENT(f, info->base, name);
     BAIL_IF_ERRPASS(!f, 0);
     retval = __PHYSFS_platformDelete(f);
     __PHYSFS_smallFree(f);
@@ -141,10 +634,14 @@ static int DIR_remove(void *opaque, const char *name)
 
 static int DIR_mkdir(void *opaque, const char *name)
 {
+    DIRinfo *info = (DIRinfo *) opaque;
     int retval;
     char *f;
 
-    CVT_TO_DEPENDENT(f, opaque, name);
+    if (info->dirhandle != NULL)
+        return __PHYSFS_platformMkDirAt(info->dirhandle, name);
+
+    CVT_TO_DEPENDENT(f, info->base, name);
     BAIL_IF_ERRPASS(!f, 0);
     retval = __PHYSFS_platformMkDir(f);
     __PHYSFS_smallFree(f);
@@ -154,20 +651,34 @@ static int DIR_mkdir(void *opaque, const char *name)
 
 static void DIR_closeArchive(void *opaque)
 {
-    allocator.Free(opaque);
+    DIRinfo *info = (DIRinfo *) opaque;
+    if (info->index != NULL)
+        dirIndexDestroy(info->index);
+    if (info->dirhandle != NULL)
+        __PHYSFS_platformCloseDirHandle(info->dirhandle);
+    allocator.Free(info->base);
+    allocator.Free(info);
 } /* DIR_closeArchive */
 
 
 static int DIR_stat(void *opaque, const char *name, PHYSFS_Stat *stat)
 {
-    int retval = 0;
-    char *d;
+    DIRinfo *info = (DIRinfo *) opaque;
+    DIRindex *idx = dirIndexUpdate(info);
 
-    CVT_TO_DEPENDENT(d, opaque, name);
-    BAIL_IF_ERRPASS(!d, 0);
-    retval = __PHYSFS_platformStat(d, stat, 0);
-    __PHYSFS_smallFree(d);
-    return retval;
+    if (idx != NULL)
+    {
+        DIRindexEntry *entry;
+        const int rc = dirIndexLookup(idx, name, &entry);
+        BAIL_IF(rc == 0, PHYSFS_ERR_NOT_FOUND, 0);
+        if (rc == 1)
+        {
+            memcpy(stat, &entry->stat, sizeof (*stat));
+            return 1;
+        } /* if */
+    } /* if */
+
+    return dirStat(info, name, stat);
 } /* DIR_stat */
 
 
@@ -189,7 +700,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_DIR =
     DIR_remove,
     DIR_mkdir,
     DIR_stat,
-    DIR_closeArchive
+    DIR_closeArchive,
+    DIR_enumerateTyped
 };
 
 /* end of physfs_archiver_dir.c ... */
@@ -107,7 +107,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_GRP =
     UNPK_remove,
     UNPK_mkdir,
     UNPK_stat,
-    UNPK_closeArchive
+    UNPK_closeArchive,
+    NULL  /* enumerateTyped */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_GRP */
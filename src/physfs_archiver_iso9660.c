@@ -377,7 +377,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_ISO9660 =
     UNPK_remove,
     UNPK_mkdir,
     UNPK_stat,
-    UNPK_closeArchive
+    UNPK_closeArchive,
+    NULL  /* enumerateTyped */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_ISO9660 */
@@ -101,7 +101,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_MVL =
     UNPK_remove,
     UNPK_mkdir,
     UNPK_stat,
-    UNPK_closeArchive
+    UNPK_closeArchive,
+    NULL  /* enumerateTyped */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_MVL */
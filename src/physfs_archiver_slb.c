@@ -127,7 +127,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_SLB =
     UNPK_remove,
     UNPK_mkdir,
     UNPK_stat,
-    UNPK_closeArchive
+    UNPK_closeArchive,
+    NULL  /* enumerateTyped */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_SLB */
@@ -151,6 +151,22 @@ static void UNPK_destroy(PHYSFS_Io *io)
 } /* UNPK_destroy */
 
 
+static PHYSFS_sint64 UNPK_readAt(PHYSFS_Io *io, void *buffer,
+                                 PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    UNPKfileinfo *finfo = (UNPKfileinfo *) io->opaque;
+    const UNPKentry *entry = finfo->entry;
+
+    if (offset >= entry->size)
+        return 0;
+
+    if (len > (entry->size - offset))
+        len = entry->size - offset;
+
+    return __PHYSFS_readAt(finfo->io, buffer, len, entry->startPos + offset);
+} /* UNPK_readAt */
+
+
 static const PHYSFS_Io UNPK_Io =
 {
     CURRENT_PHYSFS_IO_API_VERSION, NULL,
@@ -161,7 +177,32 @@ static const PHYSFS_Io UNPK_Io =
     UNPK_length,
     UNPK_duplicate,
     UNPK_flush,
-    UNPK_destroy
+    UNPK_destroy,
+    UNPK_readAt
+};
+
+
+static PHYSFS_Io *UNPK_rawRegion(PHYSFS_Io *io, PHYSFS_uint64 *pos,
+                                 PHYSFS_uint64 *len)
+{
+    const UNPKfileinfo *finfo;
+
+    if (io->read != UNPK_read)
+        return NULL;  /* not one of ours. */
+
+    finfo = (const UNPKfileinfo *) io->opaque;
+    *pos = finfo->entry->startPos;
+    *len = finfo->entry->size;
+    return finfo->io;
+} /* UNPK_rawRegion */
+
+
+const __PHYSFS_ArchiverHooks __PHYSFS_ArchiverHooks_UNPK =
+{
+    UNPK_rawRegion,
+    NULL,  /* no checksums to verify. */
+    NULL,  /* no decoders to give a dictionary. */
+    NULL   /* entries are resolved when the archive is opened. */
 };
 
 
@@ -198,6 +239,8 @@ PHYSFS_Io *UNPK_openRead(void *opaque, const char *name)
 
     memcpy(retval, &UNPK_Io, sizeof (*retval));
     retval->opaque = finfo;
+    if (!__PHYSFS_ioHasReadAt(finfo->io))
+        retval->readAt = NULL;  /* we'd have to seek around; not safe. */
     return retval;
 
 UNPK_openRead_failed:
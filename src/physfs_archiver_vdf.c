@@ -160,7 +160,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_VDF =
     UNPK_remove,
     UNPK_mkdir,
     UNPK_stat,
-    UNPK_closeArchive
+    UNPK_closeArchive,
+    NULL  /* enumerateTyped */
 };
 
 #endif /* defined PHYSFS_SUPPORTS_VDF */
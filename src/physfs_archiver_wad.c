@@ -126,7 +126,8 @@ const PHYSFS_Archiver __PHYSFS_Archiver_WAD =
     UNPK_remove,
     UNPK_mkdir,
     UNPK_stat,
-    UNPK_closeArchive
+    UNPK_closeArchive,
+    NULL  /* enumerateTyped */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_WAD */
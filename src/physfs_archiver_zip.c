@@ -7,6 +7,27 @@
  *   by Gilles Vollant.
  */
 
+/*
+ * CPU support for zip_crc32(). These headers come before physfs_internal.h,
+ *  since some of them use malloc() and free().
+ */
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ZIP_CRC32_CLMUL 1
+#define ZIP_CRC32_CLMUL_TARGET
+#include <intrin.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && \
+      (defined(__clang__) || \
+       (defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))))
+#define ZIP_CRC32_CLMUL 1
+#define ZIP_CRC32_CLMUL_TARGET __attribute__((target("sse2,pclmul")))
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#define ZIP_CRC32_ARM 1
+#include <arm_acle.h>
+#endif
+
 #define __PHYSICSFS_INTERNAL__
 #include "physfs_internal.h"
 
@@ -15,8 +36,55 @@
 #include <errno.h>
 #include <time.h>
 
+#define MINIZ_NO_DEFLATE_APIS
 #include "physfs_miniz.h"
 
+/*
+ * LZMA entries (compression method 14) are decoded with the LZMA SDK, which
+ *  is only built in with PHYSFS_ARCHIVE_7Z_UPSTREAM_SDK. Without it, opening
+ *  them fails with PHYSFS_ERR_UNSUPPORTED.
+ */
+#ifndef PHYSFS_ZIP_LZMA
+#define PHYSFS_ZIP_LZMA 0
+#endif
+
+#if PHYSFS_ZIP_LZMA
+#include "LzmaDec.h"
+#endif
+
+/*
+ * WinZip AES entries are decrypted with the LZMA SDK's AES, too, so they
+ *  need PHYSFS_ARCHIVE_7Z_UPSTREAM_SDK as well.
+ */
+#ifndef PHYSFS_ZIP_AES
+#define PHYSFS_ZIP_AES 0
+#endif
+
+#if PHYSFS_ZIP_AES
+#include "Aes.h"
+#endif
+
+/*
+ * Zstandard entries (compression method 93) use the decoder in zstd/, which
+ *  is built in unless you turn off the PHYSFS_ZIP_ZSTD CMake option.
+ */
+#ifndef PHYSFS_ZIP_ZSTD
+#define PHYSFS_ZIP_ZSTD 0
+#endif
+
+#if PHYSFS_ZIP_ZSTD
+#define ZSTD_STATIC_LINKING_ONLY  /* for ZSTD_customMem. */
+#include "zstd.h"
+#include "zstd_errors.h"
+
+/* Dictionaries replaced by PHYSFS_setDecoderDictionary(); see there. */
+typedef struct ZIPzstddict
+{
+    ZSTD_DDict *ddict;
+    struct ZIPzstddict *next;
+} ZIPzstddict;
+#endif
+
 /*
  * A buffer of ZIP_READBUFSIZE is allocated for each compressed file opened,
  *  and is freed when you close the file; compressed data is read into
@@ -38,7 +106,8 @@
  *  at the actual file data instead of the header, and symlinks will be
  *  followed and optimized. This means that we don't seek and read around the
  *  archive until forced to do so, and after the first time, we had to do
- *  less reading and parsing, which is very CD-ROM friendly.
+ *  less reading and parsing, which is very CD-ROM friendly. The app can
+ *  also have them all resolved at once, in order (see zip_resolve_all()).
  */
 typedef enum
 {
@@ -54,24 +123,198 @@ typedef enum
 
 /*
  * One ZIPentry is kept for each file in an open ZIP archive.
+ *
+ * Archives can have millions of these, so we keep them small: offsets and
+ *  sizes are 32 bits unless the archive needs more (then every entry is
+ *  really a ZIPentry64; use the accessors below), and the resolve state
+ *  shares a byte with the ZIP_ENTRY_* flags. The MS-DOS timestamp is only
+ *  converted when someone stat()s the entry, since mktime() is slow.
  */
 typedef struct _ZIPentry
 {
     __PHYSFS_DirTreeEntry tree;         /* manages directory tree         */
     struct _ZIPentry *symlink;          /* NULL or file we symlink to     */
-    ZipResolveType resolved;            /* Have we resolved file/symlink? */
-    PHYSFS_uint64 offset;               /* offset of data in archive      */
-    PHYSFS_uint16 version;              /* version made by                */
+    PHYSFS_uint32 lazydir;              /* lazy mode: 1+dir id, 0 if done */
+    PHYSFS_uint32 offset;               /* offset of data in archive      */
+    PHYSFS_uint32 compressed_size;      /* compressed size                */
+    PHYSFS_uint32 uncompressed_size;    /* uncompressed size              */
+    PHYSFS_uint32 crc;                  /* crc-32                         */
+    PHYSFS_uint32 dos_mod_time;         /* original MS-DOS style mod time */
     PHYSFS_uint16 version_needed;       /* version needed to extract      */
     PHYSFS_uint16 general_bits;         /* general purpose bits           */
     PHYSFS_uint16 compression_method;   /* compression method             */
-    PHYSFS_uint32 crc;                  /* crc-32                         */
-    PHYSFS_uint64 compressed_size;      /* compressed size                */
-    PHYSFS_uint64 uncompressed_size;    /* uncompressed size              */
-    PHYSFS_sint64 last_mod_time;        /* last file mod time             */
-    PHYSFS_uint32 dos_mod_time;         /* original MS-DOS style mod time */
+    PHYSFS_uint8 flags;                 /* ZipResolveType | ZIP_ENTRY_*   */
+    PHYSFS_uint8 aes;                   /* ZIP_AES_* once resolved, or 0  */
 } ZIPentry;
 
+/* Entries are these instead when an offset or size might not fit in 32 bits. */
+typedef struct
+{
+    ZIPentry entry;
+    PHYSFS_uint32 offset_hi;
+    PHYSFS_uint32 compressed_size_hi;
+    PHYSFS_uint32 uncompressed_size_hi;
+} ZIPentry64;
+
+#define ZIP_ENTRY_RESOLVE_MASK  0x07  /* the ZipResolveType lives here.    */
+#define ZIP_ENTRY_FROM_CDIR     0x08  /* came from a central dir record.  */
+#define ZIP_ENTRY_DOS_PATHS     0x10  /* made on MS-DOS; '\\' is a dirsep. */
+#define ZIP_ENTRY_WIDE          0x20  /* this is really a ZIPentry64.     */
+
+static inline ZipResolveType zip_entry_resolved(const ZIPentry *entry)
+{
+    return (ZipResolveType) (entry->flags & ZIP_ENTRY_RESOLVE_MASK);
+} /* zip_entry_resolved */
+
+static inline void zip_entry_set_resolved(ZIPentry *entry,
+                                          const ZipResolveType resolved)
+{
+    entry->flags &= ~ZIP_ENTRY_RESOLVE_MASK;
+    entry->flags |= (PHYSFS_uint8) resolved;
+} /* zip_entry_set_resolved */
+
+static inline PHYSFS_uint64 zip_entry_offset(const ZIPentry *entry)
+{
+    PHYSFS_uint64 retval = entry->offset;
+    if (entry->flags & ZIP_ENTRY_WIDE)
+        retval |= ((PHYSFS_uint64) ((const ZIPentry64 *) entry)->offset_hi) << 32;
+    return retval;
+} /* zip_entry_offset */
+
+static inline PHYSFS_uint64 zip_entry_compressed_size(const ZIPentry *entry)
+{
+    PHYSFS_uint64 retval = entry->compressed_size;
+    if (entry->flags & ZIP_ENTRY_WIDE)
+    {
+        const ZIPentry64 *entry64 = (const ZIPentry64 *) entry;
+        retval |= ((PHYSFS_uint64) entry64->compressed_size_hi) << 32;
+    } /* if */
+    return retval;
+} /* zip_entry_compressed_size */
+
+static inline PHYSFS_uint64 zip_entry_uncompressed_size(const ZIPentry *entry)
+{
+    PHYSFS_uint64 retval = entry->uncompressed_size;
+    if (entry->flags & ZIP_ENTRY_WIDE)
+    {
+        const ZIPentry64 *entry64 = (const ZIPentry64 *) entry;
+        retval |= ((PHYSFS_uint64) entry64->uncompressed_size_hi) << 32;
+    } /* if */
+    return retval;
+} /* zip_entry_uncompressed_size */
+
+/* Returns zero if the values don't fit in a narrow entry. */
+static int zip_entry_set_location(ZIPentry *entry, const PHYSFS_uint64 offset,
+                                  const PHYSFS_uint64 compressed_size,
+                                  const PHYSFS_uint64 uncompressed_size)
+{
+    entry->offset = (PHYSFS_uint32) offset;
+    entry->compressed_size = (PHYSFS_uint32) compressed_size;
+    entry->uncompressed_size = (PHYSFS_uint32) uncompressed_size;
+
+    if (entry->flags & ZIP_ENTRY_WIDE)
+    {
+        ZIPentry64 *entry64 = (ZIPentry64 *) entry;
+        entry64->offset_hi = (PHYSFS_uint32) (offset >> 32);
+        entry64->compressed_size_hi = (PHYSFS_uint32) (compressed_size >> 32);
+        entry64->uncompressed_size_hi = (PHYSFS_uint32) (uncompressed_size >> 32);
+        return 1;
+    } /* if */
+
+    return ((offset | compressed_size | uncompressed_size) <= 0xFFFFFFFF);
+} /* zip_entry_set_location */
+
+/*
+ * With PHYSFS_setLazyMounting(), archives are mounted "lazily": every
+ *  directory goes into the DirTree up front, but files just get a
+ *  ZIPlazyfile, which is a hash of the path and the offset of the file's
+ *  central directory record. A file gets a real ZIPentry the first time
+ *  someone looks it up, or when its parent directory is enumerated. The
+ *  files in each directory aren't chained together until the first
+ *  enumeration, either.
+ */
+typedef struct
+{
+    PHYSFS_uint32 hash;      /* __PHYSFS_hashString() of the full path.   */
+    PHYSFS_uint32 cdofs;     /* record's offset from start of central dir. */
+    PHYSFS_uint32 parent;    /* parent's dir id, plus ZIP_LAZY_LOADED bit. */
+    PHYSFS_uint32 next;      /* 1+index of next file in the same dir.     */
+} ZIPlazyfile;
+
+#define ZIP_LAZY_LOADED 0x80000000
+
+/* Identifies a specific version of an archive for the on-disk caches. */
+typedef struct
+{
+    PHYSFS_uint64 arclen;      /* size of the archive in bytes.     */
+    PHYSFS_sint64 modtime;     /* archive's modtime in the native fs. */
+    PHYSFS_uint32 tailcrc;     /* CRC-32 of the end of the archive. */
+} ZIPindexkey;
+
+/*
+ * An archive mounted from the index cache looks up its files right in the
+ *  index file, which we map if we can (see zip_index_load()).
+ */
+typedef struct
+{
+    PHYSFS_Io *io;                 /* mapped index file, or NULL if...    */
+    PHYSFS_uint8 *buf;             /* ...we had to read it in here.       */
+    const PHYSFS_uint8 *dirs;      /* directory records.                  */
+    const PHYSFS_uint8 *files;     /* file records, grouped by directory. */
+    const PHYSFS_uint8 *buckets;   /* file hash, like ZIPinfo::lazybuckets. */
+    const PHYSFS_uint8 *names;     /* every name, unterminated.           */
+    PHYSFS_uint32 dircount;        /* number of directory records.        */
+    PHYSFS_uint32 nameslen;        /* bytes at names.                     */
+    PHYSFS_uint8 *loaded;          /* bit per file: in the DirTree yet?   */
+} ZIPindex;
+
+/*
+ * Seek index for compressed entries.
+ *
+ * While a compressed entry is being decoded, we make a checkpoint at the
+ *  first deflate block boundary every PHYSFS_ZIP_SEEK_SPACING bytes of
+ *  output. Nothing from earlier blocks is needed there but the last 32k of
+ *  output, so a checkpoint is just that window and the bit offset of the
+ *  next block, and a seek primes a fresh decoder with them. That costs at
+ *  most the spacing (plus a block) of decoding instead of everything from
+ *  the start of the file. Checkpoints are shared by every handle open on
+ *  the same entry, and they're written to the index cache (see
+ *  PHYSFS_setIndexCacheDir()) on unmount, so the next run can seek quickly
+ *  right away.
+ *
+ * Each checkpoint is a little over 32k, so the default spacing costs about
+ *  1.6% of the uncompressed size of entries that actually get read. Set it
+ *  to 0 at build time to disable this.
+ */
+#ifndef PHYSFS_ZIP_SEEK_SPACING
+#define PHYSFS_ZIP_SEEK_SPACING (2 * 1024 * 1024)
+#endif
+
+#define ZIP_CHECKPOINT_WINDOW 32768
+
+/* A checkpoint has less than a full window near the start of the file. */
+#define ZIP_CHECKPOINT_WINDOWLEN(pos) \
+    ((mz_uint) (((pos) < ZIP_CHECKPOINT_WINDOW) ? (pos) : \
+                ZIP_CHECKPOINT_WINDOW))
+
+typedef struct
+{
+    PHYSFS_uint64 uncompressed_position;  /* output offset of this point.   */
+    PHYSFS_uint64 bit_position;           /* where its block starts.        */
+    PHYSFS_uint8 window[ZIP_CHECKPOINT_WINDOW];  /* output right before it. */
+} ZIPcheckpoint;
+
+typedef struct ZIPseekindex
+{
+    const ZIPentry *entry;          /* entry these checkpoints belong to.  */
+    ZIPcheckpoint **points;         /* sorted by uncompressed_position.    */
+    PHYSFS_uint32 count;            /* number of items in points.          */
+    PHYSFS_uint32 allocated;        /* number of slots allocated in points. */
+    PHYSFS_uint32 saved;            /* how many are already on disk.       */
+    void *lock;                     /* the archive's seeklock.             */
+    struct ZIPseekindex *next;      /* next index in this archive.         */
+} ZIPseekindex;
+
 /*
  * One ZIPinfo is kept for each open ZIP archive.
  */
@@ -81,21 +324,65 @@ typedef struct
     PHYSFS_Io *io;            /* the i/o interface for this archive.    */
     int zip64;                /* non-zero if this is a Zip64 archive.   */
     int has_crypto;           /* non-zero if any entry uses encryption. */
+    int wide;                 /* non-zero if entries are ZIPentry64.    */
+    int needs_wide;           /* non-zero if a narrow entry overflowed. */
+    ZIPlazyfile *lazyfiles;   /* NULL unless mounted lazily.            */
+    PHYSFS_uint32 lazyfilecount;  /* number of items in lazyfiles.      */
+    PHYSFS_uint32 *lazybuckets;   /* 1+index into lazyfiles, 0 if free.  */
+    PHYSFS_uint32 lazymask;       /* number of lazybuckets, minus one.   */
+    PHYSFS_uint32 *lazyfirst;     /* 1+index of first file, per dir id.  */
+    PHYSFS_uint32 lazydircount;   /* dir ids handed out so far.          */
+    PHYSFS_uint64 lazycentral;    /* offset of the central directory.    */
+    PHYSFS_uint64 lazydataofs;    /* (ofs_fixup) for zip_load_entry().   */
+    ZIPindex *index;              /* NULL unless mounted from the cache. */
+    ZIPseekindex *seekindexes;    /* entries we've built seek indexes for. */
+    void *seeklock;               /* guards every seek index's points.   */
+    char *arcname;                /* NULL unless we have an index key.   */
+    ZIPindexkey key;              /* valid if arcname isn't NULL.        */
+    struct ZIPfileinfo *pool;     /* closed handles, ready to reuse.     */
+    PHYSFS_uint32 poolcount;      /* number of items in pool.            */
+    void *poollock;               /* guards pool and poolcount.          */
+#if PHYSFS_ZIP_AES
+    struct ZIPaespassword *aespasswords;  /* PBKDF2 cache, see there.    */
+#endif
+#if PHYSFS_ZIP_ZSTD
+    ZSTD_DDict *zstddict;         /* for zstd entries, NULL if none.     */
+    ZIPzstddict *oldzstddicts;    /* replaced, but maybe still in use.   */
+#endif
 } ZIPinfo;
 
 /*
  * One ZIPfileinfo is kept for each open file in a ZIP archive.
  */
-typedef struct
+typedef struct ZIPfileinfo
 {
+    PHYSFS_Io iface;                      /* what we hand to the app.   */
+    ZIPinfo *info;                        /* archive we came from.      */
+    struct ZIPfileinfo *nextfree;         /* next in info->pool.        */
     ZIPentry *entry;                      /* Info on file.              */
     PHYSFS_Io *io;                        /* physical file handle.      */
-    PHYSFS_uint32 compressed_position;    /* offset in compressed data. */
-    PHYSFS_uint32 uncompressed_position;  /* tell() position.           */
+    PHYSFS_uint64 compressed_position;    /* offset in compressed data. */
+    PHYSFS_uint64 uncompressed_position;  /* tell() position.           */
     PHYSFS_uint8 *buffer;                 /* decompression buffer.      */
     PHYSFS_uint32 crypto_keys[3];         /* for "traditional" crypto.  */
     PHYSFS_uint32 initial_crypto_keys[3]; /* for "traditional" crypto.  */
     z_stream stream;                      /* zlib stream state.         */
+    ZIPseekindex *seekindex;              /* NULL if not checkpointing. */
+    PHYSFS_uint64 nextcheckpoint;         /* check seekindex from here. */
+#if PHYSFS_ZIP_LZMA
+    struct ZIPlzma *lzma;                 /* NULL until we decode LZMA. */
+#endif
+#if PHYSFS_ZIP_ZSTD
+    ZSTD_DCtx *zstd;                      /* NULL until we decode zstd. */
+    ZSTD_inBuffer zstdin;                 /* compressed data in buffer. */
+    const ZSTD_DDict *zstddict;           /* info's dict when opened.   */
+#endif
+#if PHYSFS_ZIP_AES
+    struct ZIPaes *aes;                   /* NULL unless WinZip AES.    */
+#endif
+    PHYSFS_uint32 crc;                    /* CRC-32 of bytes read so far. */
+    PHYSFS_uint64 crcpos;                 /* bytes covered by (crc).    */
+    int verify;                           /* 1 to check crc, -1 failed. */
 } ZIPfileinfo;
 
 
@@ -106,11 +393,43 @@ typedef struct
 #define ZIP64_END_OF_CENTRAL_DIR_SIG                0x06064b50
 #define ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIG  0x07064b50
 #define ZIP64_EXTENDED_INFO_EXTRA_FIELD_SIG         0x0001
+#define ZIP_AES_EXTRA_FIELD_SIG                     0x9901
+
+/* bytes in a local file header, before the filename and extra field. */
+#define ZIP_LOCAL_HEADER_LEN 30
+/* ...and in a central directory record, before those and the comment. */
+#define ZIP_CENTRAL_DIR_RECORD_LEN 46
 
 /* compression methods... */
 #define COMPMETH_NONE 0
+#define COMPMETH_DEFLATE 8
+#define COMPMETH_LZMA 14
+#define COMPMETH_ZSTD 93
+#define COMPMETH_AES 99  /* WinZip AES; the real method is in the extra field. */
 /* ...and others... */
 
+/*
+ * A pooled handle keeps its decoder, but not if the decoder is holding on
+ *  to more memory than this (a big LZMA dictionary or zstd window); those
+ *  would leave a lot of memory sitting in the pool.
+ */
+#define ZIP_POOL_MAX_DECODER (1024 * 1024)
+
+#if PHYSFS_ZIP_LZMA
+/*
+ * LZMA decoder for an open file. Its compressed data starts with a 4-byte
+ *  header (the SDK version that wrote it, and the size of the properties
+ *  that follow) and the 5 bytes of LZMA properties, then the raw stream.
+ *  Input is read into the ZIPfileinfo's buffer like deflate's is.
+ */
+typedef struct ZIPlzma
+{
+    CLzmaDec dec;            /* the SDK's decoder state and dictionary. */
+    PHYSFS_uint32 bufpos;    /* next unused byte in the file's buffer. */
+    PHYSFS_uint32 buflen;    /* bytes of compressed data in the buffer. */
+} ZIPlzma;
+#endif
+
 
 #define UNIX_FILETYPE_MASK    0170000
 #define UNIX_FILETYPE_SYMLINK 0120000
@@ -118,12 +437,72 @@ typedef struct
 #define ZIP_GENERAL_BITS_TRADITIONAL_CRYPTO   (1 << 0)
 #define ZIP_GENERAL_BITS_IGNORE_LOCAL_HEADER  (1 << 3)
 
+/*
+ * WinZip AES entries set the same general purpose bit as "traditional"
+ *  encryption, but use compression method 99, with the real method in an
+ *  extra field. zip_parse_local() reads that into entry->aes and puts the
+ *  real method in entry->compression_method.
+ */
+#define ZIP_AES_STRENGTH_MASK  0x03  /* 1, 2, 3: AES-128, -192, -256.  */
+#define ZIP_AES_NO_CRC         0x04  /* AE-2: the crc field is unused. */
+#define ZIP_AES_MACLEN         10    /* HMAC-SHA1 after the data.      */
+
+static int zip_entry_is_encrypted(const ZIPentry *entry)
+{
+    return (entry->general_bits & ZIP_GENERAL_BITS_TRADITIONAL_CRYPTO) != 0;
+} /* zip_entry_is_encrypted */
+
 /* support for "traditional" PKWARE encryption. */
 static int zip_entry_is_tradional_crypto(const ZIPentry *entry)
 {
-    return (entry->general_bits & ZIP_GENERAL_BITS_TRADITIONAL_CRYPTO) != 0;
+    return zip_entry_is_encrypted(entry) && (entry->aes == 0) &&
+           (entry->compression_method != COMPMETH_AES);
 } /* zip_entry_is_traditional_crypto */
 
+static PHYSFS_uint32 zip_aes_keylen(const ZIPentry *entry)
+{
+    return 8 + (8 * (entry->aes & ZIP_AES_STRENGTH_MASK));
+} /* zip_aes_keylen */
+
+/* Bytes of encryption header in front of an entry's (compressed) data. */
+static PHYSFS_uint32 zip_entry_crypto_header_len(const ZIPentry *entry)
+{
+    if (entry->aes)
+        return (zip_aes_keylen(entry) / 2) + 2;  /* salt, password check. */
+    else if (zip_entry_is_tradional_crypto(entry))
+        return 12;
+    return 0;
+} /* zip_entry_crypto_header_len */
+
+/* Size of an entry's (compressed) data, not counting encryption overhead. */
+static PHYSFS_uint64 zip_entry_data_size(const ZIPentry *entry)
+{
+    const PHYSFS_uint64 complen = zip_entry_compressed_size(entry);
+    PHYSFS_uint64 overhead = zip_entry_crypto_header_len(entry);
+    if (entry->aes)
+        overhead += ZIP_AES_MACLEN;
+    return (complen < overhead) ? 0 : (complen - overhead);
+} /* zip_entry_data_size */
+
+/* compression methods ZIP_read() knows how to decode. */
+static int zip_compression_supported(const ZIPentry *entry)
+{
+    switch (entry->compression_method)
+    {
+        case COMPMETH_NONE:
+        case COMPMETH_DEFLATE:
+        #if PHYSFS_ZIP_LZMA
+        case COMPMETH_LZMA:
+        #endif
+        #if PHYSFS_ZIP_ZSTD
+        case COMPMETH_ZSTD:
+        #endif
+            return 1;
+    } /* switch */
+
+    return 0;
+} /* zip_compression_supported */
+
 static int zip_entry_ignore_local_header(const ZIPentry *entry)
 {
     return (entry->general_bits & ZIP_GENERAL_BITS_IGNORE_LOCAL_HEADER) != 0;
@@ -152,6 +531,511 @@ static PHYSFS_uint8 zip_decrypt_byte(const PHYSFS_uint32 *keys)
     return (PHYSFS_uint8) ((tmp * (tmp ^ 1)) >> 8);
 } /* zip_decrypt_byte */
 
+#if PHYSFS_ZIP_AES
+/*
+ * WinZip AES (AE-1 and AE-2).
+ *
+ * The entry's data starts with a salt (half the key length) and a 2-byte
+ *  password check, and ends with the first ZIP_AES_MACLEN bytes of an
+ *  HMAC-SHA1 of the ciphertext. PBKDF2-HMAC-SHA1 over the password and salt
+ *  gives the AES key, the HMAC key and the password check, in that order.
+ *  The data is AES in CTR mode, with a little-endian block counter that
+ *  starts at 1. Since any block can be decrypted on its own, stored entries
+ *  can still seek directly.
+ *
+ * The AES comes from the LZMA SDK, which uses AES-NI on CPUs that have it.
+ *  We check the HMAC when verifying checksums (it's the only check an AE-2
+ *  entry has), for the same reasons we don't always check the CRC.
+ */
+#define ZIP_AES_ITERATIONS   1000
+#define ZIP_AES_MAX_KEYLEN   32
+#define ZIP_AES_KEYSTREAM    (4 * 1024)  /* keystream made per AES call. */
+#define ZIP_AES_KEYCACHE     64  /* derived keys kept per password.      */
+#define ZIP_AES_PASSWORDS    4   /* passwords kept per archive.          */
+
+typedef struct
+{
+    PHYSFS_uint32 h[5];
+    PHYSFS_uint64 len;         /* bytes hashed so far. */
+    PHYSFS_uint8 buf[64];      /* the unfinished block. */
+} ZIPsha1;
+
+/* HMAC-SHA1 state with the key already hashed in. */
+typedef struct
+{
+    ZIPsha1 inner;
+    ZIPsha1 outer;
+} ZIPhmac;
+
+/* Per-file state; the UInt32 arrays are aligned by zip_aes_align(). */
+typedef struct ZIPaes
+{
+    UInt32 ctx[AES_NUM_IVMRK_WORDS + 3];  /* counter, then key schedule. */
+    UInt32 keystream[(ZIP_AES_KEYSTREAM / 4) + 3];
+    PHYSFS_uint64 kspos;     /* data offset of the keystream's first byte. */
+    PHYSFS_uint32 kslen;     /* bytes of keystream made, 0 if none yet.   */
+    PHYSFS_uint64 pos;       /* data offset of the next byte to decrypt.  */
+    ZIPhmac hmac;            /* keyed with this entry's HMAC key.         */
+    ZIPsha1 mac;             /* inner hash of the ciphertext so far.      */
+    PHYSFS_uint64 macpos;    /* bytes of ciphertext in (mac).             */
+} ZIPaes;
+
+/*
+ * PBKDF2 makes every file open cost a couple thousand SHA-1 blocks, so each
+ *  archive keeps the HMAC state for the last few passwords, and the keys
+ *  derived from them for recent salts. Salts are random per file, so the
+ *  key cache helps files that get opened more than once, and the password's
+ *  HMAC state (plus doing PBKDF2's rounds straight on the compression
+ *  function) cuts the work for the rest in half. This is only touched
+ *  from ZIP_openRead(), under the stateLock.
+ */
+typedef struct
+{
+    PHYSFS_uint8 aes;        /* entry->aes it's for, 0 if the slot is empty. */
+    PHYSFS_uint8 salt[ZIP_AES_MAX_KEYLEN / 2];
+    PHYSFS_uint8 keys[(ZIP_AES_MAX_KEYLEN * 2) + 2];  /* PBKDF2's output. */
+} ZIPaeskey;
+
+typedef struct ZIPaespassword
+{
+    char *password;
+    ZIPhmac hmac;            /* keyed with the password. */
+    ZIPaeskey keys[ZIP_AES_KEYCACHE];
+    struct ZIPaespassword *next;
+} ZIPaespassword;
+
+
+static UInt32 *zip_aes_align(UInt32 *ptr)
+{
+    return ptr + ((0 - (((size_t) ptr) >> 2)) & 3);  /* Aes.c wants 16. */
+} /* zip_aes_align */
+
+
+static void zip_sha1_block(PHYSFS_uint32 *h, const PHYSFS_uint8 *p)
+{
+    PHYSFS_uint32 w[16];
+    PHYSFS_uint32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    int i;
+
+    for (i = 0; i < 16; i++, p += 4)
+    {
+        w[i] = (((PHYSFS_uint32) p[0]) << 24) | (((PHYSFS_uint32) p[1]) << 16) |
+               (((PHYSFS_uint32) p[2]) << 8) | ((PHYSFS_uint32) p[3]);
+    } /* for */
+
+    /* the message schedule only ever looks back 16 words, so it rolls. */
+    #define ZIP_SHA1_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+    #define ZIP_SHA1_W(i) (w[(i) & 15] = ZIP_SHA1_ROL(w[((i) + 13) & 15] ^ \
+                w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+    #define ZIP_SHA1_R(v, w, x, y, z, f, k, wi) \
+        z += ZIP_SHA1_ROL(v, 5) + (f) + (k) + (wi); w = ZIP_SHA1_ROL(w, 30);
+    #define ZIP_SHA1_F1(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+    #define ZIP_SHA1_F2(x, y, z) ((x) ^ (y) ^ (z))
+    #define ZIP_SHA1_F3(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+    #define ZIP_SHA1_5(i, f, k, wi) \
+        ZIP_SHA1_R(a, b, c, d, e, f(b, c, d), k, wi(i)) \
+        ZIP_SHA1_R(e, a, b, c, d, f(a, b, c), k, wi((i) + 1)) \
+        ZIP_SHA1_R(d, e, a, b, c, f(e, a, b), k, wi((i) + 2)) \
+        ZIP_SHA1_R(c, d, e, a, b, f(d, e, a), k, wi((i) + 3)) \
+        ZIP_SHA1_R(b, c, d, e, a, f(c, d, e), k, wi((i) + 4))
+    #define ZIP_SHA1_W0(i) w[i]
+
+    ZIP_SHA1_5(0, ZIP_SHA1_F1, 0x5A827999, ZIP_SHA1_W0)
+    ZIP_SHA1_5(5, ZIP_SHA1_F1, 0x5A827999, ZIP_SHA1_W0)
+    ZIP_SHA1_5(10, ZIP_SHA1_F1, 0x5A827999, ZIP_SHA1_W0)
+    ZIP_SHA1_R(a, b, c, d, e, ZIP_SHA1_F1(b, c, d), 0x5A827999, w[15])
+    ZIP_SHA1_R(e, a, b, c, d, ZIP_SHA1_F1(a, b, c), 0x5A827999, ZIP_SHA1_W(16))
+    ZIP_SHA1_R(d, e, a, b, c, ZIP_SHA1_F1(e, a, b), 0x5A827999, ZIP_SHA1_W(17))
+    ZIP_SHA1_R(c, d, e, a, b, ZIP_SHA1_F1(d, e, a), 0x5A827999, ZIP_SHA1_W(18))
+    ZIP_SHA1_R(b, c, d, e, a, ZIP_SHA1_F1(c, d, e), 0x5A827999, ZIP_SHA1_W(19))
+    for (i = 20; i < 40; i += 5) { ZIP_SHA1_5(i, ZIP_SHA1_F2, 0x6ED9EBA1, ZIP_SHA1_W) }
+    for (; i < 60; i += 5) { ZIP_SHA1_5(i, ZIP_SHA1_F3, 0x8F1BBCDC, ZIP_SHA1_W) }
+    for (; i < 80; i += 5) { ZIP_SHA1_5(i, ZIP_SHA1_F2, 0xCA62C1D6, ZIP_SHA1_W) }
+
+    #undef ZIP_SHA1_W0
+    #undef ZIP_SHA1_5
+    #undef ZIP_SHA1_F3
+    #undef ZIP_SHA1_F2
+    #undef ZIP_SHA1_F1
+    #undef ZIP_SHA1_R
+    #undef ZIP_SHA1_W
+    #undef ZIP_SHA1_ROL
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+} /* zip_sha1_block */
+
+
+static void zip_sha1_init(ZIPsha1 *ctx)
+{
+    ctx->h[0] = 0x67452301;
+    ctx->h[1] = 0xEFCDAB89;
+    ctx->h[2] = 0x98BADCFE;
+    ctx->h[3] = 0x10325476;
+    ctx->h[4] = 0xC3D2E1F0;
+    ctx->len = 0;
+} /* zip_sha1_init */
+
+
+static void zip_sha1_update(ZIPsha1 *ctx, const void *_data, size_t len)
+{
+    const PHYSFS_uint8 *data = (const PHYSFS_uint8 *) _data;
+    size_t used = (size_t) (ctx->len & 63);
+
+    ctx->len += len;
+
+    if (used != 0)
+    {
+        const size_t cpy = ((64 - used) < len) ? (64 - used) : len;
+        memcpy(ctx->buf + used, data, cpy);
+        data += cpy;
+        len -= cpy;
+        if (used + cpy < 64)
+            return;
+        zip_sha1_block(ctx->h, ctx->buf);
+    } /* if */
+
+    for (; len >= 64; data += 64, len -= 64)
+        zip_sha1_block(ctx->h, data);
+
+    memcpy(ctx->buf, data, len);
+} /* zip_sha1_update */
+
+
+/* store the hash state as a big-endian digest. */
+static void zip_sha1_digest(const PHYSFS_uint32 *h, PHYSFS_uint8 *out)
+{
+    int i;
+    for (i = 0; i < 5; i++, out += 4)
+    {
+        out[0] = (PHYSFS_uint8) (h[i] >> 24);
+        out[1] = (PHYSFS_uint8) (h[i] >> 16);
+        out[2] = (PHYSFS_uint8) (h[i] >> 8);
+        out[3] = (PHYSFS_uint8) h[i];
+    } /* for */
+} /* zip_sha1_digest */
+
+
+static void zip_sha1_final(ZIPsha1 *ctx, PHYSFS_uint8 *out)
+{
+    const PHYSFS_uint64 bits = ctx->len * 8;
+    size_t used = (size_t) (ctx->len & 63);
+    int i;
+
+    ctx->buf[used++] = 0x80;
+    if (used > 56)
+    {
+        memset(ctx->buf + used, '\0', 64 - used);
+        zip_sha1_block(ctx->h, ctx->buf);
+        used = 0;
+    } /* if */
+
+    memset(ctx->buf + used, '\0', 56 - used);
+    for (i = 0; i < 8; i++)
+        ctx->buf[56 + i] = (PHYSFS_uint8) (bits >> (56 - (i * 8)));
+    zip_sha1_block(ctx->h, ctx->buf);
+    zip_sha1_digest(ctx->h, out);
+} /* zip_sha1_final */
+
+
+static void zip_hmac_init(ZIPhmac *hmac, const PHYSFS_uint8 *key, size_t keylen)
+{
+    PHYSFS_uint8 digest[20];
+    PHYSFS_uint8 pad[64];
+    size_t i;
+
+    if (keylen > sizeof (pad))
+    {
+        zip_sha1_init(&hmac->inner);
+        zip_sha1_update(&hmac->inner, key, keylen);
+        zip_sha1_final(&hmac->inner, digest);
+        key = digest;
+        keylen = sizeof (digest);
+    } /* if */
+
+    memset(pad, 0x36, sizeof (pad));
+    for (i = 0; i < keylen; i++)
+        pad[i] ^= key[i];
+    zip_sha1_init(&hmac->inner);
+    zip_sha1_update(&hmac->inner, pad, sizeof (pad));
+
+    memset(pad, 0x5C, sizeof (pad));
+    for (i = 0; i < keylen; i++)
+        pad[i] ^= key[i];
+    zip_sha1_init(&hmac->outer);
+    zip_sha1_update(&hmac->outer, pad, sizeof (pad));
+} /* zip_hmac_init */
+
+
+/* finish (inner), which started as a copy of hmac->inner. */
+static void zip_hmac_final(const ZIPhmac *hmac, ZIPsha1 *inner,
+                           PHYSFS_uint8 *out)
+{
+    ZIPsha1 outer;
+    PHYSFS_uint8 digest[20];
+    zip_sha1_final(inner, digest);
+    memcpy(&outer, &hmac->outer, sizeof (outer));
+    zip_sha1_update(&outer, digest, sizeof (digest));
+    zip_sha1_final(&outer, out);
+} /* zip_hmac_final */
+
+
+/*
+ * PBKDF2-HMAC-SHA1. After the first, each round is an HMAC of a 20-byte
+ *  value; with the password's pads already hashed, that's exactly one
+ *  block each for the inner and outer hash, so we build that block once
+ *  and run the compression function on it directly.
+ */
+static void zip_pbkdf2(const ZIPhmac *hmac, const PHYSFS_uint8 *salt,
+                       const size_t saltlen, PHYSFS_uint8 *out, size_t outlen)
+{
+    PHYSFS_uint32 blocknum;
+
+    for (blocknum = 1; outlen > 0; blocknum++)
+    {
+        PHYSFS_uint8 u[64];  /* one round's value, padded as a SHA-1 block. */
+        PHYSFS_uint8 t[20];
+        PHYSFS_uint8 be[4];
+        PHYSFS_uint32 h[5];
+        ZIPsha1 ctx;
+        size_t i;
+        int round;
+
+        be[0] = (PHYSFS_uint8) (blocknum >> 24);
+        be[1] = (PHYSFS_uint8) (blocknum >> 16);
+        be[2] = (PHYSFS_uint8) (blocknum >> 8);
+        be[3] = (PHYSFS_uint8) blocknum;
+        memcpy(&ctx, &hmac->inner, sizeof (ctx));
+        zip_sha1_update(&ctx, salt, saltlen);
+        zip_sha1_update(&ctx, be, sizeof (be));
+        zip_hmac_final(hmac, &ctx, u);
+        memcpy(t, u, sizeof (t));
+
+        /* 20 bytes after a 64-byte pad: 672 bits total. */
+        memset(u + 20, '\0', sizeof (u) - 20);
+        u[20] = 0x80;
+        u[62] = (PHYSFS_uint8) (672 >> 8);
+        u[63] = (PHYSFS_uint8) (672 & 0xFF);
+
+        for (round = 1; round < ZIP_AES_ITERATIONS; round++)
+        {
+            memcpy(h, hmac->inner.h, sizeof (h));
+            zip_sha1_block(h, u);
+            zip_sha1_digest(h, u);
+            memcpy(h, hmac->outer.h, sizeof (h));
+            zip_sha1_block(h, u);
+            zip_sha1_digest(h, u);
+            for (i = 0; i < sizeof (t); i++)
+                t[i] ^= u[i];
+        } /* for */
+
+        i = (outlen < sizeof (t)) ? outlen : sizeof (t);
+        memcpy(out, t, i);
+        out += i;
+        outlen -= i;
+    } /* for */
+} /* zip_pbkdf2 */
+
+
+/* Get PBKDF2's output for this password and salt, from the cache if we can. */
+static const PHYSFS_uint8 *zip_aes_derive(ZIPinfo *info, const ZIPentry *entry,
+                                          const char *password,
+                                          const PHYSFS_uint8 *salt)
+{
+    const PHYSFS_uint32 keylen = zip_aes_keylen(entry);
+    const PHYSFS_uint32 saltlen = keylen / 2;
+    ZIPaespassword *prev = NULL;
+    ZIPaespassword *pw;
+    ZIPaeskey *key;
+    int count = 0;
+
+    for (pw = info->aespasswords; pw != NULL; prev = pw, pw = pw->next)
+    {
+        if (strcmp(pw->password, password) == 0)
+            break;
+        count++;
+    } /* for */
+
+    if (pw != NULL)  /* move it to the front. */
+    {
+        if (prev != NULL)
+        {
+            prev->next = pw->next;
+            pw->next = info->aespasswords;
+            info->aespasswords = pw;
+        } /* if */
+    } /* if */
+    else
+    {
+        const size_t len = strlen(password);
+
+        if (count >= ZIP_AES_PASSWORDS)  /* forget the oldest. */
+        {
+            for (prev = info->aespasswords; prev->next->next; prev = prev->next) {}
+            pw = prev->next;
+            prev->next = NULL;
+            allocator.Free(pw->password);
+        } /* if */
+        else
+        {
+            pw = (ZIPaespassword *) allocator.Malloc(sizeof (ZIPaespassword));
+            BAIL_IF(!pw, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        } /* else */
+
+        memset(pw, '\0', sizeof (*pw));
+        pw->password = (char *) allocator.Malloc(len + 1);
+        if (!pw->password)
+        {
+            allocator.Free(pw);
+            BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        } /* if */
+        memcpy(pw->password, password, len + 1);
+        zip_hmac_init(&pw->hmac, (const PHYSFS_uint8 *) password, len);
+        pw->next = info->aespasswords;
+        info->aespasswords = pw;
+    } /* else */
+
+    /* salts are random, so any few bytes of one make a fine hash. */
+    key = &pw->keys[(salt[0] | (salt[1] << 8)) % ZIP_AES_KEYCACHE];
+    if ((key->aes != entry->aes) || (memcmp(key->salt, salt, saltlen) != 0))
+    {
+        zip_pbkdf2(&pw->hmac, salt, saltlen, key->keys, (keylen * 2) + 2);
+        memcpy(key->salt, salt, saltlen);
+        key->aes = entry->aes;
+    } /* if */
+
+    return key->keys;
+} /* zip_aes_derive */
+
+
+static void zip_aes_free_passwords(ZIPinfo *info)
+{
+    while (info->aespasswords != NULL)
+    {
+        ZIPaespassword *pw = info->aespasswords;
+        info->aespasswords = pw->next;
+        memset(pw->password, '\0', strlen(pw->password));
+        allocator.Free(pw->password);
+        memset(pw, '\0', sizeof (*pw));
+        allocator.Free(pw);
+    } /* while */
+} /* zip_aes_free_passwords */
+
+
+/* back to the start of the data, as when the file was opened. */
+static void zip_aes_restart(ZIPaes *aes)
+{
+    aes->pos = 0;
+    aes->macpos = 0;
+    memcpy(&aes->mac, &aes->hmac.inner, sizeof (aes->mac));
+} /* zip_aes_restart */
+
+
+/*
+ * Read the salt and password check, and set up (finfo->aes) for the entry.
+ *  (finfo->io) has to be at the start of the entry's data; this leaves it
+ *  at the start of the ciphertext.
+ */
+static int zip_aes_prep(ZIPinfo *info, ZIPfileinfo *finfo,
+                        const char *password)
+{
+    const ZIPentry *entry = finfo->entry;
+    const PHYSFS_uint32 keylen = zip_aes_keylen(entry);
+    const PHYSFS_uint32 hdrlen = zip_entry_crypto_header_len(entry);
+    PHYSFS_uint8 header[(ZIP_AES_MAX_KEYLEN / 2) + 2];
+    const PHYSFS_uint8 *keys;
+    ZIPaes *aes = finfo->aes;
+
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(finfo->io, header, hdrlen), 0);
+    keys = zip_aes_derive(info, entry, password, header);
+    BAIL_IF_ERRPASS(!keys, 0);
+
+    /* this one's 2 bytes, so 1 in 65536 wrong passwords get past it. */
+    BAIL_IF(memcmp(keys + (keylen * 2), header + (hdrlen - 2), 2) != 0,
+            PHYSFS_ERR_BAD_PASSWORD, 0);
+
+    Aes_SetKey_Enc(zip_aes_align(aes->ctx) + 4, keys, keylen);
+    zip_hmac_init(&aes->hmac, keys + keylen, keylen);
+    aes->kslen = 0;
+    zip_aes_restart(aes);
+    return 1;
+} /* zip_aes_prep */
+
+
+static int zip_aes_check_mac(ZIPfileinfo *finfo)
+{
+    ZIPaes *aes = finfo->aes;
+    PHYSFS_uint8 stored[ZIP_AES_MACLEN];
+    PHYSFS_uint8 mac[20];
+
+    /* we just read the last of the ciphertext, so the MAC is up next. */
+    zip_hmac_final(&aes->hmac, &aes->mac, mac);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(finfo->io, stored, sizeof (stored)), 0);
+    if (memcmp(mac, stored, sizeof (stored)) != 0)
+    {
+        finfo->verify = -1;
+        BAIL(PHYSFS_ERR_CORRUPT, 0);
+    } /* if */
+
+    return 1;
+} /* zip_aes_check_mac */
+
+
+/* Decrypt (len) bytes just read from the entry's data at aes->pos. */
+static int zip_aes_decrypt(ZIPfileinfo *finfo, PHYSFS_uint8 *buf,
+                           const PHYSFS_uint64 len)
+{
+    ZIPaes *aes = finfo->aes;
+    const PHYSFS_uint64 pos = aes->pos;
+    PHYSFS_uint8 *ks = (PHYSFS_uint8 *) zip_aes_align(aes->keystream);
+    PHYSFS_uint64 i = 0;
+
+    /* like zip_verify_read(): only bytes we haven't hashed yet. */
+    if ((finfo->verify > 0) && (aes->macpos >= pos) && (aes->macpos < pos + len))
+    {
+        const size_t skip = (size_t) (aes->macpos - pos);
+        zip_sha1_update(&aes->mac, buf + skip, (size_t) (len - skip));
+        aes->macpos = pos + len;
+        if (aes->macpos == zip_entry_data_size(finfo->entry))
+            BAIL_IF_ERRPASS(!zip_aes_check_mac(finfo), 0);
+    } /* if */
+
+    while (i < len)
+    {
+        const PHYSFS_uint64 at = pos + i;
+        PHYSFS_uint32 ksofs;
+        PHYSFS_uint64 avail;
+        PHYSFS_uint64 j;
+
+        if ((at < aes->kspos) || (at >= aes->kspos + aes->kslen))
+        {
+            /* CTR_Code bumps the counter before each block, so block 0
+               (counter 1) starts from a counter of 0. */
+            UInt32 *ctr = zip_aes_align(aes->ctx);
+            const PHYSFS_uint64 block = at / 16;
+            ctr[0] = (UInt32) block;
+            ctr[1] = (UInt32) (block >> 32);
+            ctr[2] = ctr[3] = 0;
+            memset(ks, '\0', ZIP_AES_KEYSTREAM);
+            g_AesCtr_Code(ctr, ks, ZIP_AES_KEYSTREAM / 16);
+            aes->kspos = block * 16;
+            aes->kslen = ZIP_AES_KEYSTREAM;
+        } /* if */
+
+        ksofs = (PHYSFS_uint32) (at - aes->kspos);
+        avail = aes->kslen - ksofs;
+        if (avail > len - i)
+            avail = len - i;
+
+        for (j = 0; j < avail; j++)
+            buf[i + j] ^= ks[ksofs + j];
+        i += avail;
+    } /* while */
+
+    aes->pos = pos + len;
+    return 1;
+} /* zip_aes_decrypt */
+#endif
+
 static PHYSFS_sint64 zip_read_decrypt(ZIPfileinfo *finfo, void *buf, PHYSFS_uint64 len)
 {
     PHYSFS_Io *io = finfo->io;
@@ -170,6 +1054,13 @@ static PHYSFS_sint64 zip_read_decrypt(ZIPfileinfo *finfo, void *buf, PHYSFS_uint
             *ptr = ch;
         } /* for */
     } /* if  */
+    #if PHYSFS_ZIP_AES
+    else if ((finfo->entry->aes) && (br > 0))
+    {
+        BAIL_IF_ERRPASS(!zip_aes_decrypt(finfo, (PHYSFS_uint8 *) buf,
+                                         (PHYSFS_uint64) br), -1);
+    } /* else if */
+    #endif
 
     return br;
 } /* zip_read_decrypt */
@@ -230,21 +1121,77 @@ static void zlibPhysfsFree(voidpf opaque, voidpf address)
 } /* zlibPhysfsFree */
 
 
+#if PHYSFS_ZIP_LZMA
 /*
- * Construct a new z_stream to a sane state.
+ * Bridge LZMA SDK allocation to PhysicsFS's allocator.
  */
-static void initializeZStream(z_stream *pstr)
+static void *lzmaPhysfsAlloc(ISzAllocPtr p, size_t size)
 {
-    memset(pstr, '\0', sizeof (z_stream));
-    pstr->zalloc = zlibPhysfsAlloc;
-    pstr->zfree = zlibPhysfsFree;
-    pstr->opaque = &allocator;
-} /* initializeZStream */
+    return allocator.Malloc(size);
+} /* lzmaPhysfsAlloc */
 
 
-static PHYSFS_ErrorCode zlib_error_code(int rc)
+static void lzmaPhysfsFree(ISzAllocPtr p, void *address)
 {
-    switch (rc)
+    if (address != NULL)
+        allocator.Free(address);
+} /* lzmaPhysfsFree */
+
+static const ISzAlloc lzmaPhysfsAllocator = { lzmaPhysfsAlloc, lzmaPhysfsFree };
+#endif
+
+
+#if PHYSFS_ZIP_ZSTD
+/*
+ * Bridge zstd allocation to PhysicsFS's allocator.
+ */
+static void *zstdPhysfsAlloc(void *opaque, size_t size)
+{
+    return allocator.Malloc(size);
+} /* zstdPhysfsAlloc */
+
+
+static void zstdPhysfsFree(void *opaque, void *address)
+{
+    if (address != NULL)
+        allocator.Free(address);
+} /* zstdPhysfsFree */
+
+static const ZSTD_customMem zstdPhysfsMem = { zstdPhysfsAlloc, zstdPhysfsFree, NULL };
+
+
+static PHYSFS_ErrorCode zstd_error_code(const size_t rc)
+{
+    switch (ZSTD_getErrorCode(rc))
+    {
+        case ZSTD_error_memory_allocation: return PHYSFS_ERR_OUT_OF_MEMORY;
+        case ZSTD_error_dictionary_wrong:  /* we don't have its dictionary. */
+        case ZSTD_error_frameParameter_windowTooLarge:
+        case ZSTD_error_frameParameter_unsupported:
+            return PHYSFS_ERR_UNSUPPORTED;
+        default: break;
+    } /* switch */
+
+    return PHYSFS_ERR_CORRUPT;
+} /* zstd_error_code */
+#endif
+
+
+/*
+ * Construct a new z_stream to a sane state.
+ */
+static void initializeZStream(z_stream *pstr)
+{
+    memset(pstr, '\0', sizeof (z_stream));
+    pstr->zalloc = zlibPhysfsAlloc;
+    pstr->zfree = zlibPhysfsFree;
+    pstr->opaque = &allocator;
+} /* initializeZStream */
+
+
+static PHYSFS_ErrorCode zlib_error_code(int rc)
+{
+    switch (rc)
     {
         case Z_OK: return PHYSFS_ERR_OK;  /* not an error. */
         case Z_STREAM_END: return PHYSFS_ERR_OK; /* not an error. */
@@ -299,1147 +1246,4600 @@ static int readui16(PHYSFS_Io *io, PHYSFS_uint16 *val)
 } /* readui16 */
 
 
-static PHYSFS_sint64 ZIP_read(PHYSFS_Io *_io, void *buf, PHYSFS_uint64 len)
+/*
+ * Same as readui64(), readui32() and readui16(), for bytes we've already read.
+ */
+static inline PHYSFS_uint64 peekui64(const PHYSFS_uint8 *ptr)
 {
-    ZIPfileinfo *finfo = (ZIPfileinfo *) _io->opaque;
-    ZIPentry *entry = finfo->entry;
-    PHYSFS_sint64 retval = 0;
-    PHYSFS_sint64 maxread = (PHYSFS_sint64) len;
-    PHYSFS_sint64 avail = entry->uncompressed_size -
-                          finfo->uncompressed_position;
+    PHYSFS_uint64 v;
+    memcpy(&v, ptr, sizeof (v));
+    return PHYSFS_swapULE64(v);
+} /* peekui64 */
 
-    if (avail < maxread)
-        maxread = avail;
+static inline PHYSFS_uint32 peekui32(const PHYSFS_uint8 *ptr)
+{
+    PHYSFS_uint32 v;
+    memcpy(&v, ptr, sizeof (v));
+    return PHYSFS_swapULE32(v);
+} /* peekui32 */
 
-    BAIL_IF_ERRPASS(maxread == 0, 0);    /* quick rejection. */
+static inline PHYSFS_uint16 peekui16(const PHYSFS_uint8 *ptr)
+{
+    PHYSFS_uint16 v;
+    memcpy(&v, ptr, sizeof (v));
+    return PHYSFS_swapULE16(v);
+} /* peekui16 */
 
-    if (entry->compression_method == COMPMETH_NONE)
-        retval = zip_read_decrypt(finfo, buf, maxread);
-    else
+
+/*
+ * CRC-32 (same polynomial as zlib). This is separate from zip_crypto_crc32(),
+ *  which only ever needs to digest a byte at a time.
+ *
+ * This has to keep up with the decompressor when we verify entries, so it
+ *  does eight bytes per step with a set of eight tables ("slice-by-8"), and
+ *  uses the CPU's carry-less multiply (x86 PCLMULQDQ) or CRC-32 (ARMv8)
+ *  instructions when they're available, which is several times faster
+ *  still. ZIP_global_init() builds the tables and checks the CPU.
+ */
+static PHYSFS_uint32 zip_crc32_table[8][256];
+
+#if ZIP_CRC32_CLMUL
+static int zip_crc32_have_clmul = 0;
+
+/*
+ * This folds 64 bytes at a time into four 128-bit accumulators, then folds
+ *  those down and does a Barrett reduction to get the 32-bit CRC; see Intel's
+ *  "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ *  Instruction." (len) must be at least 64 and a multiple of 16, and (crc)
+ *  is the raw (not inverted) register value.
+ */
+ZIP_CRC32_CLMUL_TARGET
+static PHYSFS_uint32 zip_crc32_clmul(PHYSFS_uint32 crc,
+                                     const PHYSFS_uint8 *buf, size_t len)
+{
+    const __m128i k1k2 = _mm_set_epi32(0x00000001, 0xC6E41596, 0x00000001, 0x54442BD4);
+    const __m128i k3k4 = _mm_set_epi32(0x00000000, 0xCCAA009E, 0x00000001, 0x751997D0);
+    const __m128i k5k0 = _mm_set_epi32(0x00000000, 0x00000000, 0x00000001, 0x63CD6124);
+    const __m128i poly = _mm_set_epi32(0x00000001, 0xF7011641, 0x00000001, 0xDB710641);
+    const __m128i mask32 = _mm_set_epi32(0, -1, 0, -1);
+    __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+    buf += 64;
+    len -= 64;
+
+    while (len >= 64)
     {
-        finfo->stream.next_out = buf;
-        finfo->stream.avail_out = (uInt) maxread;
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *) (buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *) (buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *) (buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *) (buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    } /* while */
 
-        while (retval < maxread)
-        {
-            const PHYSFS_uint32 before = (PHYSFS_uint32) finfo->stream.total_out;
-            int rc;
+    /* fold the four accumulators into one... */
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* ...then any remaining 16-byte blocks into that... */
+    while (len >= 16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *) buf)), x5);
+        buf += 16;
+        len -= 16;
+    } /* while */
 
-            if (finfo->stream.avail_in == 0)
-            {
-                PHYSFS_sint64 br;
+    /* ...then 128 bits down to 64... */
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
 
-                br = entry->compressed_size - finfo->compressed_position;
-                if (br > 0)
-                {
-                    if (br > ZIP_READBUFSIZE)
-                        br = ZIP_READBUFSIZE;
+    /* ...and a Barrett reduction down to 32. */
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
 
-                    br = zip_read_decrypt(finfo, finfo->buffer, (PHYSFS_uint64) br);
-                    if (br <= 0)
-                        break;
+    return (PHYSFS_uint32) _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+} /* zip_crc32_clmul */
+#endif
 
-                    finfo->compressed_position += (PHYSFS_uint32) br;
-                    finfo->stream.next_in = finfo->buffer;
-                    finfo->stream.avail_in = (unsigned int) br;
-                } /* if */
-            } /* if */
+static PHYSFS_uint32 zip_crc32(PHYSFS_uint32 crc, const void *_buf, size_t len)
+{
+    const PHYSFS_uint8 *buf = (const PHYSFS_uint8 *) _buf;
 
-            rc = zlib_err(inflate(&finfo->stream, Z_SYNC_FLUSH));
-            retval += (finfo->stream.total_out - before);
+    crc = ~crc;
 
-            if (rc != Z_OK)
-                break;
-        } /* while */
-    } /* else */
+    #if ZIP_CRC32_CLMUL
+    if ((zip_crc32_have_clmul) && (len >= 64))
+    {
+        const size_t blocks = len & ~((size_t) 15);
+        crc = zip_crc32_clmul(crc, buf, blocks);
+        buf += blocks;
+        len -= blocks;
+    } /* if */
+    #elif ZIP_CRC32_ARM
+    while ((len > 0) && (((size_t) buf) & 7))
+    {
+        crc = __crc32b(crc, *(buf++));
+        len--;
+    } /* while */
 
-    if (retval > 0)
-        finfo->uncompressed_position += (PHYSFS_uint32) retval;
+    while (len >= 8)
+    {
+        crc = __crc32d(crc, *((const PHYSFS_uint64 *) buf));
+        buf += 8;
+        len -= 8;
+    } /* while */
+    #endif
 
-    return retval;
-} /* ZIP_read */
+    while (len >= 8)
+    {
+        const PHYSFS_uint32 one = crc ^ ( ((PHYSFS_uint32) buf[0]) |
+                                          (((PHYSFS_uint32) buf[1]) << 8) |
+                                          (((PHYSFS_uint32) buf[2]) << 16) |
+                                          (((PHYSFS_uint32) buf[3]) << 24) );
+        const PHYSFS_uint32 two = ( ((PHYSFS_uint32) buf[4]) |
+                                    (((PHYSFS_uint32) buf[5]) << 8) |
+                                    (((PHYSFS_uint32) buf[6]) << 16) |
+                                    (((PHYSFS_uint32) buf[7]) << 24) );
+        crc = zip_crc32_table[7][one & 0xFF] ^
+              zip_crc32_table[6][(one >> 8) & 0xFF] ^
+              zip_crc32_table[5][(one >> 16) & 0xFF] ^
+              zip_crc32_table[4][one >> 24] ^
+              zip_crc32_table[3][two & 0xFF] ^
+              zip_crc32_table[2][(two >> 8) & 0xFF] ^
+              zip_crc32_table[1][(two >> 16) & 0xFF] ^
+              zip_crc32_table[0][two >> 24];
+        buf += 8;
+        len -= 8;
+    } /* while */
 
+    while (len--)
+        crc = zip_crc32_table[0][(crc ^ *(buf++)) & 0xFF] ^ (crc >> 8);
 
-static PHYSFS_sint64 ZIP_write(PHYSFS_Io *io, const void *b, PHYSFS_uint64 len)
-{
-    BAIL(PHYSFS_ERR_READ_ONLY, -1);
-} /* ZIP_write */
+    return ~crc;
+} /* zip_crc32 */
 
 
-static PHYSFS_sint64 ZIP_tell(PHYSFS_Io *io)
+PHYSFS_uint32 __PHYSFS_zipCrc32(PHYSFS_uint32 crc, const void *buf, size_t len)
 {
-    return ((ZIPfileinfo *) io->opaque)->uncompressed_position;
-} /* ZIP_tell */
+    return zip_crc32(crc, buf, len);
+} /* __PHYSFS_zipCrc32 */
 
 
-static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
+void ZIP_global_init(void)
 {
-    ZIPfileinfo *finfo = (ZIPfileinfo *) _io->opaque;
-    ZIPentry *entry = finfo->entry;
-    PHYSFS_Io *io = finfo->io;
-    const int encrypted = zip_entry_is_tradional_crypto(entry);
+    /* this just needs to calculate some things, so it only ever
+       has to run once, even after a deinit. */
+    static int generatedTables = 0;
+    PHYSFS_uint32 i, j;
 
-    BAIL_IF(offset > entry->uncompressed_size, PHYSFS_ERR_PAST_EOF, 0);
+    if (generatedTables)
+        return;
 
-    if (!encrypted && (entry->compression_method == COMPMETH_NONE))
+    for (i = 0; i < 256; i++)
     {
-        PHYSFS_sint64 newpos = offset + entry->offset;
-        BAIL_IF_ERRPASS(!io->seek(io, newpos), 0);
-        finfo->uncompressed_position = (PHYSFS_uint32) offset;
-    } /* if */
+        PHYSFS_uint32 val = i;
+        for (j = 0; j < 8; j++)
+            val = ((val & 1) ? (0xEDB88320 ^ (val >> 1)) : (val >> 1));
+        zip_crc32_table[0][i] = val;
+    } /* for */
 
-    else
+    for (i = 0; i < 256; i++)
     {
-        /*
-         * If seeking backwards, we need to redecode the file
-         *  from the start and throw away the compressed bits until we hit
-         *  the offset we need. If seeking forward, we still need to
-         *  decode, but we don't rewind first.
-         */
-        if (offset < finfo->uncompressed_position)
+        for (j = 1; j < 8; j++)
         {
-            /* we do a copy so state is sane if inflateInit2() fails. */
-            z_stream str;
-            initializeZStream(&str);
-            if (zlib_err(inflateInit2(&str, -MAX_WBITS)) != Z_OK)
-                return 0;
+            const PHYSFS_uint32 prev = zip_crc32_table[j-1][i];
+            zip_crc32_table[j][i] = (prev >> 8) ^ zip_crc32_table[0][prev & 0xFF];
+        } /* for */
+    } /* for */
 
-            if (!io->seek(io, entry->offset + (encrypted ? 12 : 0)))
-                return 0;
+    #if PHYSFS_ZIP_AES
+    AesGenTables();  /* this also picks AES-NI if the CPU has it. */
+    #endif
 
-            inflateEnd(&finfo->stream);
-            memcpy(&finfo->stream, &str, sizeof (z_stream));
-            finfo->uncompressed_position = finfo->compressed_position = 0;
+    #if ZIP_CRC32_CLMUL
+    {
+        #ifdef _MSC_VER
+        int regs[4];
+        __cpuid(regs, 1);
+        zip_crc32_have_clmul = ((regs[2] & (1 << 1)) != 0) &&
+                               ((regs[3] & (1 << 26)) != 0);
+        #else
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        {
+            zip_crc32_have_clmul = ((ecx & bit_PCLMUL) != 0) &&
+                                   ((edx & bit_SSE2) != 0);
+        } /* if */
+        #endif
+    }
+    #endif
 
-            if (encrypted)
-                memcpy(finfo->crypto_keys, finfo->initial_crypto_keys, 12);
+    generatedTables = 1;
+} /* ZIP_global_init */
+
+
+/*
+ * Make a checkpoint if we've gone far enough past the last one. Only call
+ *  this where inflate(Z_BLOCK) stopped at the end of a block.
+ */
+static void zip_add_checkpoint(ZIPfileinfo *finfo, const PHYSFS_uint64 pos)
+{
+    ZIPseekindex *idx = finfo->seekindex;
+    PHYSFS_uint64 last = 0;
+
+    __PHYSFS_platformGrabMutex(idx->lock);
+
+    if (idx->count > 0)
+        last = idx->points[idx->count - 1]->uncompressed_position;
+
+    if (pos >= last + PHYSFS_ZIP_SEEK_SPACING)
+    {
+        ZIPcheckpoint *cp = NULL;
+
+        if (idx->count == idx->allocated)
+        {
+            const PHYSFS_uint32 newalloc = idx->allocated ? idx->allocated * 2 : 8;
+            void *ptr = allocator.Realloc(idx->points,
+                                          newalloc * sizeof (ZIPcheckpoint *));
+            if (ptr != NULL)
+            {
+                idx->points = (ZIPcheckpoint **) ptr;
+                idx->allocated = newalloc;
+            } /* if */
         } /* if */
 
-        while (finfo->uncompressed_position != offset)
+        if (idx->count < idx->allocated)
+            cp = (ZIPcheckpoint *) allocator.Malloc(sizeof (ZIPcheckpoint));
+
+        if (cp != NULL)
         {
-            PHYSFS_uint8 buf[512];
-            PHYSFS_uint32 maxread;
+            /* the decoder may have read a few bytes past the boundary. */
+            const PHYSFS_uint64 consumed = finfo->compressed_position -
+                                           finfo->stream.avail_in;
+            mz_uint len = 0;
+            inflateGetDictionary(&finfo->stream, cp->window, &len);
+            if (len != ZIP_CHECKPOINT_WINDOWLEN(pos))
+                allocator.Free(cp);  /* shouldn't happen; skip this one. */
+            else
+            {
+                memset(cp->window + len, '\0', sizeof (cp->window) - len);
+                cp->uncompressed_position = pos;
+                cp->bit_position = (consumed * 8) -
+                                   (finfo->stream.data_type & 127);
+                idx->points[idx->count++] = cp;
+            } /* else */
+        } /* if */
 
-            maxread = (PHYSFS_uint32) (offset - finfo->uncompressed_position);
-            if (maxread > sizeof (buf))
-                maxread = sizeof (buf);
+        last = pos;  /* if we're out of memory, don't retry right away. */
+    } /* if */
 
-            if (ZIP_read(_io, buf, maxread) != maxread)
-                return 0;
-        } /* while */
-    } /* else */
+    finfo->nextcheckpoint = last + PHYSFS_ZIP_SEEK_SPACING;
 
-    return 1;
-} /* ZIP_seek */
+    __PHYSFS_platformReleaseMutex(idx->lock);
+} /* zip_add_checkpoint */
 
 
-static PHYSFS_sint64 ZIP_length(PHYSFS_Io *io)
+/*
+ * Restart decoding from the last checkpoint at or before (offset), if that
+ *  gets us closer than we already are. Returns 1 if we moved, 0 if there
+ *  was no point, -1 on i/o error.
+ */
+static int zip_seek_checkpoint(ZIPfileinfo *finfo, const PHYSFS_uint64 offset)
 {
-    const ZIPfileinfo *finfo = (ZIPfileinfo *) io->opaque;
-    return (PHYSFS_sint64) finfo->entry->uncompressed_size;
-} /* ZIP_length */
+    ZIPseekindex *idx = finfo->seekindex;
+    PHYSFS_Io *io = finfo->io;
+    const ZIPcheckpoint *cp = NULL;
+    PHYSFS_uint8 byte = 0;
+    PHYSFS_uint64 ofs;
+    PHYSFS_uint32 lo = 0;
+    PHYSFS_uint32 hi;
+    int shift;
+
+    __PHYSFS_platformGrabMutex(idx->lock);
+    hi = idx->count;
+    while (lo < hi)  /* find the first point past (offset)... */
+    {
+        const PHYSFS_uint32 mid = lo + ((hi - lo) / 2);
+        if (idx->points[mid]->uncompressed_position <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    } /* while */
+    if (lo > 0)  /* ...and use the one before it. Points never go away. */
+        cp = idx->points[lo - 1];
+    __PHYSFS_platformReleaseMutex(idx->lock);
+
+    if (cp == NULL)
+        return 0;
+    else if ( (offset >= finfo->uncompressed_position) &&
+              (cp->uncompressed_position <= finfo->uncompressed_position) )
+        return 0;  /* just decoding forward from here is better. */
+
+    /* the block can start partway into a byte; the decoder gets the rest. */
+    ofs = cp->bit_position >> 3;
+    shift = (int) (cp->bit_position & 7);
+    GOTO_IF_ERRPASS(!io->seek(io, zip_entry_offset(finfo->entry) + ofs),
+                    zip_seek_checkpoint_failed);
+    if (shift != 0)
+    {
+        GOTO_IF_ERRPASS(zip_read_decrypt(finfo, &byte, 1) != 1,
+                        zip_seek_checkpoint_failed);
+        ofs++;
+    } /* if */
+
+    /* Prime first: it marks the decoder as past the start of the stream. */
+    inflateReset(&finfo->stream);
+    inflatePrime(&finfo->stream, (8 - shift) & 7, byte >> shift);
+    inflateSetDictionary(&finfo->stream, cp->window,
+                   ZIP_CHECKPOINT_WINDOWLEN(cp->uncompressed_position));
+    finfo->stream.next_in = finfo->buffer;
+    finfo->stream.avail_in = 0;
+    finfo->compressed_position = ofs;
+    finfo->uncompressed_position = cp->uncompressed_position;
+    return 1;
 
+zip_seek_checkpoint_failed:
+    /* we don't know where the io is now; start over on the next read. */
+    inflateReset(&finfo->stream);
+    finfo->stream.avail_in = 0;
+    finfo->compressed_position = finfo->uncompressed_position = 0;
+    io->seek(io, zip_entry_offset(finfo->entry));
+    return -1;
+} /* zip_seek_checkpoint */
 
-static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, ZIPinfo *inf, ZIPentry *entry);
 
-static PHYSFS_Io *ZIP_duplicate(PHYSFS_Io *io)
+/*
+ * Reading a whole compressed entry in one call (which is what most apps do
+ *  right after PHYSFS_fileLength()) doesn't need to go through the stream
+ *  a buffer at a time. We get all the compressed data at once--straight out
+ *  of the mapping if the archive is memory-mapped, or with a single read
+ *  otherwise--and decode it directly into the caller's buffer in one pass,
+ *  without the sliding window in between.
+ *
+ * This gets the compressed data: (*src) points at it, and if it had to be
+ *  read into (*heapbuf), the caller frees that. The archive's Io is left
+ *  just past the entry, as if we'd streamed it. Returns 1 on success, -1 on
+ *  error, or 0 if this entry can't be done this way; read it normally then.
+ */
+static int zip_get_whole_entry(ZIPfileinfo *finfo, const PHYSFS_uint8 **src,
+                               PHYSFS_uint8 **heapbuf, PHYSFS_uint64 *_complen)
 {
-    ZIPfileinfo *origfinfo = (ZIPfileinfo *) io->opaque;
-    PHYSFS_Io *retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    ZIPfileinfo *finfo = (ZIPfileinfo *) allocator.Malloc(sizeof (ZIPfileinfo));
-    GOTO_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, failed);
-    GOTO_IF(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, failed);
-    memset(finfo, '\0', sizeof (*finfo));
+    const ZIPentry *entry = finfo->entry;
+    const int encrypted = zip_entry_is_encrypted(entry);
+    const PHYSFS_uint64 startpos = zip_entry_offset(entry) +
+                                   zip_entry_crypto_header_len(entry);
+    const PHYSFS_uint64 complen = zip_entry_data_size(entry);
+    PHYSFS_Io *io = finfo->io;
 
-    finfo->entry = origfinfo->entry;
-    finfo->io = zip_get_io(origfinfo->io, NULL, finfo->entry);
-    GOTO_IF_ERRPASS(!finfo->io, failed);
+    *src = NULL;
+    *heapbuf = NULL;
 
-    initializeZStream(&finfo->stream);
-    if (finfo->entry->compression_method != COMPMETH_NONE)
-    {
-        finfo->buffer = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
-        GOTO_IF(!finfo->buffer, PHYSFS_ERR_OUT_OF_MEMORY, failed);
-        if (zlib_err(inflateInit2(&finfo->stream, -MAX_WBITS)) != Z_OK)
-            goto failed;
-    } /* if */
+    /* the decoders' counters are 32 bits. */
+    if ((complen == 0) || (complen > 0xFFFFFFFF))
+        return 0;
 
-    memcpy(retval, io, sizeof (PHYSFS_Io));
-    retval->opaque = finfo;
-    return retval;
+    if (!encrypted)
+        *src = (const PHYSFS_uint8 *) __PHYSFS_ioMemoryRegion(io, startpos, complen);
 
-failed:
-    if (finfo != NULL)
+    if (*src != NULL)
+        BAIL_IF_ERRPASS(!io->seek(io, startpos + complen), -1);  /* as if we read it. */
+    else
     {
-        if (finfo->io != NULL)
-            finfo->io->destroy(finfo->io);
-
-        if (finfo->buffer != NULL)
+        if (!__PHYSFS_ui64FitsAddressSpace(complen))
+            return 0;
+        *heapbuf = (PHYSFS_uint8 *) allocator.Malloc((size_t) complen);
+        if (*heapbuf == NULL)
+            return 0;  /* just stream it through the small buffer, then. */
+        else if (zip_read_decrypt(finfo, *heapbuf, complen) != (PHYSFS_sint64) complen)
         {
-            allocator.Free(finfo->buffer);
-            inflateEnd(&finfo->stream);
-        } /* if */
+            allocator.Free(*heapbuf);
+            *heapbuf = NULL;
+            return -1;
+        } /* else if */
+        *src = *heapbuf;
+    } /* else */
 
-        allocator.Free(finfo);
-    } /* if */
+    finfo->compressed_position = complen;
+    *_complen = complen;
+    return 1;
+} /* zip_get_whole_entry */
 
-    if (retval != NULL)
-        allocator.Free(retval);
 
-    return NULL;
-} /* ZIP_duplicate */
+/*
+ * Inflate a whole entry with zip_get_whole_entry(). Returns the number of
+ *  bytes decoded, -1 on error, or 0 to read it normally.
+ */
+static PHYSFS_sint64 zip_inflate_whole(ZIPfileinfo *finfo, void *buf,
+                                       const PHYSFS_uint64 len)
+{
+    const PHYSFS_uint8 *src = NULL;
+    PHYSFS_uint8 *heapbuf = NULL;
+    PHYSFS_uint64 complen = 0;
+    int rc;
 
-static int ZIP_flush(PHYSFS_Io *io) { return 1;  /* no write support. */ }
+    if (len > 0xFFFFFFFF)
+        return 0;
 
-static void ZIP_destroy(PHYSFS_Io *io)
-{
-    ZIPfileinfo *finfo = (ZIPfileinfo *) io->opaque;
-    finfo->io->destroy(finfo->io);
+    rc = zip_get_whole_entry(finfo, &src, &heapbuf, &complen);
+    if (rc <= 0)
+        return rc;
 
-    if (finfo->entry->compression_method != COMPMETH_NONE)
-        inflateEnd(&finfo->stream);
+    finfo->stream.next_in = (PHYSFS_uint8 *) src;
+    finfo->stream.avail_in = (uInt) complen;
+    finfo->stream.next_out = buf;
+    finfo->stream.avail_out = (uInt) len;
+    rc = zlib_err(inflate(&finfo->stream, Z_FINISH));
+    finfo->stream.next_in = finfo->buffer;  /* don't point at freed memory. */
+    finfo->stream.avail_in = 0;
 
-    if (finfo->buffer != NULL)
-        allocator.Free(finfo->buffer);
+    if (heapbuf != NULL)
+        allocator.Free(heapbuf);
 
-    allocator.Free(finfo);
-    allocator.Free(io);
-} /* ZIP_destroy */
+    BAIL_IF(rc != Z_STREAM_END, PHYSFS_ERR_CORRUPT, -1);
+    BAIL_IF(finfo->stream.total_out != len, PHYSFS_ERR_CORRUPT, -1);
+    return (PHYSFS_sint64) len;
+} /* zip_inflate_whole */
 
 
-static const PHYSFS_Io ZIP_Io =
+#if PHYSFS_ZIP_LZMA || PHYSFS_ZIP_ZSTD
+/*
+ * Read the next chunk of compressed data into finfo->buffer, for decoders
+ *  that keep track of their own place in it. Returns the number of bytes
+ *  read, 0 at the end of the entry, -1 on error.
+ */
+static PHYSFS_sint64 zip_read_compressed(ZIPfileinfo *finfo)
 {
-    CURRENT_PHYSFS_IO_API_VERSION, NULL,
-    ZIP_read,
-    ZIP_write,
-    ZIP_seek,
-    ZIP_tell,
-    ZIP_length,
-    ZIP_duplicate,
-    ZIP_flush,
-    ZIP_destroy
-};
+    const PHYSFS_uint64 complen = zip_entry_data_size(finfo->entry);
+    PHYSFS_sint64 br = 0;
 
+    if (complen > finfo->compressed_position)
+    {
+        br = (PHYSFS_sint64) (complen - finfo->compressed_position);
+        if (br > ZIP_READBUFSIZE)
+            br = ZIP_READBUFSIZE;
 
+        br = zip_read_decrypt(finfo, finfo->buffer, (PHYSFS_uint64) br);
+        BAIL_IF_ERRPASS(br < 0, -1);
+        finfo->compressed_position += (PHYSFS_uint64) br;
+    } /* if */
 
-static PHYSFS_sint64 zip_find_end_of_central_dir(PHYSFS_Io *io, PHYSFS_sint64 *len)
+    return br;
+} /* zip_read_compressed */
+#endif
+
+
+#if PHYSFS_ZIP_LZMA
+/* Read the next chunk of an LZMA entry's compressed data into the buffer. */
+static PHYSFS_sint64 zip_lzma_fill(ZIPfileinfo *finfo)
 {
-    PHYSFS_uint8 buf[256];
-    PHYSFS_uint8 extra[4] = { 0, 0, 0, 0 };
-    PHYSFS_sint32 i = 0;
-    PHYSFS_sint64 filelen;
-    PHYSFS_sint64 filepos;
-    PHYSFS_sint32 maxread;
-    PHYSFS_sint32 totalread = 0;
-    int found = 0;
+    ZIPlzma *lz = finfo->lzma;
+    const PHYSFS_sint64 br = zip_read_compressed(finfo);
+    BAIL_IF_ERRPASS(br < 0, -1);
+    lz->bufpos = 0;
+    lz->buflen = (PHYSFS_uint32) br;
+    return br;
+} /* zip_lzma_fill */
 
-    filelen = io->length(io);
-    BAIL_IF_ERRPASS(filelen == -1, -1);
+
+/* Parse the LZMA header at the start of the entry and set up the decoder. */
+static int zip_lzma_start(ZIPfileinfo *finfo)
+{
+    ZIPlzma *lz = finfo->lzma;
+    const PHYSFS_uint64 size = zip_entry_uncompressed_size(finfo->entry);
+    const PHYSFS_uint8 *hdr = finfo->buffer;
+    PHYSFS_uint8 props[LZMA_PROPS_SIZE];
+    PHYSFS_uint32 dictsize;
+    SRes rc;
+
+    BAIL_IF_ERRPASS(zip_lzma_fill(finfo) < 0, 0);
+    BAIL_IF(lz->buflen < 4 + LZMA_PROPS_SIZE, PHYSFS_ERR_CORRUPT, 0);
+
+    /* hdr[0] and hdr[1] are the SDK version that wrote this; ignore it. */
+    BAIL_IF((hdr[2] | (hdr[3] << 8)) != LZMA_PROPS_SIZE, PHYSFS_ERR_CORRUPT, 0);
+    memcpy(props, hdr + 4, LZMA_PROPS_SIZE);
+    lz->bufpos = 4 + LZMA_PROPS_SIZE;
 
     /*
-     * Jump to the end of the file and start reading backwards.
-     *  The last thing in the file is the zipfile comment, which is variable
-     *  length, and the field that specifies its size is before it in the
-     *  file (argh!)...this means that we need to scan backwards until we
-     *  hit the end-of-central-dir signature. We can then sanity check that
-     *  the comment was as big as it should be to make sure we're in the
-     *  right place. The comment length field is 16 bits, so we can stop
-     *  searching for that signature after a little more than 64k at most,
-     *  and call it a corrupted zipfile.
+     * Nothing can refer back past the start of the file, so a dictionary
+     *  bigger than the file is wasted memory. Compressors tend to use the
+     *  same (big) dictionary size for every entry, even tiny ones.
      */
-
-    if (sizeof (buf) < filelen)
+    dictsize = ((PHYSFS_uint32) props[1]) | (((PHYSFS_uint32) props[2]) << 8) |
+               (((PHYSFS_uint32) props[3]) << 16) |
+               (((PHYSFS_uint32) props[4]) << 24);
+    if (dictsize > size)
     {
-        filepos = filelen - sizeof (buf);
-        maxread = sizeof (buf);
+        dictsize = (size < 4096) ? 4096 : (PHYSFS_uint32) size;
+        props[1] = (PHYSFS_uint8) (dictsize & 0xFF);
+        props[2] = (PHYSFS_uint8) ((dictsize >> 8) & 0xFF);
+        props[3] = (PHYSFS_uint8) ((dictsize >> 16) & 0xFF);
+        props[4] = (PHYSFS_uint8) ((dictsize >> 24) & 0xFF);
     } /* if */
-    else
-    {
-        filepos = 0;
-        maxread = (PHYSFS_uint32) filelen;
-    } /* else */
 
-    while ((totalread < filelen) && (totalread < 65557))
+    rc = LzmaDec_Allocate(&lz->dec, props, LZMA_PROPS_SIZE, &lzmaPhysfsAllocator);
+    BAIL_IF(rc == SZ_ERROR_MEM, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    BAIL_IF(rc != SZ_OK, PHYSFS_ERR_CORRUPT, 0);
+    LzmaDec_Init(&lz->dec);
+    return 1;
+} /* zip_lzma_start */
+
+
+static PHYSFS_sint64 zip_lzma_read(ZIPfileinfo *finfo, void *buf,
+                                   const PHYSFS_uint64 len)
+{
+    ZIPlzma *lz = finfo->lzma;
+    PHYSFS_uint8 *out = (PHYSFS_uint8 *) buf;
+    PHYSFS_uint64 retval = 0;
+
+    if (finfo->compressed_position == 0)  /* at the start (or rewound). */
+        BAIL_IF_ERRPASS(!zip_lzma_start(finfo), -1);
+
+    while (retval < len)
     {
-        BAIL_IF_ERRPASS(!io->seek(io, filepos), -1);
+        SizeT outlen = (SizeT) (len - retval);
+        SizeT inlen;
+        ELzmaStatus status;
+        SRes rc;
 
-        /* make sure we catch a signature between buffers. */
-        if (totalread != 0)
+        if (lz->bufpos == lz->buflen)
         {
-            if (!__PHYSFS_readAll(io, buf, maxread - 4))
-                return -1;
-            memcpy(&buf[maxread - 4], &extra, sizeof (extra));
-            totalread += maxread - 4;
+            const PHYSFS_sint64 br = zip_lzma_fill(finfo);
+            BAIL_IF_ERRPASS(br < 0, -1);
+            BAIL_IF(br == 0, PHYSFS_ERR_CORRUPT, -1);  /* truncated. */
         } /* if */
-        else
-        {
-            if (!__PHYSFS_readAll(io, buf, maxread))
-                return -1;
-            totalread += maxread;
-        } /* else */
 
-        memcpy(&extra, buf, sizeof (extra));
-
-        for (i = maxread - 4; i > 0; i--)
-        {
-            if ((buf[i + 0] == 0x50) &&
-                (buf[i + 1] == 0x4B) &&
-                (buf[i + 2] == 0x05) &&
-                (buf[i + 3] == 0x06) )
-            {
-                found = 1;  /* that's the signature! */
-                break;  
-            } /* if */
-        } /* for */
+        inlen = (SizeT) (lz->buflen - lz->bufpos);
+        rc = LzmaDec_DecodeToBuf(&lz->dec, out + retval, &outlen,
+                                 finfo->buffer + lz->bufpos, &inlen,
+                                 LZMA_FINISH_ANY, &status);
+        lz->bufpos += (PHYSFS_uint32) inlen;
+        retval += outlen;
 
-        if (found)
-            break;
+        BAIL_IF(rc != SZ_OK, PHYSFS_ERR_CORRUPT, -1);
 
-        filepos -= (maxread - 4);
-        if (filepos < 0)
-            filepos = 0;
+        /* the end marker can't come before the size we were promised. */
+        BAIL_IF((status == LZMA_STATUS_FINISHED_WITH_MARK) && (retval < len),
+                PHYSFS_ERR_CORRUPT, -1);
     } /* while */
 
-    BAIL_IF(!found, PHYSFS_ERR_UNSUPPORTED, -1);
-
-    if (len != NULL)
-        *len = filelen;
-
-    return (filepos + i);
-} /* zip_find_end_of_central_dir */
+    return (PHYSFS_sint64) retval;
+} /* zip_lzma_read */
+#endif
 
 
-static int isZip(PHYSFS_Io *io)
+#if PHYSFS_ZIP_ZSTD
+/*
+ * Decode a whole zstd entry with zip_get_whole_entry(). Returns the number
+ *  of bytes decoded, -1 on error, or 0 to stream it instead.
+ */
+static PHYSFS_sint64 zip_zstd_whole(ZIPfileinfo *finfo, void *buf,
+                                    const PHYSFS_uint64 len)
 {
-    PHYSFS_uint32 sig = 0;
-    int retval = 0;
+    const PHYSFS_uint8 *src = NULL;
+    PHYSFS_uint8 *heapbuf = NULL;
+    PHYSFS_uint64 complen = 0;
+    size_t rc;
+    int got;
 
-    /*
-     * The first thing in a zip file might be the signature of the
-     *  first local file record, so it makes for a quick determination.
-     */
-    if (readui32(io, &sig))
-    {
-        retval = (sig == ZIP_LOCAL_FILE_SIG);
-        if (!retval)
-        {
-            /*
-             * No sig...might be a ZIP with data at the start
-             *  (a self-extracting executable, etc), so we'll have to do
-             *  it the hard way...
-             */
-            retval = (zip_find_end_of_central_dir(io, NULL) != -1);
-        } /* if */
-    } /* if */
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        return 0;
 
-    return retval;
-} /* isZip */
+    got = zip_get_whole_entry(finfo, &src, &heapbuf, &complen);
+    if (got <= 0)
+        return got;
 
+    /* this uses the dictionary zip_zstd_read() referenced. */
+    rc = ZSTD_decompressDCtx(finfo->zstd, buf, (size_t) len,
+                             src, (size_t) complen);
 
-/* Convert paths from old, buggy DOS zippers... */
-static void zip_convert_dos_path(const PHYSFS_uint16 entryversion, char *path)
-{
-    const PHYSFS_uint8 hosttype = (PHYSFS_uint8) ((entryversion >> 8) & 0xFF);
-    if (hosttype == 0)  /* FS_FAT_ */
-    {
-        while (*path)
-        {
-            if (*path == '\\')
-                *path = '/';
-            path++;
-        } /* while */
-    } /* if */
-} /* zip_convert_dos_path */
+    if (heapbuf != NULL)
+        allocator.Free(heapbuf);
 
+    BAIL_IF(ZSTD_isError(rc), zstd_error_code(rc), -1);
+    BAIL_IF(rc != len, PHYSFS_ERR_CORRUPT, -1);
+    return (PHYSFS_sint64) len;
+} /* zip_zstd_whole */
 
-static void zip_expand_symlink_path(char *path)
+
+static PHYSFS_sint64 zip_zstd_read(ZIPfileinfo *finfo, void *buf,
+                                   const PHYSFS_uint64 len)
 {
-    char *ptr = path;
-    char *prevptr = path;
+    ZSTD_outBuffer out;
+    size_t rc;
 
-    while (1)
+    if (finfo->compressed_position == 0)  /* at the start (or rewound). */
     {
-        ptr = strchr(ptr, '/');
-        if (ptr == NULL)
-            break;
+        ZSTD_DCtx_reset(finfo->zstd, ZSTD_reset_session_only);
+        rc = ZSTD_DCtx_refDDict(finfo->zstd, finfo->zstddict);
+        BAIL_IF(ZSTD_isError(rc), zstd_error_code(rc), -1);
+        finfo->zstdin.src = finfo->buffer;
+        finfo->zstdin.size = finfo->zstdin.pos = 0;
 
-        if (*(ptr + 1) == '.')
+        if (len == zip_entry_uncompressed_size(finfo->entry))
         {
-            if (*(ptr + 2) == '/')
-            {
-                /* current dir in middle of string: ditch it. */
-                memmove(ptr, ptr + 2, strlen(ptr + 2) + 1);
-            } /* else if */
-
-            else if (*(ptr + 2) == '\0')
-            {
-                /* current dir at end of string: ditch it. */
-                *ptr = '\0';
-            } /* else if */
+            const PHYSFS_sint64 retval = zip_zstd_whole(finfo, buf, len);
+            if (retval != 0)
+                return retval;
+        } /* if */
+    } /* if */
 
-            else if (*(ptr + 2) == '.')
-            {
-                if (*(ptr + 3) == '/')
-                {
-                    /* parent dir in middle: move back one, if possible. */
-                    memmove(prevptr, ptr + 4, strlen(ptr + 4) + 1);
-                    ptr = prevptr;
-                    while (prevptr != path)
-                    {
-                        prevptr--;
-                        if (*prevptr == '/')
-                        {
-                            prevptr++;
-                            break;
-                        } /* if */
-                    } /* while */
-                } /* if */
+    out.dst = buf;
+    out.size = (size_t) len;
+    out.pos = 0;
 
-                if (*(ptr + 3) == '\0')
-                {
-                    /* parent dir at end: move back one, if possible. */
-                    *prevptr = '\0';
-                } /* if */
-            } /* if */
-        } /* if */
-        else
+    while (out.pos < out.size)
+    {
+        if (finfo->zstdin.pos == finfo->zstdin.size)
         {
-            prevptr = ptr;
-            ptr++;
-        } /* else */
-    } /* while */
-} /* zip_expand_symlink_path */
+            const PHYSFS_sint64 br = zip_read_compressed(finfo);
+            BAIL_IF_ERRPASS(br < 0, -1);
+            BAIL_IF(br == 0, PHYSFS_ERR_CORRUPT, -1);  /* truncated. */
+            finfo->zstdin.size = (size_t) br;
+            finfo->zstdin.pos = 0;
+        } /* if */
 
+        rc = ZSTD_decompressStream(finfo->zstd, &out, &finfo->zstdin);
+        BAIL_IF(ZSTD_isError(rc), zstd_error_code(rc), -1);
+    } /* while */
 
-static inline ZIPentry *zip_find_entry(ZIPinfo *info, const char *path)
-{
-    return (ZIPentry *) __PHYSFS_DirTreeFind(&info->tree, path);
-} /* zip_find_entry */
+    return (PHYSFS_sint64) out.pos;
+} /* zip_zstd_read */
+#endif
 
-/* (forward reference: zip_follow_symlink and zip_resolve call each other.) */
-static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry);
 
 /*
- * Look for the entry named by (path). If it exists, resolve it, and return
- *  a pointer to that entry. If it's another symlink, keep resolving until you
- *  hit a real file and then return a pointer to the final non-symlink entry.
- *  If there's a problem, return NULL.
+ * Fold freshly decoded bytes into the running CRC-32, if verification is on.
+ *  (buf) holds (len) bytes that start at the current tell() position. Bytes
+ *  we've checksummed already (we seeked back and are reading them again)
+ *  are skipped, and if we seeked forward past unchecked bytes, the CRC can't
+ *  be finished on this handle, so it just stops counting. Once the last byte
+ *  is in, it has to match the central directory or the read fails.
  */
-static ZIPentry *zip_follow_symlink(PHYSFS_Io *io, ZIPinfo *info, char *path)
+static int zip_verify_read(ZIPfileinfo *finfo, const void *buf,
+                           const PHYSFS_uint64 len)
 {
-    ZIPentry *entry;
+    const PHYSFS_uint64 pos = finfo->uncompressed_position;
+    const ZIPentry *entry = finfo->entry;
+    PHYSFS_uint64 skip;
 
-    zip_expand_symlink_path(path);
-    entry = zip_find_entry(info, path);
-    if (entry != NULL)
+    if (finfo->verify == 0)
+        return 1;
+
+    BAIL_IF(finfo->verify < 0, PHYSFS_ERR_CORRUPT, 0);
+
+    if (entry->aes & ZIP_AES_NO_CRC)
+        return 1;  /* zip_aes_decrypt() checks the MAC instead. */
+
+    if ((finfo->crcpos < pos) || (finfo->crcpos >= pos + len))
+        return 1;  /* nothing new here. */
+
+    skip = finfo->crcpos - pos;
+    finfo->crc = zip_crc32(finfo->crc, ((const PHYSFS_uint8 *) buf) + skip,
+                           (size_t) (len - skip));
+    finfo->crcpos = pos + len;
+
+    if ( (finfo->crcpos == zip_entry_uncompressed_size(entry)) &&
+         (finfo->crc != entry->crc) )
     {
-        if (!zip_resolve(io, info, entry))  /* recursive! */
-            entry = NULL;
-        else
-        {
-            if (entry->symlink != NULL)
-                entry = entry->symlink;
-        } /* else */
+        finfo->verify = -1;
+        BAIL(PHYSFS_ERR_CORRUPT, 0);
     } /* if */
 
-    return entry;
-} /* zip_follow_symlink */
+    return 1;
+} /* zip_verify_read */
 
 
-static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
+static PHYSFS_sint64 ZIP_read(PHYSFS_Io *_io, void *buf, PHYSFS_uint64 len)
 {
-    const size_t size = (size_t) entry->uncompressed_size;
-    char *path = NULL;
-    int rc = 0;
+    ZIPfileinfo *finfo = (ZIPfileinfo *) _io->opaque;
+    ZIPentry *entry = finfo->entry;
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_sint64 maxread = (PHYSFS_sint64) len;
+    PHYSFS_sint64 avail = zip_entry_uncompressed_size(entry) -
+                          finfo->uncompressed_position;
 
-    /*
-     * We've already parsed the local file header of the symlink at this
-     *  point. Now we need to read the actual link from the file data and
-     *  follow it.
-     */
+    if (avail < maxread)
+        maxread = avail;
 
-    BAIL_IF_ERRPASS(!io->seek(io, entry->offset), 0);
+    BAIL_IF_ERRPASS(maxread == 0, 0);    /* quick rejection. */
 
-    path = (char *) __PHYSFS_smallAlloc(size + 1);
-    BAIL_IF(!path, PHYSFS_ERR_OUT_OF_MEMORY, 0);
-    
     if (entry->compression_method == COMPMETH_NONE)
-        rc = __PHYSFS_readAll(io, path, size);
-
-    else  /* symlink target path is compressed... */
+        retval = zip_read_decrypt(finfo, buf, maxread);
+    #if PHYSFS_ZIP_LZMA
+    else if (entry->compression_method == COMPMETH_LZMA)
+    {
+        retval = zip_lzma_read(finfo, buf, (PHYSFS_uint64) maxread);
+        BAIL_IF_ERRPASS(retval < 0, -1);
+    } /* else if */
+    #endif
+    #if PHYSFS_ZIP_ZSTD
+    else if (entry->compression_method == COMPMETH_ZSTD)
     {
-        z_stream stream;
-        const size_t complen = (size_t) entry->compressed_size;
-        PHYSFS_uint8 *compressed = (PHYSFS_uint8*) __PHYSFS_smallAlloc(complen);
-        if (compressed != NULL)
+        retval = zip_zstd_read(finfo, buf, (PHYSFS_uint64) maxread);
+        BAIL_IF_ERRPASS(retval < 0, -1);
+    } /* else if */
+    #endif
+    else if ( (maxread == zip_entry_uncompressed_size(entry)) &&
+              (finfo->compressed_position == 0) &&
+              (finfo->stream.total_in == 0) &&
+              ((retval = zip_inflate_whole(finfo, buf, maxread)) != 0) )
+    {
+        BAIL_IF_ERRPASS(retval < 0, -1);
+    } /* else if */
+    else
+    {
+        finfo->stream.next_out = buf;
+        finfo->stream.avail_out = (uInt) maxread;
+
+        while (retval < maxread)
         {
-            if (__PHYSFS_readAll(io, compressed, complen))
+            const mz_ulong before = finfo->stream.total_out;
+            int flush;
+            int rc;
+
+            if (finfo->stream.avail_in == 0)
             {
-                initializeZStream(&stream);
-                stream.next_in = compressed;
-                stream.avail_in = (unsigned int) complen;
-                stream.next_out = (unsigned char *) path;
-                stream.avail_out = (unsigned int) size;
-                if (zlib_err(inflateInit2(&stream, -MAX_WBITS)) == Z_OK)
+                PHYSFS_sint64 br;
+
+                br = zip_entry_data_size(entry) -
+                     finfo->compressed_position;
+                if (br > 0)
                 {
-                    rc = zlib_err(inflate(&stream, Z_FINISH));
-                    inflateEnd(&stream);
+                    if (br > ZIP_READBUFSIZE)
+                        br = ZIP_READBUFSIZE;
+
+                    br = zip_read_decrypt(finfo, finfo->buffer, (PHYSFS_uint64) br);
+                    if (br <= 0)
+                        break;
 
-                    /* both are acceptable outcomes... */
-                    rc = ((rc == Z_OK) || (rc == Z_STREAM_END));
+                    finfo->compressed_position += (PHYSFS_uint64) br;
+                    finfo->stream.next_in = finfo->buffer;
+                    finfo->stream.avail_in = (unsigned int) br;
                 } /* if */
             } /* if */
-            __PHYSFS_smallFree(compressed);
-        } /* if */
-    } /* else */
 
-    if (rc)
-    {
-        path[entry->uncompressed_size] = '\0';    /* null-terminate it. */
-        zip_convert_dos_path(entry->version, path);
-        entry->symlink = zip_follow_symlink(io, info, path);
+            /* due for a checkpoint? Then stop at the next block boundary. */
+            flush = Z_SYNC_FLUSH;
+            if ( (finfo->seekindex != NULL) &&
+                 (finfo->uncompressed_position + retval >= finfo->nextcheckpoint) )
+                flush = Z_BLOCK;
+
+            rc = zlib_err(inflate(&finfo->stream, flush));
+            retval += (PHYSFS_sint64) (finfo->stream.total_out - before);
+
+            if (rc != Z_OK)
+                break;
+
+            if (finfo->stream.data_type & 128)  /* at a block boundary. */
+                zip_add_checkpoint(finfo, finfo->uncompressed_position + retval);
+        } /* while */
     } /* else */
 
-    __PHYSFS_smallFree(path);
+    if (retval > 0)
+    {
+        BAIL_IF_ERRPASS(!zip_verify_read(finfo, buf, (PHYSFS_uint64) retval), -1);
+        finfo->uncompressed_position += (PHYSFS_uint64) retval;
+    } /* if */
 
-    return (entry->symlink != NULL);
-} /* zip_resolve_symlink */
+    return retval;
+} /* ZIP_read */
 
 
-/*
- * Parse the local file header of an entry, and update entry->offset.
- */
-static int zip_parse_local(PHYSFS_Io *io, ZIPentry *entry)
+static PHYSFS_sint64 ZIP_write(PHYSFS_Io *io, const void *b, PHYSFS_uint64 len)
 {
-    PHYSFS_uint32 ui32;
-    PHYSFS_uint16 ui16;
-    PHYSFS_uint16 fnamelen;
-    PHYSFS_uint16 extralen;
+    BAIL(PHYSFS_ERR_READ_ONLY, -1);
+} /* ZIP_write */
 
-    /*
-     * crc and (un)compressed_size are always zero if this is a "JAR"
-     *  archive created with Sun's Java tools, apparently. We only
-     *  consider this archive corrupted if those entries don't match and
-     *  aren't zero. That seems to work well.
-     * We also ignore a mismatch if the value is 0xFFFFFFFF here, since it's
-     *  possible that's a Zip64 thing.
-     */
 
-    /* !!! FIXME: apparently these are zero if general purpose bit 3 is set,
-       !!! FIXME:  which is probably true for Jar files, fwiw, but we don't
-       !!! FIXME:  care about these values anyhow. */
+static PHYSFS_sint64 ZIP_tell(PHYSFS_Io *io)
+{
+    return ((ZIPfileinfo *) io->opaque)->uncompressed_position;
+} /* ZIP_tell */
 
-    BAIL_IF_ERRPASS(!io->seek(io, entry->offset), 0);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 != ZIP_LOCAL_FILE_SIG, PHYSFS_ERR_CORRUPT, 0);
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
-    BAIL_IF(ui16 != entry->version_needed, PHYSFS_ERR_CORRUPT, 0);
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);  /* general bits. */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
-    BAIL_IF(ui16 != entry->compression_method, PHYSFS_ERR_CORRUPT, 0);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);  /* date/time */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 && (ui32 != entry->crc), PHYSFS_ERR_CORRUPT, 0);
 
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 && (ui32 != 0xFFFFFFFF) &&
-                  (ui32 != entry->compressed_size), PHYSFS_ERR_CORRUPT, 0);
+static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
+{
+    ZIPfileinfo *finfo = (ZIPfileinfo *) _io->opaque;
+    ZIPentry *entry = finfo->entry;
+    PHYSFS_Io *io = finfo->io;
+    const int encrypted = zip_entry_is_tradional_crypto(entry);
+    const PHYSFS_uint32 hdrlen = zip_entry_crypto_header_len(entry);
 
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 && (ui32 != 0xFFFFFFFF) &&
-                 (ui32 != entry->uncompressed_size), PHYSFS_ERR_CORRUPT, 0);
+    BAIL_IF(offset > zip_entry_uncompressed_size(entry), PHYSFS_ERR_PAST_EOF, 0);
+
+    /* stored data can seek directly, even with AES (it's CTR mode). */
+    if (!encrypted && (entry->compression_method == COMPMETH_NONE))
+    {
+        PHYSFS_sint64 newpos = offset + zip_entry_offset(entry) + hdrlen;
+        BAIL_IF_ERRPASS(!io->seek(io, newpos), 0);
+        finfo->uncompressed_position = offset;
+        #if PHYSFS_ZIP_AES
+        if (entry->aes)
+            finfo->aes->pos = offset;
+        #endif
+    } /* if */
+
+    else
+    {
+        int rc = 0;
+
+        if (finfo->seekindex != NULL)
+        {
+            rc = zip_seek_checkpoint(finfo, offset);
+            BAIL_IF_ERRPASS(rc < 0, 0);
+        } /* if */
+
+        /*
+         * If seeking backwards, we need to redecode the file
+         *  from the start (or the last checkpoint before the offset) and
+         *  throw away the compressed bits until we hit the offset we need.
+         *  If seeking forward, we still need to decode, but we don't rewind
+         *  first.
+         */
+        if ((rc == 0) && (offset < finfo->uncompressed_position))
+        {
+            if (!io->seek(io, zip_entry_offset(entry) + hdrlen))
+                return 0;
+
+            /* LZMA, zstd start over when they see compressed_position 0. */
+            if (entry->compression_method == COMPMETH_DEFLATE)
+            {
+                inflateReset(&finfo->stream);
+                finfo->stream.avail_in = 0;
+            } /* if */
+
+            finfo->uncompressed_position = finfo->compressed_position = 0;
 
-    BAIL_IF_ERRPASS(!readui16(io, &fnamelen), 0);
-    BAIL_IF_ERRPASS(!readui16(io, &extralen), 0);
+            if (encrypted)
+                memcpy(finfo->crypto_keys, finfo->initial_crypto_keys, 12);
+            #if PHYSFS_ZIP_AES
+            else if (entry->aes)
+                zip_aes_restart(finfo->aes);
+            #endif
+        } /* if */
+
+        while (finfo->uncompressed_position != offset)
+        {
+            PHYSFS_uint8 buf[4096];
+            PHYSFS_uint64 maxread;
+
+            maxread = offset - finfo->uncompressed_position;
+            if (maxread > sizeof (buf))
+                maxread = sizeof (buf);
+
+            if (ZIP_read(_io, buf, maxread) != (PHYSFS_sint64) maxread)
+                return 0;
+        } /* while */
+    } /* else */
 
-    entry->offset += fnamelen + extralen + 30;
     return 1;
-} /* zip_parse_local */
+} /* ZIP_seek */
 
 
-static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
+static PHYSFS_sint64 ZIP_length(PHYSFS_Io *io)
 {
-    int retval = 1;
-    const ZipResolveType resolve_type = entry->resolved;
+    const ZIPfileinfo *finfo = (ZIPfileinfo *) io->opaque;
+    return (PHYSFS_sint64) zip_entry_uncompressed_size(finfo->entry);
+} /* ZIP_length */
 
-    if (resolve_type == ZIP_DIRECTORY)
-        return 1;   /* we're good. */
 
-    /* Don't bother if we've failed to resolve this entry before. */
-    BAIL_IF(resolve_type == ZIP_BROKEN_FILE, PHYSFS_ERR_CORRUPT, 0);
-    BAIL_IF(resolve_type == ZIP_BROKEN_SYMLINK, PHYSFS_ERR_CORRUPT, 0);
+static ZIPfileinfo *zip_acquire_fileinfo(ZIPinfo *info, PHYSFS_Io *srcio,
+                                         ZIPentry *entry);
+static void zip_release_fileinfo(ZIPfileinfo *finfo);
 
-    /* uhoh...infinite symlink loop! */
-    BAIL_IF(resolve_type == ZIP_RESOLVING, PHYSFS_ERR_SYMLINK_LOOP, 0);
+static PHYSFS_Io *ZIP_duplicate(PHYSFS_Io *io)
+{
+    ZIPfileinfo *origfinfo = (ZIPfileinfo *) io->opaque;
+    ZIPfileinfo *finfo;
 
-    /*
-     * We fix up the offset to point to the actual data on the
-     *  first open, since we don't want to seek across the whole file on
-     *  archive open (can be SLOW on large, CD-stored files), but we
-     *  need to check the local file header...not just for corruption,
-     *  but since it stores offset info the central directory does not.
-     */
-    if (resolve_type != ZIP_RESOLVED)
+    finfo = zip_acquire_fileinfo(origfinfo->info, origfinfo->io,
+                                 origfinfo->entry);
+    BAIL_IF_ERRPASS(!finfo, NULL);
+    finfo->seekindex = origfinfo->seekindex;
+    #if PHYSFS_ZIP_ZSTD
+    finfo->zstddict = origfinfo->zstddict;
+    #endif
+
+    if (zip_entry_is_tradional_crypto(finfo->entry))
     {
-        if (entry->tree.isdir)  /* an ancestor dir that DirTree filled in? */
+        PHYSFS_Io *fio = finfo->io;
+        if (!fio->seek(fio, zip_entry_offset(finfo->entry) + 12))
         {
-            entry->resolved = ZIP_DIRECTORY;
-            return 1;
+            zip_release_fileinfo(finfo);
+            return NULL;
         } /* if */
-
-        retval = zip_parse_local(io, entry);
-        if (retval)
+        memcpy(finfo->initial_crypto_keys, origfinfo->initial_crypto_keys, 12);
+        memcpy(finfo->crypto_keys, origfinfo->initial_crypto_keys, 12);
+    } /* if */
+    #if PHYSFS_ZIP_AES
+    else if (finfo->entry->aes)
+    {
+        PHYSFS_Io *fio = finfo->io;
+        ZIPaes *aes = finfo->aes;
+        const PHYSFS_uint32 hdrlen = zip_entry_crypto_header_len(finfo->entry);
+        if (!fio->seek(fio, zip_entry_offset(finfo->entry) + hdrlen))
         {
-            /*
-             * If it's a symlink, find the original file. This will cause
-             *  resolution of other entries (other symlinks and, eventually,
-             *  the real file) if all goes well.
-             */
-            if (resolve_type == ZIP_UNRESOLVED_SYMLINK)
-                retval = zip_resolve_symlink(io, info, entry);
+            zip_release_fileinfo(finfo);
+            return NULL;
         } /* if */
+        /* the arrays can be aligned differently in each, so go by hand. */
+        memcpy(zip_aes_align(aes->ctx), zip_aes_align(origfinfo->aes->ctx),
+               AES_NUM_IVMRK_WORDS * sizeof (UInt32));
+        memcpy(&aes->hmac, &origfinfo->aes->hmac, sizeof (aes->hmac));
+        aes->kslen = 0;
+        zip_aes_restart(aes);
+    } /* else if */
+    #endif
 
-        if (resolve_type == ZIP_UNRESOLVED_SYMLINK)
-            entry->resolved = ((retval) ? ZIP_RESOLVED : ZIP_BROKEN_SYMLINK);
-        else if (resolve_type == ZIP_UNRESOLVED_FILE)
-            entry->resolved = ((retval) ? ZIP_RESOLVED : ZIP_BROKEN_FILE);
-    } /* if */
+    return &finfo->iface;
+} /* ZIP_duplicate */
 
-    return retval;
-} /* zip_resolve */
+static int ZIP_flush(PHYSFS_Io *io) { return 1;  /* no write support. */ }
+
+static void ZIP_destroy(PHYSFS_Io *io)
+{
+    zip_release_fileinfo((ZIPfileinfo *) io->opaque);
+} /* ZIP_destroy */
 
 
-static int zip_entry_is_symlink(const ZIPentry *entry)
+/* Only used for stored, unencrypted entries; see ZIP_openRead(). */
+static PHYSFS_sint64 ZIP_readAt(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len,
+                                PHYSFS_uint64 offset)
 {
-    return ((entry->resolved == ZIP_UNRESOLVED_SYMLINK) ||
-            (entry->resolved == ZIP_BROKEN_SYMLINK) ||
-            (entry->symlink));
-} /* zip_entry_is_symlink */
+    ZIPfileinfo *finfo = (ZIPfileinfo *) io->opaque;
+    const ZIPentry *entry = finfo->entry;
+    const PHYSFS_uint64 size = zip_entry_uncompressed_size(entry);
 
+    assert(entry->compression_method == COMPMETH_NONE);
+    assert(!zip_entry_is_encrypted(entry));
 
-static int zip_version_does_symlinks(PHYSFS_uint32 version)
+    if (offset >= size)
+        return 0;
+
+    if (len > (size - offset))
+        len = size - offset;
+
+    return __PHYSFS_readAt(finfo->io, buf, len,
+                           zip_entry_offset(entry) + offset);
+} /* ZIP_readAt */
+
+
+static PHYSFS_Io *ZIP_rawRegion(PHYSFS_Io *io, PHYSFS_uint64 *pos,
+                                PHYSFS_uint64 *len)
 {
-    int retval = 0;
-    PHYSFS_uint8 hosttype = (PHYSFS_uint8) ((version >> 8) & 0xFF);
+    const ZIPfileinfo *finfo;
+    const ZIPentry *entry;
 
-    switch (hosttype)
+    if (io->read != ZIP_read)
+        return NULL;  /* not one of ours. */
+
+    finfo = (const ZIPfileinfo *) io->opaque;
+    entry = finfo->entry;
+    if (finfo->verify)
+        return NULL;  /* the bytes have to go through ZIP_read to be checked. */
+    else if (entry->compression_method != COMPMETH_NONE)
+        return NULL;
+    else if (zip_entry_is_encrypted(entry))
+        return NULL;
+
+    *pos = zip_entry_offset(entry);
+    *len = zip_entry_uncompressed_size(entry);
+    return finfo->io;
+} /* ZIP_rawRegion */
+
+
+static int ZIP_verifyIo(PHYSFS_Io *io)
+{
+    ZIPfileinfo *finfo;
+
+    if (io->read != ZIP_read)
+        return 0;  /* not one of ours. */
+
+    finfo = (ZIPfileinfo *) io->opaque;
+    assert(finfo->uncompressed_position == 0);
+    if (finfo->verify == 0)
     {
-            /*
-             * These are the platforms that can NOT build an archive with
-             *  symlinks, according to the Info-ZIP project.
-             */
-        case 0:  /* FS_FAT_  */
-        case 1:  /* AMIGA_   */
-        case 2:  /* VMS_     */
-        case 4:  /* VM_CSM_  */
-        case 6:  /* FS_HPFS_ */
-        case 11: /* FS_NTFS_ */
-        case 14: /* FS_VFAT_ */
-        case 13: /* ACORN_   */
-        case 15: /* MVS_     */
-        case 18: /* THEOS_   */
-            break;  /* do nothing. */
+        finfo->verify = 1;
+        finfo->iface.readAt = NULL;
+    } /* if */
 
-        default:  /* assume the rest to be unix-like. */
-            retval = 1;
-            break;
-    } /* switch */
+    return 1;
+} /* ZIP_verifyIo */
 
-    return retval;
-} /* zip_version_does_symlinks */
 
+static int ZIP_setDictionary(void *opaque, const void *dict,
+                             const PHYSFS_uint64 len)
+{
+#if !PHYSFS_ZIP_ZSTD
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#else
+    ZIPinfo *info = (ZIPinfo *) opaque;
+    ZSTD_DDict *ddict = NULL;
 
-static inline int zip_has_symlink_attr(const ZIPentry *entry,
-                                       const PHYSFS_uint32 extern_attr)
+    if (dict != NULL)
+    {
+        BAIL_IF(!__PHYSFS_ui64FitsAddressSpace(len), PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        ddict = ZSTD_createDDict_advanced(dict, (size_t) len,
+                                          ZSTD_dlm_byCopy, ZSTD_dct_auto,
+                                          zstdPhysfsMem);
+        BAIL_IF(!ddict, PHYSFS_ERR_CORRUPT, 0);  /* or out of memory. */
+    } /* if */
+
+    /*
+     * Open handles (and pooled ones being reused by duplicate()) can still
+     *  point at the old one, so it lives until the archive is closed.
+     */
+    if (info->zstddict != NULL)
+    {
+        ZIPzstddict *old = (ZIPzstddict *) allocator.Malloc(sizeof (*old));
+        if (!old)
+        {
+            ZSTD_freeDDict(ddict);
+            BAIL(PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        } /* if */
+        old->ddict = info->zstddict;
+        old->next = info->oldzstddicts;
+        info->oldzstddicts = old;
+    } /* if */
+
+    info->zstddict = ddict;
+    return 1;
+#endif
+} /* ZIP_setDictionary */
+
+
+static const PHYSFS_Io ZIP_Io =
 {
-    PHYSFS_uint16 xattr = ((extern_attr >> 16) & 0xFFFF);
-    return ( (zip_version_does_symlinks(entry->version)) &&
-             (entry->uncompressed_size > 0) &&
-             ((xattr & UNIX_FILETYPE_MASK) == UNIX_FILETYPE_SYMLINK) );
-} /* zip_has_symlink_attr */
+    CURRENT_PHYSFS_IO_API_VERSION, NULL,
+    ZIP_read,
+    ZIP_write,
+    ZIP_seek,
+    ZIP_tell,
+    ZIP_length,
+    ZIP_duplicate,
+    ZIP_flush,
+    ZIP_destroy,
+    ZIP_readAt
+};
 
 
-static PHYSFS_sint64 zip_dos_time_to_physfs_time(PHYSFS_uint32 dostime)
+/*
+ * Every open file needs a ZIPfileinfo, a duplicate of the archive's Io, and,
+ *  if it's compressed, a read buffer and a decoder of about 86k, and apps
+ *  that open and close lots of small files spend a surprising amount of
+ *  time allocating and freeing all of that. So closed handles go back to a
+ *  small pool in the archive with everything still attached, and the next
+ *  open just resets them. PHYSFS_setDecoderPoolSize() decides how many each
+ *  archive keeps; they're all freed when the archive is unmounted.
+ */
+static void zip_free_fileinfo(ZIPfileinfo *finfo)
 {
-    PHYSFS_uint32 dosdate;
-    struct tm unixtime;
-    memset(&unixtime, '\0', sizeof (unixtime));
+    if (finfo->io != NULL)
+        finfo->io->destroy(finfo->io);
 
-    dosdate = (PHYSFS_uint32) ((dostime >> 16) & 0xFFFF);
-    dostime &= 0xFFFF;
+    inflateEnd(&finfo->stream);  /* safe if it was never initialized. */
 
-    /* dissect date */
-    unixtime.tm_year = ((dosdate >> 9) & 0x7F) + 80;
-    unixtime.tm_mon  = ((dosdate >> 5) & 0x0F) - 1;
-    unixtime.tm_mday = ((dosdate     ) & 0x1F);
+    #if PHYSFS_ZIP_LZMA
+    if (finfo->lzma != NULL)
+    {
+        LzmaDec_Free(&finfo->lzma->dec, &lzmaPhysfsAllocator);
+        allocator.Free(finfo->lzma);
+    } /* if */
+    #endif
 
-    /* dissect time */
-    unixtime.tm_hour = ((dostime >> 11) & 0x1F);
-    unixtime.tm_min  = ((dostime >>  5) & 0x3F);
-    unixtime.tm_sec  = ((dostime <<  1) & 0x3E);
+    #if PHYSFS_ZIP_ZSTD
+    ZSTD_freeDCtx(finfo->zstd);  /* safe if it's NULL. */
+    #endif
 
-    /* let mktime calculate daylight savings time. */
-    unixtime.tm_isdst = -1;
+    #if PHYSFS_ZIP_AES
+    if (finfo->aes != NULL)
+    {
+        memset(finfo->aes, '\0', sizeof (ZIPaes));  /* don't leave keys around. */
+        allocator.Free(finfo->aes);
+    } /* if */
+    #endif
 
-    return ((PHYSFS_sint64) mktime(&unixtime));
-} /* zip_dos_time_to_physfs_time */
+    if (finfo->buffer != NULL)
+        allocator.Free(finfo->buffer);
 
+    allocator.Free(finfo);
+} /* zip_free_fileinfo */
 
-static ZIPentry *zip_load_entry(ZIPinfo *info, const int zip64,
-                                const PHYSFS_uint64 ofs_fixup)
+
+/* Get a ZIPfileinfo ready to read (entry) from the start. */
+static ZIPfileinfo *zip_acquire_fileinfo(ZIPinfo *info, PHYSFS_Io *srcio,
+                                         ZIPentry *entry)
 {
-    PHYSFS_Io *io = info->io;
-    ZIPentry entry;
-    ZIPentry *retval = NULL;
-    PHYSFS_uint16 fnamelen, extralen, commentlen;
-    PHYSFS_uint32 external_attr;
-    PHYSFS_uint32 starting_disk;
-    PHYSFS_uint64 offset;
-    PHYSFS_uint16 ui16;
-    PHYSFS_uint32 ui32;
-    PHYSFS_sint64 si64;
-    char *name = NULL;
-    int isdir = 0;
+    ZIPfileinfo *finfo;
 
-    /* sanity check with central directory signature... */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), NULL);
-    BAIL_IF(ui32 != ZIP_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, NULL);
+    __PHYSFS_platformGrabMutex(info->poollock);
+    finfo = info->pool;
+    if (finfo != NULL)
+    {
+        info->pool = finfo->nextfree;
+        info->poolcount--;
+    } /* if */
+    __PHYSFS_platformReleaseMutex(info->poollock);
+
+    if (finfo == NULL)
+    {
+        finfo = (ZIPfileinfo *) allocator.Malloc(sizeof (ZIPfileinfo));
+        BAIL_IF(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        memset(finfo, '\0', sizeof (ZIPfileinfo));
+        initializeZStream(&finfo->stream);
+        finfo->info = info;
+    } /* if */
+
+    /* a pooled Io is a duplicate of the archive's Io, too, so it's fine. */
+    if (finfo->io == NULL)
+    {
+        finfo->io = srcio->duplicate(srcio);
+        GOTO_IF_ERRPASS(!finfo->io, acquire_failed);
+    } /* if */
+
+    GOTO_IF_ERRPASS(!finfo->io->seek(finfo->io, zip_entry_offset(entry)), acquire_failed);
+
+    #if PHYSFS_ZIP_AES
+    if ((entry->aes) && (finfo->aes == NULL))
+    {
+        /* the keys get set up by ZIP_openRead() or ZIP_duplicate(). */
+        finfo->aes = (ZIPaes *) allocator.Malloc(sizeof (ZIPaes));
+        GOTO_IF(!finfo->aes, PHYSFS_ERR_OUT_OF_MEMORY, acquire_failed);
+    } /* if */
+    #endif
+
+    if (entry->compression_method != COMPMETH_NONE)
+    {
+        if (finfo->buffer == NULL)
+        {
+            finfo->buffer = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
+            GOTO_IF(!finfo->buffer, PHYSFS_ERR_OUT_OF_MEMORY, acquire_failed);
+        } /* if */
+
+        #if PHYSFS_ZIP_LZMA
+        if (entry->compression_method == COMPMETH_LZMA)
+        {
+            if (finfo->lzma == NULL)
+            {
+                finfo->lzma = (ZIPlzma *) allocator.Malloc(sizeof (ZIPlzma));
+                GOTO_IF(!finfo->lzma, PHYSFS_ERR_OUT_OF_MEMORY, acquire_failed);
+                LzmaDec_Construct(&finfo->lzma->dec);
+            } /* if */
+
+            /* the header gets read, and the decoder set up, on first read. */
+            finfo->lzma->bufpos = finfo->lzma->buflen = 0;
+        } /* if */
+        else
+        #endif
+        #if PHYSFS_ZIP_ZSTD
+        if (entry->compression_method == COMPMETH_ZSTD)
+        {
+            if (finfo->zstd == NULL)
+            {
+                finfo->zstd = ZSTD_createDCtx_advanced(zstdPhysfsMem);
+                GOTO_IF(!finfo->zstd, PHYSFS_ERR_OUT_OF_MEMORY, acquire_failed);
+            } /* if */
+            /* zip_zstd_read() resets it at compressed_position 0. */
+        } /* if */
+        else
+        #endif
+        {
+            if (finfo->stream.state != NULL)
+                inflateReset(&finfo->stream);
+            else if (zlib_err(inflateInit2(&finfo->stream, -MAX_WBITS)) != Z_OK)
+                goto acquire_failed;
+
+            finfo->stream.next_in = finfo->buffer;
+            finfo->stream.avail_in = 0;
+        } /* else */
+    } /* if */
+
+    finfo->entry = entry;
+    finfo->nextfree = NULL;
+    finfo->compressed_position = finfo->uncompressed_position = 0;
+    memset(finfo->crypto_keys, '\0', sizeof (finfo->crypto_keys));
+    memset(finfo->initial_crypto_keys, '\0', sizeof (finfo->initial_crypto_keys));
+    finfo->seekindex = NULL;
+    finfo->nextcheckpoint = 0;
+    finfo->crc = 0;
+    finfo->crcpos = 0;
+    #if PHYSFS_ZIP_ZSTD
+    finfo->zstddict = NULL;  /* the caller sets this, under the stateLock. */
+    #endif
+    finfo->verify = PHYSFS_getChecksumVerification() ? 1 : 0;
+
+    memcpy(&finfo->iface, &ZIP_Io, sizeof (PHYSFS_Io));
+    finfo->iface.opaque = finfo;
+
+    /*
+     * positional reads only make sense if the data is stored as-is, and
+     *  they'd go around the CRC check. They also have to be positional all
+     *  the way down, or two threads would fight over the archive's seek
+     *  position.
+     */
+    if ((entry->compression_method != COMPMETH_NONE) ||
+        (zip_entry_is_encrypted(entry)) || (finfo->verify) ||
+        (!__PHYSFS_ioHasReadAt(finfo->io)))
+        finfo->iface.readAt = NULL;
+
+    return finfo;
+
+acquire_failed:
+    zip_free_fileinfo(finfo);
+    return NULL;
+} /* zip_acquire_fileinfo */
+
+
+static void zip_release_fileinfo(ZIPfileinfo *finfo)
+{
+    ZIPinfo *info = finfo->info;
+    const int poolsize = PHYSFS_getDecoderPoolSize();
+    ZIPfileinfo *extra = NULL;
+
+    #if PHYSFS_ZIP_LZMA
+    if ((finfo->lzma != NULL) &&
+        (finfo->lzma->dec.dicBufSize > ZIP_POOL_MAX_DECODER))
+        LzmaDec_Free(&finfo->lzma->dec, &lzmaPhysfsAllocator);
+    #endif
+
+    #if PHYSFS_ZIP_ZSTD
+    if ((finfo->zstd != NULL) &&
+        (ZSTD_sizeof_DCtx(finfo->zstd) > ZIP_POOL_MAX_DECODER))
+    {
+        ZSTD_freeDCtx(finfo->zstd);
+        finfo->zstd = NULL;
+    } /* if */
+    #endif
+
+    __PHYSFS_platformGrabMutex(info->poollock);
+    finfo->nextfree = info->pool;
+    info->pool = finfo;
+    info->poolcount++;
+
+    /* this also trims the pool if the app made it smaller. */
+    while ((info->pool != NULL) && (info->poolcount > (PHYSFS_uint32) poolsize))
+    {
+        finfo = info->pool;
+        info->pool = finfo->nextfree;
+        info->poolcount--;
+        finfo->nextfree = extra;
+        extra = finfo;
+    } /* while */
+    __PHYSFS_platformReleaseMutex(info->poollock);
+
+    while (extra != NULL)
+    {
+        finfo = extra;
+        extra = finfo->nextfree;
+        zip_free_fileinfo(finfo);
+    } /* while */
+} /* zip_release_fileinfo */
+
+
+/*
+ * Set up (finfo), fresh from zip_acquire_fileinfo(), to decrypt its entry
+ *  with (password). (password) can be NULL if the caller doesn't have one,
+ *  which is an error.
+ */
+static int zip_prep_decrypt(ZIPinfo *info, ZIPfileinfo *finfo,
+                            const PHYSFS_uint8 *password)
+{
+    PHYSFS_Io *io = finfo->io;
+    PHYSFS_uint8 crypto_header[12];
+
+    BAIL_IF(password == NULL, PHYSFS_ERR_BAD_PASSWORD, 0);
+
+    #if PHYSFS_ZIP_AES
+    if (finfo->entry->aes)
+        return zip_aes_prep(info, finfo, (const char *) password);
+    #endif
+
+    BAIL_IF_ERRPASS(io->read(io, crypto_header, 12) != 12, 0);
+    return zip_prep_crypto_keys(finfo, crypto_header, password);
+} /* zip_prep_decrypt */
+
+
+
+static PHYSFS_sint64 zip_find_end_of_central_dir(PHYSFS_Io *io, PHYSFS_sint64 *len)
+{
+    PHYSFS_uint8 buf[256];
+    PHYSFS_uint8 extra[4] = { 0, 0, 0, 0 };
+    PHYSFS_sint32 i = 0;
+    PHYSFS_sint64 filelen;
+    PHYSFS_sint64 filepos;
+    PHYSFS_sint32 maxread;
+    PHYSFS_sint32 totalread = 0;
+    int found = 0;
+
+    filelen = io->length(io);
+    BAIL_IF_ERRPASS(filelen == -1, -1);
+
+    /*
+     * Jump to the end of the file and start reading backwards.
+     *  The last thing in the file is the zipfile comment, which is variable
+     *  length, and the field that specifies its size is before it in the
+     *  file (argh!)...this means that we need to scan backwards until we
+     *  hit the end-of-central-dir signature. We can then sanity check that
+     *  the comment was as big as it should be to make sure we're in the
+     *  right place. The comment length field is 16 bits, so we can stop
+     *  searching for that signature after a little more than 64k at most,
+     *  and call it a corrupted zipfile.
+     */
+
+    if (sizeof (buf) < filelen)
+    {
+        filepos = filelen - sizeof (buf);
+        maxread = sizeof (buf);
+    } /* if */
+    else
+    {
+        filepos = 0;
+        maxread = (PHYSFS_uint32) filelen;
+    } /* else */
+
+    while ((totalread < filelen) && (totalread < 65557))
+    {
+        BAIL_IF_ERRPASS(!io->seek(io, filepos), -1);
+
+        /* make sure we catch a signature between buffers. */
+        if (totalread != 0)
+        {
+            if (!__PHYSFS_readAll(io, buf, maxread - 4))
+                return -1;
+            memcpy(&buf[maxread - 4], &extra, sizeof (extra));
+            totalread += maxread - 4;
+        } /* if */
+        else
+        {
+            if (!__PHYSFS_readAll(io, buf, maxread))
+                return -1;
+            totalread += maxread;
+        } /* else */
+
+        memcpy(&extra, buf, sizeof (extra));
+
+        for (i = maxread - 4; i > 0; i--)
+        {
+            if ((buf[i + 0] == 0x50) &&
+                (buf[i + 1] == 0x4B) &&
+                (buf[i + 2] == 0x05) &&
+                (buf[i + 3] == 0x06) )
+            {
+                found = 1;  /* that's the signature! */
+                break;  
+            } /* if */
+        } /* for */
+
+        if (found)
+            break;
+
+        filepos -= (maxread - 4);
+        if (filepos < 0)
+            filepos = 0;
+    } /* while */
+
+    BAIL_IF(!found, PHYSFS_ERR_UNSUPPORTED, -1);
+
+    if (len != NULL)
+        *len = filelen;
+
+    return (filepos + i);
+} /* zip_find_end_of_central_dir */
+
+
+static int isZip(PHYSFS_Io *io)
+{
+    PHYSFS_uint32 sig = 0;
+    int retval = 0;
+
+    /*
+     * The first thing in a zip file might be the signature of the
+     *  first local file record, so it makes for a quick determination.
+     */
+    if (readui32(io, &sig))
+    {
+        retval = (sig == ZIP_LOCAL_FILE_SIG);
+        if (!retval)
+        {
+            /*
+             * No sig...might be a ZIP with data at the start
+             *  (a self-extracting executable, etc), so we'll have to do
+             *  it the hard way...
+             */
+            retval = (zip_find_end_of_central_dir(io, NULL) != -1);
+        } /* if */
+    } /* if */
+
+    return retval;
+} /* isZip */
+
+
+/* Convert paths from old, buggy DOS zippers... */
+static int zip_version_has_dos_paths(const PHYSFS_uint16 entryversion)
+{
+    const PHYSFS_uint8 hosttype = (PHYSFS_uint8) ((entryversion >> 8) & 0xFF);
+    return (hosttype == 0);  /* FS_FAT_ */
+} /* zip_version_has_dos_paths */
+
+
+static void zip_convert_dos_path(const int dospaths, char *path)
+{
+    if (dospaths)
+    {
+        while (*path)
+        {
+            if (*path == '\\')
+                *path = '/';
+            path++;
+        } /* while */
+    } /* if */
+} /* zip_convert_dos_path */
+
+
+static void zip_expand_symlink_path(char *path)
+{
+    char *ptr = path;
+    char *prevptr = path;
+
+    while (1)
+    {
+        ptr = strchr(ptr, '/');
+        if (ptr == NULL)
+            break;
+
+        if (*(ptr + 1) == '.')
+        {
+            if (*(ptr + 2) == '/')
+            {
+                /* current dir in middle of string: ditch it. */
+                memmove(ptr, ptr + 2, strlen(ptr + 2) + 1);
+            } /* else if */
+
+            else if (*(ptr + 2) == '\0')
+            {
+                /* current dir at end of string: ditch it. */
+                *ptr = '\0';
+            } /* else if */
+
+            else if (*(ptr + 2) == '.')
+            {
+                if (*(ptr + 3) == '/')
+                {
+                    /* parent dir in middle: move back one, if possible. */
+                    memmove(prevptr, ptr + 4, strlen(ptr + 4) + 1);
+                    ptr = prevptr;
+                    while (prevptr != path)
+                    {
+                        prevptr--;
+                        if (*prevptr == '/')
+                        {
+                            prevptr++;
+                            break;
+                        } /* if */
+                    } /* while */
+                } /* if */
+
+                if (*(ptr + 3) == '\0')
+                {
+                    /* parent dir at end: move back one, if possible. */
+                    *prevptr = '\0';
+                } /* if */
+            } /* if */
+        } /* if */
+        else
+        {
+            prevptr = ptr;
+            ptr++;
+        } /* else */
+    } /* while */
+} /* zip_expand_symlink_path */
+
+
+/* (forward reference: lazily-mounted files are found via the central dir.) */
+static ZIPentry *zip_lazy_find(ZIPinfo *info, const char *path);
+
+static inline ZIPentry *zip_find_entry(ZIPinfo *info, const char *path)
+{
+    ZIPentry *retval = (ZIPentry *) __PHYSFS_DirTreeFind(&info->tree, path);
+    if ((retval == NULL) && ((info->lazyfiles) || (info->index)))
+        retval = zip_lazy_find(info, path);
+    return retval;
+} /* zip_find_entry */
+
+/* (forward reference: zip_follow_symlink and zip_resolve call each other.) */
+static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry,
+                       const PHYSFS_uint8 *password);
+
+/*
+ * Look for the entry named by (path). If it exists, resolve it, and return
+ *  a pointer to that entry. If it's another symlink, keep resolving until you
+ *  hit a real file and then return a pointer to the final non-symlink entry.
+ *  If there's a problem, return NULL. (password) is for encrypted links.
+ */
+static ZIPentry *zip_follow_symlink(PHYSFS_Io *io, ZIPinfo *info, char *path,
+                                    const PHYSFS_uint8 *password)
+{
+    ZIPentry *entry;
+
+    zip_expand_symlink_path(path);
+    entry = zip_find_entry(info, path);
+    if (entry != NULL)
+    {
+        if (!zip_resolve(io, info, entry, password))  /* recursive! */
+            entry = NULL;
+        else
+        {
+            if (entry->symlink != NULL)
+                entry = entry->symlink;
+        } /* else */
+    } /* if */
+
+    return entry;
+} /* zip_follow_symlink */
+
+
+static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry,
+                               const PHYSFS_uint8 *password)
+{
+    const size_t size = (size_t) zip_entry_uncompressed_size(entry);
+    ZIPfileinfo *finfo = NULL;
+    char *path = NULL;
+    int rc = 0;
+
+    /*
+     * We've already parsed the local file header of the symlink at this
+     *  point. Now we need to read the actual link from the file data and
+     *  follow it. It's read like any other entry, so whatever compression
+     *  and encryption ZIP_openRead() can handle works here, too.
+     */
+
+    BAIL_IF(!zip_compression_supported(entry), PHYSFS_ERR_UNSUPPORTED, 0);
+
+    path = (char *) __PHYSFS_smallAlloc(size + 1);
+    BAIL_IF(!path, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    finfo = zip_acquire_fileinfo(info, io, entry);
+    if (finfo != NULL)
+    {
+        #if PHYSFS_ZIP_ZSTD
+        finfo->zstddict = info->zstddict;
+        #endif
+        if ((!zip_entry_is_encrypted(entry)) ||
+            (zip_prep_decrypt(info, finfo, password)))
+            rc = (ZIP_read(&finfo->iface, path, size) == (PHYSFS_sint64) size);
+        zip_release_fileinfo(finfo);
+    } /* if */
+
+    if (rc)
+    {
+        path[size] = '\0';    /* null-terminate it. */
+        zip_convert_dos_path(entry->flags & ZIP_ENTRY_DOS_PATHS, path);
+        entry->symlink = zip_follow_symlink(io, info, path, password);
+    } /* else */
+
+    __PHYSFS_smallFree(path);
+
+    return (entry->symlink != NULL);
+} /* zip_resolve_symlink */
+
+
+#if PHYSFS_ZIP_AES
+/*
+ * Find the WinZip AES extra field in the (extralen) bytes of a local header's
+ *  extra field at (extra). This sets entry->aes and the real compression
+ *  method.
+ */
+static int zip_parse_aes_extra(ZIPentry *entry, const PHYSFS_uint8 *extra,
+                               PHYSFS_uint16 extralen)
+{
+    PHYSFS_uint16 sig = 0;
+    PHYSFS_uint16 len = 0;
+    PHYSFS_uint16 version, vendor, method;
+    PHYSFS_uint8 strength;
+
+    while (extralen >= 4)
+    {
+        sig = peekui16(extra);
+        len = peekui16(extra + 2);
+        BAIL_IF(len > extralen - 4, PHYSFS_ERR_CORRUPT, 0);
+        if (sig == ZIP_AES_EXTRA_FIELD_SIG)
+            break;
+        extra += 4 + len;
+        extralen -= 4 + len;
+    } /* while */
+
+    BAIL_IF(sig != ZIP_AES_EXTRA_FIELD_SIG, PHYSFS_ERR_CORRUPT, 0);
+    BAIL_IF(len < 7, PHYSFS_ERR_CORRUPT, 0);
+    version = peekui16(extra + 4);
+    vendor = peekui16(extra + 6);
+    strength = extra[8];
+    method = peekui16(extra + 9);
+
+    BAIL_IF(vendor != ('A' | ('E' << 8)), PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF((version != 1) && (version != 2), PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF((strength < 1) || (strength > 3), PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF(method == COMPMETH_AES, PHYSFS_ERR_CORRUPT, 0);
+
+    entry->aes = strength | ((version == 2) ? ZIP_AES_NO_CRC : 0);
+    entry->compression_method = method;
+
+    BAIL_IF(zip_entry_compressed_size(entry) <
+                zip_entry_crypto_header_len(entry) + ZIP_AES_MACLEN,
+            PHYSFS_ERR_CORRUPT, 0);
+
+    return 1;
+} /* zip_parse_aes_extra */
+#endif
+
+
+/*
+ * Check the fixed part of an entry's local file header, which is at (hdr),
+ *  and update entry->offset to point at the file data. The filename and
+ *  extra field lengths come back in (*fnamelen) and (*extralen).
+ */
+static int zip_check_local(ZIPentry *entry, const PHYSFS_uint8 *hdr,
+                           PHYSFS_uint16 *fnamelen, PHYSFS_uint16 *extralen)
+{
+    PHYSFS_uint32 ui32;
+    const PHYSFS_uint64 offset = zip_entry_offset(entry);
+    const PHYSFS_uint64 compressed_size = zip_entry_compressed_size(entry);
+    const PHYSFS_uint64 uncompressed_size = zip_entry_uncompressed_size(entry);
+
+    /*
+     * crc and (un)compressed_size are always zero if this is a "JAR"
+     *  archive created with Sun's Java tools, apparently. We only
+     *  consider this archive corrupted if those entries don't match and
+     *  aren't zero. That seems to work well.
+     * We also ignore a mismatch if the value is 0xFFFFFFFF here, since it's
+     *  possible that's a Zip64 thing.
+     */
+
+    /* !!! FIXME: apparently these are zero if general purpose bit 3 is set,
+       !!! FIXME:  which is probably true for Jar files, fwiw, but we don't
+       !!! FIXME:  care about these values anyhow. */
+
+    BAIL_IF(peekui32(hdr) != ZIP_LOCAL_FILE_SIG, PHYSFS_ERR_CORRUPT, 0);
+    BAIL_IF(peekui16(hdr + 4) != entry->version_needed, PHYSFS_ERR_CORRUPT, 0);
+    /* (hdr + 6) is the general bits. */
+    BAIL_IF(peekui16(hdr + 8) != entry->compression_method,
+            PHYSFS_ERR_CORRUPT, 0);
+    /* (hdr + 10) is the date/time. */
+    ui32 = peekui32(hdr + 14);
+    BAIL_IF(ui32 && (ui32 != entry->crc), PHYSFS_ERR_CORRUPT, 0);
+
+    ui32 = peekui32(hdr + 18);
+    BAIL_IF(ui32 && (ui32 != 0xFFFFFFFF) &&
+                  (ui32 != compressed_size), PHYSFS_ERR_CORRUPT, 0);
+
+    ui32 = peekui32(hdr + 22);
+    BAIL_IF(ui32 && (ui32 != 0xFFFFFFFF) &&
+                 (ui32 != uncompressed_size), PHYSFS_ERR_CORRUPT, 0);
+
+    *fnamelen = peekui16(hdr + 26);
+    *extralen = peekui16(hdr + 28);
+
+    BAIL_IF(!zip_entry_set_location(entry, offset + ZIP_LOCAL_HEADER_LEN +
+                                           *fnamelen + *extralen,
+                                    compressed_size, uncompressed_size),
+            PHYSFS_ERR_CORRUPT, 0);
+
+    return 1;
+} /* zip_check_local */
+
+
+/*
+ * Parse the local file header of an entry, and update entry->offset.
+ */
+static int zip_parse_local(PHYSFS_Io *io, ZIPentry *entry)
+{
+    PHYSFS_uint8 hdr[ZIP_LOCAL_HEADER_LEN];
+    PHYSFS_uint16 fnamelen;
+    PHYSFS_uint16 extralen;
+    const PHYSFS_uint64 offset = zip_entry_offset(entry);
+
+    BAIL_IF_ERRPASS(!io->seek(io, offset), 0);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(io, hdr, sizeof (hdr)), 0);
+    BAIL_IF_ERRPASS(!zip_check_local(entry, hdr, &fnamelen, &extralen), 0);
+
+    #if PHYSFS_ZIP_AES
+    if ((entry->compression_method == COMPMETH_AES) &&
+        (zip_entry_is_encrypted(entry)))
+    {
+        PHYSFS_uint8 *extra = (PHYSFS_uint8 *) __PHYSFS_smallAlloc(extralen + 1);
+        int rc = 0;
+        BAIL_IF(!extra, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        if (io->seek(io, offset + ZIP_LOCAL_HEADER_LEN + fnamelen))
+        {
+            if (__PHYSFS_readAll(io, extra, extralen))
+                rc = zip_parse_aes_extra(entry, extra, extralen);
+        } /* if */
+        __PHYSFS_smallFree(extra);
+        BAIL_IF_ERRPASS(!rc, 0);
+    } /* if */
+    #endif
+
+    return 1;
+} /* zip_parse_local */
+
+
+static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry,
+                       const PHYSFS_uint8 *password)
+{
+    int retval = 1;
+    const ZipResolveType resolve_type = zip_entry_resolved(entry);
+
+    if (resolve_type == ZIP_DIRECTORY)
+        return 1;   /* we're good. */
+
+    /*
+     * An encrypted link can't be followed without the password, but it
+     *  isn't broken; leave it alone so an open with "$PASSWORD" can do it.
+     */
+    BAIL_IF((resolve_type == ZIP_UNRESOLVED_SYMLINK) && (password == NULL) &&
+            (zip_entry_is_encrypted(entry)), PHYSFS_ERR_BAD_PASSWORD, 0);
+
+    /* Don't bother if we've failed to resolve this entry before. */
+    BAIL_IF(resolve_type == ZIP_BROKEN_FILE, PHYSFS_ERR_CORRUPT, 0);
+    BAIL_IF(resolve_type == ZIP_BROKEN_SYMLINK, PHYSFS_ERR_CORRUPT, 0);
+
+    /* uhoh...infinite symlink loop! */
+    BAIL_IF(resolve_type == ZIP_RESOLVING, PHYSFS_ERR_SYMLINK_LOOP, 0);
+
+    /*
+     * We fix up the offset to point to the actual data on the
+     *  first open, since we don't want to seek across the whole file on
+     *  archive open (can be SLOW on large, CD-stored files), but we
+     *  need to check the local file header...not just for corruption,
+     *  but since it stores offset info the central directory does not.
+     */
+    if (resolve_type != ZIP_RESOLVED)
+    {
+        if (entry->tree.isdir)  /* an ancestor dir that DirTree filled in? */
+        {
+            zip_entry_set_resolved(entry, ZIP_DIRECTORY);
+            return 1;
+        } /* if */
+
+        retval = zip_parse_local(io, entry);
+        if (retval)
+        {
+            /*
+             * If it's a symlink, find the original file. This will cause
+             *  resolution of other entries (other symlinks and, eventually,
+             *  the real file) if all goes well.
+             */
+            if (resolve_type == ZIP_UNRESOLVED_SYMLINK)
+                retval = zip_resolve_symlink(io, info, entry, password);
+        } /* if */
+
+        if (resolve_type == ZIP_UNRESOLVED_SYMLINK)
+        {
+            zip_entry_set_resolved(entry, (retval) ? ZIP_RESOLVED :
+                                                     ZIP_BROKEN_SYMLINK);
+        } /* if */
+        else if (resolve_type == ZIP_UNRESOLVED_FILE)
+        {
+            zip_entry_set_resolved(entry, (retval) ? ZIP_RESOLVED :
+                                                     ZIP_BROKEN_FILE);
+        } /* else if */
+    } /* if */
+
+    return retval;
+} /* zip_resolve */
+
+
+/*
+ * Resolving entries as they're opened means a seek back into the archive
+ *  for each one, which is painful on a hard drive or a network filesystem.
+ *  zip_resolve_all() does every file that's still unresolved in one pass:
+ *  it sorts them by offset and reads forward through the archive, up to
+ *  ZIP_RESOLVE_BUFLEN bytes at a time. Each read stops at the last header
+ *  that fits, so a run of small files costs one read, and a big file
+ *  between two headers costs one forward seek instead of reading through
+ *  its data. Symlinks are left alone; they still need to read their targets.
+ */
+#define ZIP_RESOLVE_BUFLEN (256 * 1024)
+
+static int zip_resolve_cmp(void *_a, size_t one, size_t two)
+{
+    ZIPentry **a = (ZIPentry **) _a;
+    const PHYSFS_uint64 x = zip_entry_offset(a[one]);
+    const PHYSFS_uint64 y = zip_entry_offset(a[two]);
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+} /* zip_resolve_cmp */
+
+static void zip_resolve_swap(void *_a, size_t one, size_t two)
+{
+    ZIPentry **a = (ZIPentry **) _a;
+    ZIPentry *tmp = a[one];
+    a[one] = a[two];
+    a[two] = tmp;
+} /* zip_resolve_swap */
+
+
+/* Fill (buf) with up to (want) bytes from (pos); less at end of archive. */
+static int zip_resolve_fill(PHYSFS_Io *io, PHYSFS_uint8 *buf,
+                            const PHYSFS_uint64 pos, const size_t want,
+                            size_t *len)
+{
+    assert(want <= ZIP_RESOLVE_BUFLEN);
+    *len = 0;
+    BAIL_IF_ERRPASS(!io->seek(io, pos), 0);
+    while (*len < want)
+    {
+        const PHYSFS_sint64 br = io->read(io, buf + *len, want - *len);
+        BAIL_IF_ERRPASS(br < 0, 0);
+        if (br == 0)
+            break;  /* end of archive. */
+        *len += (size_t) br;
+    } /* while */
+    return 1;
+} /* zip_resolve_fill */
+
+
+/*
+ * Entries with bad local headers are marked broken, just like a failed
+ *  zip_resolve(), and we report PHYSFS_ERR_CORRUPT once the rest are done.
+ *  If reading the archive fails, whatever we didn't get to is left to be
+ *  resolved when it's opened.
+ */
+static int zip_resolve_all(ZIPinfo *info)
+{
+    const __PHYSFS_DirTree *tree = &info->tree;
+    PHYSFS_Io *io = info->io;
+    const PHYSFS_sint64 arclen = io->length(io);
+    ZIPentry **entries = NULL;
+    PHYSFS_uint8 *buf = NULL;
+    PHYSFS_uint64 bufpos = 0;
+    size_t buflen = 0;
+    size_t count = 0;
+    size_t i;
+    int broken = 0;
+    int retval = 0;
+
+    BAIL_IF_ERRPASS(arclen == -1, 0);
+
+    for (i = 0; i < tree->hashBuckets; i++)
+    {
+        const __PHYSFS_DirTreeEntry *e;
+        for (e = tree->hash[i]; e != NULL; e = e->hashnext)
+        {
+            const ZIPentry *entry = (const ZIPentry *) e;
+            if ((!e->isdir) && (zip_entry_resolved(entry) == ZIP_UNRESOLVED_FILE))
+                count++;
+        } /* for */
+    } /* for */
+
+    if (count == 0)
+        return 1;  /* nothing to do. */
+
+    entries = (ZIPentry **) allocator.Malloc(count * sizeof (ZIPentry *));
+    GOTO_IF(!entries, PHYSFS_ERR_OUT_OF_MEMORY, zip_resolve_all_done);
+    buf = (PHYSFS_uint8 *) allocator.Malloc(ZIP_RESOLVE_BUFLEN);
+    GOTO_IF(!buf, PHYSFS_ERR_OUT_OF_MEMORY, zip_resolve_all_done);
+
+    count = 0;
+    for (i = 0; i < tree->hashBuckets; i++)
+    {
+        __PHYSFS_DirTreeEntry *e;
+        for (e = tree->hash[i]; e != NULL; e = e->hashnext)
+        {
+            ZIPentry *entry = (ZIPentry *) e;
+            if ((!e->isdir) && (zip_entry_resolved(entry) == ZIP_UNRESOLVED_FILE))
+                entries[count++] = entry;
+        } /* for */
+    } /* for */
+
+    __PHYSFS_sort(entries, count, zip_resolve_cmp, zip_resolve_swap);
+
+    for (i = 0; i < count; i++)
+    {
+        ZIPentry *entry = entries[i];
+        const PHYSFS_uint64 offset = zip_entry_offset(entry);
+        PHYSFS_uint64 need = offset + ZIP_LOCAL_HEADER_LEN;
+        PHYSFS_uint16 fnamelen = 0;
+        PHYSFS_uint16 extralen = 0;
+        int rc = 0;
+
+        if (need > (PHYSFS_uint64) arclen)
+            PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+        else
+        {
+            if (need > bufpos + buflen)  /* sorted, so never behind us. */
+            {
+                const PHYSFS_uint64 end = offset + ZIP_RESOLVE_BUFLEN;
+                size_t j;
+                for (j = i + 1; j < count; j++)
+                {
+                    const PHYSFS_uint64 next = zip_entry_offset(entries[j]);
+                    if (next + ZIP_LOCAL_HEADER_LEN > end)
+                        break;
+                    need = next + ZIP_LOCAL_HEADER_LEN;
+                } /* for */
+
+                bufpos = offset;
+                GOTO_IF_ERRPASS(!zip_resolve_fill(io, buf, bufpos,
+                                                  (size_t) (need - offset),
+                                                  &buflen),
+                                zip_resolve_all_done);
+                need = offset + ZIP_LOCAL_HEADER_LEN;
+            } /* if */
+
+            if (need > bufpos + buflen)  /* archive changed under us? */
+                PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+            else
+            {
+                rc = zip_check_local(entry, buf + (size_t) (offset - bufpos),
+                                     &fnamelen, &extralen);
+            } /* else */
+        } /* else */
+
+        #if PHYSFS_ZIP_AES
+        if ((rc) && (entry->compression_method == COMPMETH_AES) &&
+            (zip_entry_is_encrypted(entry)))
+        {
+            /* a header and its extra field always fit in the buffer. */
+            need += fnamelen + extralen;
+            if (need > bufpos + buflen)
+            {
+                bufpos = offset;
+                GOTO_IF_ERRPASS(!zip_resolve_fill(io, buf, bufpos,
+                                                  (size_t) (need - offset),
+                                                  &buflen),
+                                zip_resolve_all_done);
+            } /* if */
+
+            if (need > bufpos + buflen)
+            {
+                PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+                rc = 0;
+            } /* if */
+            else
+            {
+                rc = zip_parse_aes_extra(entry, buf + (size_t)
+                            (offset + ZIP_LOCAL_HEADER_LEN + fnamelen - bufpos),
+                            extralen);
+            } /* else */
+        } /* if */
+        #endif
+
+        zip_entry_set_resolved(entry, rc ? ZIP_RESOLVED : ZIP_BROKEN_FILE);
+        if (!rc)
+            broken = 1;
+    } /* for */
+
+    if (broken)
+        PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+    else
+        retval = 1;
+
+zip_resolve_all_done:
+    if (buf != NULL)
+        allocator.Free(buf);
+    if (entries != NULL)
+        allocator.Free(entries);
+    return retval;
+} /* zip_resolve_all */
+
+
+static int ZIP_resolveAll(void *opaque)
+{
+    return zip_resolve_all((ZIPinfo *) opaque);
+} /* ZIP_resolveAll */
+
+
+static int zip_entry_is_symlink(const ZIPentry *entry)
+{
+    const ZipResolveType resolved = zip_entry_resolved(entry);
+    return ((resolved == ZIP_UNRESOLVED_SYMLINK) ||
+            (resolved == ZIP_BROKEN_SYMLINK) ||
+            (entry->symlink));
+} /* zip_entry_is_symlink */
+
+
+static int zip_version_does_symlinks(PHYSFS_uint32 version)
+{
+    int retval = 0;
+    PHYSFS_uint8 hosttype = (PHYSFS_uint8) ((version >> 8) & 0xFF);
+
+    switch (hosttype)
+    {
+            /*
+             * These are the platforms that can NOT build an archive with
+             *  symlinks, according to the Info-ZIP project.
+             */
+        case 0:  /* FS_FAT_  */
+        case 1:  /* AMIGA_   */
+        case 2:  /* VMS_     */
+        case 4:  /* VM_CSM_  */
+        case 6:  /* FS_HPFS_ */
+        case 11: /* FS_NTFS_ */
+        case 14: /* FS_VFAT_ */
+        case 13: /* ACORN_   */
+        case 15: /* MVS_     */
+        case 18: /* THEOS_   */
+            break;  /* do nothing. */
+
+        default:  /* assume the rest to be unix-like. */
+            retval = 1;
+            break;
+    } /* switch */
+
+    return retval;
+} /* zip_version_does_symlinks */
+
+
+static inline int zip_has_symlink_attr(const PHYSFS_uint16 version,
+                                       const PHYSFS_uint64 uncompressed_size,
+                                       const PHYSFS_uint32 extern_attr)
+{
+    PHYSFS_uint16 xattr = ((extern_attr >> 16) & 0xFFFF);
+    return ( (zip_version_does_symlinks(version)) &&
+             (uncompressed_size > 0) &&
+             ((xattr & UNIX_FILETYPE_MASK) == UNIX_FILETYPE_SYMLINK) );
+} /* zip_has_symlink_attr */
+
+
+static PHYSFS_sint64 zip_dos_time_to_physfs_time(PHYSFS_uint32 dostime)
+{
+    PHYSFS_uint32 dosdate;
+    struct tm unixtime;
+    memset(&unixtime, '\0', sizeof (unixtime));
+
+    dosdate = (PHYSFS_uint32) ((dostime >> 16) & 0xFFFF);
+    dostime &= 0xFFFF;
+
+    /* dissect date */
+    unixtime.tm_year = ((dosdate >> 9) & 0x7F) + 80;
+    unixtime.tm_mon  = ((dosdate >> 5) & 0x0F) - 1;
+    unixtime.tm_mday = ((dosdate     ) & 0x1F);
+
+    /* dissect time */
+    unixtime.tm_hour = ((dostime >> 11) & 0x1F);
+    unixtime.tm_min  = ((dostime >>  5) & 0x3F);
+    unixtime.tm_sec  = ((dostime <<  1) & 0x3E);
+
+    /* let mktime calculate daylight savings time. */
+    unixtime.tm_isdst = -1;
+
+    return ((PHYSFS_sint64) mktime(&unixtime));
+} /* zip_dos_time_to_physfs_time */
+
+
+/*
+ * A central directory record, parsed but not added to the DirTree yet. The
+ *  big-archive loader below parses these on other threads.
+ */
+typedef struct
+{
+    char *name;                         /* converted, null-terminated.    */
+    PHYSFS_uint64 cdofs;                /* from start of central dir.     */
+    PHYSFS_uint64 offset;               /* offset of local header, fixed. */
+    PHYSFS_uint64 compressed_size;
+    PHYSFS_uint64 uncompressed_size;
+    PHYSFS_uint32 crc;
+    PHYSFS_uint32 dos_mod_time;
+    PHYSFS_uint32 hash;                 /* of name; lazy mounts only.     */
+    PHYSFS_uint16 version_needed;
+    PHYSFS_uint16 general_bits;
+    PHYSFS_uint16 compression_method;
+    PHYSFS_uint8 flags;                 /* ZipResolveType | ZIP_ENTRY_*   */
+    PHYSFS_uint8 isdir;
+} ZIPcdrecord;
+
+static inline size_t zip_cdrecord_len(const PHYSFS_uint8 *ptr)
+{
+    return ZIP_CENTRAL_DIR_RECORD_LEN + ((size_t) peekui16(ptr + 28)) +
+           ((size_t) peekui16(ptr + 30)) + ((size_t) peekui16(ptr + 32));
+} /* zip_cdrecord_len */
+
+
+/*
+ * Parse the central directory record at (ptr), which has (avail) bytes
+ *  after it that we're allowed to look at, into (rec). The name is copied to
+ *  (name), which needs room for the filename length plus one. This runs on
+ *  worker threads, so it returns an error code instead of setting one.
+ */
+static PHYSFS_ErrorCode zip_parse_cdrecord(const PHYSFS_uint8 *ptr,
+                                           const size_t avail, const int zip64,
+                                           const PHYSFS_uint64 ofs_fixup,
+                                           ZIPcdrecord *rec, char *name)
+{
+    PHYSFS_uint16 version;
+    PHYSFS_uint16 fnamelen, extralen;
+    PHYSFS_uint32 external_attr;
+    PHYSFS_uint32 starting_disk;
+    PHYSFS_uint64 offset;
+    PHYSFS_uint64 compressed_size;
+    PHYSFS_uint64 uncompressed_size;
+
+    /* sanity check with central directory signature... */
+    if ((avail < ZIP_CENTRAL_DIR_RECORD_LEN) ||
+        (peekui32(ptr) != ZIP_CENTRAL_DIR_SIG) ||
+        (avail < zip_cdrecord_len(ptr)))
+        return PHYSFS_ERR_CORRUPT;
+
+    /* Get the pertinent parts of the record... */
+    version = peekui16(ptr + 4);
+    rec->version_needed = peekui16(ptr + 6);
+    rec->general_bits = peekui16(ptr + 8);
+    rec->compression_method = peekui16(ptr + 10);
+    rec->dos_mod_time = peekui32(ptr + 12);
+    rec->crc = peekui32(ptr + 16);
+    compressed_size = (PHYSFS_uint64) peekui32(ptr + 20);
+    uncompressed_size = (PHYSFS_uint64) peekui32(ptr + 24);
+    fnamelen = peekui16(ptr + 28);
+    extralen = peekui16(ptr + 30);
+    /* (ptr + 32) is the comment length. */
+    starting_disk = (PHYSFS_uint32) peekui16(ptr + 34);
+    /* (ptr + 36) is the internal file attribs. */
+    external_attr = peekui32(ptr + 38);
+    offset = (PHYSFS_uint64) peekui32(ptr + 42);
+
+    if (fnamelen == 0)
+        return PHYSFS_ERR_CORRUPT;
+
+    memcpy(name, ptr + ZIP_CENTRAL_DIR_RECORD_LEN, fnamelen);
+    rec->isdir = (name[fnamelen - 1] == '/');
+    if (rec->isdir)
+        name[fnamelen - 1] = '\0';
+    name[fnamelen] = '\0';  /* null-terminate the filename. */
+    rec->name = name;
+
+    rec->flags = 0;
+    if (zip_version_has_dos_paths(version))
+    {
+        rec->flags |= ZIP_ENTRY_DOS_PATHS;
+        zip_convert_dos_path(1, name);
+    } /* if */
+
+    if (rec->isdir)
+        rec->flags |= ZIP_DIRECTORY;
+    else if (zip_has_symlink_attr(version, uncompressed_size, external_attr))
+        rec->flags |= ZIP_UNRESOLVED_SYMLINK;
+    else
+        rec->flags |= ZIP_UNRESOLVED_FILE;
+
+    /* If the actual sizes didn't fit in 32-bits, look for the Zip64
+        extended information extra field... */
+    if ( (zip64) &&
+         ((offset == 0xFFFFFFFF) ||
+          (starting_disk == 0xFFFFFFFF) ||
+          (compressed_size == 0xFFFFFFFF) ||
+          (uncompressed_size == 0xFFFFFFFF)) )
+    {
+        const PHYSFS_uint8 *extra = ptr + ZIP_CENTRAL_DIR_RECORD_LEN + fnamelen;
+        int found = 0;
+        PHYSFS_uint16 sig = 0;
+        PHYSFS_uint16 len = 0;
+        while (extralen > 4)
+        {
+            sig = peekui16(extra);
+            len = peekui16(extra + 2);
+            if (len > extralen - 4)
+                return PHYSFS_ERR_CORRUPT;
+
+            extra += 4;
+            if (sig == ZIP64_EXTENDED_INFO_EXTRA_FIELD_SIG)
+            {
+                found = 1;
+                break;
+            } /* if */
+
+            extra += len;
+            extralen -= 4 + len;
+        } /* while */
+
+        if (!found)
+            return PHYSFS_ERR_CORRUPT;
+
+        if (uncompressed_size == 0xFFFFFFFF)
+        {
+            if (len < 8)
+                return PHYSFS_ERR_CORRUPT;
+            uncompressed_size = peekui64(extra);
+            extra += 8;
+            len -= 8;
+        } /* if */
+
+        if (compressed_size == 0xFFFFFFFF)
+        {
+            if (len < 8)
+                return PHYSFS_ERR_CORRUPT;
+            compressed_size = peekui64(extra);
+            extra += 8;
+            len -= 8;
+        } /* if */
+
+        if (offset == 0xFFFFFFFF)
+        {
+            if (len < 8)
+                return PHYSFS_ERR_CORRUPT;
+            offset = peekui64(extra);
+            extra += 8;
+            len -= 8;
+        } /* if */
+
+        if (starting_disk == 0xFFFFFFFF)
+        {
+            if (len < 8)
+                return PHYSFS_ERR_CORRUPT;
+            starting_disk = peekui32(extra);
+            len -= 4;
+        } /* if */
+
+        if (len != 0)
+            return PHYSFS_ERR_CORRUPT;
+    } /* if */
+
+    if (starting_disk != 0)
+        return PHYSFS_ERR_CORRUPT;
+
+    rec->offset = offset + ofs_fixup;
+    rec->compressed_size = compressed_size;
+    rec->uncompressed_size = uncompressed_size;
+    return PHYSFS_ERR_OK;
+} /* zip_parse_cdrecord */
+
+
+/* Add a parsed record to the DirTree. */
+static ZIPentry *zip_add_cdrecord(ZIPinfo *info, const ZIPcdrecord *rec)
+{
+    ZIPentry *retval;
+    PHYSFS_uint32 lazydir;
+
+    retval = (ZIPentry *) __PHYSFS_DirTreeAdd(&info->tree, rec->name,
+                                              rec->isdir);
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+
+    /* It's okay to BAIL without freeing retval, because it's stored in the
+       __PHYSFS_DirTree and will be freed later anyhow. */
+    BAIL_IF(retval->flags & ZIP_ENTRY_FROM_CDIR, PHYSFS_ERR_CORRUPT, NULL); /* dupe? */
+    BAIL_IF(retval->tree.isdir != rec->isdir, PHYSFS_ERR_CORRUPT, NULL);
+
+    /* a lazy mount may have already given this directory an id. */
+    lazydir = retval->lazydir;
+    memset(((PHYSFS_uint8 *) retval) + sizeof (__PHYSFS_DirTreeEntry), '\0',
+           sizeof (ZIPentry) - sizeof (__PHYSFS_DirTreeEntry));
+    retval->lazydir = lazydir;
+    retval->crc = rec->crc;
+    retval->dos_mod_time = rec->dos_mod_time;
+    retval->version_needed = rec->version_needed;
+    retval->general_bits = rec->general_bits;
+    retval->compression_method = rec->compression_method;
+    retval->symlink = NULL;  /* will be resolved later, if necessary. */
+    retval->flags = rec->flags | ZIP_ENTRY_FROM_CDIR;
+    if (info->wide)
+        retval->flags |= ZIP_ENTRY_WIDE;
+
+    if (!zip_entry_set_location(retval, rec->offset, rec->compressed_size,
+                                rec->uncompressed_size))
+    {
+        info->needs_wide = 1;
+        BAIL(PHYSFS_ERR_CORRUPT, NULL);
+    } /* if */
+
+    return retval;  /* success. */
+} /* zip_add_cdrecord */
+
+
+static int zip_lazy_file_is_named(ZIPinfo *info, const ZIPlazyfile *file,
+                                  const char *path, const size_t pathlen);
+
+/*
+ * Make sure no lazy file is named (name) yet, and set (*bucket) to the free
+ *  bucket at the end of its probe sequence. Names aren't kept, so when a
+ *  file has the same hash (rare with full paths) we read its name back. A
+ *  lazy mount has to refuse duplicates just like zip_add_cdrecord() does.
+ */
+static int zip_lazy_check_unique(ZIPinfo *info, const char *name,
+                                 const size_t namelen,
+                                 const PHYSFS_uint32 hash,
+                                 PHYSFS_uint32 *bucket)
+{
+    PHYSFS_uint32 idx;
+
+    *bucket = hash & info->lazymask;
+    while ((idx = info->lazybuckets[*bucket]) != 0)
+    {
+        if (info->lazyfiles[idx - 1].hash == hash)
+        {
+            const int rc = zip_lazy_file_is_named(info,
+                                    &info->lazyfiles[idx - 1], name, namelen);
+            BAIL_IF_ERRPASS(rc < 0, 0);
+            BAIL_IF(rc, PHYSFS_ERR_CORRUPT, 0);  /* dupe. */
+        } /* if */
+        *bucket = (*bucket + 1) & info->lazymask;
+    } /* while */
+
+    return 1;
+} /* zip_lazy_check_unique */
+
+
+/*
+ * A file can't share its name with a directory either, whichever one came
+ *  first in the archive. Every directory is in the tree once the central
+ *  directory has been read, so check them all against the file hash then.
+ */
+static int zip_lazy_check_dirs(ZIPinfo *info)
+{
+    size_t i;
+
+    for (i = 0; i < info->tree.hashBuckets; i++)
+    {
+        const __PHYSFS_DirTreeEntry *entry;
+        for (entry = info->tree.hash[i]; entry; entry = entry->hashnext)
+        {
+            const size_t len = strlen(entry->name);
+            PHYSFS_uint32 bucket;
+            if (!entry->isdir)
+                continue;
+            BAIL_IF_ERRPASS(!zip_lazy_check_unique(info, entry->name, len,
+                                   __PHYSFS_hashString(entry->name, len),
+                                   &bucket), 0);
+        } /* for */
+    } /* for */
+
+    return 1;
+} /* zip_lazy_check_dirs */
+
+
+/* Hash a lazy file; (cdofs) is its record's offset in the central dir. */
+static int zip_lazy_add_file(ZIPinfo *info, const char *name,
+                             const size_t namelen, const PHYSFS_uint32 hash,
+                             const PHYSFS_uint64 cdofs, const ZIPentry *parent)
+{
+    ZIPlazyfile *file;
+    PHYSFS_uint32 bucket;
+
+    BAIL_IF_ERRPASS(!zip_lazy_check_unique(info, name, namelen, hash,
+                                           &bucket), 0);
+
+    file = &info->lazyfiles[info->lazyfilecount];
+    file->hash = hash;
+    file->cdofs = (PHYSFS_uint32) cdofs;
+    file->parent = parent->lazydir - 1;
+    file->next = 0;
+    info->lazybuckets[bucket] = ++info->lazyfilecount;
+
+    return 1;
+} /* zip_lazy_add_file */
+
+
+/*
+ * Add a parsed record to a lazy mount (see ZIPlazyfile). Archives are
+ *  usually sorted by directory, so (*parent) and (*parentlen) remember the
+ *  last file's directory between calls; start them at NULL and 0.
+ */
+static int zip_lazy_add_cdrecord(ZIPinfo *info, const ZIPcdrecord *rec,
+                                 ZIPentry **parent, size_t *parentlen)
+{
+    char *name = rec->name;
+    char *sep;
+
+    if (rec->general_bits & ZIP_GENERAL_BITS_TRADITIONAL_CRYPTO)
+        info->has_crypto = 1;
+
+    if (rec->isdir)  /* directories are never lazy. */
+        return (zip_add_cdrecord(info, rec) != NULL);
+
+    sep = strrchr(name, '/');
+    if (sep == NULL)
+        *parent = (ZIPentry *) info->tree.root;
+    else if ( (*parent == NULL) || ((size_t) (sep - name) != *parentlen) ||
+              (memcmp(name, (*parent)->tree.name, *parentlen) != 0) )
+    {
+        *sep = '\0';
+        *parent = (ZIPentry *) __PHYSFS_DirTreeAdd(&info->tree, name, 1);
+        *sep = '/';
+        BAIL_IF_ERRPASS(!*parent, 0);
+        BAIL_IF(!(*parent)->tree.isdir, PHYSFS_ERR_CORRUPT, 0);
+    } /* else if */
+    *parentlen = sep ? (size_t) (sep - name) : 0;
+
+    if ((*parent)->lazydir == 0)
+        (*parent)->lazydir = ++info->lazydircount;
+
+    return zip_lazy_add_file(info, name, strlen(name), rec->hash,
+                             rec->cdofs, *parent);
+} /* zip_lazy_add_cdrecord */
+
+
+/*
+ * Load the central directory record at the current position of info->io,
+ *  and leave the io at the start of the next one.
+ */
+static ZIPentry *zip_load_entry(ZIPinfo *info, const int zip64,
+                                const PHYSFS_uint64 ofs_fixup)
+{
+    PHYSFS_Io *io = info->io;
+    PHYSFS_uint8 fixed[ZIP_CENTRAL_DIR_RECORD_LEN];
+    PHYSFS_uint8 *buf;
+    PHYSFS_ErrorCode err = PHYSFS_ERR_OK;
+    ZIPentry *retval = NULL;
+    ZIPcdrecord rec;
+    size_t reclen;
+
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(io, fixed, sizeof (fixed)), NULL);
+    BAIL_IF(peekui32(fixed) != ZIP_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, NULL);
+
+    /* the whole record, then room for the name after it. */
+    reclen = zip_cdrecord_len(fixed);
+    buf = (PHYSFS_uint8 *) __PHYSFS_smallAlloc(reclen + peekui16(fixed + 28) + 1);
+    BAIL_IF(!buf, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memcpy(buf, fixed, sizeof (fixed));
+
+    if (__PHYSFS_readAll(io, buf + sizeof (fixed), reclen - sizeof (fixed)))
+    {
+        err = zip_parse_cdrecord(buf, reclen, zip64, ofs_fixup, &rec,
+                                 (char *) (buf + reclen));
+        if (err != PHYSFS_ERR_OK)
+            PHYSFS_setErrorCode(err);
+        else
+            retval = zip_add_cdrecord(info, &rec);
+    } /* if */
+
+    __PHYSFS_smallFree(buf);
+
+    return retval;
+} /* zip_load_entry */
+
+
+/*
+ * Big archives spend most of their mount time in the central directory, so
+ *  we get the whole thing in one block (it's contiguous), either straight
+ *  out of a memory-mapped archive or with a single read, and parse it
+ *  ZIP_CDJOB_RECORDS records at a time. Parsing a job doesn't touch the
+ *  DirTree, so jobs are handed to up to PHYSFS_ZIP_PARSE_THREADS workers,
+ *  which are started once and live until the whole directory is parsed.
+ *  Meanwhile this thread adds the previous batch of records to the tree, in
+ *  their original order, and parses queued jobs itself when it would
+ *  otherwise wait. Small archives just parse one job right here.
+ *
+ * Lazy mounts go through here too; they just add the records differently.
+ *
+ * If we can't get the block in memory, we fall back to reading the records
+ *  one at a time.
+ */
+#ifndef PHYSFS_ZIP_PARSE_THREADS
+#define PHYSFS_ZIP_PARSE_THREADS 4
+#endif
+
+#if PHYSFS_ZIP_PARSE_THREADS < 1
+#error PHYSFS_ZIP_PARSE_THREADS must be at least 1.
+#endif
+
+#define ZIP_CDJOB_RECORDS 16384
+#define ZIP_CDQUEUE_LEN (PHYSFS_ZIP_PARSE_THREADS * 2)
+
+typedef struct
+{
+    const PHYSFS_uint8 *ptr;    /* first record of this job.             */
+    size_t len;                 /* bytes of records at ptr.              */
+    PHYSFS_uint64 cdofs;        /* ptr's offset in the central dir.      */
+    PHYSFS_uint32 count;        /* number of records at ptr.             */
+    int zip64;                  /* same as ZIPinfo::zip64.                */
+    int lazy;                   /* nonzero to hash names for lazy mounts. */
+    PHYSFS_uint64 ofs_fixup;    /* data_ofs, for zip_parse_cdrecord().   */
+    ZIPcdrecord *records;       /* (count) parsed records, and...        */
+    char *names;                /* ...their names, in (len) bytes.       */
+    size_t alloced;             /* bytes at records, kept between batches. */
+    PHYSFS_uint32 parsed;       /* records that parsed okay.             */
+    PHYSFS_ErrorCode errcode;   /* why record (parsed) didn't.           */
+    int done;                   /* zero while queued or being parsed.    */
+} ZIPcdjob;
+
+typedef struct
+{
+    ZIPcdjob jobs[PHYSFS_ZIP_PARSE_THREADS];
+    int count;                  /* jobs in use.                          */
+} ZIPcdbatch;
+
+/* The workers, shared by every batch. At most two batches are in flight. */
+typedef struct
+{
+    ZIPcdjob *queue[ZIP_CDQUEUE_LEN];  /* jobs nobody took yet. */
+    int head;                   /* next job to take from queue.          */
+    int queued;                 /* jobs in queue.                        */
+    void *lock;                 /* protects everything here, and ::done. */
+    void *workready;            /* posted once per job queued.           */
+    void *jobdone;              /* posted once per job a worker finishes. */
+    void *workers[PHYSFS_ZIP_PARSE_THREADS];
+    int numworkers;             /* zero to parse everything on this thread. */
+    int quit;
+} ZIPcdparser;
+
+
+static void zip_parse_cdjob(ZIPcdjob *job)
+{
+    const PHYSFS_uint8 *ptr = job->ptr;
+    const PHYSFS_uint8 *end = ptr + job->len;
+    char *name = job->names;
+    PHYSFS_uint32 i;
+
+    job->errcode = PHYSFS_ERR_OK;
+    for (i = 0; i < job->count; i++)
+    {
+        ZIPcdrecord *rec = &job->records[i];
+        const PHYSFS_uint16 fnamelen = peekui16(ptr + 28);
+        job->errcode = zip_parse_cdrecord(ptr, (size_t) (end - ptr),
+                                          job->zip64, job->ofs_fixup,
+                                          rec, name);
+        if (job->errcode != PHYSFS_ERR_OK)
+            break;
+        rec->cdofs = job->cdofs + (PHYSFS_uint64) (ptr - job->ptr);
+        if (job->lazy)
+            rec->hash = __PHYSFS_hashString(name, fnamelen);
+        name += fnamelen + 1;
+        ptr += zip_cdrecord_len(ptr);
+    } /* for */
+
+    job->parsed = i;
+} /* zip_parse_cdjob */
+
+
+/* the caller holds parser->lock. */
+static ZIPcdjob *zip_cdparser_take(ZIPcdparser *parser)
+{
+    ZIPcdjob *retval = NULL;
+    if (parser->queued > 0)
+    {
+        retval = parser->queue[parser->head];
+        parser->head = (parser->head + 1) % ZIP_CDQUEUE_LEN;
+        parser->queued--;
+    } /* if */
+    return retval;
+} /* zip_cdparser_take */
+
+
+static void zip_cdparser_thread(void *_parser)
+{
+    ZIPcdparser *parser = (ZIPcdparser *) _parser;
+
+    while (1)
+    {
+        ZIPcdjob *job;
+
+        __PHYSFS_platformWaitSemaphore(parser->workready);
+        __PHYSFS_platformGrabMutex(parser->lock);
+        if (parser->quit)
+        {
+            __PHYSFS_platformReleaseMutex(parser->lock);
+            break;
+        } /* if */
+        job = zip_cdparser_take(parser);
+        __PHYSFS_platformReleaseMutex(parser->lock);
+
+        if (job == NULL)
+            continue;  /* the calling thread got to it first. */
+
+        zip_parse_cdjob(job);
+
+        __PHYSFS_platformGrabMutex(parser->lock);
+        job->done = 1;
+        __PHYSFS_platformReleaseMutex(parser->lock);
+        __PHYSFS_platformPostSemaphore(parser->jobdone);
+    } /* while */
+} /* zip_cdparser_thread */
+
+
+/* if we can't get workers, everything gets parsed here; just slower. */
+static void zip_cdparser_init(ZIPcdparser *parser, const int threaded)
+{
+    memset(parser, '\0', sizeof (*parser));
+    if (!threaded)
+        return;
+
+    parser->lock = __PHYSFS_platformCreateMutex();
+    parser->workready = __PHYSFS_platformCreateSemaphore();
+    parser->jobdone = __PHYSFS_platformCreateSemaphore();
+    if (!parser->lock || !parser->workready || !parser->jobdone)
+        return;
+
+    while (parser->numworkers < PHYSFS_ZIP_PARSE_THREADS)
+    {
+        void *thread = __PHYSFS_platformCreateThread(zip_cdparser_thread,
+                                                     parser);
+        if (thread == NULL)
+            break;
+        parser->workers[parser->numworkers++] = thread;
+    } /* while */
+} /* zip_cdparser_init */
+
+
+/* every job must be done before this. */
+static void zip_cdparser_deinit(ZIPcdparser *parser)
+{
+    int i;
+
+    if (parser->numworkers > 0)
+    {
+        __PHYSFS_platformGrabMutex(parser->lock);
+        parser->quit = 1;
+        __PHYSFS_platformReleaseMutex(parser->lock);
+        for (i = 0; i < parser->numworkers; i++)
+            __PHYSFS_platformPostSemaphore(parser->workready);
+        for (i = 0; i < parser->numworkers; i++)
+            __PHYSFS_platformWaitThread(parser->workers[i]);
+    } /* if */
+
+    if (parser->jobdone) __PHYSFS_platformDestroySemaphore(parser->jobdone);
+    if (parser->workready) __PHYSFS_platformDestroySemaphore(parser->workready);
+    if (parser->lock) __PHYSFS_platformDestroyMutex(parser->lock);
+    memset(parser, '\0', sizeof (*parser));
+} /* zip_cdparser_deinit */
+
+
+/* Block until every job in (batch) is parsed, pitching in while we wait. */
+static void zip_cdbatch_wait(ZIPcdparser *parser, ZIPcdbatch *batch)
+{
+    int i;
+
+    if (parser->numworkers == 0)
+        return;  /* zip_cdbatch_start() parsed it all already. */
+
+    for (i = 0; i < batch->count; i++)
+    {
+        ZIPcdjob *job = &batch->jobs[i];
+        while (1)
+        {
+            ZIPcdjob *other;
+            __PHYSFS_platformGrabMutex(parser->lock);
+            if (job->done)
+            {
+                __PHYSFS_platformReleaseMutex(parser->lock);
+                break;
+            } /* if */
+            other = zip_cdparser_take(parser);
+            __PHYSFS_platformReleaseMutex(parser->lock);
+
+            if (other == NULL)  /* everything's taken; wait for a worker. */
+                __PHYSFS_platformWaitSemaphore(parser->jobdone);
+            else
+            {
+                zip_parse_cdjob(other);
+                __PHYSFS_platformGrabMutex(parser->lock);
+                other->done = 1;
+                __PHYSFS_platformReleaseMutex(parser->lock);
+            } /* else */
+        } /* while */
+    } /* for */
+} /* zip_cdbatch_wait */
+
+
+static void zip_cdbatch_free(ZIPcdparser *parser, ZIPcdbatch *batch)
+{
+    int i;
+    zip_cdbatch_wait(parser, batch);
+    for (i = 0; i < PHYSFS_ZIP_PARSE_THREADS; i++)
+    {
+        if (batch->jobs[i].records != NULL)
+            allocator.Free(batch->jobs[i].records);
+    } /* for */
+    memset(batch, '\0', sizeof (*batch));
+} /* zip_cdbatch_free */
+
+
+/*
+ * Split off the next batch of records from the block at (*pos) and get it
+ *  parsing. We only find where each record starts here. A record that
+ *  doesn't add up goes in the last job anyhow, so it fails to parse there,
+ *  at the same spot the one-at-a-time loader would have failed.
+ */
+static int zip_cdbatch_start(ZIPcdparser *parser, ZIPcdbatch *batch,
+                             const PHYSFS_uint8 *block, const size_t blocklen,
+                             size_t *pos, PHYSFS_uint64 *remaining,
+                             const int zip64, const int lazy,
+                             const PHYSFS_uint64 ofs_fixup)
+{
+    int i;
+
+    assert(batch->count == 0);
+
+    for (i = 0; (i < PHYSFS_ZIP_PARSE_THREADS) && (*remaining > 0); i++)
+    {
+        ZIPcdjob *job = &batch->jobs[i];
+        ZIPcdrecord *records = job->records;
+        const size_t alloced = job->alloced;
+        const size_t start = *pos;
+        size_t needed;
+
+        /* reuse the last batch's buffers; fresh pages are expensive. */
+        memset(job, '\0', sizeof (*job));
+        job->records = records;
+        job->alloced = alloced;
+        job->ptr = block + start;
+        job->cdofs = (PHYSFS_uint64) start;
+        job->zip64 = zip64;
+        job->lazy = lazy;
+        job->ofs_fixup = ofs_fixup;
+        job->done = 1;  /* until it's queued. */
+
+        while ((job->count < ZIP_CDJOB_RECORDS) && (*remaining > 0))
+        {
+            const size_t avail = blocklen - *pos;
+            const PHYSFS_uint8 *ptr = block + *pos;
+            job->count++;
+            (*remaining)--;
+            if ( (avail < ZIP_CENTRAL_DIR_RECORD_LEN) ||
+                 (peekui32(ptr) != ZIP_CENTRAL_DIR_SIG) ||
+                 (avail < zip_cdrecord_len(ptr)) )
+            {
+                *pos = blocklen;   /* let zip_parse_cdrecord() complain. */
+                *remaining = 0;
+                break;
+            } /* if */
+            *pos += zip_cdrecord_len(ptr);
+        } /* while */
+
+        job->len = *pos - start;
+        needed = (sizeof (ZIPcdrecord) * job->count) + job->len;
+        if (needed > job->alloced)
+        {
+            void *ptr = allocator.Realloc(job->records, needed);
+            BAIL_IF(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+            job->records = (ZIPcdrecord *) ptr;
+            job->alloced = needed;
+        } /* if */
+        job->names = (char *) (job->records + job->count);
+        batch->count++;
+    } /* for */
+
+    if (parser->numworkers == 0)
+    {
+        for (i = 0; i < batch->count; i++)
+            zip_parse_cdjob(&batch->jobs[i]);
+        return 1;
+    } /* if */
+
+    __PHYSFS_platformGrabMutex(parser->lock);
+    for (i = 0; i < batch->count; i++)
+    {
+        const int tail = (parser->head + parser->queued) % ZIP_CDQUEUE_LEN;
+        assert(parser->queued < ZIP_CDQUEUE_LEN);
+        batch->jobs[i].done = 0;
+        parser->queue[tail] = &batch->jobs[i];
+        parser->queued++;
+    } /* for */
+    __PHYSFS_platformReleaseMutex(parser->lock);
+
+    for (i = 0; i < batch->count; i++)
+        __PHYSFS_platformPostSemaphore(parser->workready);
+
+    return 1;
+} /* zip_cdbatch_start */
+
+
+static int zip_cdbatch_add(ZIPinfo *info, ZIPcdbatch *batch)
+{
+    ZIPentry *parent = NULL;  /* for zip_lazy_add_cdrecord(). */
+    size_t parentlen = 0;
+    int i;
+
+    for (i = 0; i < batch->count; i++)
+    {
+        const ZIPcdjob *job = &batch->jobs[i];
+        PHYSFS_uint32 j;
+
+        for (j = 0; j < job->parsed; j++)
+        {
+            const ZIPcdrecord *rec = &job->records[j];
+            if (info->lazyfiles != NULL)
+            {
+                BAIL_IF_ERRPASS(!zip_lazy_add_cdrecord(info, rec, &parent,
+                                                       &parentlen), 0);
+            } /* if */
+            else
+            {
+                const ZIPentry *entry = zip_add_cdrecord(info, rec);
+                BAIL_IF_ERRPASS(!entry, 0);
+                if (zip_entry_is_encrypted(entry))
+                    info->has_crypto = 1;
+            } /* else */
+        } /* for */
+
+        BAIL_IF(job->parsed < job->count, job->errcode, 0);
+    } /* for */
+
+    return 1;
+} /* zip_cdbatch_add */
+
+
+/*
+ * Get the central directory, from (central_ofs) to the end of the archive,
+ *  in one block: mapped if possible, read into (*buf) if not. (*block) is
+ *  left NULL if there's no memory for it, so the caller can go slowly.
+ */
+static int zip_get_central_dir(ZIPinfo *info, const PHYSFS_uint64 central_ofs,
+                               const PHYSFS_uint8 **block,
+                               PHYSFS_uint64 *blocklen, PHYSFS_uint8 **buf)
+{
+    PHYSFS_Io *io = info->io;
+    const PHYSFS_sint64 arclen = io->length(io);
+
+    *block = NULL;
+    *buf = NULL;
+
+    BAIL_IF_ERRPASS(arclen == -1, 0);
+    BAIL_IF((PHYSFS_uint64) arclen < central_ofs, PHYSFS_ERR_CORRUPT, 0);
+
+    /* the records all come before the end of the archive, at least. */
+    *blocklen = ((PHYSFS_uint64) arclen) - central_ofs;
+    if ((*blocklen == 0) || (!__PHYSFS_ui64FitsAddressSpace(*blocklen)))
+        return 1;
+
+    *block = (const PHYSFS_uint8 *)
+                __PHYSFS_ioMemoryRegion(io, central_ofs, *blocklen);
+    if (*block == NULL)
+    {
+        *buf = (PHYSFS_uint8 *) allocator.Malloc((size_t) *blocklen);
+        if (*buf != NULL)
+        {
+            BAIL_IF_ERRPASS(!io->seek(io, central_ofs), 0);
+            BAIL_IF_ERRPASS(!__PHYSFS_readAll(io, *buf, (size_t) *blocklen), 0);
+            *block = *buf;
+        } /* if */
+    } /* if */
+
+    return 1;
+} /* zip_get_central_dir */
+
+
+/* Parse and add every record in (block), from zip_get_central_dir(). */
+static int zip_parse_central_dir(ZIPinfo *info, const PHYSFS_uint8 *block,
+                                 const PHYSFS_uint64 blocklen,
+                                 const PHYSFS_uint64 data_ofs,
+                                 const PHYSFS_uint64 entry_count)
+{
+    const int zip64 = info->zip64;
+    const int lazy = (info->lazyfiles != NULL);
+    ZIPcdparser parser;
+    ZIPcdbatch batches[2];
+    PHYSFS_uint64 remaining = entry_count;
+    size_t pos = 0;
+    int cur = 0;
+    int retval = 0;
+
+    memset(batches, '\0', sizeof (batches));
+    zip_cdparser_init(&parser, entry_count > ZIP_CDJOB_RECORDS);
+    GOTO_IF_ERRPASS(!zip_cdbatch_start(&parser, &batches[cur], block,
+                                       (size_t) blocklen, &pos, &remaining,
+                                       zip64, lazy, data_ofs),
+                    zip_parse_done);
+
+    while (1)
+    {
+        ZIPcdbatch *batch = &batches[cur];
+        ZIPcdbatch *next = &batches[cur ^ 1];
+
+        /* start parsing the next batch while we add this one to the tree. */
+        zip_cdbatch_wait(&parser, batch);
+        if (remaining > 0)
+        {
+            GOTO_IF_ERRPASS(!zip_cdbatch_start(&parser, next, block,
+                                               (size_t) blocklen, &pos,
+                                               &remaining, zip64, lazy,
+                                               data_ofs),
+                            zip_parse_done);
+        } /* if */
+
+        GOTO_IF_ERRPASS(!zip_cdbatch_add(info, batch), zip_parse_done);
+        batch->count = 0;  /* its buffers stay around for reuse. */
+
+        if (next->count == 0)
+            break;  /* that was the last one. */
+        cur ^= 1;
+    } /* while */
+
+    retval = 1;
+
+zip_parse_done:
+    zip_cdbatch_free(&parser, &batches[0]);
+    zip_cdbatch_free(&parser, &batches[1]);
+    zip_cdparser_deinit(&parser);
+    return retval;
+} /* zip_parse_central_dir */
+
+
+/* This leaves things allocated on error; the caller will clean up the mess. */
+static int zip_load_entries(ZIPinfo *info,
+                            const PHYSFS_uint64 data_ofs,
+                            const PHYSFS_uint64 central_ofs,
+                            const PHYSFS_uint64 entry_count)
+{
+    PHYSFS_Io *io = info->io;
+    const PHYSFS_uint8 *block = NULL;
+    PHYSFS_uint8 *buf = NULL;
+    PHYSFS_uint64 blocklen = 0;
+    int retval = 0;
+
+    if (!zip_get_central_dir(info, central_ofs, &block, &blocklen, &buf))
+        goto zip_load_done;
+
+    if (block == NULL)  /* no memory for it? Do it the slow way. */
+    {
+        PHYSFS_uint64 i;
+        BAIL_IF_ERRPASS(!io->seek(io, central_ofs), 0);
+        for (i = 0; i < entry_count; i++)
+        {
+            ZIPentry *entry = zip_load_entry(info, info->zip64, data_ofs);
+            BAIL_IF_ERRPASS(!entry, 0);
+            if (zip_entry_is_encrypted(entry))
+                info->has_crypto = 1;
+        } /* for */
+        return 1;
+    } /* if */
+
+    /* size the hash up front instead of rehashing it over and over. */
+    __PHYSFS_DirTreeReserve(&info->tree, (size_t)
+        ((entry_count < (blocklen / ZIP_CENTRAL_DIR_RECORD_LEN)) ?
+            entry_count : (blocklen / ZIP_CENTRAL_DIR_RECORD_LEN)));
+
+    retval = zip_parse_central_dir(info, block, blocklen, data_ofs,
+                                   entry_count);
+
+zip_load_done:
+    if (buf != NULL)
+        allocator.Free(buf);
+    return retval;
+} /* zip_load_entries */
+
+
+static PHYSFS_sint64 zip64_find_end_of_central_dir(PHYSFS_Io *io,
+                                                   PHYSFS_sint64 _pos,
+                                                   PHYSFS_uint64 offset)
+{
+    /*
+     * Naturally, the offset is useless to us; it is the offset from the
+     *  start of file, which is meaningless if we've appended this .zip to
+     *  a self-extracting .exe. We need to find this on our own. It should
+     *  be directly before the locator record, but the record in question,
+     *  like the original end-of-central-directory record, ends with a
+     *  variable-length field. Unlike the original, which has to store the
+     *  size of that variable-length field in a 16-bit int and thus has to be
+     *  within 64k, the new one gets 64-bits.
+     *
+     * Fortunately, the only currently-specified record for that variable
+     *  length block is some weird proprietary thing that deals with EBCDIC
+     *  and tape backups or something. So we don't seek far.
+     */
+
+    PHYSFS_uint32 ui32;
+    const PHYSFS_uint64 pos = (PHYSFS_uint64) _pos;
+
+    assert(_pos > 0);
+
+    /* Try offset specified in the Zip64 end of central directory locator. */
+    /* This works if the entire PHYSFS_Io is the zip file. */
+    BAIL_IF_ERRPASS(!io->seek(io, offset), -1);
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), -1);
+    if (ui32 == ZIP64_END_OF_CENTRAL_DIR_SIG)
+        return offset;
+
+    /* Try 56 bytes before the Zip64 end of central directory locator. */
+    /* This works if the record isn't variable length and is version 1. */
+    if (pos > 56)
+    {
+        BAIL_IF_ERRPASS(!io->seek(io, pos-56), -1);
+        BAIL_IF_ERRPASS(!readui32(io, &ui32), -1);
+        if (ui32 == ZIP64_END_OF_CENTRAL_DIR_SIG)
+            return pos-56;
+    } /* if */
+
+    /* Try 84 bytes before the Zip64 end of central directory locator. */
+    /* This works if the record isn't variable length and is version 2. */
+    if (pos > 84)
+    {
+        BAIL_IF_ERRPASS(!io->seek(io, pos-84), -1);
+        BAIL_IF_ERRPASS(!readui32(io, &ui32), -1);
+        if (ui32 == ZIP64_END_OF_CENTRAL_DIR_SIG)
+            return pos-84;
+    } /* if */
+
+    /* Ok, brute force: we know it's between (offset) and (pos) somewhere. */
+    /*  Just try moving back at most 256k. Oh well. */
+    if ((offset < pos) && (pos > 4))
+    {
+        const size_t maxbuflen = 256 * 1024;
+        size_t len = (size_t) (pos - offset);
+        PHYSFS_uint8 *buf = NULL;
+        PHYSFS_sint32 i;
+
+        if (len > maxbuflen)
+            len = maxbuflen;
+
+        buf = (PHYSFS_uint8 *) __PHYSFS_smallAlloc(len);
+        BAIL_IF(!buf, PHYSFS_ERR_OUT_OF_MEMORY, -1);
+
+        if (!io->seek(io, pos - len) || !__PHYSFS_readAll(io, buf, len))
+        {
+            __PHYSFS_smallFree(buf);
+            return -1;  /* error was set elsewhere. */
+        } /* if */
+
+        for (i = (PHYSFS_sint32) (len - 4); i >= 0; i--)
+        {
+            if ( (buf[i] == 0x50) && (buf[i+1] == 0x4b) &&
+                 (buf[i+2] == 0x06) && (buf[i+3] == 0x06) )
+            {
+                __PHYSFS_smallFree(buf);
+                return pos - ((PHYSFS_sint64) (len - i));
+            } /* if */
+        } /* for */
+
+        __PHYSFS_smallFree(buf);
+    } /* if */
+
+    BAIL(PHYSFS_ERR_CORRUPT, -1);  /* didn't find it. */
+} /* zip64_find_end_of_central_dir */
+
+
+static int zip64_parse_end_of_central_dir(ZIPinfo *info,
+                                          PHYSFS_uint64 *data_start,
+                                          PHYSFS_uint64 *dir_ofs,
+                                          PHYSFS_uint64 *entry_count,
+                                          PHYSFS_sint64 pos)
+{
+    PHYSFS_Io *io = info->io;
+    PHYSFS_uint64 ui64;
+    PHYSFS_uint32 ui32;
+    PHYSFS_uint16 ui16;
+
+    /* We should be positioned right past the locator signature. */
+
+    if ((pos < 0) || (!io->seek(io, pos)))
+        return 0;
+
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    if (ui32 != ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIG)
+        return -1;  /* it's not a Zip64 archive. Not an error, though! */
+
+    info->zip64 = 1;
+
+    /* number of the disk with the start of the central directory. */
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    BAIL_IF(ui32 != 0, PHYSFS_ERR_CORRUPT, 0);
+
+    /* offset of Zip64 end of central directory record. */
+    BAIL_IF_ERRPASS(!readui64(io, &ui64), 0);
+
+    /* total number of disks */
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    BAIL_IF(ui32 != 1, PHYSFS_ERR_CORRUPT, 0);
+
+    pos = zip64_find_end_of_central_dir(io, pos, ui64);
+    if (pos < 0)
+        return 0;  /* oh well. */
+
+    /*
+     * For self-extracting archives, etc, there's crapola in the file
+     *  before the zipfile records; we calculate how much data there is
+     *  prepended by determining how far the zip64-end-of-central-directory
+     *  offset is from where it is supposed to be...the difference in bytes
+     *  is how much arbitrary data is at the start of the physical file.
+     */
+    assert(((PHYSFS_uint64) pos) >= ui64);
+    *data_start = ((PHYSFS_uint64) pos) - ui64;
+
+    BAIL_IF_ERRPASS(!io->seek(io, pos), 0);
+
+    /* check signature again, just in case. */
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    BAIL_IF(ui32 != ZIP64_END_OF_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, 0);
+
+    /* size of Zip64 end of central directory record. */
+    BAIL_IF_ERRPASS(!readui64(io, &ui64), 0);
+
+    /* version made by. */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+
+    /* version needed to extract. */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+
+    /* number of this disk. */
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    BAIL_IF(ui32 != 0, PHYSFS_ERR_CORRUPT, 0);
+
+    /* number of disk with start of central directory record. */
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    BAIL_IF(ui32 != 0, PHYSFS_ERR_CORRUPT, 0);
+
+    /* total number of entries in the central dir on this disk */
+    BAIL_IF_ERRPASS(!readui64(io, &ui64), 0);
+
+    /* total number of entries in the central dir */
+    BAIL_IF_ERRPASS(!readui64(io, entry_count), 0);
+    BAIL_IF(ui64 != *entry_count, PHYSFS_ERR_CORRUPT, 0);
+
+    /* size of the central directory */
+    BAIL_IF_ERRPASS(!readui64(io, &ui64), 0);
+
+    /* offset of central directory */
+    BAIL_IF_ERRPASS(!readui64(io, dir_ofs), 0);
+
+    /* Since we know the difference, fix up the central dir offset... */
+    *dir_ofs += *data_start;
+
+    /*
+     * There are more fields here, for encryption and feature-specific things,
+     *  but we don't care about any of them at the moment.
+     */
+
+    return 1;  /* made it. */
+} /* zip64_parse_end_of_central_dir */
+
+
+static int zip_parse_end_of_central_dir(ZIPinfo *info,
+                                        PHYSFS_uint64 *data_start,
+                                        PHYSFS_uint64 *dir_ofs,
+                                        PHYSFS_uint64 *entry_count)
+{
+    PHYSFS_Io *io = info->io;
+    PHYSFS_uint16 entryCount16;
+    PHYSFS_uint32 offset32;
+    PHYSFS_uint32 ui32;
+    PHYSFS_uint16 ui16;
+    PHYSFS_sint64 len;
+    PHYSFS_sint64 pos;
+    int rc;
+
+    /* find the end-of-central-dir record, and seek to it. */
+    pos = zip_find_end_of_central_dir(io, &len);
+    BAIL_IF_ERRPASS(pos == -1, 0);
+    BAIL_IF_ERRPASS(!io->seek(io, pos), 0);
+
+    /* check signature again, just in case. */
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    BAIL_IF(ui32 != ZIP_END_OF_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, 0);
+
+    /* Seek back to see if "Zip64 end of central directory locator" exists. */
+    /* this record is 20 bytes before end-of-central-dir */
+    rc = zip64_parse_end_of_central_dir(info, data_start, dir_ofs,
+                                        entry_count, pos - 20);
+
+    /* Error or success? Bounce out of here. Keep going if not zip64. */
+    if ((rc == 0) || (rc == 1))
+        return rc;
+
+    assert(rc == -1);  /* no error, just not a Zip64 archive. */
+
+    /* Not Zip64? Seek back to where we were and keep processing. */
+    BAIL_IF_ERRPASS(!io->seek(io, pos + 4), 0);
+
+    /* number of this disk */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+    BAIL_IF(ui16 != 0, PHYSFS_ERR_CORRUPT, 0);
+
+    /* number of the disk with the start of the central directory */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+    BAIL_IF(ui16 != 0, PHYSFS_ERR_CORRUPT, 0);
+
+    /* total number of entries in the central dir on this disk */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+
+    /* total number of entries in the central dir */
+    BAIL_IF_ERRPASS(!readui16(io, &entryCount16), 0);
+    BAIL_IF(ui16 != entryCount16, PHYSFS_ERR_CORRUPT, 0);
+
+    *entry_count = entryCount16;
+
+    /* size of the central directory */
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+
+    /* offset of central directory */
+    BAIL_IF_ERRPASS(!readui32(io, &offset32), 0);
+    *dir_ofs = (PHYSFS_uint64) offset32;
+    BAIL_IF(((PHYSFS_uint64) pos) < (*dir_ofs + ui32), PHYSFS_ERR_CORRUPT, 0);
+
+    /*
+     * For self-extracting archives, etc, there's crapola in the file
+     *  before the zipfile records; we calculate how much data there is
+     *  prepended by determining how far the central directory offset is
+     *  from where it is supposed to be (start of end-of-central-dir minus
+     *  sizeof central dir)...the difference in bytes is how much arbitrary
+     *  data is at the start of the physical file.
+     */
+    *data_start = (PHYSFS_uint64) (pos - (*dir_ofs + ui32));
+
+    /* Now that we know the difference, fix up the central dir offset... */
+    *dir_ofs += *data_start;
+
+    /* zipfile comment length */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+
+    /*
+     * Make sure that the comment length matches to the end of file...
+     *  If it doesn't, we're either in the wrong part of the file, or the
+     *  file is corrupted, but we give up either way.
+     */
+    BAIL_IF((pos + 22 + ui16) != len, PHYSFS_ERR_CORRUPT, 0);
+
+    return 1;  /* made it. */
+} /* zip_parse_end_of_central_dir */
+
+
+/*
+ * On-disk index cache (see PHYSFS_setIndexCacheDir()).
+ *
+ * An index file is laid out so we can map it and answer lookups straight
+ *  out of it, without building a ZIPentry for everything up front:
+ *
+ *  - a fixed-size header, then the archive's name;
+ *  - one record per directory, root first. A dir record's first two words
+ *    are the index of its first file and how many files it holds;
+ *  - one record per file, grouped by directory. A file record's first word
+ *    is __PHYSFS_hashString() of its full path;
+ *  - a hash table of files: a power-of-two count of 32-bit buckets, each
+ *    1+index of a file, or zero, probed linearly like ZIPinfo::lazybuckets;
+ *  - every name, unterminated, one after another.
+ *
+ * Everything is little endian, and records are fixed-size. Mounting from an
+ *  index only adds the directories to the DirTree; files get a ZIPentry on
+ *  first lookup, or when their directory is enumerated, the same way a lazy
+ *  mount does it (see ZIPlazyfile).
+ *
+ * Since we don't read the whole file at mount time, we can't checksum it.
+ *  The header has its own CRC and lengths, and its magic is written last,
+ *  so a truncated or half-written index is ignored. Anything we read from
+ *  the rest of it is bounds-checked before we use it.
+ *
+ * The index is only used for archives that live in the physical filesystem,
+ *  since we need a size and modtime to decide if it's still current. As a
+ *  last line of defense, we also hash the end of the archive, which covers
+ *  the end-of-central-dir record and the tail of the central directory.
+ */
+#define ZIP_INDEX_EXT        "zipidx"
+#define ZIP_INDEX_MAGIC      "PHYSFSZI"
+#define ZIP_INDEX_VERSION    4
+#define ZIP_INDEX_HEADERLEN  68
+#define ZIP_INDEX_RECORDLEN  56
+#define ZIP_INDEX_TAILLEN    4096
+
+static PHYSFS_uint8 *zip_index_put(PHYSFS_uint8 *ptr, PHYSFS_uint64 val,
+                                   const int bytes)
+{
+    int i;
+    for (i = 0; i < bytes; i++, val >>= 8)
+        *(ptr++) = (PHYSFS_uint8) (val & 0xFF);
+    return ptr;
+} /* zip_index_put */
+
+static PHYSFS_uint64 zip_index_get(const PHYSFS_uint8 **_ptr, const int bytes)
+{
+    const PHYSFS_uint8 *ptr = *_ptr;
+    PHYSFS_uint64 retval = 0;
+    int i;
+    for (i = bytes - 1; i >= 0; i--)
+        retval = (retval << 8) | ptr[i];
+    *_ptr = ptr + bytes;
+    return retval;
+} /* zip_index_get */
+
+static inline PHYSFS_uint32 zip_index_get32(const PHYSFS_uint8 *ptr)
+{
+    return (PHYSFS_uint32) zip_index_get(&ptr, 4);
+} /* zip_index_get32 */
+
+
+/* Returns zero if (io) isn't something we can key an index on. */
+static int zip_index_make_key(PHYSFS_Io *io, const char *name,
+                              ZIPindexkey *key)
+{
+    const PHYSFS_sint64 len = io->length(io);
+    PHYSFS_uint8 *buf;
+    PHYSFS_Stat st;
+    size_t taillen;
+    int rc;
+
+    if ((len <= 0) || (!__PHYSFS_platformStat(name, &st, 1)))
+        return 0;
+    else if (st.filetype != PHYSFS_FILETYPE_REGULAR)
+        return 0;
+    else if (st.filesize != len)
+        return 0;  /* probably not the same file we're actually reading. */
+
+    taillen = (len < ZIP_INDEX_TAILLEN) ? (size_t) len : ZIP_INDEX_TAILLEN;
+    buf = (PHYSFS_uint8 *) __PHYSFS_smallAlloc(taillen);
+    BAIL_IF(!buf, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    rc = io->seek(io, (PHYSFS_uint64) len - taillen) &&
+         __PHYSFS_readAll(io, buf, taillen);
+    if (rc)
+    {
+        key->arclen = (PHYSFS_uint64) len;
+        key->modtime = st.modtime;
+        key->tailcrc = zip_crc32(0, buf, taillen);
+    } /* if */
+    __PHYSFS_smallFree(buf);
+
+    return rc;
+} /* zip_index_make_key */
+
+
+/*
+ * Find (rec)'s name in the index. Returns NULL if it's out of bounds, and
+ *  leaves its length in (*len).
+ */
+static const char *zip_index_record_name(const ZIPindex *index,
+                                         const PHYSFS_uint8 *rec,
+                                         size_t *len)
+{
+    const PHYSFS_uint32 ofs = zip_index_get32(rec + 8);
+    const PHYSFS_uint8 *ptr = rec + 12;
+    *len = (size_t) zip_index_get(&ptr, 2);
+    if ((ofs > index->nameslen) || (*len > index->nameslen - ofs))
+        return NULL;
+    return (const char *) (index->names + ofs);
+} /* zip_index_record_name */
+
+
+/* Add index record (rec) to the DirTree, as (name). */
+static ZIPentry *zip_index_add_record(ZIPinfo *info, const PHYSFS_uint8 *rec,
+                                      char *name, const int isdir)
+{
+    const PHYSFS_uint8 *ptr = rec + 14;
+    PHYSFS_uint64 offset, compressed_size, uncompressed_size;
+    ZipResolveType resolved;
+    ZIPentry *entry;
+
+    BAIL_IF(*name == '\0', PHYSFS_ERR_CORRUPT, NULL);
+    entry = (ZIPentry *) __PHYSFS_DirTreeAdd(&info->tree, name, isdir);
+    BAIL_IF_ERRPASS(!entry, NULL);
+    BAIL_IF(entry->tree.isdir != isdir, PHYSFS_ERR_CORRUPT, NULL);
+
+    entry->flags = (PHYSFS_uint8) zip_index_get(&ptr, 1);
+    entry->flags &= ~ZIP_ENTRY_WIDE;
+    if (info->wide)
+        entry->flags |= ZIP_ENTRY_WIDE;
+    ptr++;  /* reserved. */
+    entry->version_needed = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+    entry->general_bits = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+    entry->compression_method = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+    ptr += 2;  /* reserved. */
+    entry->crc = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    entry->dos_mod_time = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    offset = zip_index_get(&ptr, 8);
+    compressed_size = zip_index_get(&ptr, 8);
+    uncompressed_size = zip_index_get(&ptr, 8);
+    entry->symlink = NULL;
+    assert(ptr == rec + ZIP_INDEX_RECORDLEN);
+
+    BAIL_IF(!zip_entry_set_location(entry, offset, compressed_size,
+                                    uncompressed_size),
+            PHYSFS_ERR_CORRUPT, NULL);
+
+    resolved = zip_entry_resolved(entry);
+    BAIL_IF((resolved != ZIP_UNRESOLVED_FILE) &&
+            (resolved != ZIP_UNRESOLVED_SYMLINK) &&
+            (resolved != ZIP_DIRECTORY), PHYSFS_ERR_CORRUPT, NULL);
+
+    return entry;
+} /* zip_index_add_record */
+
+
+/* Build the real ZIPentry for file (i) in the index. */
+static ZIPentry *zip_index_load_file(ZIPinfo *info, const PHYSFS_uint32 i)
+{
+    ZIPindex *index = info->index;
+    const PHYSFS_uint8 *rec = index->files + (i * ZIP_INDEX_RECORDLEN);
+    ZIPentry *retval;
+    const char *name;
+    char *str;
+    size_t len;
+
+    assert(i < info->lazyfilecount);
+    assert((index->loaded[i / 8] & (1 << (i % 8))) == 0);
+
+    name = zip_index_record_name(index, rec, &len);
+    BAIL_IF(!name, PHYSFS_ERR_CORRUPT, NULL);
+    str = (char *) __PHYSFS_smallAlloc(len + 1);
+    BAIL_IF(!str, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memcpy(str, name, len);
+    str[len] = '\0';
+    retval = zip_index_add_record(info, rec, str, 0);
+    __PHYSFS_smallFree(str);
+    BAIL_IF_ERRPASS(!retval, NULL);
+
+    index->loaded[i / 8] |= (1 << (i % 8));
+    return retval;
+} /* zip_index_load_file */
+
+
+static ZIPentry *zip_index_find(ZIPinfo *info, const char *path,
+                                const size_t len, const PHYSFS_uint32 hash)
+{
+    const ZIPindex *index = info->index;
+    PHYSFS_uint32 bucket = hash & info->lazymask;
+    PHYSFS_uint32 tries;
+
+    /* a damaged index might have no empty buckets, so don't go around twice. */
+    for (tries = 0; tries <= info->lazymask; tries++)
+    {
+        const PHYSFS_uint8 *slot = index->buckets + (bucket * 4);
+        const PHYSFS_uint32 idx = zip_index_get32(slot);
+        const PHYSFS_uint8 *rec;
+        const char *name;
+        size_t namelen;
+
+        if (idx == 0)
+            break;
+
+        BAIL_IF(idx > info->lazyfilecount, PHYSFS_ERR_CORRUPT, NULL);
+        rec = index->files + ((idx - 1) * ZIP_INDEX_RECORDLEN);
+
+        /* loaded files are in the DirTree, so we wouldn't be here. */
+        if ( (zip_index_get32(rec) == hash) &&
+             ((index->loaded[(idx - 1) / 8] & (1 << ((idx - 1) % 8))) == 0) )
+        {
+            name = zip_index_record_name(index, rec, &namelen);
+            if ((name != NULL) && (namelen == len) &&
+                (memcmp(name, path, len) == 0))
+                return zip_index_load_file(info, idx - 1);
+        } /* if */
+
+        bucket = (bucket + 1) & info->lazymask;
+    } /* for */
+
+    BAIL(PHYSFS_ERR_NOT_FOUND, NULL);
+} /* zip_index_find */
+
+
+/* Make sure every file in directory (dir) is in the DirTree. */
+static int zip_index_populate(ZIPinfo *info, ZIPentry *dir)
+{
+    const ZIPindex *index = info->index;
+    const PHYSFS_uint8 *rec;
+    PHYSFS_uint32 first, count, i;
+
+    assert(dir->lazydir != 0);
+    assert(dir->lazydir <= index->dircount);
+    rec = index->dirs + ((dir->lazydir - 1) * ZIP_INDEX_RECORDLEN);
+    first = zip_index_get32(rec);
+    count = zip_index_get32(rec + 4);
+    /* zip_index_load() made sure this range is sane. */
+
+    for (i = first; i < first + count; i++)
+    {
+        if ((index->loaded[i / 8] & (1 << (i % 8))) == 0)
+            BAIL_IF_ERRPASS(!zip_index_load_file(info, i), 0);
+    } /* for */
 
-    memset(&entry, '\0', sizeof (entry));
+    return 1;
+} /* zip_index_populate */
 
-    /* Get the pertinent parts of the record... */
-    BAIL_IF_ERRPASS(!readui16(io, &entry.version), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &entry.version_needed), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &entry.general_bits), NULL);  /* general bits */
-    BAIL_IF_ERRPASS(!readui16(io, &entry.compression_method), NULL);
-    BAIL_IF_ERRPASS(!readui32(io, &entry.dos_mod_time), NULL);
-    entry.last_mod_time = zip_dos_time_to_physfs_time(entry.dos_mod_time);
-    BAIL_IF_ERRPASS(!readui32(io, &entry.crc), NULL);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), NULL);
-    entry.compressed_size = (PHYSFS_uint64) ui32;
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), NULL);
-    entry.uncompressed_size = (PHYSFS_uint64) ui32;
-    BAIL_IF_ERRPASS(!readui16(io, &fnamelen), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &extralen), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &commentlen), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), NULL);
-    starting_disk = (PHYSFS_uint32) ui16;
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), NULL);  /* internal file attribs */
-    BAIL_IF_ERRPASS(!readui32(io, &external_attr), NULL);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), NULL);
-    offset = (PHYSFS_uint64) ui32;
-
-    name = (char *) __PHYSFS_smallAlloc(fnamelen + 1);
-    BAIL_IF(!name, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    if (!__PHYSFS_readAll(io, name, fnamelen))
-    {
-        __PHYSFS_smallFree(name);
-        return NULL;
-    } /* if */
 
-    if (name[fnamelen - 1] == '/')
+static void zip_index_free(ZIPinfo *info)
+{
+    ZIPindex *index = info->index;
+    if (index != NULL)
     {
-        name[fnamelen - 1] = '\0';
-        isdir = 1;
+        if (index->io != NULL)
+            index->io->destroy(index->io);
+        allocator.Free(index->buf);
+        allocator.Free(index->loaded);
+        allocator.Free(index);
+        info->index = NULL;
     } /* if */
-    name[fnamelen] = '\0';  /* null-terminate the filename. */
+} /* zip_index_free */
 
-    zip_convert_dos_path(entry.version, name);
 
-    retval = (ZIPentry *) __PHYSFS_DirTreeAdd(&info->tree, name, isdir);
-    __PHYSFS_smallFree(name);
+/*
+ * Mount from the index cache. The caller cleans up the DirTree on failure.
+ *  The caller must have made every entry wide if this is a Zip64 archive,
+ *  since files get loaded later, when we can't start over.
+ */
+static int zip_index_load(ZIPinfo *info, const char *name,
+                          const ZIPindexkey *key)
+{
+    const size_t namelen = strlen(name);
+    PHYSFS_Io *io = __PHYSFS_openIndexCache(name, ZIP_INDEX_EXT);
+    ZIPentry *root = (ZIPentry *) info->tree.root;
+    const PHYSFS_uint8 *base = NULL;
+    const PHYSFS_uint8 *ptr;
+    ZIPindex *index = NULL;
+    PHYSFS_uint32 flags, filecount, bucketcount, i;
+    PHYSFS_uint64 needed;
+    PHYSFS_sint64 len;
+    char *str = NULL;
 
-    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    assert(info->index == NULL);
+    assert((info->wide) || (!info->zip64));
 
-    /* It's okay to BAIL without freeing retval, because it's stored in the
-       __PHYSFS_DirTree and will be freed later anyhow. */
-    BAIL_IF(retval->last_mod_time != 0, PHYSFS_ERR_CORRUPT, NULL); /* dupe? */
+    if (!io)
+        return 0;
 
-    /* Move the data we already read into place in the official object. */
-    memcpy(((PHYSFS_uint8 *) retval) + sizeof (__PHYSFS_DirTreeEntry),
-           ((PHYSFS_uint8 *) &entry) + sizeof (__PHYSFS_DirTreeEntry),
-           sizeof (*retval) - sizeof (__PHYSFS_DirTreeEntry));
+    len = io->length(io);
+    if ((len < ZIP_INDEX_HEADERLEN) || (!__PHYSFS_ui64FitsAddressSpace(len)))
+    {
+        io->destroy(io);
+        return 0;
+    } /* if */
 
-    retval->symlink = NULL;  /* will be resolved later, if necessary. */
+    index = (ZIPindex *) allocator.Malloc(sizeof (ZIPindex));
+    if (!index)
+    {
+        io->destroy(io);
+        return 0;
+    } /* if */
+    memset(index, '\0', sizeof (*index));
+    info->index = index;
 
-    if (isdir)
-        retval->resolved = ZIP_DIRECTORY;
+    /* use it in place if it's mapped, or read it in if it isn't. */
+    base = (const PHYSFS_uint8 *) __PHYSFS_ioMemoryRegion(io, 0, len);
+    if (base != NULL)
+        index->io = io;
     else
     {
-        retval->resolved = (zip_has_symlink_attr(retval, external_attr)) ?
-                                ZIP_UNRESOLVED_SYMLINK : ZIP_UNRESOLVED_FILE;
+        index->buf = (PHYSFS_uint8 *) allocator.Malloc((size_t) len);
+        if ( (index->buf != NULL) && (io->seek(io, 0)) &&
+             (__PHYSFS_readAll(io, index->buf, (size_t) len)) )
+            base = index->buf;
+        io->destroy(io);
+        if (!base)
+            goto zip_index_load_failed;
     } /* else */
 
-    si64 = io->tell(io);
-    BAIL_IF_ERRPASS(si64 == -1, NULL);
-
-    /* If the actual sizes didn't fit in 32-bits, look for the Zip64
-        extended information extra field... */
-    if ( (zip64) &&
-         ((offset == 0xFFFFFFFF) ||
-          (starting_disk == 0xFFFFFFFF) ||
-          (retval->compressed_size == 0xFFFFFFFF) ||
-          (retval->uncompressed_size == 0xFFFFFFFF)) )
+    ptr = base;
+    if (memcmp(ptr, ZIP_INDEX_MAGIC, 8) != 0)
+        goto zip_index_load_failed;
+    ptr += 8;
+    if (zip_index_get32(base + 64) != zip_crc32(0, ptr, 56))
+        goto zip_index_load_failed;
+    else if (zip_index_get(&ptr, 4) != ZIP_INDEX_VERSION)
+        goto zip_index_load_failed;
+    else if (zip_index_get(&ptr, 8) != key->arclen)
+        goto zip_index_load_failed;
+    else if ((PHYSFS_sint64) zip_index_get(&ptr, 8) != key->modtime)
+        goto zip_index_load_failed;
+    else if (zip_index_get(&ptr, 4) != key->tailcrc)
+        goto zip_index_load_failed;
+
+    flags = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    if (zip_index_get(&ptr, 4) != namelen)
+        goto zip_index_load_failed;
+    index->dircount = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    filecount = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    bucketcount = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    index->nameslen = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    if (zip_index_get(&ptr, 8) != (PHYSFS_uint64) len)
+        goto zip_index_load_failed;
+    ptr += 4;  /* header CRC, checked above. */
+    assert(ptr == base + ZIP_INDEX_HEADERLEN);
+
+    if ((index->dircount == 0) || (filecount >= ZIP_LAZY_LOADED))
+        goto zip_index_load_failed;
+    else if ((bucketcount <= filecount) || (bucketcount & (bucketcount - 1)))
+        goto zip_index_load_failed;
+
+    needed = ZIP_INDEX_HEADERLEN + namelen;
+    needed += ((PHYSFS_uint64) index->dircount) * ZIP_INDEX_RECORDLEN;
+    needed += ((PHYSFS_uint64) filecount) * ZIP_INDEX_RECORDLEN;
+    needed += ((PHYSFS_uint64) bucketcount) * 4;
+    needed += index->nameslen;
+    if (needed != (PHYSFS_uint64) len)
+        goto zip_index_load_failed;
+
+    /* the hash of the name picked this file, but make sure it's ours. */
+    if (memcmp(ptr, name, namelen) != 0)
+        goto zip_index_load_failed;
+    ptr += namelen;
+
+    index->dirs = ptr;
+    ptr += ((size_t) index->dircount) * ZIP_INDEX_RECORDLEN;
+    index->files = ptr;
+    ptr += ((size_t) filecount) * ZIP_INDEX_RECORDLEN;
+    index->buckets = ptr;
+    ptr += ((size_t) bucketcount) * 4;
+    index->names = ptr;
+
+    /* we already parsed the end-of-central-dir; this had better agree. */
+    if (((flags & 1) ? 1 : 0) != info->zip64)
+        goto zip_index_load_failed;
+    info->has_crypto = (flags & 2) ? 1 : 0;
+
+    index->loaded = (PHYSFS_uint8 *) allocator.Malloc((filecount / 8) + 1);
+    str = (char *) allocator.Malloc(0xFFFF + 1);
+    if ((!index->loaded) || (!str))
+        goto zip_index_load_failed;
+    memset(index->loaded, '\0', (filecount / 8) + 1);
+
+    /* directories all go in the DirTree now; only files wait. */
+    for (i = 0; i < index->dircount; i++)
     {
-        int found = 0;
-        PHYSFS_uint16 sig = 0;
-        PHYSFS_uint16 len = 0;
-        while (extralen > 4)
+        const PHYSFS_uint8 *rec = index->dirs + (i * ZIP_INDEX_RECORDLEN);
+        const PHYSFS_uint32 first = zip_index_get32(rec);
+        const PHYSFS_uint32 count = zip_index_get32(rec + 4);
+        ZIPentry *dir = root;
+
+        if ((first > filecount) || (count > filecount - first))
+            goto zip_index_load_failed;
+
+        if (i > 0)  /* the root is already there. */
         {
-            BAIL_IF_ERRPASS(!readui16(io, &sig), NULL);
-            BAIL_IF_ERRPASS(!readui16(io, &len), NULL);
+            size_t dnamelen;
+            const char *dname = zip_index_record_name(index, rec, &dnamelen);
+            if (!dname)
+                goto zip_index_load_failed;
+            memcpy(str, dname, dnamelen);
+            str[dnamelen] = '\0';
+            dir = zip_index_add_record(info, rec, str, 1);
+            if (!dir)
+                goto zip_index_load_failed;
+        } /* if */
 
-            si64 += 4 + len;
-            extralen -= 4 + len;
-            if (sig != ZIP64_EXTENDED_INFO_EXTRA_FIELD_SIG)
-            {
-                BAIL_IF_ERRPASS(!io->seek(io, si64), NULL);
-                continue;
-            } /* if */
+        dir->lazydir = (count > 0) ? (i + 1) : 0;
+    } /* for */
 
-            found = 1;
-            break;
-        } /* while */
+    allocator.Free(str);
+    info->lazyfilecount = filecount;
+    info->lazymask = bucketcount - 1;
+    info->lazydircount = index->dircount;
+    return 1;
 
-        BAIL_IF(!found, PHYSFS_ERR_CORRUPT, NULL);
+zip_index_load_failed:
+    allocator.Free(str);
+    zip_index_free(info);
+    return 0;
+} /* zip_index_load */
 
-        if (retval->uncompressed_size == 0xFFFFFFFF)
-        {
-            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, NULL);
-            BAIL_IF_ERRPASS(!readui64(io, &retval->uncompressed_size), NULL);
-            len -= 8;
-        } /* if */
 
-        if (retval->compressed_size == 0xFFFFFFFF)
-        {
-            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, NULL);
-            BAIL_IF_ERRPASS(!readui64(io, &retval->compressed_size), NULL);
-            len -= 8;
-        } /* if */
+/* Where zip_index_save() puts things. */
+typedef struct
+{
+    ZIPentry **dirs;            /* every dir, root first.                */
+    PHYSFS_uint32 dircount;
+    PHYSFS_uint32 *dirfiles;    /* per dir: files, then next free slot.  */
+    PHYSFS_uint32 *parents;     /* per file: its dir, from the count pass. */
+    PHYSFS_uint32 filecount;    /* files seen so far.                    */
+    PHYSFS_uint64 nameslen;     /* bytes of names so far.                */
+    const PHYSFS_uint8 *cdir;   /* central dir, for lazy mounts.         */
+    PHYSFS_uint64 cdirlen;
+    char *namebuf;              /* scratch for lazy files' names.        */
+    PHYSFS_uint8 *files;        /* file records in the index, and...     */
+    PHYSFS_uint8 *buckets;      /* ...the rest, in the filling pass.     */
+    PHYSFS_uint32 bucketmask;
+    PHYSFS_uint8 *names;
+} ZIPindexsave;
+
+
+static void zip_index_put_record(PHYSFS_uint8 *ptr, const PHYSFS_uint32 word0,
+                                 const PHYSFS_uint32 word1,
+                                 const PHYSFS_uint32 nameofs,
+                                 const size_t namelen, const ZIPcdrecord *rec)
+{
+    ptr = zip_index_put(ptr, word0, 4);
+    ptr = zip_index_put(ptr, word1, 4);
+    ptr = zip_index_put(ptr, nameofs, 4);
+    ptr = zip_index_put(ptr, namelen, 2);
+    ptr = zip_index_put(ptr, rec->flags & ~ZIP_ENTRY_WIDE, 1);
+    ptr = zip_index_put(ptr, 0, 1);
+    ptr = zip_index_put(ptr, rec->version_needed, 2);
+    ptr = zip_index_put(ptr, rec->general_bits, 2);
+    ptr = zip_index_put(ptr, rec->compression_method, 2);
+    ptr = zip_index_put(ptr, 0, 2);
+    ptr = zip_index_put(ptr, rec->crc, 4);
+    ptr = zip_index_put(ptr, rec->dos_mod_time, 4);
+    ptr = zip_index_put(ptr, rec->offset, 8);
+    ptr = zip_index_put(ptr, rec->compressed_size, 8);
+    ptr = zip_index_put(ptr, rec->uncompressed_size, 8);
+} /* zip_index_put_record */
+
+
+static void zip_index_entry_record(const ZIPentry *entry, ZIPcdrecord *rec)
+{
+    memset(rec, '\0', sizeof (*rec));
+    rec->name = entry->tree.name;
+    rec->offset = zip_entry_offset(entry);
+    rec->compressed_size = zip_entry_compressed_size(entry);
+    rec->uncompressed_size = zip_entry_uncompressed_size(entry);
+    rec->crc = entry->crc;
+    rec->dos_mod_time = entry->dos_mod_time;
+    rec->version_needed = entry->version_needed;
+    rec->general_bits = entry->general_bits;
+    rec->compression_method = entry->compression_method;
+    rec->flags = entry->flags;
+    rec->isdir = entry->tree.isdir;
+} /* zip_index_entry_record */
 
-        if (offset == 0xFFFFFFFF)
-        {
-            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, NULL);
-            BAIL_IF_ERRPASS(!readui64(io, &offset), NULL);
-            len -= 8;
-        } /* if */
 
-        if (starting_disk == 0xFFFFFFFF)
+/*
+ * Count (if save->files is NULL) or store file record (rec). Dirs have
+ *  their index in ZIPentry::lazydir while we're saving.
+ */
+static int zip_index_save_file(ZIPinfo *info, ZIPindexsave *save,
+                               const ZIPcdrecord *rec)
+{
+    const size_t namelen = strlen(rec->name);
+    const PHYSFS_uint32 i = save->filecount++;
+    PHYSFS_uint32 parent = 0;
+
+    if (save->files == NULL)
+    {
+        /* (rec->name) might be in the DirTree, so look up a copy. */
+        const char *sep = strrchr(rec->name, '/');
+        if (sep != NULL)
         {
-            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, NULL);
-            BAIL_IF_ERRPASS(!readui32(io, &starting_disk), NULL);
-            len -= 4;
+            const size_t dnamelen = (size_t) (sep - rec->name);
+            char *dname = (char *) __PHYSFS_smallAlloc(dnamelen + 1);
+            ZIPentry *dir;
+            BAIL_IF(!dname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+            memcpy(dname, rec->name, dnamelen);
+            dname[dnamelen] = '\0';
+            dir = (ZIPentry *) __PHYSFS_DirTreeFind(&info->tree, dname);
+            __PHYSFS_smallFree(dname);
+            BAIL_IF((!dir) || (!dir->tree.isdir), PHYSFS_ERR_CORRUPT, 0);
+            parent = dir->lazydir - 1;
         } /* if */
-
-        BAIL_IF(len != 0, PHYSFS_ERR_CORRUPT, NULL);
+        save->parents[i] = parent;
+        save->dirfiles[parent]++;
+        save->nameslen += namelen;
     } /* if */
 
-    BAIL_IF(starting_disk != 0, PHYSFS_ERR_CORRUPT, NULL);
-
-    retval->offset = offset + ofs_fixup;
-
-    /* seek to the start of the next entry in the central directory... */
-    BAIL_IF_ERRPASS(!io->seek(io, si64 + extralen + commentlen), NULL);
+    else
+    {
+        const PHYSFS_uint32 slot = save->dirfiles[save->parents[i]]++;
+        const PHYSFS_uint32 hash = __PHYSFS_hashString(rec->name, namelen);
+        PHYSFS_uint32 bucket = hash & save->bucketmask;
+        PHYSFS_uint8 *ptr;
+
+        zip_index_put_record(save->files + (slot * ZIP_INDEX_RECORDLEN), hash,
+                             0, (PHYSFS_uint32) save->nameslen, namelen, rec);
+        memcpy(save->names + save->nameslen, rec->name, namelen);
+        save->nameslen += namelen;
+
+        /* the mount refused duplicates, but never write an index that
+           would accept something the archive itself wouldn't. */
+        ptr = save->buckets + (bucket * 4);
+        while (zip_index_get32(ptr) != 0)
+        {
+            const PHYSFS_uint8 *other = save->files +
+                ((zip_index_get32(ptr) - 1) * ZIP_INDEX_RECORDLEN);
+            if (zip_index_get32(other) == hash)
+            {
+                const PHYSFS_uint32 nameofs = zip_index_get32(other + 8);
+                other += 12;
+                if ((zip_index_get(&other, 2) == namelen) &&
+                    (memcmp(save->names + nameofs, rec->name, namelen) == 0))
+                    BAIL(PHYSFS_ERR_CORRUPT, 0);  /* dupe. */
+            } /* if */
+            bucket = (bucket + 1) & save->bucketmask;
+            ptr = save->buckets + (bucket * 4);
+        } /* while */
+        zip_index_put(ptr, slot + 1, 4);
+    } /* else */
 
-    return retval;  /* success. */
-} /* zip_load_entry */
+    return 1;
+} /* zip_index_save_file */
 
 
-/* This leaves things allocated on error; the caller will clean up the mess. */
-static int zip_load_entries(ZIPinfo *info,
-                            const PHYSFS_uint64 data_ofs,
-                            const PHYSFS_uint64 central_ofs,
-                            const PHYSFS_uint64 entry_count)
+/* Run every file in the archive through zip_index_save_file(). */
+static int zip_index_save_files(ZIPinfo *info, ZIPindexsave *save)
 {
-    PHYSFS_Io *io = info->io;
-    const int zip64 = info->zip64;
-    PHYSFS_uint64 i;
+    const __PHYSFS_DirTree *tree = &info->tree;
+    ZIPcdrecord rec;
+    size_t i;
 
-    BAIL_IF_ERRPASS(!io->seek(io, central_ofs), 0);
+    save->filecount = 0;  /* (save->nameslen) carries on from the dirs. */
 
-    for (i = 0; i < entry_count; i++)
+    if (info->lazyfiles == NULL)
     {
-        ZIPentry *entry = zip_load_entry(info, zip64, data_ofs);
-        BAIL_IF_ERRPASS(!entry, 0);
-        if (zip_entry_is_tradional_crypto(entry))
-            info->has_crypto = 1;
+        for (i = 0; i < tree->hashBuckets; i++)
+        {
+            const __PHYSFS_DirTreeEntry *e;
+            for (e = tree->hash[i]; e != NULL; e = e->hashnext)
+            {
+                if (e->isdir)
+                    continue;
+                zip_index_entry_record((const ZIPentry *) e, &rec);
+                BAIL_IF_ERRPASS(!zip_index_save_file(info, save, &rec), 0);
+            } /* for */
+        } /* for */
+        return 1;
+    } /* if */
+
+    /* a lazy mount doesn't have most of its files in the tree, of course. */
+    for (i = 0; i < info->lazyfilecount; i++)
+    {
+        const PHYSFS_uint64 cdofs = info->lazyfiles[i].cdofs;
+        PHYSFS_ErrorCode err;
+        BAIL_IF(cdofs >= save->cdirlen, PHYSFS_ERR_CORRUPT, 0);
+        err = zip_parse_cdrecord(save->cdir + cdofs,
+                                 (size_t) (save->cdirlen - cdofs),
+                                 info->zip64, info->lazydataofs, &rec,
+                                 save->namebuf);
+        BAIL_IF(err != PHYSFS_ERR_OK, err, 0);
+        rec.flags |= ZIP_ENTRY_FROM_CDIR;
+        BAIL_IF_ERRPASS(!zip_index_save_file(info, save, &rec), 0);
     } /* for */
 
     return 1;
-} /* zip_load_entries */
+} /* zip_index_save_files */
 
 
-static PHYSFS_sint64 zip64_find_end_of_central_dir(PHYSFS_Io *io,
-                                                   PHYSFS_sint64 _pos,
-                                                   PHYSFS_uint64 offset)
+static void zip_index_save(ZIPinfo *info, const char *name,
+                           const ZIPindexkey *key)
 {
-    /*
-     * Naturally, the offset is useless to us; it is the offset from the
-     *  start of file, which is meaningless if we've appended this .zip to
-     *  a self-extracting .exe. We need to find this on our own. It should
-     *  be directly before the locator record, but the record in question,
-     *  like the original end-of-central-directory record, ends with a
-     *  variable-length field. Unlike the original, which has to store the
-     *  size of that variable-length field in a 16-bit int and thus has to be
-     *  within 64k, the new one gets 64-bits.
-     *
-     * Fortunately, the only currently-specified record for that variable
-     *  length block is some weird proprietary thing that deals with EBCDIC
-     *  and tape backups or something. So we don't seek far.
-     */
+    const __PHYSFS_DirTree *tree = &info->tree;
+    const size_t namelen = strlen(name);
+    PHYSFS_uint32 *olddirids = NULL;
+    int renumbered = 0;
+    PHYSFS_uint8 *cdirbuf = NULL;
+    PHYSFS_uint8 *buf = NULL;
+    PHYSFS_uint8 *ptr;
+    PHYSFS_uint64 len = 0;
+    PHYSFS_uint32 bucketcount = 16;
+    PHYSFS_uint32 filecount;
+    ZIPindexsave save;
+    ZIPcdrecord rec;
+    size_t i;
+
+    memset(&save, '\0', sizeof (save));
+
+    /* number the dirs, stashing the id in lazydir; we put it back later. */
+    save.dircount = 1;
+    for (i = 0; i < tree->hashBuckets; i++)
+    {
+        const __PHYSFS_DirTreeEntry *e;
+        for (e = tree->hash[i]; e != NULL; e = e->hashnext)
+            save.dircount += e->isdir ? 1 : 0;
+    } /* for */
 
-    PHYSFS_uint32 ui32;
-    const PHYSFS_uint64 pos = (PHYSFS_uint64) _pos;
+    save.dirs = (ZIPentry **) allocator.Malloc(save.dircount *
+                                               sizeof (ZIPentry *));
+    olddirids = (PHYSFS_uint32 *) allocator.Malloc(save.dircount * 4);
+    save.dirfiles = (PHYSFS_uint32 *) allocator.Malloc(save.dircount * 4);
+    if ((!save.dirs) || (!olddirids) || (!save.dirfiles))
+        goto zip_index_save_done;
+    memset(save.dirfiles, '\0', save.dircount * 4);
+
+    save.dirs[0] = (ZIPentry *) tree->root;
+    save.dircount = 1;
+    for (i = 0; i < tree->hashBuckets; i++)
+    {
+        __PHYSFS_DirTreeEntry *e;
+        for (e = tree->hash[i]; e != NULL; e = e->hashnext)
+        {
+            if (e->isdir)
+                save.dirs[save.dircount++] = (ZIPentry *) e;
+        } /* for */
+    } /* for */
 
-    assert(_pos > 0);
+    for (i = 0; i < save.dircount; i++)
+    {
+        olddirids[i] = save.dirs[i]->lazydir;
+        save.dirs[i]->lazydir = (PHYSFS_uint32) (i + 1);
+    } /* for */
+    renumbered = 1;
 
-    /* Try offset specified in the Zip64 end of central directory locator. */
-    /* This works if the entire PHYSFS_Io is the zip file. */
-    BAIL_IF_ERRPASS(!io->seek(io, offset), -1);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), -1);
-    if (ui32 == ZIP64_END_OF_CENTRAL_DIR_SIG)
-        return offset;
+    if (info->lazyfiles == NULL)
+        filecount = (PHYSFS_uint32) (tree->entrycount - (save.dircount - 1));
+    else
+    {
+        const PHYSFS_uint8 *block = NULL;
+        filecount = info->lazyfilecount;
+        save.namebuf = (char *) allocator.Malloc(0xFFFF + 1);
+        if ((!save.namebuf) ||
+            (!zip_get_central_dir(info, info->lazycentral, &block,
+                                  &save.cdirlen, &cdirbuf)) ||
+            (block == NULL))
+            goto zip_index_save_done;
+        save.cdir = block;
+    } /* else */
 
-    /* Try 56 bytes before the Zip64 end of central directory locator. */
-    /* This works if the record isn't variable length and is version 1. */
-    if (pos > 56)
+    if (filecount >= ZIP_LAZY_LOADED)
+        goto zip_index_save_done;
+    save.parents = (PHYSFS_uint32 *) allocator.Malloc((filecount + 1) * 4);
+    if (!save.parents)
+        goto zip_index_save_done;
+
+    /* first pass: find every file's dir, and count names. */
+    if (!zip_index_save_files(info, &save))
+        goto zip_index_save_done;
+    assert(save.filecount == filecount);
+    for (i = 0; i < save.dircount; i++)
+        save.nameslen += strlen(save.dirs[i]->tree.name);
+    save.nameslen -= strlen(tree->root->name);  /* root is nameless. */
+
+    while (bucketcount < (((PHYSFS_uint64) filecount) * 2))
+        bucketcount <<= 1;
+
+    len = ZIP_INDEX_HEADERLEN + namelen;
+    len += ((PHYSFS_uint64) save.dircount) * ZIP_INDEX_RECORDLEN;
+    len += ((PHYSFS_uint64) filecount) * ZIP_INDEX_RECORDLEN;
+    len += ((PHYSFS_uint64) bucketcount) * 4;
+    len += save.nameslen;
+    if ((save.nameslen > 0xFFFFFFFF) || (!__PHYSFS_ui64FitsAddressSpace(len)))
+        goto zip_index_save_done;
+
+    buf = (PHYSFS_uint8 *) allocator.Malloc((size_t) len);
+    if (!buf)
+        goto zip_index_save_done;  /* oh well, maybe next time. */
+
+    ptr = buf + ZIP_INDEX_HEADERLEN;
+    memcpy(ptr, name, namelen);
+    ptr += namelen;
+
+    /* dirs, each with the range of file slots it gets. */
+    save.nameslen = 0;
+    save.files = ptr + (save.dircount * ZIP_INDEX_RECORDLEN);
+    save.buckets = save.files + (((size_t) filecount) * ZIP_INDEX_RECORDLEN);
+    save.bucketmask = bucketcount - 1;
+    save.names = save.buckets + (((size_t) bucketcount) * 4);
+    memset(save.buckets, '\0', ((size_t) bucketcount) * 4);
+
+    for (i = 0, filecount = 0; i < save.dircount; i++)
     {
-        BAIL_IF_ERRPASS(!io->seek(io, pos-56), -1);
-        BAIL_IF_ERRPASS(!readui32(io, &ui32), -1);
-        if (ui32 == ZIP64_END_OF_CENTRAL_DIR_SIG)
-            return pos-56;
-    } /* if */
+        const PHYSFS_uint32 count = save.dirfiles[i];
+        const size_t dnamelen = (i == 0) ? 0 : strlen(save.dirs[i]->tree.name);
+        zip_index_entry_record(save.dirs[i], &rec);
+        zip_index_put_record(ptr, filecount, count,
+                             (PHYSFS_uint32) save.nameslen, dnamelen, &rec);
+        memcpy(save.names + save.nameslen, rec.name, dnamelen);
+        save.nameslen += dnamelen;
+        ptr += ZIP_INDEX_RECORDLEN;
+        save.dirfiles[i] = filecount;  /* now it's the next free slot. */
+        filecount += count;
+    } /* for */
 
-    /* Try 84 bytes before the Zip64 end of central directory locator. */
-    /* This works if the record isn't variable length and is version 2. */
-    if (pos > 84)
+    /* second pass: drop the files in their slots. */
+    if (!zip_index_save_files(info, &save))
+        goto zip_index_save_done;
+    assert(save.names + save.nameslen == buf + len);
+
+    memcpy(buf, ZIP_INDEX_MAGIC, 8);
+    ptr = zip_index_put(buf + 8, ZIP_INDEX_VERSION, 4);
+    ptr = zip_index_put(ptr, key->arclen, 8);
+    ptr = zip_index_put(ptr, (PHYSFS_uint64) key->modtime, 8);
+    ptr = zip_index_put(ptr, key->tailcrc, 4);
+    ptr = zip_index_put(ptr, (info->zip64 ? 1 : 0) |
+                             (info->has_crypto ? 2 : 0), 4);
+    ptr = zip_index_put(ptr, namelen, 4);
+    ptr = zip_index_put(ptr, save.dircount, 4);
+    ptr = zip_index_put(ptr, filecount, 4);
+    ptr = zip_index_put(ptr, bucketcount, 4);
+    ptr = zip_index_put(ptr, save.nameslen, 4);
+    ptr = zip_index_put(ptr, len, 8);
+    ptr = zip_index_put(ptr, zip_crc32(0, buf + 8, 56), 4);
+    assert(ptr == buf + ZIP_INDEX_HEADERLEN);
+
+    /* other mounts may have the old one mapped; this never touches it. */
+    __PHYSFS_saveIndexCache(name, ZIP_INDEX_EXT, buf, (size_t) len);
+
+zip_index_save_done:
+    if (renumbered)
     {
-        BAIL_IF_ERRPASS(!io->seek(io, pos-84), -1);
-        BAIL_IF_ERRPASS(!readui32(io, &ui32), -1);
-        if (ui32 == ZIP64_END_OF_CENTRAL_DIR_SIG)
-            return pos-84;
+        for (i = 0; i < save.dircount; i++)
+            save.dirs[i]->lazydir = olddirids[i];
     } /* if */
+    allocator.Free(olddirids);
+    allocator.Free(save.dirs);
+    allocator.Free(save.dirfiles);
+    allocator.Free(save.parents);
+    allocator.Free(save.namebuf);
+    allocator.Free(cdirbuf);
+    allocator.Free(buf);
+} /* zip_index_save */
 
-    /* Ok, brute force: we know it's between (offset) and (pos) somewhere. */
-    /*  Just try moving back at most 256k. Oh well. */
-    if ((offset < pos) && (pos > 4))
-    {
-        const size_t maxbuflen = 256 * 1024;
-        size_t len = (size_t) (pos - offset);
-        PHYSFS_uint8 *buf = NULL;
-        PHYSFS_sint32 i;
 
-        if (len > maxbuflen)
-            len = maxbuflen;
+/*
+ * Seek indexes go in the index cache too, one file per entry. Each
+ *  checkpoint is its output position and bit position, 8 bytes each, then
+ *  its window, zero-padded to ZIP_CHECKPOINT_WINDOW. That's plain deflate,
+ *  so it doesn't depend on the decoder's insides, but the header still
+ *  records the window size and spacing we expect. A bad bit position just
+ *  makes the decoder fail (or produce garbage) later, never read out of
+ *  bounds, but we check that the positions make sense anyhow.
+ */
+#define ZIP_SEEKIDX_EXT        "zipseek"
+#define ZIP_SEEKIDX_MAGIC      "PHYSFSZS"
+#define ZIP_SEEKIDX_VERSION    2
+#define ZIP_SEEKIDX_HEADERLEN  64
+#define ZIP_SEEKIDX_POINTLEN   (16 + ZIP_CHECKPOINT_WINDOW)
+
+/* Caller must allocator.Free() the returned string. */
+static char *zip_seekindex_name(const ZIPinfo *info, const ZIPentry *entry)
+{
+    const size_t arclen = strlen(info->arcname);
+    const size_t namelen = strlen(entry->tree.name);
+    char *retval = (char *) allocator.Malloc(arclen + namelen + 2);
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memcpy(retval, info->arcname, arclen);
+    retval[arclen] = '\n';
+    memcpy(retval + arclen + 1, entry->tree.name, namelen + 1);
+    return retval;
+} /* zip_seekindex_name */
 
-        buf = (PHYSFS_uint8 *) __PHYSFS_smallAlloc(len);
-        BAIL_IF(!buf, PHYSFS_ERR_OUT_OF_MEMORY, -1);
 
-        if (!io->seek(io, pos - len) || !__PHYSFS_readAll(io, buf, len))
-        {
-            __PHYSFS_smallFree(buf);
-            return -1;  /* error was set elsewhere. */
-        } /* if */
+static PHYSFS_uint8 *zip_seekindex_header(PHYSFS_uint8 *ptr,
+                                          const ZIPinfo *info,
+                                          const ZIPentry *entry,
+                                          const PHYSFS_uint32 count,
+                                          const size_t namelen,
+                                          const PHYSFS_uint32 bodycrc)
+{
+    memcpy(ptr, ZIP_SEEKIDX_MAGIC, 8);
+    ptr += 8;
+    ptr = zip_index_put(ptr, ZIP_SEEKIDX_VERSION, 4);
+    ptr = zip_index_put(ptr, ZIP_CHECKPOINT_WINDOW, 4);
+    ptr = zip_index_put(ptr, PHYSFS_ZIP_SEEK_SPACING, 4);
+    ptr = zip_index_put(ptr, info->key.arclen, 8);
+    ptr = zip_index_put(ptr, (PHYSFS_uint64) info->key.modtime, 8);
+    ptr = zip_index_put(ptr, info->key.tailcrc, 4);
+    ptr = zip_index_put(ptr, zip_entry_offset(entry), 8);
+    ptr = zip_index_put(ptr, entry->crc, 4);
+    ptr = zip_index_put(ptr, count, 4);
+    ptr = zip_index_put(ptr, namelen, 4);
+    ptr = zip_index_put(ptr, bodycrc, 4);
+    return ptr;
+} /* zip_seekindex_header */
+
+
+static void zip_seekindex_free_points(ZIPseekindex *idx)
+{
+    PHYSFS_uint32 i;
+    for (i = 0; i < idx->count; i++)
+        allocator.Free(idx->points[i]);
+    allocator.Free(idx->points);
+    idx->points = NULL;
+    idx->count = idx->allocated = idx->saved = 0;
+} /* zip_seekindex_free_points */
 
-        for (i = (PHYSFS_sint32) (len - 4); i >= 0; i--)
-        {
-            if ( (buf[i] == 0x50) && (buf[i+1] == 0x4b) &&
-                 (buf[i+2] == 0x06) && (buf[i+3] == 0x06) )
-            {
-                __PHYSFS_smallFree(buf);
-                return pos - ((PHYSFS_sint64) (len - i));
-            } /* if */
-        } /* for */
 
+static int zip_seekindex_load(ZIPinfo *info, ZIPseekindex *idx)
+{
+    const ZIPentry *entry = idx->entry;
+    PHYSFS_uint8 header[ZIP_SEEKIDX_HEADERLEN];
+    PHYSFS_uint8 expected[ZIP_SEEKIDX_HEADERLEN];
+    const PHYSFS_uint8 *ptr;
+    PHYSFS_uint64 lastpos = 0;
+    PHYSFS_uint64 lastbit = 0;
+    PHYSFS_uint32 bodycrc, crc, count;
+    PHYSFS_Io *io = NULL;
+    char *name = NULL;
+    char *buf = NULL;
+    size_t namelen;
+    int retval = 0;
+
+    name = zip_seekindex_name(info, entry);
+    if (name == NULL)
+        return 0;
+    namelen = strlen(name);
+
+    io = __PHYSFS_openIndexCache(name, ZIP_SEEKIDX_EXT);
+    if ((io == NULL) || (!__PHYSFS_readAll(io, header, sizeof (header))))
+        goto zip_seekindex_load_done;
+
+    /* everything but the count and the body's CRC has to match exactly. */
+    ptr = header + (ZIP_SEEKIDX_HEADERLEN - 12);
+    count = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    ptr += 4;
+    bodycrc = (PHYSFS_uint32) zip_index_get(&ptr, 4);
+    zip_seekindex_header(expected, info, entry, count, namelen, bodycrc);
+    if (memcmp(header, expected, sizeof (header)) != 0)
+        goto zip_seekindex_load_done;
+    else if ((count == 0) || (io->length(io) != (PHYSFS_sint64)
+               (ZIP_SEEKIDX_HEADERLEN + namelen + (count * ZIP_SEEKIDX_POINTLEN))))
+        goto zip_seekindex_load_done;
+
+    /* the hash of the name picked this file, but make sure it's ours. */
+    buf = (char *) __PHYSFS_smallAlloc(namelen);
+    if ((buf == NULL) || (!__PHYSFS_readAll(io, buf, namelen)))
+        goto zip_seekindex_load_done;
+    else if (memcmp(buf, name, namelen) != 0)
+        goto zip_seekindex_load_done;
+    crc = zip_crc32(0, buf, namelen);
+
+    idx->points = (ZIPcheckpoint **) allocator.Malloc(count * sizeof (ZIPcheckpoint *));
+    if (idx->points == NULL)
+        goto zip_seekindex_load_done;
+    idx->allocated = count;
+
+    while (idx->count < count)
+    {
+        PHYSFS_uint8 positions[16];
+        ZIPcheckpoint *cp;
+
+        cp = (ZIPcheckpoint *) allocator.Malloc(sizeof (ZIPcheckpoint));
+        if (cp == NULL)
+            goto zip_seekindex_load_done;
+        idx->points[idx->count++] = cp;
+
+        if (!__PHYSFS_readAll(io, positions, sizeof (positions)))
+            goto zip_seekindex_load_done;
+        else if (!__PHYSFS_readAll(io, cp->window, sizeof (cp->window)))
+            goto zip_seekindex_load_done;
+        crc = zip_crc32(crc, positions, sizeof (positions));
+        crc = zip_crc32(crc, cp->window, sizeof (cp->window));
+
+        /* both positions only go forward, and stay inside the entry. */
+        ptr = positions;
+        cp->uncompressed_position = zip_index_get(&ptr, 8);
+        cp->bit_position = zip_index_get(&ptr, 8);
+        if (cp->uncompressed_position < lastpos + PHYSFS_ZIP_SEEK_SPACING)
+            goto zip_seekindex_load_done;
+        else if (cp->uncompressed_position > zip_entry_uncompressed_size(entry))
+            goto zip_seekindex_load_done;
+        else if (cp->bit_position <= lastbit)
+            goto zip_seekindex_load_done;
+        else if ((cp->bit_position >> 3) >= zip_entry_compressed_size(entry))
+            goto zip_seekindex_load_done;
+        lastpos = cp->uncompressed_position;
+        lastbit = cp->bit_position;
+    } /* while */
+
+    retval = (crc == bodycrc);
+
+zip_seekindex_load_done:
+    if (!retval)
+        zip_seekindex_free_points(idx);
+    idx->saved = idx->count;
+    if (buf != NULL)
         __PHYSFS_smallFree(buf);
+    if (io != NULL)
+        io->destroy(io);
+    allocator.Free(name);
+    return retval;
+} /* zip_seekindex_load */
+
+
+static void zip_seekindex_save(ZIPinfo *info, ZIPseekindex *idx)
+{
+    PHYSFS_uint8 *buf;
+    PHYSFS_uint8 *ptr;
+    PHYSFS_uint32 crc, i;
+    size_t namelen;
+    size_t len;
+    char *name;
+
+    name = zip_seekindex_name(info, idx->entry);
+    if (name == NULL)
+        return;
+    namelen = strlen(name);
+
+    len = ZIP_SEEKIDX_HEADERLEN + namelen +
+          (((size_t) idx->count) * ZIP_SEEKIDX_POINTLEN);
+    buf = (PHYSFS_uint8 *) allocator.Malloc(len);
+    if (buf == NULL)
+    {
+        allocator.Free(name);
+        return;
     } /* if */
 
-    BAIL(PHYSFS_ERR_CORRUPT, -1);  /* didn't find it. */
-} /* zip64_find_end_of_central_dir */
+    /* the body goes in first, so the header can have its CRC. */
+    ptr = buf + ZIP_SEEKIDX_HEADERLEN;
+    memcpy(ptr, name, namelen);
+    ptr += namelen;
+    for (i = 0; i < idx->count; i++)
+    {
+        const ZIPcheckpoint *cp = idx->points[i];
+        ptr = zip_index_put(ptr, cp->uncompressed_position, 8);
+        ptr = zip_index_put(ptr, cp->bit_position, 8);
+        memcpy(ptr, cp->window, sizeof (cp->window));
+        ptr += sizeof (cp->window);
+    } /* for */
+    assert(ptr == buf + len);
 
+    crc = zip_crc32(0, buf + ZIP_SEEKIDX_HEADERLEN,
+                    len - ZIP_SEEKIDX_HEADERLEN);
+    zip_seekindex_header(buf, info, idx->entry, idx->count, namelen, crc);
 
-static int zip64_parse_end_of_central_dir(ZIPinfo *info,
-                                          PHYSFS_uint64 *data_start,
-                                          PHYSFS_uint64 *dir_ofs,
-                                          PHYSFS_uint64 *entry_count,
-                                          PHYSFS_sint64 pos)
+    /* other handles may be reading the old one; this never touches it. */
+    __PHYSFS_saveIndexCache(name, ZIP_SEEKIDX_EXT, buf, len);
+
+    allocator.Free(buf);
+    allocator.Free(name);
+} /* zip_seekindex_save */
+
+
+/*
+ * Find (or make) the seek index for (entry). Returns NULL if the entry isn't
+ *  worth one or we're out of memory; reads just won't checkpoint then.
+ *  The caller must hold the stateLock, which protects info->seekindexes.
+ */
+static ZIPseekindex *zip_get_seekindex(ZIPinfo *info, const ZIPentry *entry)
 {
-    PHYSFS_Io *io = info->io;
-    PHYSFS_uint64 ui64;
-    PHYSFS_uint32 ui32;
-    PHYSFS_uint16 ui16;
+    ZIPseekindex *idx;
 
-    /* We should be positioned right past the locator signature. */
+    if (PHYSFS_ZIP_SEEK_SPACING == 0)
+        return NULL;
+    else if (entry->compression_method != COMPMETH_DEFLATE)
+        return NULL;  /* stored needs no help; LZMA state is not one block. */
+    else if (zip_entry_is_encrypted(entry))
+        return NULL;  /* we'd have to snapshot the crypto state, too. */
+    else if (zip_entry_uncompressed_size(entry) <= PHYSFS_ZIP_SEEK_SPACING)
+        return NULL;
 
-    if ((pos < 0) || (!io->seek(io, pos)))
-        return 0;
+    for (idx = info->seekindexes; idx != NULL; idx = idx->next)
+    {
+        if (idx->entry == entry)
+            return idx;
+    } /* for */
 
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    if (ui32 != ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIG)
-        return -1;  /* it's not a Zip64 archive. Not an error, though! */
+    if (info->seeklock == NULL)
+    {
+        info->seeklock = __PHYSFS_platformCreateMutex();
+        if (info->seeklock == NULL)
+            return NULL;
+    } /* if */
 
-    info->zip64 = 1;
+    idx = (ZIPseekindex *) allocator.Malloc(sizeof (ZIPseekindex));
+    if (idx == NULL)
+        return NULL;
+    memset(idx, '\0', sizeof (ZIPseekindex));
+    idx->entry = entry;
+    idx->lock = info->seeklock;
 
-    /* number of the disk with the start of the central directory. */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 != 0, PHYSFS_ERR_CORRUPT, 0);
+    if (info->arcname != NULL)
+        zip_seekindex_load(info, idx);
 
-    /* offset of Zip64 end of central directory record. */
-    BAIL_IF_ERRPASS(!readui64(io, &ui64), 0);
+    idx->next = info->seekindexes;
+    info->seekindexes = idx;
+    return idx;
+} /* zip_get_seekindex */
 
-    /* total number of disks */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 != 1, PHYSFS_ERR_CORRUPT, 0);
 
-    pos = zip64_find_end_of_central_dir(io, pos, ui64);
-    if (pos < 0)
-        return 0;  /* oh well. */
+/*
+ * Lazy mounting (see ZIPlazyfile).
+ *
+ * The central directory gets parsed in parallel like any other, when we can
+ *  get it in one block. If not, we read it in big chunks here instead of a
+ *  few bytes at a time, since a lazy mount only needs each record's name.
+ */
+#define ZIP_LAZY_BUFSIZE (256 * 1024)
+
+typedef struct
+{
+    PHYSFS_Io *io;
+    PHYSFS_uint8 *buf;
+    size_t len;            /* bytes of buf that are valid.            */
+    size_t pos;            /* read position in buf.                   */
+    PHYSFS_uint64 ofs;     /* offset in the archive of buf[len].      */
+    PHYSFS_uint64 end;     /* don't read past this offset.            */
+} ZIPcdreader;
+
+/* make sure (need) bytes are buffered at reader->buf + reader->pos. */
+static int zip_cdreader_fill(ZIPcdreader *reader, const size_t need)
+{
+    size_t avail = reader->len - reader->pos;
+    if (avail < need)
+    {
+        PHYSFS_uint64 toread = ZIP_LAZY_BUFSIZE - avail;
+        if (toread > reader->end - reader->ofs)
+            toread = reader->end - reader->ofs;
+        BAIL_IF(avail + toread < need, PHYSFS_ERR_CORRUPT, 0);
+
+        memmove(reader->buf, reader->buf + reader->pos, avail);
+        reader->pos = 0;
+        reader->len = avail;
+
+        /* seek every time; loading directories moves the io around. */
+        BAIL_IF_ERRPASS(!reader->io->seek(reader->io, reader->ofs), 0);
+        BAIL_IF_ERRPASS(!__PHYSFS_readAll(reader->io, reader->buf + avail,
+                                          (size_t) toread), 0);
+        reader->len += (size_t) toread;
+        reader->ofs += toread;
+    } /* if */
+
+    return 1;
+} /* zip_cdreader_fill */
+
+static void zip_cdreader_skip(ZIPcdreader *reader, const size_t len)
+{
+    reader->pos += len;
+    if (reader->pos > reader->len)  /* skipped past what we buffered? */
+    {
+        reader->ofs += reader->pos - reader->len;
+        reader->pos = reader->len = 0;
+    } /* if */
+} /* zip_cdreader_skip */
+
 
-    /*
-     * For self-extracting archives, etc, there's crapola in the file
-     *  before the zipfile records; we calculate how much data there is
-     *  prepended by determining how far the zip64-end-of-central-directory
-     *  offset is from where it is supposed to be...the difference in bytes
-     *  is how much arbitrary data is at the start of the physical file.
-     */
-    assert(((PHYSFS_uint64) pos) >= ui64);
-    *data_start = ((PHYSFS_uint64) pos) - ui64;
+static int zip_want_lazy(ZIPinfo *info, const PHYSFS_uint64 central_ofs,
+                         const PHYSFS_uint64 entry_count)
+{
+    const PHYSFS_sint64 len = info->io->length(info->io);
+    if ((entry_count == 0) || (!PHYSFS_getLazyMounting()))
+        return 0;
+    else if (entry_count >= ZIP_LAZY_LOADED)  /* we keep 31-bit indices. */
+        return 0;
+    else if ((len < 0) || (((PHYSFS_uint64) len) < central_ofs))
+        return 0;
+    return ((((PHYSFS_uint64) len) - central_ofs) <= 0xFFFFFFFF);
+} /* zip_want_lazy */
 
-    BAIL_IF_ERRPASS(!io->seek(io, pos), 0);
 
-    /* check signature again, just in case. */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 != ZIP64_END_OF_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, 0);
+/* This leaves things allocated on error; the caller will clean up the mess. */
+static int zip_lazy_load_entries(ZIPinfo *info,
+                                 const PHYSFS_uint64 data_ofs,
+                                 const PHYSFS_uint64 central_ofs,
+                                 const PHYSFS_uint64 entry_count)
+{
+    PHYSFS_Io *io = info->io;
+    ZIPentry *root = (ZIPentry *) info->tree.root;
+    ZIPentry *parent = root;   /* dir of the last file we saw. */
+    size_t parentlen = 0;
+    PHYSFS_uint32 buckets = 16;
+    const PHYSFS_uint8 *block = NULL;
+    PHYSFS_uint8 *buf = NULL;
+    PHYSFS_uint64 blocklen = 0;
+    ZIPcdreader reader;
+    char *name = NULL;
+    PHYSFS_uint64 i;
+    int retval = 0;
+    int rc;
 
-    /* size of Zip64 end of central directory record. */
-    BAIL_IF_ERRPASS(!readui64(io, &ui64), 0);
+    while (buckets < (entry_count * 2))
+        buckets <<= 1;
+
+    info->lazycentral = central_ofs;
+    info->lazydataofs = data_ofs;
+    info->lazymask = buckets - 1;
+    info->lazybuckets = (PHYSFS_uint32 *)
+                   allocator.Malloc(buckets * sizeof (PHYSFS_uint32));
+    BAIL_IF(!info->lazybuckets, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    memset(info->lazybuckets, '\0', buckets * sizeof (PHYSFS_uint32));
+    info->lazyfiles = (ZIPlazyfile *)
+          allocator.Malloc(((size_t) entry_count) * sizeof (ZIPlazyfile));
+    BAIL_IF(!info->lazyfiles, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    rc = zip_get_central_dir(info, central_ofs, &block, &blocklen, &buf);
+    if ((!rc) || (block != NULL))
+    {
+        if (rc)
+        {
+            retval = zip_parse_central_dir(info, block, blocklen, data_ofs,
+                                           entry_count) &&
+                     zip_lazy_check_dirs(info);
+        } /* if */
+        allocator.Free(buf);
+        return retval;
+    } /* if */
 
-    /* version made by. */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+    memset(&reader, '\0', sizeof (reader));
+    reader.io = io;
+    reader.ofs = central_ofs;
+    reader.end = (PHYSFS_uint64) io->length(io);
+    reader.buf = (PHYSFS_uint8 *) allocator.Malloc(ZIP_LAZY_BUFSIZE);
+    GOTO_IF(!reader.buf, PHYSFS_ERR_OUT_OF_MEMORY, zip_lazy_load_done);
+    name = (char *) allocator.Malloc(0xFFFF + 1);
+    GOTO_IF(!name, PHYSFS_ERR_OUT_OF_MEMORY, zip_lazy_load_done);
 
-    /* version needed to extract. */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+    for (i = 0; i < entry_count; i++)
+    {
+        const PHYSFS_uint64 recofs = reader.ofs - reader.len + reader.pos;
+        const PHYSFS_uint8 *ptr;
+        PHYSFS_uint16 version, general_bits, fnamelen, extralen, commentlen;
+        char *sep;
+
+        GOTO_IF_ERRPASS(!zip_cdreader_fill(&reader, 46), zip_lazy_load_done);
+        ptr = reader.buf + reader.pos;
+        GOTO_IF(zip_index_get(&ptr, 4) != ZIP_CENTRAL_DIR_SIG,
+                PHYSFS_ERR_CORRUPT, zip_lazy_load_done);
+        version = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+        ptr += 2;  /* version needed */
+        general_bits = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+        ptr += 18;  /* method, times, crc, sizes */
+        fnamelen = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+        extralen = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+        commentlen = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+        GOTO_IF(fnamelen == 0, PHYSFS_ERR_CORRUPT, zip_lazy_load_done);
+
+        if (general_bits & ZIP_GENERAL_BITS_TRADITIONAL_CRYPTO)
+            info->has_crypto = 1;
 
-    /* number of this disk. */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 != 0, PHYSFS_ERR_CORRUPT, 0);
+        GOTO_IF_ERRPASS(!zip_cdreader_fill(&reader, 46 + fnamelen),
+                        zip_lazy_load_done);
+        memcpy(name, reader.buf + reader.pos + 46, fnamelen);
+        zip_cdreader_skip(&reader, 46 + fnamelen + extralen + commentlen);
 
-    /* number of disk with start of central directory record. */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 != 0, PHYSFS_ERR_CORRUPT, 0);
+        if (name[fnamelen - 1] == '/')  /* directories are never lazy. */
+        {
+            GOTO_IF_ERRPASS(!io->seek(io, recofs), zip_lazy_load_done);
+            GOTO_IF_ERRPASS(!zip_load_entry(info, info->zip64, data_ofs),
+                            zip_lazy_load_done);
+            continue;
+        } /* if */
 
-    /* total number of entries in the central dir on this disk */
-    BAIL_IF_ERRPASS(!readui64(io, &ui64), 0);
+        name[fnamelen] = '\0';
+        zip_convert_dos_path(zip_version_has_dos_paths(version), name);
 
-    /* total number of entries in the central dir */
-    BAIL_IF_ERRPASS(!readui64(io, entry_count), 0);
-    BAIL_IF(ui64 != *entry_count, PHYSFS_ERR_CORRUPT, 0);
+        /* archives are usually sorted by directory; don't rehash the dir. */
+        sep = strrchr(name, '/');
+        if (sep == NULL)
+            parent = root;
+        else if ( ((size_t) (sep - name) != parentlen) ||
+                  (memcmp(name, parent->tree.name, parentlen) != 0) )
+        {
+            *sep = '\0';
+            parent = (ZIPentry *) __PHYSFS_DirTreeAdd(&info->tree, name, 1);
+            *sep = '/';
+            GOTO_IF_ERRPASS(!parent, zip_lazy_load_done);
+            GOTO_IF(!parent->tree.isdir, PHYSFS_ERR_CORRUPT, zip_lazy_load_done);
+        } /* else if */
+        parentlen = sep ? (size_t) (sep - name) : 0;
+
+        if (parent->lazydir == 0)
+            parent->lazydir = ++info->lazydircount;
+
+        GOTO_IF_ERRPASS(!zip_lazy_add_file(info, name, fnamelen,
+                                        __PHYSFS_hashString(name, fnamelen),
+                                        recofs - central_ofs, parent),
+                        zip_lazy_load_done);
+    } /* for */
 
-    /* size of the central directory */
-    BAIL_IF_ERRPASS(!readui64(io, &ui64), 0);
+    retval = zip_lazy_check_dirs(info);
 
-    /* offset of central directory */
-    BAIL_IF_ERRPASS(!readui64(io, dir_ofs), 0);
+zip_lazy_load_done:
+    allocator.Free(reader.buf);
+    allocator.Free(name);
+    return retval;
+} /* zip_lazy_load_entries */
 
-    /* Since we know the difference, fix up the central dir offset... */
-    *dir_ofs += *data_start;
 
-    /*
-     * There are more fields here, for encryption and feature-specific things,
-     *  but we don't care about any of them at the moment.
-     */
+/* Build the real ZIPentry for a lazy file. */
+static ZIPentry *zip_lazy_load_file(ZIPinfo *info, ZIPlazyfile *file)
+{
+    PHYSFS_Io *io = info->io;
+    ZIPentry *retval;
 
-    return 1;  /* made it. */
-} /* zip64_parse_end_of_central_dir */
+    assert((file->parent & ZIP_LAZY_LOADED) == 0);
+    BAIL_IF_ERRPASS(!io->seek(io, info->lazycentral + file->cdofs), NULL);
+    retval = zip_load_entry(info, info->zip64, info->lazydataofs);
+    BAIL_IF_ERRPASS(!retval, NULL);
+    file->parent |= ZIP_LAZY_LOADED;
+    return retval;
+} /* zip_lazy_load_file */
 
 
-static int zip_parse_end_of_central_dir(ZIPinfo *info,
-                                        PHYSFS_uint64 *data_start,
-                                        PHYSFS_uint64 *dir_ofs,
-                                        PHYSFS_uint64 *entry_count)
+/* returns 1 if (file)'s record is named (path), 0 if not, -1 on i/o error. */
+static int zip_lazy_file_is_named(ZIPinfo *info, const ZIPlazyfile *file,
+                                  const char *path, const size_t pathlen)
 {
     PHYSFS_Io *io = info->io;
-    PHYSFS_uint16 entryCount16;
-    PHYSFS_uint32 offset32;
-    PHYSFS_uint32 ui32;
-    PHYSFS_uint16 ui16;
-    PHYSFS_sint64 len;
-    PHYSFS_sint64 pos;
-    int rc;
+    PHYSFS_uint8 hdr[46];
+    const PHYSFS_uint8 *ptr;
+    PHYSFS_uint16 version;
+    char *name;
+    int retval;
+
+    BAIL_IF_ERRPASS(!io->seek(io, info->lazycentral + file->cdofs), -1);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(io, hdr, sizeof (hdr)), -1);
+
+    ptr = hdr + 4;
+    version = (PHYSFS_uint16) zip_index_get(&ptr, 2);
+    ptr = hdr + 28;
+    if (zip_index_get(&ptr, 2) != pathlen)
+        return 0;
 
-    /* find the end-of-central-dir record, and seek to it. */
-    pos = zip_find_end_of_central_dir(io, &len);
-    BAIL_IF_ERRPASS(pos == -1, 0);
-    BAIL_IF_ERRPASS(!io->seek(io, pos), 0);
+    name = (char *) __PHYSFS_smallAlloc(pathlen + 1);
+    BAIL_IF(!name, PHYSFS_ERR_OUT_OF_MEMORY, -1);
+    if (!__PHYSFS_readAll(io, name, pathlen))
+        retval = -1;
+    else
+    {
+        name[pathlen] = '\0';
+        zip_convert_dos_path(zip_version_has_dos_paths(version), name);
+        retval = (memcmp(name, path, pathlen) == 0);
+    } /* else */
+    __PHYSFS_smallFree(name);
 
-    /* check signature again, just in case. */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
-    BAIL_IF(ui32 != ZIP_END_OF_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, 0);
+    return retval;
+} /* zip_lazy_file_is_named */
 
-    /* Seek back to see if "Zip64 end of central directory locator" exists. */
-    /* this record is 20 bytes before end-of-central-dir */
-    rc = zip64_parse_end_of_central_dir(info, data_start, dir_ofs,
-                                        entry_count, pos - 20);
 
-    /* Error or success? Bounce out of here. Keep going if not zip64. */
-    if ((rc == 0) || (rc == 1))
-        return rc;
+static ZIPentry *zip_lazy_find(ZIPinfo *info, const char *path)
+{
+    const size_t len = strlen(path);
+    const PHYSFS_uint32 hash = __PHYSFS_hashString(path, len);
+    PHYSFS_uint32 bucket = hash & info->lazymask;
+    PHYSFS_uint32 idx;
 
-    assert(rc == -1);  /* no error, just not a Zip64 archive. */
+    if (info->index != NULL)
+        return zip_index_find(info, path, len, hash);
 
-    /* Not Zip64? Seek back to where we were and keep processing. */
-    BAIL_IF_ERRPASS(!io->seek(io, pos + 4), 0);
+    while ((idx = info->lazybuckets[bucket]) != 0)
+    {
+        ZIPlazyfile *file = &info->lazyfiles[idx - 1];
+        /* loaded files are in the DirTree, so we wouldn't be here. */
+        if ((file->hash == hash) && ((file->parent & ZIP_LAZY_LOADED) == 0))
+        {
+            const int rc = zip_lazy_file_is_named(info, file, path, len);
+            BAIL_IF_ERRPASS(rc < 0, NULL);
+            if (rc)
+                return zip_lazy_load_file(info, file);
+        } /* if */
+        bucket = (bucket + 1) & info->lazymask;
+    } /* while */
 
-    /* number of this disk */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
-    BAIL_IF(ui16 != 0, PHYSFS_ERR_CORRUPT, 0);
+    BAIL(PHYSFS_ERR_NOT_FOUND, NULL);
+} /* zip_lazy_find */
 
-    /* number of the disk with the start of the central directory */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
-    BAIL_IF(ui16 != 0, PHYSFS_ERR_CORRUPT, 0);
 
-    /* total number of entries in the central dir on this disk */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+/* Make sure every file in a directory is in the DirTree before we walk it. */
+static int zip_lazy_populate(ZIPinfo *info, const char *dname)
+{
+    ZIPentry *dir;
+    PHYSFS_uint32 i;
 
-    /* total number of entries in the central dir */
-    BAIL_IF_ERRPASS(!readui16(io, &entryCount16), 0);
-    BAIL_IF(ui16 != entryCount16, PHYSFS_ERR_CORRUPT, 0);
+    if ((info->lazyfiles == NULL) && (info->index == NULL))
+        return 1;
 
-    *entry_count = entryCount16;
+    dir = (ZIPentry *) __PHYSFS_DirTreeFind(&info->tree, dname);
+    if ((dir == NULL) || (dir->lazydir == 0))
+        return 1;  /* nothing to do (or let the enumerator report it). */
 
-    /* size of the central directory */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    if (info->index != NULL)
+    {
+        BAIL_IF_ERRPASS(!zip_index_populate(info, dir), 0);
+        dir->lazydir = 0;
+        return 1;
+    } /* if */
 
-    /* offset of central directory */
-    BAIL_IF_ERRPASS(!readui32(io, &offset32), 0);
-    *dir_ofs = (PHYSFS_uint64) offset32;
-    BAIL_IF(((PHYSFS_uint64) pos) < (*dir_ofs + ui32), PHYSFS_ERR_CORRUPT, 0);
+    if (info->lazyfirst == NULL)  /* first time? Chain up every dir's files. */
+    {
+        const size_t len = info->lazydircount * sizeof (PHYSFS_uint32);
+        info->lazyfirst = (PHYSFS_uint32 *) allocator.Malloc(len);
+        BAIL_IF(!info->lazyfirst, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        memset(info->lazyfirst, '\0', len);
 
-    /*
-     * For self-extracting archives, etc, there's crapola in the file
-     *  before the zipfile records; we calculate how much data there is
-     *  prepended by determining how far the central directory offset is
-     *  from where it is supposed to be (start of end-of-central-dir minus
-     *  sizeof central dir)...the difference in bytes is how much arbitrary
-     *  data is at the start of the physical file.
-     */
-    *data_start = (PHYSFS_uint64) (pos - (*dir_ofs + ui32));
+        /* go backwards, so each list ends up in central directory order. */
+        for (i = info->lazyfilecount; i > 0; i--)
+        {
+            ZIPlazyfile *file = &info->lazyfiles[i - 1];
+            const PHYSFS_uint32 dirid = file->parent & ~ZIP_LAZY_LOADED;
+            file->next = info->lazyfirst[dirid];
+            info->lazyfirst[dirid] = i;
+        } /* for */
+    } /* if */
 
-    /* Now that we know the difference, fix up the central dir offset... */
-    *dir_ofs += *data_start;
+    for (i = info->lazyfirst[dir->lazydir - 1]; i; i = info->lazyfiles[i - 1].next)
+    {
+        ZIPlazyfile *file = &info->lazyfiles[i - 1];
+        if ((file->parent & ZIP_LAZY_LOADED) == 0)
+            BAIL_IF_ERRPASS(!zip_lazy_load_file(info, file), 0);
+    } /* for */
 
-    /* zipfile comment length */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+    dir->lazydir = 0;
+    return 1;
+} /* zip_lazy_populate */
 
-    /*
-     * Make sure that the comment length matches to the end of file...
-     *  If it doesn't, we're either in the wrong part of the file, or the
-     *  file is corrupted, but we give up either way.
-     */
-    BAIL_IF((pos + 22 + ui16) != len, PHYSFS_ERR_CORRUPT, 0);
 
-    return 1;  /* made it. */
-} /* zip_parse_end_of_central_dir */
+static void zip_lazy_free(ZIPinfo *info)
+{
+    zip_index_free(info);
+    allocator.Free(info->lazyfiles);
+    allocator.Free(info->lazybuckets);
+    allocator.Free(info->lazyfirst);
+    info->lazyfiles = NULL;
+    info->lazybuckets = NULL;
+    info->lazyfirst = NULL;
+    info->lazyfilecount = info->lazydircount = 0;
+} /* zip_lazy_free */
 
 
 static void ZIP_closeArchive(void *opaque)
@@ -1449,23 +5849,75 @@ static void ZIP_closeArchive(void *opaque)
     if (!info)
         return;
 
+    /* pooled handles hold duplicates of (info->io), so they go first. */
+    while (info->pool != NULL)
+    {
+        ZIPfileinfo *finfo = info->pool;
+        info->pool = finfo->nextfree;
+        zip_free_fileinfo(finfo);
+    } /* while */
+
+    if (info->poollock)
+        __PHYSFS_platformDestroyMutex(info->poollock);
+
     if (info->io)
         info->io->destroy(info->io);
 
+    while (info->seekindexes != NULL)
+    {
+        ZIPseekindex *idx = info->seekindexes;
+        info->seekindexes = idx->next;
+        if ((info->arcname != NULL) && (idx->count > idx->saved))
+            zip_seekindex_save(info, idx);
+        zip_seekindex_free_points(idx);
+        allocator.Free(idx);
+    } /* while */
+
+    if (info->seeklock)
+        __PHYSFS_platformDestroyMutex(info->seeklock);
+
     __PHYSFS_DirTreeDeinit(&info->tree);
 
+    #if PHYSFS_ZIP_AES
+    zip_aes_free_passwords(info);
+    #endif
+
+    #if PHYSFS_ZIP_ZSTD
+    ZSTD_freeDDict(info->zstddict);  /* safe if it's NULL. */
+    while (info->oldzstddicts != NULL)
+    {
+        ZIPzstddict *old = info->oldzstddicts;
+        info->oldzstddicts = old->next;
+        ZSTD_freeDDict(old->ddict);
+        allocator.Free(old);
+    } /* while */
+    #endif
+
+    zip_lazy_free(info);
+    allocator.Free(info->arcname);
     allocator.Free(info);
 } /* ZIP_closeArchive */
 
 
+static int zip_init_tree(ZIPinfo *info)
+{
+    const size_t entrylen = info->wide ? sizeof (ZIPentry64) : sizeof (ZIPentry);
+    BAIL_IF_ERRPASS(!__PHYSFS_DirTreeInit(&info->tree, entrylen), 0);
+    zip_entry_set_resolved((ZIPentry *) info->tree.root, ZIP_DIRECTORY);
+    return 1;
+} /* zip_init_tree */
+
+
 static void *ZIP_openArchive(PHYSFS_Io *io, const char *name,
                              int forWriting, int *claimed)
 {
     ZIPinfo *info = NULL;
-    ZIPentry *root = NULL;
     PHYSFS_uint64 dstart = 0;  /* data start */
     PHYSFS_uint64 cdir_ofs;  /* central dir offset */
     PHYSFS_uint64 count;
+    int have_key = 0;
+    int lazy = 0;
+    int rc;
 
     assert(io != NULL);  /* shouldn't ever happen. */
 
@@ -1480,18 +5932,80 @@ static void *ZIP_openArchive(PHYSFS_Io *io, const char *name,
 
     info->io = io;
 
+    info->poollock = __PHYSFS_platformCreateMutex();
+    GOTO_IF_ERRPASS(!info->poollock, ZIP_openarchive_failed);
+
     if (!zip_parse_end_of_central_dir(info, &dstart, &cdir_ofs, &count))
         goto ZIP_openarchive_failed;
-    else if (!__PHYSFS_DirTreeInit(&info->tree, sizeof (ZIPentry)))
-        goto ZIP_openarchive_failed;
 
-    root = (ZIPentry *) info->tree.root;
-    root->resolved = ZIP_DIRECTORY;
+    if (PHYSFS_getIndexCacheDir() != NULL)
+        have_key = zip_index_make_key(io, name, &info->key);
 
-    if (!zip_load_entries(info, dstart, cdir_ofs, count))
-        goto ZIP_openarchive_failed;
+    /* seek indexes get cached with the same key, even for lazy mounts. */
+    if (have_key)
+    {
+        info->arcname = (char *) allocator.Malloc(strlen(name) + 1);
+        if (info->arcname == NULL)
+            have_key = 0;
+        else
+            strcpy(info->arcname, name);
+    } /* if */
+
+    /*
+     * Entries are narrow unless offsets can pass 4 gigs. A smaller Zip64
+     *  archive might still hold a file that's bigger than that once it's
+     *  uncompressed; if we trip over one, we start over with wide entries.
+     *  Lazy mounts, and mounts from the index cache, load files later and
+     *  can't start over then, so they're wide for any Zip64.
+     */
+    lazy = zip_want_lazy(info, cdir_ofs, count);
+    info->wide = ((io->length(io) > 0xFFFFFFFF) ||
+                  (((lazy) || (have_key)) && (info->zip64)));
+
+    while (1)
+    {
+        if (!zip_init_tree(info))
+            goto ZIP_openarchive_failed;
+
+        if (have_key && zip_index_load(info, name, &info->key))
+        {
+            have_key = 0;  /* got it from the cache, don't write it back. */
+            break;
+        } /* if */
+
+        if (have_key)  /* stale or damaged index; start over with a clean tree. */
+        {
+            __PHYSFS_DirTreeDeinit(&info->tree);
+            info->has_crypto = 0;
+            if (!zip_init_tree(info))
+                goto ZIP_openarchive_failed;
+        } /* if */
+
+        if (lazy)
+            rc = zip_lazy_load_entries(info, dstart, cdir_ofs, count);
+        else
+            rc = zip_load_entries(info, dstart, cdir_ofs, count);
+
+        if (rc)
+            break;
+        else if ((info->wide) || (!info->needs_wide))
+            goto ZIP_openarchive_failed;
+
+        __PHYSFS_DirTreeDeinit(&info->tree);
+        zip_lazy_free(info);
+        info->has_crypto = info->needs_wide = 0;
+        info->wide = 1;
+    } /* while */
 
     assert(info->tree.root->sibling == NULL);
+
+    if (have_key)
+        zip_index_save(info, name, &info->key);
+
+    /* (after saving the index, which only holds unresolved entries.) */
+    if (PHYSFS_getResolveOnMount())
+        zip_resolve_all(info);  /* failures just get resolved on open. */
+
     return info;
 
 ZIP_openarchive_failed:
@@ -1501,40 +6015,11 @@ ZIP_openarchive_failed:
 } /* ZIP_openArchive */
 
 
-static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, ZIPinfo *inf, ZIPentry *entry)
-{
-    int success;
-    PHYSFS_Io *retval = io->duplicate(io);
-    BAIL_IF_ERRPASS(!retval, NULL);
-
-    assert(!entry->tree.isdir); /* should have been checked before calling. */
-
-    /* (inf) can be NULL if we already resolved. */
-    success = (inf == NULL) || zip_resolve(retval, inf, entry);
-    if (success)
-    {
-        PHYSFS_sint64 offset;
-        offset = ((entry->symlink) ? entry->symlink->offset : entry->offset);
-        success = retval->seek(retval, offset);
-    } /* if */
-
-    if (!success)
-    {
-        retval->destroy(retval);
-        retval = NULL;
-    } /* if */
-
-    return retval;
-} /* zip_get_io */
-
-
 static PHYSFS_Io *ZIP_openRead(void *opaque, const char *filename)
 {
-    PHYSFS_Io *retval = NULL;
     ZIPinfo *info = (ZIPinfo *) opaque;
     ZIPentry *entry = zip_find_entry(info, filename);
     ZIPfileinfo *finfo = NULL;
-    PHYSFS_Io *io = NULL;
     PHYSFS_uint8 *password = NULL;
 
     /* if not found, see if maybe "$PASSWORD" is appended. */
@@ -1556,67 +6041,36 @@ static PHYSFS_Io *ZIP_openRead(void *opaque, const char *filename)
 
     BAIL_IF_ERRPASS(!entry, NULL);
 
-    BAIL_IF_ERRPASS(!zip_resolve(info->io, info, entry), NULL);
+    BAIL_IF_ERRPASS(!zip_resolve(info->io, info, entry, password), NULL);
 
     BAIL_IF(entry->tree.isdir, PHYSFS_ERR_NOT_A_FILE, NULL);
 
-    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
+    BAIL_IF(!zip_compression_supported((entry->symlink != NULL) ?
+                                       entry->symlink : entry),
+            PHYSFS_ERR_UNSUPPORTED, NULL);
 
-    finfo = (ZIPfileinfo *) allocator.Malloc(sizeof (ZIPfileinfo));
-    GOTO_IF(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
-    memset(finfo, '\0', sizeof (ZIPfileinfo));
+    finfo = zip_acquire_fileinfo(info, info->io,
+                    (entry->symlink != NULL) ? entry->symlink : entry);
+    BAIL_IF_ERRPASS(!finfo, NULL);
 
-    io = zip_get_io(info->io, info, entry);
-    GOTO_IF_ERRPASS(!io, ZIP_openRead_failed);
-    finfo->io = io;
-    finfo->entry = ((entry->symlink != NULL) ? entry->symlink : entry);
-    initializeZStream(&finfo->stream);
-
-    if (finfo->entry->compression_method != COMPMETH_NONE)
+    /* (entry) might be an encrypted link that used the password already. */
+    if (zip_entry_is_encrypted(finfo->entry))
     {
-        finfo->buffer = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
-        if (!finfo->buffer)
-            GOTO(PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
-        else if (zlib_err(inflateInit2(&finfo->stream, -MAX_WBITS)) != Z_OK)
+        if (!zip_prep_decrypt(info, finfo, password))
             goto ZIP_openRead_failed;
     } /* if */
-
-    if (!zip_entry_is_tradional_crypto(entry))
+    else if (!zip_entry_is_encrypted(entry))
         GOTO_IF(password != NULL, PHYSFS_ERR_BAD_PASSWORD, ZIP_openRead_failed);
-    else
-    {
-        PHYSFS_uint8 crypto_header[12];
-        GOTO_IF(password == NULL, PHYSFS_ERR_BAD_PASSWORD, ZIP_openRead_failed);
-        if (io->read(io, crypto_header, 12) != 12)
-            goto ZIP_openRead_failed;
-        else if (!zip_prep_crypto_keys(finfo, crypto_header, password))
-            goto ZIP_openRead_failed;
-    } /* if */
 
-    memcpy(retval, &ZIP_Io, sizeof (PHYSFS_Io));
-    retval->opaque = finfo;
+    finfo->seekindex = zip_get_seekindex(info, finfo->entry);
+    #if PHYSFS_ZIP_ZSTD
+    finfo->zstddict = info->zstddict;
+    #endif
 
-    return retval;
+    return &finfo->iface;
 
 ZIP_openRead_failed:
-    if (finfo != NULL)
-    {
-        if (finfo->io != NULL)
-            finfo->io->destroy(finfo->io);
-
-        if (finfo->buffer != NULL)
-        {
-            allocator.Free(finfo->buffer);
-            inflateEnd(&finfo->stream);
-        } /* if */
-
-        allocator.Free(finfo);
-    } /* if */
-
-    if (retval != NULL)
-        allocator.Free(retval);
-
+    zip_release_fileinfo(finfo);
     return NULL;
 } /* ZIP_openRead */
 
@@ -1653,10 +6107,10 @@ static int ZIP_stat(void *opaque, const char *filename, PHYSFS_Stat *stat)
     if (entry == NULL)
         return 0;
 
-    else if (!zip_resolve(info->io, info, entry))
+    else if (!zip_resolve(info->io, info, entry, NULL))
         return 0;
 
-    else if (entry->resolved == ZIP_DIRECTORY)
+    else if (zip_entry_resolved(entry) == ZIP_DIRECTORY)
     {
         stat->filesize = 0;
         stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
@@ -1670,11 +6124,15 @@ static int ZIP_stat(void *opaque, const char *filename, PHYSFS_Stat *stat)
 
     else
     {
-        stat->filesize = (PHYSFS_sint64) entry->uncompressed_size;
+        stat->filesize = (PHYSFS_sint64) zip_entry_uncompressed_size(entry);
         stat->filetype = PHYSFS_FILETYPE_REGULAR;
     } /* else */
 
-    stat->modtime = ((entry) ? entry->last_mod_time : 0);
+    /* DirTree-made ancestor dirs have no timestamp; everything else does. */
+    if (entry->flags & ZIP_ENTRY_FROM_CDIR)
+        stat->modtime = zip_dos_time_to_physfs_time(entry->dos_mod_time);
+    else
+        stat->modtime = 0;
     stat->createtime = stat->modtime;
     stat->accesstime = -1;
     stat->readonly = 1; /* .zip files are always read only */
@@ -1683,6 +6141,40 @@ static int ZIP_stat(void *opaque, const char *filename, PHYSFS_Stat *stat)
 } /* ZIP_stat */
 
 
+/* the central directory already told us what each entry is; no I/O here. */
+static int zip_entry_filetype(const void *_entry)
+{
+    const ZIPentry *entry = (const ZIPentry *) _entry;
+    if (entry->tree.isdir)
+        return PHYSFS_FILETYPE_DIRECTORY;
+    else if (zip_entry_is_symlink(entry))
+        return PHYSFS_FILETYPE_SYMLINK;
+    return PHYSFS_FILETYPE_REGULAR;
+} /* zip_entry_filetype */
+
+
+static PHYSFS_EnumerateCallbackResult ZIP_enumerate(void *opaque,
+                              const char *dname, PHYSFS_EnumerateCallback cb,
+                              const char *origdir, void *callbackdata)
+{
+    ZIPinfo *info = (ZIPinfo *) opaque;
+    BAIL_IF_ERRPASS(!zip_lazy_populate(info, dname), PHYSFS_ENUM_ERROR);
+    return __PHYSFS_DirTreeEnumerate(&info->tree, dname, cb, origdir,
+                                     callbackdata);
+} /* ZIP_enumerate */
+
+
+static PHYSFS_EnumerateCallbackResult ZIP_enumerateTyped(void *opaque,
+                         const char *dname, PHYSFS_EnumerateTypedCallback cb,
+                         const char *origdir, void *callbackdata)
+{
+    ZIPinfo *info = (ZIPinfo *) opaque;
+    BAIL_IF_ERRPASS(!zip_lazy_populate(info, dname), PHYSFS_ENUM_ERROR);
+    return __PHYSFS_DirTreeEnumerateTyped(&info->tree, dname, cb, origdir,
+                                          callbackdata, zip_entry_filetype);
+} /* ZIP_enumerateTyped */
+
+
 const PHYSFS_Archiver __PHYSFS_Archiver_ZIP =
 {
     CURRENT_PHYSFS_ARCHIVER_API_VERSION,
@@ -1694,14 +6186,24 @@ const PHYSFS_Archiver __PHYSFS_Archiver_ZIP =
         1,  /* supportsSymlinks */
     },
     ZIP_openArchive,
-    __PHYSFS_DirTreeEnumerate,
+    ZIP_enumerate,
     ZIP_openRead,
     ZIP_openWrite,
     ZIP_openAppend,
     ZIP_remove,
     ZIP_mkdir,
     ZIP_stat,
-    ZIP_closeArchive
+    ZIP_closeArchive,
+    ZIP_enumerateTyped
+};
+
+
+const __PHYSFS_ArchiverHooks __PHYSFS_ArchiverHooks_ZIP =
+{
+    ZIP_rawRegion,
+    ZIP_verifyIo,
+    ZIP_setDictionary,
+    ZIP_resolveAll
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_ZIP */
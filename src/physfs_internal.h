@@ -92,6 +92,54 @@ extern const PHYSFS_Archiver __PHYSFS_Archiver_SLB;
 extern const PHYSFS_Archiver __PHYSFS_Archiver_ISO9660;
 extern const PHYSFS_Archiver __PHYSFS_Archiver_VDF;
 
+/*
+ * Things the core sometimes needs from a built-in archiver that the public
+ *  PHYSFS_Archiver interface doesn't cover. Each archiver that has any of
+ *  these hands its hooks to initStaticArchivers() along with its
+ *  PHYSFS_Archiver, and the core reaches them through the DirHandle of a
+ *  mount, so it never has to know which archiver it's talking to. Any
+ *  member can be NULL. Archivers added with PHYSFS_registerArchiver() have
+ *  no hooks at all.
+ */
+typedef struct __PHYSFS_ArchiverHooks
+{
+    /*
+     * If reading (io), which came from this archiver's openRead(), just
+     *  reads a contiguous piece of another Io (no decompression, decryption,
+     *  checksums, etc), set (*pos) to where the piece starts in that Io and
+     *  (*len) to its length, and return that Io. Otherwise, return NULL.
+     *  This must not set an error code.
+     */
+    PHYSFS_Io *(*rawRegion)(PHYSFS_Io *io, PHYSFS_uint64 *pos,
+                            PHYSFS_uint64 *len);
+
+    /*
+     * Turn on checksum checking for (io), which came from this archiver's
+     *  openRead() and hasn't been read yet, even if
+     *  PHYSFS_setChecksumVerification() is off. Return zero if (io) can't
+     *  be checked; that isn't an error.
+     */
+    int (*verifyIo)(PHYSFS_Io *io);
+
+    /*
+     * Set the dictionary (opaque)'s decoders should use, or drop it if
+     *  (dict) is NULL. Called with the stateLock held. Return zero and set
+     *  an error code on failure.
+     */
+    int (*setDictionary)(void *opaque, const void *dict,
+                         const PHYSFS_uint64 len);
+
+    /*
+     * Do whatever per-entry work (opaque) put off at open time, for every
+     *  entry that still needs it. Called with the stateLock held. Return
+     *  zero and set an error code on failure.
+     */
+    int (*resolveAll)(void *opaque);
+} __PHYSFS_ArchiverHooks;
+
+extern const __PHYSFS_ArchiverHooks __PHYSFS_ArchiverHooks_ZIP;
+extern const __PHYSFS_ArchiverHooks __PHYSFS_ArchiverHooks_UNPK;
+
 /* a real C99-compliant snprintf() is in Visual Studio 2015,
    but just use this everywhere for binary compatibility. */
 #if defined(_MSC_VER)
@@ -107,15 +155,15 @@ const void *__PHYSFS_winrtCalcBaseDir(void);
 const void *__PHYSFS_winrtCalcPrefDir(void);
 #endif
 
-/* atomic operations. */
+/* atomic operations. These all return the new value, like InterlockedIncrement. */
 #if defined(_MSC_VER) && (_MSC_VER >= 1500)
 #include <intrin.h>
 __PHYSFS_COMPILE_TIME_ASSERT(LongEqualsInt, sizeof (int) == sizeof (long));
 #define __PHYSFS_ATOMIC_INCR(ptrval) _InterlockedIncrement((long*)(ptrval))
 #define __PHYSFS_ATOMIC_DECR(ptrval) _InterlockedDecrement((long*)(ptrval))
 #elif defined(__clang__) || (defined(__GNUC__) && (((__GNUC__ * 10000) + (__GNUC_MINOR__ * 100)) >= 40100))
-#define __PHYSFS_ATOMIC_INCR(ptrval) __sync_fetch_and_add(ptrval, 1)
-#define __PHYSFS_ATOMIC_DECR(ptrval) __sync_fetch_and_add(ptrval, -1)
+#define __PHYSFS_ATOMIC_INCR(ptrval) __sync_add_and_fetch(ptrval, 1)
+#define __PHYSFS_ATOMIC_DECR(ptrval) __sync_add_and_fetch(ptrval, -1)
 #else
 #define PHYSFS_NEED_ATOMIC_OP_FALLBACK 1
 int __PHYSFS_ATOMIC_INCR(int *ptrval);
@@ -204,16 +252,21 @@ void __PHYSFS_smallFree(void *ptr);
 #define PHYSFS_SUPPORTS_VDF 1
 #endif
 
+#if PHYSFS_SUPPORTS_ZIP
+/* zip support builds its CRC-32 tables at startup (no deinit). */
+extern void ZIP_global_init(void);
+#endif
+
 #if PHYSFS_SUPPORTS_7Z
 /* 7zip support needs a global init function called at startup (no deinit). */
 extern void SZIP_global_init(void);
 #endif
 
 /* The latest supported PHYSFS_Io::version value. */
-#define CURRENT_PHYSFS_IO_API_VERSION 0
+#define CURRENT_PHYSFS_IO_API_VERSION 1
 
 /* The latest supported PHYSFS_Archiver::version value. */
-#define CURRENT_PHYSFS_ARCHIVER_API_VERSION 0
+#define CURRENT_PHYSFS_ARCHIVER_API_VERSION 1
 
 /* This byteorder stuff was lifted from SDL. https://www.libsdl.org/ */
 #define PHYSFS_LIL_ENDIAN  1234
@@ -332,6 +385,49 @@ extern PHYSFS_Allocator __PHYSFS_AllocatorHooks;
  */
 PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode);
 
+/*
+ * Like __PHYSFS_createNativeIo(), but wraps a handle you already opened
+ *  with a __PHYSFS_platformOpen*() function. This takes ownership of
+ *  (handle), and closes it on failure. (path) is only used to open the
+ *  file again for duplicates that can't share the handle; it can be NULL,
+ *  in which case those duplicates fail.
+ */
+PHYSFS_Io *__PHYSFS_createNativeIoFromHandle(void *handle, const char *path,
+                                             const int mode);
+
+/*
+ * Open the index cache file for archive (arcname) for reading, if the
+ *  application enabled the cache with PHYSFS_setIndexCacheDir(). (ext) is a
+ *  short, archiver-specific suffix for the filename. The file is
+ *  memory-mapped when archive mapping is enabled, so
+ *  __PHYSFS_ioMemoryRegion() can hand out pointers into it. Returns NULL if
+ *  the cache is disabled or the file can't be opened; archivers should treat
+ *  that as a cache miss, not an error. The archiver is responsible for
+ *  validating what it reads back!
+ */
+PHYSFS_Io *__PHYSFS_openIndexCache(const char *arcname, const char *ext);
+
+/*
+ * Replace the index cache file for archive (arcname) with the (len) bytes
+ *  at (buf). The new file is written under a temporary name and renamed
+ *  into place, so anything still reading (or mapping) the old one keeps
+ *  seeing the old one, whole. Returns zero if the cache is disabled or the
+ *  file couldn't be written, which archivers can ignore.
+ */
+int __PHYSFS_saveIndexCache(const char *arcname, const char *ext,
+                            const void *buf, const size_t len);
+
+/*
+ * Create a read-only PHYSFS_Io for a file in the physical filesystem that
+ *  serves reads straight out of a memory mapping of the file, so reading and
+ *  seeking don't need system calls. Duplicates share the file handle and,
+ *  where address space allows, the mapping. Returns NULL if the file can't
+ *  be mapped; you should fall back to __PHYSFS_createNativeIo() then.
+ *  Building with PHYSFS_NO_MMAP defined stops PhysicsFS from using this for
+ *  archives.
+ */
+PHYSFS_Io *__PHYSFS_createMappedIo(const char *path);
+
 /*
  * Create a PHYSFS_Io for a buffer of memory (READ-ONLY). If you already
  *  have one of these, just use its duplicate() method, and it'll increment
@@ -341,12 +437,66 @@ PHYSFS_Io *__PHYSFS_createMemoryIo(const void *buf, PHYSFS_uint64 len,
                                    void (*destruct)(void *));
 
 
+/*
+ * Read (len) bytes from (io) into (buf), starting at byte (offset), with
+ *  PHYSFS_Io::readAt() if (io) has one. Otherwise this falls back to seek()
+ *  and read(), restoring the old i/o position afterwards, so it's correct
+ *  but not thread safe for Ios that don't implement readAt().
+ */
+PHYSFS_sint64 __PHYSFS_readAt(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len,
+                              PHYSFS_uint64 offset);
+
+/*
+ * Non-zero if (io) has a usable PHYSFS_Io::readAt(). An Io that wraps
+ *  another one must only offer readAt() if the one it wraps does, since the
+ *  seek-and-read fallback in __PHYSFS_readAt() isn't thread safe, and
+ *  readAt() promises to be.
+ */
+int __PHYSFS_ioHasReadAt(const PHYSFS_Io *io);
+
 /*
  * Read (len) bytes from (io) into (buf). Returns non-zero on success,
  *  zero on i/o error. Literally: "return (io->read(io, buf, len) == len);"
  */
 int __PHYSFS_readAll(PHYSFS_Io *io, void *buf, const size_t len);
 
+/*
+ * If (io) is one of the core's native or memory-mapped file Ios opened for
+ *  reading, set (*handle) to the platform handle of that file and (*offset)
+ *  to zero, and return the file's length. Otherwise, return -1. This doesn't
+ *  set an error code. PHYSFS_sendToFd() uses this, along with an archiver's
+ *  rawRegion hook, to let the OS do the copy.
+ */
+PHYSFS_sint64 __PHYSFS_ioNativeRegion(PHYSFS_Io *io, void **handle,
+                                      PHYSFS_uint64 *offset);
+
+/*
+ * If the (len) bytes at (pos) in (io) are already sitting in memory (a
+ *  memory Io, or a memory-mapped file), return a pointer to them without
+ *  copying anything. Otherwise, return NULL; just read them normally then.
+ *  The pointer stays valid until (io) is read, seeked, or destroyed.
+ */
+const void *__PHYSFS_ioMemoryRegion(PHYSFS_Io *io, const PHYSFS_uint64 pos,
+                                    const PHYSFS_uint64 len);
+
+#if PHYSFS_SUPPORTS_ZIP
+/* CRC-32 of (len) bytes at (buf), continuing from (crc); start with zero. */
+PHYSFS_uint32 __PHYSFS_zipCrc32(PHYSFS_uint32 crc, const void *buf, size_t len);
+
+/*
+ * The guts of PHYSFS_ZipWriter, in physfs_zipwriter.c. Create takes over
+ *  (out), an empty file from PHYSFS_openWrite(), and Close always closes it
+ *  and frees the writer, even if it fails. Add gets its data from (buf) or,
+ *  if that's NULL, (len) bytes read from (in). (name) is already sanitized.
+ */
+void *__PHYSFS_zipWriterCreate(PHYSFS_File *out, int threads,
+                               const PHYSFS_uint32 alignment);
+int __PHYSFS_zipWriterAdd(void *zw, char *name, const void *buf,
+                          PHYSFS_File *in, const PHYSFS_uint64 len,
+                          const PHYSFS_sint64 modtime, int level);
+int __PHYSFS_zipWriterClose(void *zw);
+#endif
+
 
 /* These are shared between some archivers. */
 
@@ -384,15 +534,24 @@ typedef struct __PHYSFS_DirTree
     __PHYSFS_DirTreeEntry **hash;  /* all entries hashed for fast lookup. */
     size_t hashBuckets;            /* number of buckets in hash.          */
     size_t entrylen;    /* size in bytes of entries (including subclass). */
+    size_t entrycount;  /* number of entries in hash (root isn't hashed). */
 } __PHYSFS_DirTree;
 
 
 int __PHYSFS_DirTreeInit(__PHYSFS_DirTree *dt, const size_t entrylen);
 void *__PHYSFS_DirTreeAdd(__PHYSFS_DirTree *dt, char *name, const int isdir);
+/* Size the hash for about (count) entries, if you know. Just a hint. */
+void __PHYSFS_DirTreeReserve(__PHYSFS_DirTree *dt, const size_t count);
 void *__PHYSFS_DirTreeFind(__PHYSFS_DirTree *dt, const char *path);
+void __PHYSFS_DirTreeRemove(__PHYSFS_DirTree *dt, void *entry);
 PHYSFS_EnumerateCallbackResult __PHYSFS_DirTreeEnumerate(void *opaque,
                               const char *dname, PHYSFS_EnumerateCallback cb,
                               const char *origdir, void *callbackdata);
+PHYSFS_EnumerateCallbackResult __PHYSFS_DirTreeEnumerateTyped(
+                              __PHYSFS_DirTree *dt, const char *dname,
+                              PHYSFS_EnumerateTypedCallback cb,
+                              const char *origdir, void *callbackdata,
+                              int (*filetype)(const void *entry));
 void __PHYSFS_DirTreeDeinit(__PHYSFS_DirTree *dt);
 
 
@@ -488,6 +647,95 @@ void *__PHYSFS_platformOpenWrite(const char *filename);
  */
 void *__PHYSFS_platformOpenAppend(const char *filename);
 
+/*
+ * Like __PHYSFS_platformOpenWrite(), but only if (filename) doesn't exist
+ *  yet; if it does, fail instead of truncating it. Two processes can never
+ *  both get the same new file this way.
+ *
+ * Call PHYSFS_setErrorCode() and return (NULL) if the file can't be opened.
+ */
+void *__PHYSFS_platformOpenNew(const char *filename);
+
+/*
+ * Open a directory so files in it can be reached by relative path with the
+ *  "At" functions below, which lets the OS skip resolving the directory's
+ *  own path every time (POSIX openat() and friends, for example). Return
+ *  NULL and call PHYSFS_setErrorCode() on failure; if your platform can't
+ *  do this, use PHYSFS_ERR_UNSUPPORTED and callers will use full paths.
+ *
+ * The "At" functions otherwise behave like their counterparts without the
+ *  "At". (relpath) is in platform-independent notation ('/' separators,
+ *  no ".." pieces), and "" means the directory itself.
+ *
+ * __PHYSFS_platformOpenAt()'s (mode) is 'r', 'w' or 'a'. If (confine) is
+ *  non-zero, it should refuse to follow symlinks or leave (dir) while
+ *  resolving (relpath), if the platform can enforce that (report
+ *  PHYSFS_ERR_SYMLINK_FORBIDDEN if so).
+ */
+void *__PHYSFS_platformOpenDirHandle(const char *path);
+void __PHYSFS_platformCloseDirHandle(void *dir);
+void *__PHYSFS_platformOpenAt(void *dir, const char *relpath, const int mode,
+                              const int confine);
+int __PHYSFS_platformStatAt(void *dir, const char *relpath, PHYSFS_Stat *st,
+                            const int follow);
+int __PHYSFS_platformMkDirAt(void *dir, const char *relpath);
+int __PHYSFS_platformDeleteAt(void *dir, const char *relpath);
+PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerateAt(void *dir,
+                               const char *relpath,
+                               PHYSFS_EnumerateTypedCallback callback,
+                               const char *origdir, void *callbackdata);
+
+/*
+ * Read more data from a platform-specific file handle, like
+ *  __PHYSFS_platformRead(), but starting at byte (offset) and without
+ *  moving the file pointer (POSIX pread(), for example). This must be safe
+ *  to call on the same handle from several threads at once, since PhysicsFS
+ *  uses it to let many PHYSFS_Io duplicates share one handle.
+ *
+ * Return -1 and call PHYSFS_setErrorCode() on failure. If your platform
+ *  can't do this atomically, report PHYSFS_ERR_UNSUPPORTED when (len) is
+ *  zero; PhysicsFS checks that way and opens a handle per duplicate instead.
+ */
+PHYSFS_sint64 __PHYSFS_platformReadAt(void *opaque, void *buf,
+                                      PHYSFS_uint64 len, PHYSFS_uint64 offset);
+
+/*
+ * Write data to a platform-specific file handle, like
+ *  __PHYSFS_platformWrite(), but starting at byte (offset) (POSIX pwrite(),
+ *  for example). The file pointer may or may not move; callers that use
+ *  this resync it with __PHYSFS_platformSeek() before going back to
+ *  __PHYSFS_platformWrite().
+ *
+ * Return -1 and call PHYSFS_setErrorCode() on failure. If your platform
+ *  can't do this, report PHYSFS_ERR_UNSUPPORTED when (len) is zero.
+ */
+PHYSFS_sint64 __PHYSFS_platformWriteAt(void *opaque, const void *buf,
+                                       PHYSFS_uint64 len, PHYSFS_uint64 offset);
+
+/*
+ * Copy (len) bytes, starting at byte (offset) of the platform-specific file
+ *  handle (opaque), to the POSIX file descriptor (fd), without bringing the
+ *  data into userspace if you can (Linux sendfile() or copy_file_range(),
+ *  for example). This must not move (opaque)'s file pointer.
+ *
+ * Return the number of bytes copied, which may be less than (len) if (fd) is
+ *  non-blocking and would block. Return -1 and call PHYSFS_setErrorCode() on
+ *  failure; report PHYSFS_ERR_UNSUPPORTED if you can't do this at all, and
+ *  PhysicsFS will read into a buffer and use __PHYSFS_platformWriteFd().
+ */
+PHYSFS_sint64 __PHYSFS_platformSendFile(int fd, void *opaque,
+                                        PHYSFS_uint64 offset,
+                                        PHYSFS_uint64 len);
+
+/*
+ * Write (len) bytes from (buf) to the POSIX file descriptor (fd). Return the
+ *  number of bytes written, which may be less than (len) if (fd) is
+ *  non-blocking and would block. Return -1 and call PHYSFS_setErrorCode()
+ *  on failure, PHYSFS_ERR_UNSUPPORTED if your platform has no such thing.
+ */
+PHYSFS_sint64 __PHYSFS_platformWriteFd(int fd, const void *buf,
+                                       PHYSFS_uint64 len);
+
 /*
  * Read more data from a platform-specific file handle. (opaque) should be
  *  cast to whatever data type your platform uses. Read a maximum of (len)
@@ -576,6 +824,15 @@ int __PHYSFS_platformStat(const char *fn, PHYSFS_Stat *stat, const int follow);
  */
 int __PHYSFS_platformFlush(void *opaque);
 
+/*
+ * Reserve disk space so the file behind (opaque) can grow to (len) bytes
+ *  without fragmenting or running out of space midway. This must not change
+ *  the file's visible size. It's only a hint: return zero and call
+ *  PHYSFS_setErrorCode() if it fails or isn't supported, and the caller
+ *  carries on without it.
+ */
+int __PHYSFS_platformPreallocate(void *opaque, PHYSFS_uint64 len);
+
 /*
  * Close file and deallocate resources. (opaque) should be cast to whatever
  *  data type your platform uses. This should close the file in any scenario:
@@ -586,6 +843,26 @@ int __PHYSFS_platformFlush(void *opaque);
  */
 void __PHYSFS_platformClose(void *opaque);
 
+/*
+ * Map (len) bytes of an open, read-only file into memory, starting at file
+ *  offset (offset). (opaque) is a handle from __PHYSFS_platformOpenRead().
+ *  (offset) does not have to be aligned to anything; the platform should
+ *  deal with page sizes itself, and return a pointer to the byte at
+ *  (offset). The mapping stays valid after the file handle is closed.
+ *
+ * Return NULL and call PHYSFS_setErrorCode() if you can't (or your platform
+ *  doesn't support mapping files, in which case use PHYSFS_ERR_UNSUPPORTED).
+ *  The caller will fall back to __PHYSFS_platformRead() and friends.
+ */
+const void *__PHYSFS_platformMap(void *opaque, PHYSFS_uint64 offset,
+                                 size_t len);
+
+/*
+ * Release a mapping from __PHYSFS_platformMap(). (ptr), (offset) and (len)
+ *  are the same values that were used/returned when it was mapped.
+ */
+void __PHYSFS_platformUnmap(const void *ptr, PHYSFS_uint64 offset, size_t len);
+
 /*
  * Platform implementation of PHYSFS_getCdRomDirsCallback()...
  *  CD directories are discovered and reported to the callback one at a time.
@@ -639,14 +916,16 @@ void *__PHYSFS_platformGetThreadID(void);
 
 /*
  * Enumerate a directory of files. This follows the rules for the
- *  PHYSFS_Archiver::enumerate() method, except that the (dirName) that is
- *  passed to this function is converted to platform-DEPENDENT notation by
+ *  PHYSFS_Archiver::enumerateTyped() method, except that the (dirName) that
+ *  is passed to this function is converted to platform-DEPENDENT notation by
  *  the caller. The PHYSFS_Archiver version uses platform-independent
  *  notation. Note that ".", "..", and other meta-entries should always
- *  be ignored.
+ *  be ignored. Report the type the OS gives you with the directory listing
+ *  (readdir()'s d_type, for example), or -1 if it didn't; don't stat()
+ *  entries just to find out.
  */
 PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
-                               PHYSFS_EnumerateCallback callback,
+                               PHYSFS_EnumerateTypedCallback callback,
                                const char *origdir, void *callbackdata);
 
 /*
@@ -670,6 +949,16 @@ int __PHYSFS_platformMkDir(const char *path);
  */
 int __PHYSFS_platformDelete(const char *path);
 
+/*
+ * Rename file (src) to (dst), replacing (dst) if it exists. Where the
+ *  platform allows, this should happen in one step, and anything that has
+ *  the old (dst) open or memory-mapped should keep seeing the old file. If
+ *  that can't be done, fail rather than change the file under them.
+ *
+ * On error, return zero and set the error message. Return non-zero on success.
+ */
+int __PHYSFS_platformRename(const char *src, const char *dst);
+
 
 /*
  * Create a platform-specific mutex. This can be whatever datatype your
@@ -717,6 +1006,71 @@ int __PHYSFS_platformGrabMutex(void *mutex);
  */
 void __PHYSFS_platformReleaseMutex(void *mutex);
 
+/*
+ * Start a new thread that calls (fn) with (data), and return an opaque
+ *  handle to it. Return NULL and call PHYSFS_setErrorCode() if you can't,
+ *  or PHYSFS_ERR_UNSUPPORTED if your platform has no threads; PhysicsFS
+ *  only uses threads for optional features, so this is allowed.
+ */
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data);
+
+/*
+ * Block until a thread from __PHYSFS_platformCreateThread() returns from
+ *  its function, then clean up its resources. (thread) is invalid after this.
+ */
+void __PHYSFS_platformWaitThread(void *thread);
+
+/*
+ * Create a counting semaphore, starting at zero. Return NULL and call
+ *  PHYSFS_setErrorCode() on failure. Platforms without threads can fail
+ *  with PHYSFS_ERR_UNSUPPORTED.
+ */
+void *__PHYSFS_platformCreateSemaphore(void);
+
+/*
+ * Destroy a semaphore from __PHYSFS_platformCreateSemaphore(). Nothing
+ *  may be waiting on it.
+ */
+void __PHYSFS_platformDestroySemaphore(void *sem);
+
+/*
+ * Increment a semaphore, waking one thread waiting on it, if any.
+ */
+void __PHYSFS_platformPostSemaphore(void *sem);
+
+/*
+ * Block until a semaphore's count is positive, then decrement it.
+ */
+void __PHYSFS_platformWaitSemaphore(void *sem);
+
+/*
+ * Directory change notification, for archivers that cache what's on disk.
+ *  A "dir watch" is a set of watched directories, each with an id. Pending
+ *  changes are collected with __PHYSFS_platformPollDirWatch(), which calls
+ *  a __PHYSFS_DirWatchCallback for each:
+ *
+ *  - (id) >= 0 and (name) is a filename: that entry in the watched
+ *    directory was created, deleted, renamed, or changed somehow.
+ *  - (id) >= 0 and (name) is "": the watched directory itself changed.
+ *  - (id) >= 0 and (name) is NULL: the watched directory was deleted or
+ *    renamed; its id won't report anything useful after this.
+ *  - (id) < 0: events were lost; the caller must assume anything changed.
+ *
+ * Create one with __PHYSFS_platformCreateDirWatch(), which returns NULL and
+ *  sets PHYSFS_ERR_UNSUPPORTED on platforms without this (the caller then
+ *  goes to disk every time, like it always did).
+ *  __PHYSFS_platformAddDirWatch() returns a new id, or -1 on failure (such
+ *  as PHYSFS_ERR_NO_SPACE when the system's watch limit is reached). It
+ *  doesn't follow symlinks. Polling never blocks; it returns zero on error.
+ */
+typedef void (*__PHYSFS_DirWatchCallback)(void *data, int id, const char *name);
+void *__PHYSFS_platformCreateDirWatch(void);
+int __PHYSFS_platformAddDirWatch(void *watch, const char *path);
+void __PHYSFS_platformRemoveDirWatch(void *watch, int id);
+int __PHYSFS_platformPollDirWatch(void *watch, __PHYSFS_DirWatchCallback cb,
+                                  void *data);
+void __PHYSFS_platformDestroyDirWatch(void *watch);
+
 #if PHYSFS_HAVE_PRAGMA_VISIBILITY
 #pragma GCC visibility pop
 #endif
@@ -419,7 +419,7 @@ char *__PHYSFS_platformCalcPrefDir(const char *org, const char *app)
 } /* __PHYSFS_platformCalcPrefDir */
 
 PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
-                               PHYSFS_EnumerateCallback callback,
+                               PHYSFS_EnumerateTypedCallback callback,
                                const char *origdir, void *callbackdata)
 {                                        
     PHYSFS_EnumerateCallbackResult retval = PHYSFS_ENUM_OK;
@@ -460,7 +460,11 @@ PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
                 retval = PHYSFS_ENUM_ERROR;
             else
             {
-                retval = callback(callbackdata, origdir, utf8);
+                /* no symlinks on OS/2, so the attributes tell us enough. */
+                const int filetype = (fb.attrFile & FILE_DIRECTORY) ?
+                                        PHYSFS_FILETYPE_DIRECTORY :
+                                        PHYSFS_FILETYPE_REGULAR;
+                retval = callback(callbackdata, origdir, utf8, filetype);
                 allocator.Free(utf8);
                 if (retval == PHYSFS_ENUM_ERROR)
                     PHYSFS_setErrorCode(PHYSFS_ERR_APP_CALLBACK);
@@ -582,6 +586,16 @@ void *__PHYSFS_platformOpenWrite(const char *filename)
 } /* __PHYSFS_platformOpenWrite */
 
 
+void *__PHYSFS_platformOpenNew(const char *filename)
+{
+    return (void *) openFile(filename,
+                        OPEN_ACTION_FAIL_IF_EXISTS |
+                        OPEN_ACTION_CREATE_IF_NEW,
+                        OPEN_FLAGS_FAIL_ON_ERROR | OPEN_FLAGS_NO_LOCALITY |
+                        OPEN_FLAGS_NOINHERIT | OPEN_SHARE_DENYWRITE);
+} /* __PHYSFS_platformOpenNew */
+
+
 void *__PHYSFS_platformOpenAppend(const char *filename)
 {
     APIRET rc;
@@ -621,6 +635,36 @@ PHYSFS_sint64 __PHYSFS_platformRead(void *opaque, void *buf, PHYSFS_uint64 len)
 } /* __PHYSFS_platformRead */
 
 
+PHYSFS_sint64 __PHYSFS_platformReadAt(void *opaque, void *buf,
+                                      PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    /* !!! FIXME: no atomic seek-and-read here, so no shared handles. */
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);
+} /* __PHYSFS_platformReadAt */
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteAt(void *opaque, const void *buf,
+                                       PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);  /* !!! FIXME: write it. */
+} /* __PHYSFS_platformWriteAt */
+
+
+PHYSFS_sint64 __PHYSFS_platformSendFile(int fd, void *opaque,
+                                        PHYSFS_uint64 offset,
+                                        PHYSFS_uint64 len)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);
+} /* __PHYSFS_platformSendFile */
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteFd(int fd, const void *buf,
+                                       PHYSFS_uint64 len)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);  /* no POSIX file descriptors here. */
+} /* __PHYSFS_platformWriteFd */
+
+
 PHYSFS_sint64 __PHYSFS_platformWrite(void *opaque, const void *buf,
                                      PHYSFS_uint64 len)
 {
@@ -676,12 +720,32 @@ int __PHYSFS_platformFlush(void *opaque)
 } /* __PHYSFS_platformFlush */
 
 
+int __PHYSFS_platformPreallocate(void *opaque, PHYSFS_uint64 len)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformPreallocate */
+
+
 void __PHYSFS_platformClose(void *opaque)
 {
     DosClose((HFILE) opaque);  /* ignore errors. You should have flushed! */
 } /* __PHYSFS_platformClose */
 
 
+const void *__PHYSFS_platformMap(void *opaque, PHYSFS_uint64 offset,
+                                 size_t len)
+{
+    /* !!! FIXME: OS/2 doesn't have memory-mapped files. Just read it. */
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformMap */
+
+
+void __PHYSFS_platformUnmap(const void *ptr, PHYSFS_uint64 offset, size_t len)
+{
+    assert(0 && "__PHYSFS_platformMap() never succeeds on OS/2!");
+} /* __PHYSFS_platformUnmap */
+
+
 int __PHYSFS_platformDelete(const char *path)
 {
     char *cppath = cvtUtf8ToCodepage(path);
@@ -702,6 +766,33 @@ done:
 } /* __PHYSFS_platformDelete */
 
 
+int __PHYSFS_platformRename(const char *src, const char *dst)
+{
+    char *cpsrc = cvtUtf8ToCodepage(src);
+    char *cpdst = NULL;
+    APIRET rc;
+    int retval = 0;
+
+    BAIL_IF_ERRPASS(!cpsrc, 0);
+    cpdst = cvtUtf8ToCodepage(dst);
+    GOTO_IF_ERRPASS(!cpdst, done);
+
+    /* DosMove() won't replace a file. DosDelete() fails while anyone has
+       (dst) open, though, so nobody sees it change under them. */
+    rc = DosDelete((unsigned char *) cpdst);
+    GOTO_IF((rc != NO_ERROR) && (rc != ERROR_FILE_NOT_FOUND),
+            errcodeFromAPIRET(rc), done);
+    rc = DosMove((unsigned char *) cpsrc, (unsigned char *) cpdst);
+    GOTO_IF(rc != NO_ERROR, errcodeFromAPIRET(rc), done);
+    retval = 1;  /* success */
+
+done:
+    allocator.Free(cpdst);
+    allocator.Free(cpsrc);
+    return retval;
+} /* __PHYSFS_platformRename */
+
+
 /* Convert to a format PhysicsFS can grok... */
 PHYSFS_sint64 os2TimeToUnixTime(const FDATE *date, const FTIME *time)
 {
@@ -807,6 +898,123 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
     DosReleaseMutexSem((HMTX) mutex);
 } /* __PHYSFS_platformReleaseMutex */
 
+
+/* !!! FIXME: DosCreateThread() and event semaphores could do these. */
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformWaitThread(void *thread)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformWaitThread */
+
+
+void *__PHYSFS_platformCreateSemaphore(void)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformPostSemaphore */
+
+
+void __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformWaitSemaphore */
+
+
+/* !!! FIXME: OS/2 doesn't have anything like these. */
+void *__PHYSFS_platformOpenDirHandle(const char *path)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformOpenDirHandle */
+
+
+void __PHYSFS_platformCloseDirHandle(void *dir)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformCloseDirHandle */
+
+
+void *__PHYSFS_platformOpenAt(void *dir, const char *relpath, const int mode,
+                              const int confine)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformOpenAt */
+
+
+int __PHYSFS_platformStatAt(void *dir, const char *relpath, PHYSFS_Stat *st,
+                            const int follow)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformStatAt */
+
+
+int __PHYSFS_platformMkDirAt(void *dir, const char *relpath)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformMkDirAt */
+
+
+int __PHYSFS_platformDeleteAt(void *dir, const char *relpath)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformDeleteAt */
+
+
+PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerateAt(void *dir,
+                               const char *relpath,
+                               PHYSFS_EnumerateTypedCallback callback,
+                               const char *origdir, void *callbackdata)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, PHYSFS_ENUM_ERROR);
+} /* __PHYSFS_platformEnumerateAt */
+
+
+/* !!! FIXME: DosFindNotifyFirst() could do this. */
+void *__PHYSFS_platformCreateDirWatch(void)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformCreateDirWatch */
+
+
+int __PHYSFS_platformAddDirWatch(void *watch, const char *path)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);
+} /* __PHYSFS_platformAddDirWatch */
+
+
+void __PHYSFS_platformRemoveDirWatch(void *watch, int id)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformRemoveDirWatch */
+
+
+int __PHYSFS_platformPollDirWatch(void *watch, __PHYSFS_DirWatchCallback cb,
+                                  void *data)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformPollDirWatch */
+
+
+void __PHYSFS_platformDestroyDirWatch(void *watch)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformDestroyDirWatch */
+
 #endif  /* PHYSFS_PLATFORM_OS2 */
 
 /* end of physfs_platform_os2.c ... */
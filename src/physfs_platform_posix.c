@@ -8,6 +8,10 @@
 
 /* !!! FIXME: check for EINTR? */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1  /* for fallocate(). */
+#endif
+
 #define __PHYSICSFS_INTERNAL__
 #include "physfs_platforms.h"
 
@@ -22,6 +26,27 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
+#  if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#    if __GLIBC_PREREQ(2, 27)
+#      define PHYSFS_HAVE_COPY_FILE_RANGE 1
+#    endif
+#  endif
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/openat2.h>)
+#    include <linux/openat2.h>
+#    include <sys/syscall.h>
+#    ifdef SYS_openat2
+#      define PHYSFS_HAVE_OPENAT2 1
+#    endif
+#  endif
+#endif
 
 #include "physfs_internal.h"
 
@@ -118,17 +143,31 @@ char *__PHYSFS_platformCalcUserDir(void)
 } /* __PHYSFS_platformCalcUserDir */
 
 
-PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
-                               PHYSFS_EnumerateCallback callback,
+/* d_type isn't POSIX, but Linux, the BSDs and macOS all have it. */
+static int direntFileType(const struct dirent *ent)
+{
+#ifdef DT_UNKNOWN
+    switch (ent->d_type)
+    {
+        case DT_REG: return PHYSFS_FILETYPE_REGULAR;
+        case DT_DIR: return PHYSFS_FILETYPE_DIRECTORY;
+        case DT_LNK: return PHYSFS_FILETYPE_SYMLINK;
+        case DT_UNKNOWN: return -1;  /* some filesystems don't fill it in. */
+        default: return PHYSFS_FILETYPE_OTHER;
+    } /* switch */
+#else
+    return -1;
+#endif
+} /* direntFileType */
+
+
+static PHYSFS_EnumerateCallbackResult doEnumerate(DIR *dir,
+                               PHYSFS_EnumerateTypedCallback callback,
                                const char *origdir, void *callbackdata)
 {
-    DIR *dir;
     struct dirent *ent;
     PHYSFS_EnumerateCallbackResult retval = PHYSFS_ENUM_OK;
 
-    dir = opendir(dirname);
-    BAIL_IF(dir == NULL, errcodeFromErrno(), PHYSFS_ENUM_ERROR);
-
     while ((retval == PHYSFS_ENUM_OK) && ((ent = readdir(dir)) != NULL))
     {
         const char *name = ent->d_name;
@@ -138,7 +177,7 @@ PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
                 continue;
         } /* if */
 
-        retval = callback(callbackdata, origdir, name);
+        retval = callback(callbackdata, origdir, name, direntFileType(ent));
         if (retval == PHYSFS_ENUM_ERROR)
             PHYSFS_setErrorCode(PHYSFS_ERR_APP_CALLBACK);
     } /* while */
@@ -146,6 +185,16 @@ PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
     closedir(dir);
 
     return retval;
+} /* doEnumerate */
+
+
+PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
+                               PHYSFS_EnumerateTypedCallback callback,
+                               const char *origdir, void *callbackdata)
+{
+    DIR *dir = opendir(dirname);
+    BAIL_IF(dir == NULL, errcodeFromErrno(), PHYSFS_ENUM_ERROR);
+    return doEnumerate(dir, callback, origdir, callbackdata);
 } /* __PHYSFS_platformEnumerate */
 
 
@@ -204,6 +253,12 @@ void *__PHYSFS_platformOpenWrite(const char *filename)
 } /* __PHYSFS_platformOpenWrite */
 
 
+void *__PHYSFS_platformOpenNew(const char *filename)
+{
+    return doOpen(filename, O_WRONLY | O_CREAT | O_EXCL);
+} /* __PHYSFS_platformOpenNew */
+
+
 void *__PHYSFS_platformOpenAppend(const char *filename)
 {
     return doOpen(filename, O_WRONLY | O_CREAT | O_APPEND);
@@ -227,6 +282,136 @@ PHYSFS_sint64 __PHYSFS_platformRead(void *opaque, void *buffer,
 } /* __PHYSFS_platformRead */
 
 
+PHYSFS_sint64 __PHYSFS_platformReadAt(void *opaque, void *buffer,
+                                      PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    const int fd = *((int *) opaque);
+    ssize_t rc = 0;
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF(offset != (PHYSFS_uint64) ((off_t) offset),
+            PHYSFS_ERR_INVALID_ARGUMENT, -1);  /* 32-bit off_t? */
+
+    rc = pread(fd, buffer, (size_t) len, (off_t) offset);
+    BAIL_IF(rc == -1, errcodeFromErrno(), -1);
+    assert(rc >= 0);
+    assert(rc <= len);
+    return (PHYSFS_sint64) rc;
+} /* __PHYSFS_platformReadAt */
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteAt(void *opaque, const void *buffer,
+                                       PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    const int fd = *((int *) opaque);
+    ssize_t rc = 0;
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF(offset != (PHYSFS_uint64) ((off_t) offset),
+            PHYSFS_ERR_INVALID_ARGUMENT, -1);  /* 32-bit off_t? */
+
+    rc = pwrite(fd, buffer, (size_t) len, (off_t) offset);
+    BAIL_IF(rc == -1, errcodeFromErrno(), -1);
+    assert(rc >= 0);
+    assert(rc <= len);
+    return (PHYSFS_sint64) rc;
+} /* __PHYSFS_platformWriteAt */
+
+
+PHYSFS_sint64 __PHYSFS_platformSendFile(int fd, void *opaque,
+                                        PHYSFS_uint64 offset,
+                                        PHYSFS_uint64 len)
+{
+#ifdef __linux__
+    const int infd = *((int *) opaque);
+    PHYSFS_sint64 retval = 0;
+    off_t off = (off_t) offset;
+    int usecopy = 0;
+
+    BAIL_IF(offset != (PHYSFS_uint64) off,
+            PHYSFS_ERR_INVALID_ARGUMENT, -1);  /* 32-bit off_t? */
+
+    #if PHYSFS_HAVE_COPY_FILE_RANGE
+    {
+        /* between regular files, the filesystem might not copy at all. */
+        struct stat statbuf;
+        usecopy = ((fstat(fd, &statbuf) == 0) && (S_ISREG(statbuf.st_mode)));
+    }
+    #endif
+
+    while (len > 0)
+    {
+        /* Linux moves at most 0x7ffff000 bytes per call, so ask for that. */
+        const size_t want = (len > 0x7FFFF000) ? 0x7FFFF000 : (size_t) len;
+        ssize_t rc;
+
+        #if PHYSFS_HAVE_COPY_FILE_RANGE
+        if (usecopy)
+        {
+            rc = copy_file_range(infd, &off, fd, NULL, want, 0);
+            if ((rc == -1) && ((errno == EXDEV) || (errno == EINVAL) ||
+                               (errno == ENOSYS) || (errno == EOPNOTSUPP)))
+            {
+                usecopy = 0;  /* not here; sendfile() will do. */
+                continue;
+            } /* if */
+        } /* if */
+        else
+        #endif
+        {
+            rc = sendfile(fd, infd, &off, want);
+        } /* else */
+
+        if (rc > 0)
+        {
+            retval += (PHYSFS_sint64) rc;
+            len -= (PHYSFS_uint64) rc;
+        } /* if */
+        else if (rc == 0)
+            break;  /* EOF? The file must have shrunk. */
+        else if (errno == EINTR)
+            continue;
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            break;  /* non-blocking fd is full; report what we sent. */
+        else if (retval > 0)
+            break;  /* report what we sent; the next call gets the error. */
+        else if ((errno == EINVAL) || (errno == ENOSYS))
+            BAIL(PHYSFS_ERR_UNSUPPORTED, -1);  /* fd can't take sendfile(). */
+        else
+            BAIL(errcodeFromErrno(), -1);
+    } /* while */
+
+    return retval;
+#else
+    /* !!! FIXME: the BSDs and macOS have sendfile(), with other arguments. */
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);
+#endif
+} /* __PHYSFS_platformSendFile */
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteFd(int fd, const void *buf,
+                                       PHYSFS_uint64 len)
+{
+    ssize_t rc;
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+
+    do
+    {
+        rc = write(fd, buf, (size_t) len);
+    } while ((rc == -1) && (errno == EINTR));
+
+    if ((rc == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        return 0;  /* non-blocking fd is full. */
+
+    BAIL_IF(rc == -1, errcodeFromErrno(), -1);
+    return (PHYSFS_sint64) rc;
+} /* __PHYSFS_platformWriteFd */
+
+
 PHYSFS_sint64 __PHYSFS_platformWrite(void *opaque, const void *buffer,
                                      PHYSFS_uint64 len)
 {
@@ -281,6 +466,21 @@ int __PHYSFS_platformFlush(void *opaque)
 } /* __PHYSFS_platformFlush */
 
 
+int __PHYSFS_platformPreallocate(void *opaque, PHYSFS_uint64 len)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    const int fd = *((int *) opaque);
+    BAIL_IF(len != (PHYSFS_uint64) ((off_t) len), PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    /* posix_fallocate() would grow the file, so use the Linux extension. */
+    BAIL_IF(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) len) == -1,
+            errcodeFromErrno(), 0);
+    return 1;
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#endif
+} /* __PHYSFS_platformPreallocate */
+
+
 void __PHYSFS_platformClose(void *opaque)
 {
     const int fd = *((int *) opaque);
@@ -289,6 +489,34 @@ void __PHYSFS_platformClose(void *opaque)
 } /* __PHYSFS_platformClose */
 
 
+const void *__PHYSFS_platformMap(void *opaque, PHYSFS_uint64 offset,
+                                 size_t len)
+{
+    const int fd = *((int *) opaque);
+    const PHYSFS_uint64 pagesize = (PHYSFS_uint64) sysconf(_SC_PAGESIZE);
+    const size_t slop = (size_t) (offset % pagesize);
+    void *ptr;
+
+    BAIL_IF(len == 0, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF(len > ((size_t) -1) - slop, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    BAIL_IF((offset - slop) != (PHYSFS_uint64) ((off_t) (offset - slop)),
+            PHYSFS_ERR_UNSUPPORTED, NULL);  /* 32-bit off_t and huge file? */
+
+    ptr = mmap(NULL, len + slop, PROT_READ, MAP_SHARED, fd,
+               (off_t) (offset - slop));
+    BAIL_IF(ptr == MAP_FAILED, errcodeFromErrno(), NULL);
+    return ((const PHYSFS_uint8 *) ptr) + slop;
+} /* __PHYSFS_platformMap */
+
+
+void __PHYSFS_platformUnmap(const void *ptr, PHYSFS_uint64 offset, size_t len)
+{
+    const PHYSFS_uint64 pagesize = (PHYSFS_uint64) sysconf(_SC_PAGESIZE);
+    const size_t slop = (size_t) (offset % pagesize);
+    (void) munmap((void *) (((const PHYSFS_uint8 *) ptr) - slop), len + slop);
+} /* __PHYSFS_platformUnmap */
+
+
 int __PHYSFS_platformDelete(const char *path)
 {
     BAIL_IF(remove(path) == -1, errcodeFromErrno(), 0);
@@ -296,25 +524,28 @@ int __PHYSFS_platformDelete(const char *path)
 } /* __PHYSFS_platformDelete */
 
 
-int __PHYSFS_platformStat(const char *fname, PHYSFS_Stat *st, const int follow)
+int __PHYSFS_platformRename(const char *src, const char *dst)
 {
-    struct stat statbuf;
-    const int rc = follow ? stat(fname, &statbuf) : lstat(fname, &statbuf);
-    BAIL_IF(rc == -1, errcodeFromErrno(), 0);
+    BAIL_IF(rename(src, dst) == -1, errcodeFromErrno(), 0);
+    return 1;
+} /* __PHYSFS_platformRename */
+
 
-    if (S_ISREG(statbuf.st_mode))
+static void statToPhysfsStat(const struct stat *statbuf, PHYSFS_Stat *st)
+{
+    if (S_ISREG(statbuf->st_mode))
     {
         st->filetype = PHYSFS_FILETYPE_REGULAR;
-        st->filesize = statbuf.st_size;
+        st->filesize = statbuf->st_size;
     } /* if */
 
-    else if(S_ISDIR(statbuf.st_mode))
+    else if(S_ISDIR(statbuf->st_mode))
     {
         st->filetype = PHYSFS_FILETYPE_DIRECTORY;
         st->filesize = 0;
     } /* else if */
 
-    else if(S_ISLNK(statbuf.st_mode))
+    else if(S_ISLNK(statbuf->st_mode))
     {
         st->filetype = PHYSFS_FILETYPE_SYMLINK;
         st->filesize = 0;
@@ -323,18 +554,283 @@ int __PHYSFS_platformStat(const char *fname, PHYSFS_Stat *st, const int follow)
     else
     {
         st->filetype = PHYSFS_FILETYPE_OTHER;
-        st->filesize = statbuf.st_size;
+        st->filesize = statbuf->st_size;
     } /* else */
 
-    st->modtime = statbuf.st_mtime;
-    st->createtime = statbuf.st_ctime;
-    st->accesstime = statbuf.st_atime;
+    st->modtime = statbuf->st_mtime;
+    st->createtime = statbuf->st_ctime;
+    st->accesstime = statbuf->st_atime;
+} /* statToPhysfsStat */
+
 
+int __PHYSFS_platformStat(const char *fname, PHYSFS_Stat *st, const int follow)
+{
+    struct stat statbuf;
+    const int rc = follow ? stat(fname, &statbuf) : lstat(fname, &statbuf);
+    BAIL_IF(rc == -1, errcodeFromErrno(), 0);
+    statToPhysfsStat(&statbuf, st);
     st->readonly = (access(fname, W_OK) == -1);
     return 1;
 } /* __PHYSFS_platformStat */
 
 
+/* an empty relative path means the directory itself. */
+#define RELPATH(relpath) ((*(relpath) == '\0') ? "." : (relpath))
+
+void *__PHYSFS_platformOpenDirHandle(const char *path)
+{
+    #ifdef O_PATH
+    const int flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+    #else
+    const int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    #endif
+    int *retval;
+    const int fd = open(path, flags);
+    BAIL_IF(fd < 0, errcodeFromErrno(), NULL);
+
+    retval = (int *) allocator.Malloc(sizeof (int));
+    if (!retval)
+    {
+        close(fd);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    *retval = fd;
+    return retval;
+} /* __PHYSFS_platformOpenDirHandle */
+
+
+void __PHYSFS_platformCloseDirHandle(void *dir)
+{
+    close(*((int *) dir));
+    allocator.Free(dir);
+} /* __PHYSFS_platformCloseDirHandle */
+
+
+#ifdef PHYSFS_HAVE_OPENAT2
+static int openat2Missing = 0;  /* set if the kernel predates openat2(). */
+#endif
+
+void *__PHYSFS_platformOpenAt(void *dir, const char *relpath, const int mode,
+                              const int confine)
+{
+    const int dirfd = *((int *) dir);
+    int flags = O_CLOEXEC;
+    int fd = -1;
+    int *retval;
+
+    if (mode == 'r')
+        flags |= O_RDONLY;
+    else if (mode == 'w')
+        flags |= O_WRONLY | O_CREAT | O_TRUNC;
+    else  /* O_APPEND doesn't behave as we'd like; seek to the end instead. */
+        flags |= O_WRONLY | O_CREAT;
+
+    #ifdef PHYSFS_HAVE_OPENAT2
+    if ((confine) && (!openat2Missing))
+    {
+        /* let the kernel enforce what verifyPath() checks, without races. */
+        struct open_how how;
+        memset(&how, '\0', sizeof (how));
+        how.flags = (PHYSFS_uint64) flags;
+        how.mode = (flags & O_CREAT) ? (S_IRUSR | S_IWUSR) : 0;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS;
+        fd = (int) syscall(SYS_openat2, dirfd, relpath, &how, sizeof (how));
+        if ((fd < 0) && (errno == ENOSYS))
+            openat2Missing = 1;  /* fall through to openat(). */
+        else if ((fd < 0) && ((errno == ELOOP) || (errno == EXDEV)))
+            BAIL(PHYSFS_ERR_SYMLINK_FORBIDDEN, NULL);
+        else
+            BAIL_IF(fd < 0, errcodeFromErrno(), NULL);
+    } /* if */
+    #endif
+
+    if (fd < 0)
+    {
+        fd = openat(dirfd, relpath, flags, S_IRUSR | S_IWUSR);
+        BAIL_IF(fd < 0, errcodeFromErrno(), NULL);
+    } /* if */
+
+    if ((mode == 'a') && (lseek(fd, 0, SEEK_END) < 0))
+    {
+        const int err = errno;
+        close(fd);
+        BAIL(errcodeFromErrnoError(err), NULL);
+    } /* if */
+
+    retval = (int *) allocator.Malloc(sizeof (int));
+    if (!retval)
+    {
+        close(fd);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    *retval = fd;
+    return retval;
+} /* __PHYSFS_platformOpenAt */
+
+
+int __PHYSFS_platformStatAt(void *dir, const char *relpath, PHYSFS_Stat *st,
+                            const int follow)
+{
+    const int dirfd = *((int *) dir);
+    const char *rel = RELPATH(relpath);
+    struct stat statbuf;
+    const int rc = fstatat(dirfd, rel, &statbuf,
+                           follow ? 0 : AT_SYMLINK_NOFOLLOW);
+    BAIL_IF(rc == -1, errcodeFromErrno(), 0);
+    statToPhysfsStat(&statbuf, st);
+    st->readonly = (faccessat(dirfd, rel, W_OK, 0) == -1);
+    return 1;
+} /* __PHYSFS_platformStatAt */
+
+
+int __PHYSFS_platformMkDirAt(void *dir, const char *relpath)
+{
+    const int rc = mkdirat(*((int *) dir), relpath, S_IRWXU);
+    BAIL_IF(rc == -1, errcodeFromErrno(), 0);
+    return 1;
+} /* __PHYSFS_platformMkDirAt */
+
+
+int __PHYSFS_platformDeleteAt(void *dir, const char *relpath)
+{
+    const int dirfd = *((int *) dir);
+
+    /* like remove(): try it as a file, then as a directory. */
+    if (unlinkat(dirfd, relpath, 0) == -1)
+    {
+        const int err = errno;
+        if ((err != EISDIR) && (err != EPERM))
+            BAIL(errcodeFromErrnoError(err), 0);
+        else if (unlinkat(dirfd, relpath, AT_REMOVEDIR) == -1)
+            BAIL(errcodeFromErrnoError((errno == ENOTDIR) ? err : errno), 0);
+    } /* if */
+
+    return 1;
+} /* __PHYSFS_platformDeleteAt */
+
+
+PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerateAt(void *dir,
+                               const char *relpath,
+                               PHYSFS_EnumerateTypedCallback callback,
+                               const char *origdir, void *callbackdata)
+{
+    DIR *dirp;
+    const int fd = openat(*((int *) dir), RELPATH(relpath),
+                          O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    BAIL_IF(fd < 0, errcodeFromErrno(), PHYSFS_ENUM_ERROR);
+    dirp = fdopendir(fd);
+    if (dirp == NULL)
+    {
+        const int err = errno;
+        close(fd);
+        BAIL(errcodeFromErrnoError(err), PHYSFS_ENUM_ERROR);
+    } /* if */
+    return doEnumerate(dirp, callback, origdir, callbackdata);
+} /* __PHYSFS_platformEnumerateAt */
+
+
+typedef struct
+{
+    pthread_t thread;
+    void (*fn)(void *);
+    void *data;
+} PthreadThread;
+
+static void *pthreadEntry(void *arg)
+{
+    PthreadThread *t = (PthreadThread *) arg;
+    t->fn(t->data);
+    return NULL;
+} /* pthreadEntry */
+
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    int rc;
+    PthreadThread *t = (PthreadThread *) allocator.Malloc(sizeof (*t));
+    BAIL_IF(!t, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    t->fn = fn;
+    t->data = data;
+    rc = pthread_create(&t->thread, NULL, pthreadEntry, t);
+    if (rc != 0)
+    {
+        allocator.Free(t);
+        BAIL(errcodeFromErrnoError(rc), NULL);
+    } /* if */
+    return t;
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformWaitThread(void *thread)
+{
+    PthreadThread *t = (PthreadThread *) thread;
+    pthread_join(t->thread, NULL);
+    allocator.Free(t);
+} /* __PHYSFS_platformWaitThread */
+
+
+/* Unnamed POSIX semaphores aren't everywhere (Mac OS X!), so roll one. */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    PHYSFS_uint32 count;
+} PthreadSemaphore;
+
+void *__PHYSFS_platformCreateSemaphore(void)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) allocator.Malloc(sizeof (*s));
+    BAIL_IF(!s, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    if (pthread_mutex_init(&s->mutex, NULL) != 0)
+    {
+        allocator.Free(s);
+        BAIL(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+
+    if (pthread_cond_init(&s->cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&s->mutex);
+        allocator.Free(s);
+        BAIL(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+
+    s->count = 0;
+    return s;
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+    allocator.Free(s);
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    pthread_mutex_lock(&s->mutex);
+    s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+} /* __PHYSFS_platformPostSemaphore */
+
+
+void __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    pthread_mutex_lock(&s->mutex);
+    while (s->count == 0)
+        pthread_cond_wait(&s->cond, &s->mutex);
+    s->count--;
+    pthread_mutex_unlock(&s->mutex);
+} /* __PHYSFS_platformWaitSemaphore */
+
+
 typedef struct
 {
     pthread_mutex_t mutex;
@@ -411,6 +907,102 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
     } /* if */
 } /* __PHYSFS_platformReleaseMutex */
 
+
+void *__PHYSFS_platformCreateDirWatch(void)
+{
+#ifdef __linux__
+    int *retval;
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    BAIL_IF(fd == -1, errcodeFromErrno(), NULL);
+    retval = (int *) allocator.Malloc(sizeof (int));
+    if (!retval)
+    {
+        close(fd);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+    *retval = fd;
+    return retval;
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);  /* !!! FIXME: kqueue? FSEvents? */
+#endif
+} /* __PHYSFS_platformCreateDirWatch */
+
+
+int __PHYSFS_platformAddDirWatch(void *watch, const char *path)
+{
+#ifdef __linux__
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB |
+                          IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                          IN_DELETE_SELF | IN_MOVE_SELF |
+                          IN_ONLYDIR | IN_DONT_FOLLOW;
+    const int wd = inotify_add_watch(*((int *) watch), path, mask);
+    BAIL_IF(wd == -1, errcodeFromErrno(), -1);
+    return wd;
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);
+#endif
+} /* __PHYSFS_platformAddDirWatch */
+
+
+void __PHYSFS_platformRemoveDirWatch(void *watch, int id)
+{
+#ifdef __linux__
+    (void) inotify_rm_watch(*((int *) watch), id);  /* might be gone already. */
+#endif
+} /* __PHYSFS_platformRemoveDirWatch */
+
+
+int __PHYSFS_platformPollDirWatch(void *watch, __PHYSFS_DirWatchCallback cb,
+                                  void *data)
+{
+#ifdef __linux__
+    const int fd = *((int *) watch);
+    union { struct inotify_event ev; char buf[4096]; } events;
+
+    while (1)
+    {
+        const ssize_t br = read(fd, events.buf, sizeof (events.buf));
+        ssize_t i;
+
+        if (br == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            else if (errno == EAGAIN)
+                break;  /* nothing else pending. */
+            BAIL(errcodeFromErrno(), 0);
+        } /* if */
+
+        for (i = 0; i < br; )
+        {
+            const struct inotify_event *ev;
+            ev = (const struct inotify_event *) (events.buf + i);
+            i += sizeof (struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW)
+                cb(data, -1, NULL);
+            else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                cb(data, ev->wd, NULL);
+            else
+                cb(data, ev->wd, (ev->len > 0) ? ev->name : "");
+        } /* for */
+    } /* while */
+
+    return 1;
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#endif
+} /* __PHYSFS_platformPollDirWatch */
+
+
+void __PHYSFS_platformDestroyDirWatch(void *watch)
+{
+#ifdef __linux__
+    close(*((int *) watch));
+    allocator.Free(watch);
+#endif
+} /* __PHYSFS_platformDestroyDirWatch */
+
 #endif  /* PHYSFS_PLATFORM_POSIX */
 
 /* end of physfs_platform_posix.c ... */
@@ -623,8 +623,21 @@ void *__PHYSFS_platformGetThreadID(void)
 } /* __PHYSFS_platformGetThreadID */
 
 
+/* FindFirstFile() hands us the attributes and reparse tag for free. */
+static int findDataFileType(const WIN32_FIND_DATAW *entw)
+{
+    const DWORD attr = entw->dwFileAttributes;
+    if ((attr & PHYSFS_FILE_ATTRIBUTE_REPARSE_POINT) &&
+        (entw->dwReserved0 == PHYSFS_IO_REPARSE_TAG_SYMLINK))
+        return PHYSFS_FILETYPE_SYMLINK;
+    else if (attr & FILE_ATTRIBUTE_DIRECTORY)
+        return PHYSFS_FILETYPE_DIRECTORY;
+    return PHYSFS_FILETYPE_REGULAR;
+} /* findDataFileType */
+
+
 PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
-                               PHYSFS_EnumerateCallback callback,
+                               PHYSFS_EnumerateTypedCallback callback,
                                const char *origdir, void *callbackdata)
 {
     PHYSFS_EnumerateCallbackResult retval = PHYSFS_ENUM_OK;
@@ -675,7 +688,8 @@ PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
             retval = -1;
         else
         {
-            retval = callback(callbackdata, origdir, utf8);
+            retval = callback(callbackdata, origdir, utf8,
+                              findDataFileType(&entw));
             allocator.Free(utf8);
             if (retval == PHYSFS_ENUM_ERROR)
                 PHYSFS_setErrorCode(PHYSFS_ERR_APP_CALLBACK);
@@ -732,6 +746,13 @@ void *__PHYSFS_platformOpenWrite(const char *filename)
 } /* __PHYSFS_platformOpenWrite */
 
 
+void *__PHYSFS_platformOpenNew(const char *filename)
+{
+    HANDLE h = doOpen(filename, GENERIC_WRITE, CREATE_NEW);
+    return (h == INVALID_HANDLE_VALUE) ? NULL : (void *) h;
+} /* __PHYSFS_platformOpenNew */
+
+
 void *__PHYSFS_platformOpenAppend(const char *filename)
 {
     HANDLE h = doOpen(filename, GENERIC_WRITE, OPEN_ALWAYS);
@@ -772,6 +793,94 @@ PHYSFS_sint64 __PHYSFS_platformRead(void *opaque, void *buf, PHYSFS_uint64 len)
 } /* __PHYSFS_platformRead */
 
 
+PHYSFS_sint64 __PHYSFS_platformReadAt(void *opaque, void *_buf,
+                                      PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    HANDLE h = (HANDLE) opaque;
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) _buf;
+    PHYSFS_sint64 totalRead = 0;
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+
+    /* An OVERLAPPED offset on a synchronous handle reads from there; the
+       file pointer moves too, but PhysicsFS doesn't rely on it for handles
+       shared this way. */
+    while (len > 0)
+    {
+        const DWORD thislen = (len > 0xFFFFFFFF) ? 0xFFFFFFFF : (DWORD) len;
+        DWORD numRead = 0;
+        OVERLAPPED ov;
+        memset(&ov, '\0', sizeof (ov));
+        ov.Offset = (DWORD) (offset & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD) (offset >> 32);
+        if (!ReadFile(h, buf, thislen, &numRead, &ov))
+        {
+            if (GetLastError() == ERROR_HANDLE_EOF)
+                break;
+            BAIL(errcodeFromWinApi(), -1);
+        } /* if */
+        buf += numRead;
+        offset += numRead;
+        len -= (PHYSFS_uint64) numRead;
+        totalRead += (PHYSFS_sint64) numRead;
+        if (numRead != thislen)
+            break;
+    } /* while */
+
+    return totalRead;
+} /* __PHYSFS_platformReadAt */
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteAt(void *opaque, const void *_buf,
+                                       PHYSFS_uint64 len, PHYSFS_uint64 offset)
+{
+    HANDLE h = (HANDLE) opaque;
+    const PHYSFS_uint8 *buf = (const PHYSFS_uint8 *) _buf;
+    PHYSFS_sint64 totalWritten = 0;
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+
+    /* This moves the file pointer, too; callers resync it. */
+    while (len > 0)
+    {
+        const DWORD thislen = (len > 0xFFFFFFFF) ? 0xFFFFFFFF : (DWORD) len;
+        DWORD numWritten = 0;
+        OVERLAPPED ov;
+        memset(&ov, '\0', sizeof (ov));
+        ov.Offset = (DWORD) (offset & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD) (offset >> 32);
+        if (!WriteFile(h, buf, thislen, &numWritten, &ov))
+            BAIL(errcodeFromWinApi(), -1);
+        buf += numWritten;
+        offset += numWritten;
+        len -= (PHYSFS_uint64) numWritten;
+        totalWritten += (PHYSFS_sint64) numWritten;
+        if (numWritten != thislen)
+            break;
+    } /* while */
+
+    return totalWritten;
+} /* __PHYSFS_platformWriteAt */
+
+
+/* !!! FIXME: TransmitFile() could do this for sockets. */
+PHYSFS_sint64 __PHYSFS_platformSendFile(int fd, void *opaque,
+                                        PHYSFS_uint64 offset,
+                                        PHYSFS_uint64 len)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);
+} /* __PHYSFS_platformSendFile */
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteFd(int fd, const void *buf,
+                                       PHYSFS_uint64 len)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);  /* no POSIX file descriptors here. */
+} /* __PHYSFS_platformWriteFd */
+
+
 PHYSFS_sint64 __PHYSFS_platformWrite(void *opaque, const void *buffer,
                                      PHYSFS_uint64 len)
 {
@@ -832,6 +941,22 @@ int __PHYSFS_platformFlush(void *opaque)
 } /* __PHYSFS_platformFlush */
 
 
+int __PHYSFS_platformPreallocate(void *opaque, PHYSFS_uint64 len)
+{
+#ifdef PHYSFS_PLATFORM_WINRT
+    HANDLE h = (HANDLE) opaque;
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG) len;
+    BAIL_IF(!SetFileInformationByHandle(h, FileAllocationInfo, &info,
+                                        sizeof (info)), errcodeFromWinApi(), 0);
+    return 1;
+#else
+    /* !!! FIXME: SetFileInformationByHandle() needs Vista. */
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#endif
+} /* __PHYSFS_platformPreallocate */
+
+
 void __PHYSFS_platformClose(void *opaque)
 {
     HANDLE h = (HANDLE) opaque;
@@ -839,6 +964,55 @@ void __PHYSFS_platformClose(void *opaque)
 } /* __PHYSFS_platformClose */
 
 
+static PHYSFS_uint64 winMapGranularity(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (PHYSFS_uint64) info.dwAllocationGranularity;
+} /* winMapGranularity */
+
+
+const void *__PHYSFS_platformMap(void *opaque, PHYSFS_uint64 offset,
+                                 size_t len)
+{
+#ifdef PHYSFS_PLATFORM_WINRT
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);  /* !!! FIXME: MapViewOfFileFromApp */
+#else
+    HANDLE h = (HANDLE) opaque;
+    const size_t slop = (size_t) (offset % winMapGranularity());
+    const PHYSFS_uint64 base = offset - slop;
+    HANDLE mapping;
+    LPVOID ptr;
+
+    BAIL_IF(len == 0, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF(len > ((size_t) -1) - slop, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+
+    mapping = CreateFileMappingW(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    BAIL_IF(mapping == NULL, errcodeFromWinApi(), NULL);
+    ptr = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD) (base >> 32),
+                        (DWORD) (base & 0xFFFFFFFF), len + slop);
+    if (ptr == NULL)
+    {
+        const PHYSFS_ErrorCode err = errcodeFromWinApi();
+        CloseHandle(mapping);
+        BAIL(err, NULL);
+    } /* if */
+
+    CloseHandle(mapping);  /* the view keeps the mapping object alive. */
+    return ((const PHYSFS_uint8 *) ptr) + slop;
+#endif
+} /* __PHYSFS_platformMap */
+
+
+void __PHYSFS_platformUnmap(const void *ptr, PHYSFS_uint64 offset, size_t len)
+{
+#ifndef PHYSFS_PLATFORM_WINRT
+    const size_t slop = (size_t) (offset % winMapGranularity());
+    (void) UnmapViewOfFile(((const PHYSFS_uint8 *) ptr) - slop);
+#endif
+} /* __PHYSFS_platformUnmap */
+
+
 static int doPlatformDelete(LPWSTR wpath)
 {
     WIN32_FILE_ATTRIBUTE_DATA info;
@@ -866,6 +1040,30 @@ int __PHYSFS_platformDelete(const char *path)
 } /* __PHYSFS_platformDelete */
 
 
+int __PHYSFS_platformRename(const char *src, const char *dst)
+{
+    WCHAR *wsrc = NULL;
+    WCHAR *wdst = NULL;
+    BOOL rc;
+
+    UTF8_TO_UNICODE_STACK(wsrc, src);
+    BAIL_IF(!wsrc, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    UTF8_TO_UNICODE_STACK(wdst, dst);
+    if (!wdst)
+    {
+        __PHYSFS_smallFree(wsrc);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    } /* if */
+
+    /* this fails, instead of waiting, if something still has (dst) open. */
+    rc = MoveFileExW(wsrc, wdst, MOVEFILE_REPLACE_EXISTING);
+    __PHYSFS_smallFree(wdst);
+    __PHYSFS_smallFree(wsrc);
+    BAIL_IF(!rc, errcodeFromWinApi(), 0);
+    return 1;
+} /* __PHYSFS_platformRename */
+
+
 void *__PHYSFS_platformCreateMutex(void)
 {
     LPCRITICAL_SECTION lpcs;
@@ -902,6 +1100,165 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
 } /* __PHYSFS_platformReleaseMutex */
 
 
+#ifndef PHYSFS_PLATFORM_WINRT
+typedef struct
+{
+    HANDLE handle;
+    void (*fn)(void *);
+    void *data;
+} WinThread;
+
+static DWORD WINAPI winThreadEntry(LPVOID arg)
+{
+    WinThread *t = (WinThread *) arg;
+    t->fn(t->data);
+    return 0;
+} /* winThreadEntry */
+#endif
+
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+#ifdef PHYSFS_PLATFORM_WINRT
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);  /* !!! FIXME: use the thread pool? */
+#else
+    WinThread *t = (WinThread *) allocator.Malloc(sizeof (WinThread));
+    BAIL_IF(!t, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    t->fn = fn;
+    t->data = data;
+    t->handle = CreateThread(NULL, 0, winThreadEntry, t, 0, NULL);
+    if (!t->handle)
+    {
+        allocator.Free(t);
+        BAIL(errcodeFromWinApi(), NULL);
+    } /* if */
+    return t;
+#endif
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformWaitThread(void *thread)
+{
+#ifndef PHYSFS_PLATFORM_WINRT
+    WinThread *t = (WinThread *) thread;
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    allocator.Free(t);
+#endif
+} /* __PHYSFS_platformWaitThread */
+
+
+void *__PHYSFS_platformCreateSemaphore(void)
+{
+    HANDLE h;
+    #ifdef PHYSFS_PLATFORM_WINRT
+    h = CreateSemaphoreExW(NULL, 0, 0x7FFFFFFF, NULL, 0, SEMAPHORE_ALL_ACCESS);
+    #else
+    h = CreateSemaphoreW(NULL, 0, 0x7FFFFFFF, NULL);
+    #endif
+    BAIL_IF(!h, errcodeFromWinApi(), NULL);
+    return (void *) h;
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    CloseHandle((HANDLE) sem);
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+    ReleaseSemaphore((HANDLE) sem, 1, NULL);
+} /* __PHYSFS_platformPostSemaphore */
+
+
+void __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    WaitForSingleObjectEx((HANDLE) sem, INFINITE, FALSE);
+} /* __PHYSFS_platformWaitSemaphore */
+
+
+/* !!! FIXME: NtCreateFile() with a RootDirectory could do these. */
+void *__PHYSFS_platformOpenDirHandle(const char *path)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformOpenDirHandle */
+
+
+void __PHYSFS_platformCloseDirHandle(void *dir)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformCloseDirHandle */
+
+
+void *__PHYSFS_platformOpenAt(void *dir, const char *relpath, const int mode,
+                              const int confine)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformOpenAt */
+
+
+int __PHYSFS_platformStatAt(void *dir, const char *relpath, PHYSFS_Stat *st,
+                            const int follow)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformStatAt */
+
+
+int __PHYSFS_platformMkDirAt(void *dir, const char *relpath)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformMkDirAt */
+
+
+int __PHYSFS_platformDeleteAt(void *dir, const char *relpath)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformDeleteAt */
+
+
+PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerateAt(void *dir,
+                               const char *relpath,
+                               PHYSFS_EnumerateTypedCallback callback,
+                               const char *origdir, void *callbackdata)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, PHYSFS_ENUM_ERROR);
+} /* __PHYSFS_platformEnumerateAt */
+
+
+/* !!! FIXME: ReadDirectoryChangesW() could do this. */
+void *__PHYSFS_platformCreateDirWatch(void)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformCreateDirWatch */
+
+
+int __PHYSFS_platformAddDirWatch(void *watch, const char *path)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, -1);
+} /* __PHYSFS_platformAddDirWatch */
+
+
+void __PHYSFS_platformRemoveDirWatch(void *watch, int id)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformRemoveDirWatch */
+
+
+int __PHYSFS_platformPollDirWatch(void *watch, __PHYSFS_DirWatchCallback cb,
+                                  void *data)
+{
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformPollDirWatch */
+
+
+void __PHYSFS_platformDestroyDirWatch(void *watch)
+{
+    /* never called; see above. */
+} /* __PHYSFS_platformDestroyDirWatch */
+
+
 static PHYSFS_sint64 FileTimeToPhysfsTime(const FILETIME *ft)
 {
     SYSTEMTIME st_utc;
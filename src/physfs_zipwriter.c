@@ -0,0 +1,911 @@
+/*
+ * ZIP writing support routines for PhysicsFS.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ * This is what's behind PHYSFS_openZipWriter(). It only ever appends: each
+ *  entry is cut into pieces of ZIP_WRITER_PIECE bytes, a pool of threads
+ *  deflates the pieces, and the calling thread reads the next pieces while
+ *  writing out the finished ones, in order.
+ *
+ * A piece after the first gets the 32K of the entry before it as a preset
+ *  dictionary, and ends with an empty stored block (what zlib does for
+ *  Z_SYNC_FLUSH), so the pieces' deflate streams just concatenate into one
+ *  stream for the entry, and big files compress in parallel too; this is
+ *  the same trick pigz uses. It costs a few bytes per megabyte.
+ *
+ * The deflating itself is miniz's tdefl, from physfs_miniz.h, next to the
+ *  tinfl that the zip archiver reads with. Each thread keeps a compressor
+ *  of its own, and primes it with a piece's history before each piece.
+ */
+
+#define __PHYSICSFS_INTERNAL__
+#include "physfs_internal.h"
+
+#if PHYSFS_SUPPORTS_ZIP
+
+#include <time.h>
+
+#define MINIZ_NO_INFLATE_APIS
+#include "physfs_miniz.h"
+
+#define ZIP_LOCAL_FILE_SIG                          0x04034b50
+#define ZIP_CENTRAL_DIR_SIG                         0x02014b50
+#define ZIP_END_OF_CENTRAL_DIR_SIG                  0x06054b50
+#define ZIP64_END_OF_CENTRAL_DIR_SIG                0x06064b50
+#define ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIG  0x07064b50
+#define ZIP64_EXTENDED_INFO_EXTRA_FIELD_SIG         0x0001
+#define ZIP_ALIGNMENT_EXTRA_FIELD_SIG               0xD935  /* zipalign's. */
+
+#define ZIP_LOCAL_HEADER_LEN 30
+#define ZIP_CENTRAL_DIR_RECORD_LEN 46
+
+/* "made by" Unix, so readers take our external attributes as a file mode. */
+#define ZIP_WRITER_MADE_BY ((3 << 8) | 45)
+#define ZIP_WRITER_FILE_ATTR (((PHYSFS_uint32) 0100644) << 16)
+#define ZIP_WRITER_UTF8_NAMES 0x0800  /* general purpose bit 11. */
+
+/* Bytes of an entry per job. */
+#define ZIP_WRITER_PIECE (1024 * 1024)
+
+/*
+ * Entries at least this big get Zip64 sizes in their local header. This is
+ *  under 4 gigabytes, so that deflating something that doesn't compress
+ *  (which grows it a tiny bit) can't push it over.
+ */
+#define ZIP_WRITER_ZIP64_LIMIT ((PHYSFS_uint64) 0xF0000000)
+
+
+/* deflate... */
+
+#define ZIP_DEFLATE_WINDOW TDEFL_LZ_DICT_SIZE  /* how far back matches go. */
+
+typedef tdefl_compressor ZIPdeflater;
+
+static ZIPdeflater *zip_deflate_create(void)
+{
+    ZIPdeflater *d = (ZIPdeflater *) allocator.Malloc(sizeof (ZIPdeflater));
+    BAIL_IF(!d, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    return d;
+} /* zip_deflate_create */
+
+
+/*
+ * Worst case for zip_deflate() output: miniz's mz_compressBound(), which
+ *  allows for everything going out in stored blocks, and has room to spare
+ *  for the empty block at the end of a sync flush.
+ */
+static size_t zip_deflate_bound(const size_t len)
+{
+    return MZ_MAX(128 + (len * 110) / 100,
+                  128 + len + ((len / (31 * 1024)) + 1) * 5);
+} /* zip_deflate_bound */
+
+
+/*
+ * Deflate the (len) bytes at (in + dictlen) into (out), which has room for
+ *  zip_deflate_bound(len) bytes. The (dictlen) bytes before them, up to
+ *  32K, are what came before, for matches to refer back into. If (final)
+ *  is zero, this ends with an empty stored block instead of a final block,
+ *  so more data can follow. Returns the number of bytes written.
+ */
+static size_t zip_deflate(ZIPdeflater *d, const PHYSFS_uint8 *in,
+                          const PHYSFS_uint32 dictlen, const PHYSFS_uint32 len,
+                          const int level, const int final, PHYSFS_uint8 *out)
+{
+    const mz_uint flags = tdefl_create_comp_flags_from_zip_params(level,
+                                -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+    size_t inlen = len;
+    size_t outlen = zip_deflate_bound(len);
+    tdefl_status rc;
+
+    assert((level > 0) && (level <= 9));
+    assert(dictlen <= TDEFL_LZ_DICT_SIZE);
+
+    tdefl_init(d, NULL, NULL, (int) flags);
+    tdefl_set_dictionary(d, in, dictlen);
+    rc = tdefl_compress(d, in + dictlen, &inlen, out, &outlen,
+                        final ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+
+    /* anything short of all of it in (out) means the bound was wrong. */
+    if (rc != (final ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY))
+        return 0;
+    else if ((inlen != len) || (d->m_output_flush_remaining))
+        return 0;
+    return outlen;
+} /* zip_deflate */
+
+
+/* the writer... */
+
+typedef enum
+{
+    ZIP_PIECE_PENDING,  /* waiting for a thread to deflate it. */
+    ZIP_PIECE_BUSY,  /* a thread is deflating it. */
+    ZIP_PIECE_DONE  /* ready to write. */
+} ZipPieceState;
+
+typedef struct ZIPwriteEntry
+{
+    char *name;
+    PHYSFS_uint16 namelen;
+    PHYSFS_uint16 version_needed;
+    PHYSFS_uint16 compression_method;  /* a lone piece can switch to 0. */
+    int level;
+    int zip64;  /* local header has Zip64 sizes. */
+    PHYSFS_uint32 dos_mod_time;
+    PHYSFS_uint32 crc;  /* only final once its last piece is queued. */
+    PHYSFS_uint64 uncompressed_size;
+    PHYSFS_uint64 compressed_size;  /* written so far. */
+    PHYSFS_uint64 offset;  /* of the local header. */
+} ZIPwriteEntry;
+
+typedef struct ZIPwritePiece
+{
+    struct ZIPwritePiece *next;
+    ZIPwriteEntry *entry;
+    PHYSFS_uint8 *buf;  /* (dictlen) bytes of history, then (len) of data. */
+    PHYSFS_uint32 dictlen;
+    PHYSFS_uint32 len;
+    PHYSFS_uint8 *out;  /* deflated data, or NULL to write the data as-is. */
+    size_t outlen;
+    int first;  /* first piece of its entry. */
+    int final;  /* last piece of its entry. */
+    int freeentry;  /* the entry goes away with this piece. */
+    ZipPieceState state;
+    PHYSFS_ErrorCode errcode;
+} ZIPwritePiece;
+
+typedef struct
+{
+    PHYSFS_File *out;
+    PHYSFS_uint64 pos;  /* bytes written to (out) so far. */
+    PHYSFS_uint32 alignment;  /* for stored entries' data; 0 or 1 for none. */
+    __PHYSFS_DirTree tree;  /* every name so far, to catch duplicates. */
+    PHYSFS_uint8 *central;  /* central directory records so far. */
+    size_t centrallen;
+    size_t centralalloc;
+    PHYSFS_uint64 entry_count;
+    PHYSFS_uint8 history[ZIP_DEFLATE_WINDOW];  /* end of the last piece. */
+    PHYSFS_uint32 historylen;
+    ZIPwritePiece *head;  /* oldest queued piece, written next. */
+    ZIPwritePiece *tail;
+    PHYSFS_uint32 queued;
+    PHYSFS_uint32 maxqueued;
+    ZIPdeflater *deflater;  /* the calling thread's, when it pitches in. */
+    void *lock;  /* protects the queue's states while workers run. */
+    void *workready;  /* posted once per piece queued. */
+    void *piecedone;  /* posted once per piece a worker finishes. */
+    void **workers;
+    int numworkers;
+    int quit;
+    PHYSFS_ErrorCode errcode;  /* first failure; nothing works after it. */
+} ZIPwriter;
+
+
+static void zip_writer_poke16(PHYSFS_uint8 *ptr, const PHYSFS_uint32 val)
+{
+    ptr[0] = (PHYSFS_uint8) val;
+    ptr[1] = (PHYSFS_uint8) (val >> 8);
+} /* zip_writer_poke16 */
+
+static void zip_writer_poke32(PHYSFS_uint8 *ptr, const PHYSFS_uint32 val)
+{
+    ptr[0] = (PHYSFS_uint8) val;
+    ptr[1] = (PHYSFS_uint8) (val >> 8);
+    ptr[2] = (PHYSFS_uint8) (val >> 16);
+    ptr[3] = (PHYSFS_uint8) (val >> 24);
+} /* zip_writer_poke32 */
+
+static void zip_writer_poke64(PHYSFS_uint8 *ptr, const PHYSFS_uint64 val)
+{
+    zip_writer_poke32(ptr, (PHYSFS_uint32) val);
+    zip_writer_poke32(ptr + 4, (PHYSFS_uint32) (val >> 32));
+} /* zip_writer_poke64 */
+
+/* 32-bit fields get 0xFFFFFFFF when the real value is in a Zip64 field. */
+static PHYSFS_uint32 zip_writer_clamp32(const PHYSFS_uint64 val)
+{
+    return (val >= 0xFFFFFFFF) ? 0xFFFFFFFF : (PHYSFS_uint32) val;
+} /* zip_writer_clamp32 */
+
+
+static PHYSFS_uint32 zip_writer_dos_time(PHYSFS_sint64 modtime)
+{
+    time_t t;
+    const struct tm *tm;
+
+    if (modtime < 0)
+        modtime = (PHYSFS_sint64) time(NULL);
+
+    t = (time_t) modtime;
+    tm = localtime(&t);
+    if ((tm == NULL) || (tm->tm_year < 80))
+        return (1 << 21) | (1 << 16);  /* DOS time starts in 1980. */
+    else if (tm->tm_year > 207)
+        return (127u << 25) | (12 << 21) | (31 << 16) | (23 << 11) | (59 << 5) | 29;
+
+    return (((PHYSFS_uint32) (tm->tm_year - 80)) << 25) |
+           (((PHYSFS_uint32) (tm->tm_mon + 1)) << 21) |
+           (((PHYSFS_uint32) tm->tm_mday) << 16) |
+           (((PHYSFS_uint32) tm->tm_hour) << 11) |
+           (((PHYSFS_uint32) tm->tm_min) << 5) |
+           (((PHYSFS_uint32) tm->tm_sec) >> 1);
+} /* zip_writer_dos_time */
+
+
+static int zip_writer_write(ZIPwriter *zw, const void *buf, const size_t len)
+{
+    if (len > 0)
+    {
+        const PHYSFS_sint64 rc = PHYSFS_writeBytes(zw->out, buf, len);
+        BAIL_IF_ERRPASS(rc < 0, 0);
+        BAIL_IF(rc != (PHYSFS_sint64) len, PHYSFS_ERR_IO, 0);
+        zw->pos += len;
+    } /* if */
+    return 1;
+} /* zip_writer_write */
+
+
+/* Remember the first failure; everything fails with it from then on. */
+static void zip_writer_fail(ZIPwriter *zw)
+{
+    if (zw->errcode == PHYSFS_ERR_OK)
+    {
+        zw->errcode = PHYSFS_getLastErrorCode();
+        if (zw->errcode == PHYSFS_ERR_OK)
+            zw->errcode = PHYSFS_ERR_OTHER_ERROR;  /* shouldn't happen. */
+    } /* if */
+    PHYSFS_setErrorCode(zw->errcode);
+} /* zip_writer_fail */
+
+
+/* A name can't be added twice, or be a file and a directory both. */
+static int zip_writer_add_name(ZIPwriter *zw, char *name)
+{
+    __PHYSFS_DirTreeEntry *entry;
+    char *sep;
+
+    for (sep = strchr(name, '/'); sep != NULL; sep = strchr(sep + 1, '/'))
+    {
+        *sep = '\0';
+        entry = (__PHYSFS_DirTreeEntry *) __PHYSFS_DirTreeFind(&zw->tree, name);
+        *sep = '/';
+        BAIL_IF(entry && !entry->isdir, PHYSFS_ERR_DUPLICATE, 0);
+    } /* for */
+
+    BAIL_IF(__PHYSFS_DirTreeFind(&zw->tree, name), PHYSFS_ERR_DUPLICATE, 0);
+    BAIL_IF_ERRPASS(!__PHYSFS_DirTreeAdd(&zw->tree, name, 0), 0);
+    return 1;
+} /* zip_writer_add_name */
+
+
+static void zip_writer_deflate_piece(ZIPdeflater **_d, ZIPwritePiece *piece)
+{
+    ZIPwriteEntry *entry = piece->entry;
+
+    if (*_d == NULL)
+        *_d = zip_deflate_create();
+
+    if (*_d == NULL)
+        piece->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+    else if ((piece->out = (PHYSFS_uint8 *) allocator.Malloc(
+                                zip_deflate_bound(piece->len))) == NULL)
+        piece->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+    else
+    {
+        piece->outlen = zip_deflate(*_d, piece->buf, piece->dictlen,
+                                    piece->len, entry->level, piece->final,
+                                    piece->out);
+        if (piece->outlen == 0)
+            piece->errcode = PHYSFS_ERR_OTHER_ERROR;  /* shouldn't happen. */
+
+        /* if deflating a whole entry didn't help, store it instead. */
+        else if ((piece->first) && (piece->final) &&
+                 (piece->outlen >= piece->len))
+        {
+            allocator.Free(piece->out);
+            piece->out = NULL;
+            entry->compression_method = 0;
+        } /* else if */
+    } /* else */
+} /* zip_writer_deflate_piece */
+
+
+/* the first pending piece, marked busy. Call with zw->lock held. */
+static ZIPwritePiece *zip_writer_take_piece(ZIPwriter *zw)
+{
+    ZIPwritePiece *piece;
+    for (piece = zw->head; piece != NULL; piece = piece->next)
+    {
+        if (piece->state == ZIP_PIECE_PENDING)
+        {
+            piece->state = ZIP_PIECE_BUSY;
+            return piece;
+        } /* if */
+    } /* for */
+    return NULL;
+} /* zip_writer_take_piece */
+
+
+static void zip_writer_thread(void *_zw)
+{
+    ZIPwriter *zw = (ZIPwriter *) _zw;
+    ZIPdeflater *d = NULL;
+
+    while (1)
+    {
+        ZIPwritePiece *piece;
+
+        __PHYSFS_platformWaitSemaphore(zw->workready);
+        __PHYSFS_platformGrabMutex(zw->lock);
+        if (zw->quit)
+        {
+            __PHYSFS_platformReleaseMutex(zw->lock);
+            break;
+        } /* if */
+        piece = zip_writer_take_piece(zw);
+        __PHYSFS_platformReleaseMutex(zw->lock);
+
+        if (piece == NULL)
+            continue;  /* the calling thread got to it first. */
+
+        zip_writer_deflate_piece(&d, piece);
+
+        __PHYSFS_platformGrabMutex(zw->lock);
+        piece->state = ZIP_PIECE_DONE;
+        __PHYSFS_platformReleaseMutex(zw->lock);
+        __PHYSFS_platformPostSemaphore(zw->piecedone);
+    } /* while */
+
+    if (d != NULL)
+        allocator.Free(d);
+} /* zip_writer_thread */
+
+
+static int zip_writer_local_header(ZIPwriter *zw, ZIPwriteEntry *entry)
+{
+    PHYSFS_uint8 hdr[ZIP_LOCAL_HEADER_LEN];
+    PHYSFS_uint8 extra[20 + 6 + 32768];
+    PHYSFS_uint32 extralen = 0;
+
+    entry->offset = zw->pos;
+    if (entry->zip64)
+    {
+        /* the real sizes get patched in later, unless it's one piece. */
+        zip_writer_poke16(extra, ZIP64_EXTENDED_INFO_EXTRA_FIELD_SIG);
+        zip_writer_poke16(extra + 2, 16);
+        zip_writer_poke64(extra + 4, entry->uncompressed_size);
+        zip_writer_poke64(extra + 12, entry->compressed_size);
+        extralen = 20;
+    } /* if */
+
+    /* pad stored data out to the alignment, like Android's zipalign. */
+    if ((entry->compression_method == 0) && (zw->alignment > 1))
+    {
+        const PHYSFS_uint64 datapos = zw->pos + ZIP_LOCAL_HEADER_LEN +
+                                      entry->namelen + extralen + 6;
+        const PHYSFS_uint32 pad = (PHYSFS_uint32)
+                ((zw->alignment - (datapos % zw->alignment)) % zw->alignment);
+        zip_writer_poke16(extra + extralen, ZIP_ALIGNMENT_EXTRA_FIELD_SIG);
+        zip_writer_poke16(extra + extralen + 2, 2 + pad);
+        zip_writer_poke16(extra + extralen + 4, zw->alignment);
+        memset(extra + extralen + 6, '\0', pad);
+        extralen += 6 + pad;
+    } /* if */
+
+    zip_writer_poke32(hdr, ZIP_LOCAL_FILE_SIG);
+    zip_writer_poke16(hdr + 4, entry->version_needed);
+    zip_writer_poke16(hdr + 6, ZIP_WRITER_UTF8_NAMES);
+    zip_writer_poke16(hdr + 8, entry->compression_method);
+    zip_writer_poke32(hdr + 10, entry->dos_mod_time);
+    zip_writer_poke32(hdr + 14, entry->crc);
+    if (entry->zip64)
+    {
+        zip_writer_poke32(hdr + 18, 0xFFFFFFFF);
+        zip_writer_poke32(hdr + 22, 0xFFFFFFFF);
+    } /* if */
+    else
+    {
+        zip_writer_poke32(hdr + 18, (PHYSFS_uint32) entry->compressed_size);
+        zip_writer_poke32(hdr + 22, (PHYSFS_uint32) entry->uncompressed_size);
+    } /* else */
+    zip_writer_poke16(hdr + 26, entry->namelen);
+    zip_writer_poke16(hdr + 28, extralen);
+
+    BAIL_IF_ERRPASS(!zip_writer_write(zw, hdr, sizeof (hdr)), 0);
+    BAIL_IF_ERRPASS(!zip_writer_write(zw, entry->name, entry->namelen), 0);
+    BAIL_IF_ERRPASS(!zip_writer_write(zw, extra, extralen), 0);
+    return 1;
+} /* zip_writer_local_header */
+
+
+/* An entry in more than one piece got its header before its CRC and size. */
+static int zip_writer_patch_local_header(ZIPwriter *zw, ZIPwriteEntry *entry)
+{
+    PHYSFS_uint8 buf[16];
+    PHYSFS_File *out = zw->out;
+
+    zip_writer_poke32(buf, entry->crc);
+    zip_writer_poke32(buf + 4, entry->zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) entry->compressed_size);
+    zip_writer_poke32(buf + 8, entry->zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) entry->uncompressed_size);
+    BAIL_IF_ERRPASS(!PHYSFS_seek(out, entry->offset + 14), 0);
+    BAIL_IF(PHYSFS_writeBytes(out, buf, 12) != 12, PHYSFS_ERR_IO, 0);
+
+    if (entry->zip64)
+    {
+        const PHYSFS_uint64 pos = entry->offset + ZIP_LOCAL_HEADER_LEN +
+                                  entry->namelen + 4;
+        zip_writer_poke64(buf, entry->uncompressed_size);
+        zip_writer_poke64(buf + 8, entry->compressed_size);
+        BAIL_IF_ERRPASS(!PHYSFS_seek(out, pos), 0);
+        BAIL_IF(PHYSFS_writeBytes(out, buf, 16) != 16, PHYSFS_ERR_IO, 0);
+    } /* if */
+
+    BAIL_IF_ERRPASS(!PHYSFS_seek(out, zw->pos), 0);
+    return 1;
+} /* zip_writer_patch_local_header */
+
+
+static int zip_writer_add_central(ZIPwriter *zw, const ZIPwriteEntry *entry)
+{
+    const int bigusize = (entry->uncompressed_size >= 0xFFFFFFFF);
+    const int bigcsize = (entry->compressed_size >= 0xFFFFFFFF);
+    const int bigoffset = (entry->offset >= 0xFFFFFFFF);
+    PHYSFS_uint8 extra[28];
+    PHYSFS_uint32 extralen = 0;
+    size_t needed;
+    PHYSFS_uint8 *ptr;
+
+    if (bigusize || bigcsize || bigoffset)
+    {
+        extralen = 4;
+        if (bigusize)
+        {
+            zip_writer_poke64(extra + extralen, entry->uncompressed_size);
+            extralen += 8;
+        } /* if */
+        if (bigcsize)
+        {
+            zip_writer_poke64(extra + extralen, entry->compressed_size);
+            extralen += 8;
+        } /* if */
+        if (bigoffset)
+        {
+            zip_writer_poke64(extra + extralen, entry->offset);
+            extralen += 8;
+        } /* if */
+        zip_writer_poke16(extra, ZIP64_EXTENDED_INFO_EXTRA_FIELD_SIG);
+        zip_writer_poke16(extra + 2, extralen - 4);
+    } /* if */
+
+    needed = ZIP_CENTRAL_DIR_RECORD_LEN + entry->namelen + extralen;
+    if (zw->centrallen + needed > zw->centralalloc)
+    {
+        size_t newalloc = zw->centralalloc ? zw->centralalloc * 2 : 64 * 1024;
+        void *newbuf;
+        while (newalloc < zw->centrallen + needed)
+            newalloc *= 2;
+        newbuf = allocator.Realloc(zw->central, newalloc);
+        BAIL_IF(!newbuf, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        zw->central = (PHYSFS_uint8 *) newbuf;
+        zw->centralalloc = newalloc;
+    } /* if */
+
+    ptr = zw->central + zw->centrallen;
+    zip_writer_poke32(ptr, ZIP_CENTRAL_DIR_SIG);
+    zip_writer_poke16(ptr + 4, ZIP_WRITER_MADE_BY);
+    zip_writer_poke16(ptr + 6, entry->version_needed);
+    zip_writer_poke16(ptr + 8, ZIP_WRITER_UTF8_NAMES);
+    zip_writer_poke16(ptr + 10, entry->compression_method);
+    zip_writer_poke32(ptr + 12, entry->dos_mod_time);
+    zip_writer_poke32(ptr + 16, entry->crc);
+    zip_writer_poke32(ptr + 20, zip_writer_clamp32(entry->compressed_size));
+    zip_writer_poke32(ptr + 24, zip_writer_clamp32(entry->uncompressed_size));
+    zip_writer_poke16(ptr + 28, entry->namelen);
+    zip_writer_poke16(ptr + 30, extralen);
+    zip_writer_poke16(ptr + 32, 0);  /* comment length. */
+    zip_writer_poke16(ptr + 34, 0);  /* starting disk. */
+    zip_writer_poke16(ptr + 36, 0);  /* internal attributes. */
+    zip_writer_poke32(ptr + 38, ZIP_WRITER_FILE_ATTR);
+    zip_writer_poke32(ptr + 42, zip_writer_clamp32(entry->offset));
+    memcpy(ptr + ZIP_CENTRAL_DIR_RECORD_LEN, entry->name, entry->namelen);
+    memcpy(ptr + ZIP_CENTRAL_DIR_RECORD_LEN + entry->namelen, extra, extralen);
+
+    zw->centrallen += needed;
+    zw->entry_count++;
+    return 1;
+} /* zip_writer_add_central */
+
+
+static int zip_writer_write_piece(ZIPwriter *zw, ZIPwritePiece *piece)
+{
+    ZIPwriteEntry *entry = piece->entry;
+    const PHYSFS_uint8 *data = piece->out ? piece->out : (piece->buf + piece->dictlen);
+    const size_t datalen = piece->out ? piece->outlen : piece->len;
+
+    BAIL_IF(piece->errcode, piece->errcode, 0);
+
+    if (piece->first)
+    {
+        if (piece->final)  /* one piece: we know everything already. */
+            entry->compressed_size = datalen;
+        BAIL_IF_ERRPASS(!zip_writer_local_header(zw, entry), 0);
+        entry->compressed_size = 0;
+    } /* if */
+
+    BAIL_IF_ERRPASS(!zip_writer_write(zw, data, datalen), 0);
+    entry->compressed_size += datalen;
+
+    if (piece->final)
+    {
+        if (!piece->first)
+            BAIL_IF_ERRPASS(!zip_writer_patch_local_header(zw, entry), 0);
+        BAIL_IF_ERRPASS(!zip_writer_add_central(zw, entry), 0);
+    } /* if */
+
+    return 1;
+} /* zip_writer_write_piece */
+
+
+static void zip_writer_free_piece(ZIPwritePiece *piece)
+{
+    if (piece->freeentry)
+        allocator.Free(piece->entry);
+    if (piece->out)
+        allocator.Free(piece->out);
+    allocator.Free(piece->buf);
+    allocator.Free(piece);
+} /* zip_writer_free_piece */
+
+
+/*
+ * Write out the oldest queued piece, deflating it here if no worker has
+ *  started on it yet. While a worker has it, this thread deflates later
+ *  pieces instead of just waiting. After a failure, this only throws
+ *  pieces away.
+ */
+static int zip_writer_retire(ZIPwriter *zw)
+{
+    ZIPwritePiece *piece;
+    int retval = 1;
+
+    while (1)
+    {
+        ZIPwritePiece *mine = NULL;
+        int ready = 0;
+        int busy = 0;
+
+        __PHYSFS_platformGrabMutex(zw->lock);
+        piece = zw->head;
+        if (piece->state == ZIP_PIECE_DONE)
+            ready = 1;
+        else if (zw->errcode)
+        {
+            /* we failed earlier; throw it away once nobody's using it. */
+            ready = (piece->state == ZIP_PIECE_PENDING);
+            busy = !ready;
+        } /* else if */
+        else
+        {
+            mine = zip_writer_take_piece(zw);
+            busy = (mine == NULL);
+        } /* else */
+
+        if (ready)  /* unlink it while nobody can take it. */
+        {
+            zw->head = piece->next;
+            if (zw->head == NULL)
+                zw->tail = NULL;
+            zw->queued--;
+        } /* if */
+        __PHYSFS_platformReleaseMutex(zw->lock);
+
+        if (ready)
+            break;
+        else if (busy)
+            __PHYSFS_platformWaitSemaphore(zw->piecedone);
+        else  /* deflate it here instead of waiting on a worker. */
+        {
+            zip_writer_deflate_piece(&zw->deflater, mine);
+            __PHYSFS_platformGrabMutex(zw->lock);
+            mine->state = ZIP_PIECE_DONE;
+            __PHYSFS_platformReleaseMutex(zw->lock);
+        } /* else */
+    } /* while */
+
+    if (zw->errcode)
+        retval = 0;
+    else if (!zip_writer_write_piece(zw, piece))
+    {
+        zip_writer_fail(zw);
+        retval = 0;
+    } /* else if */
+
+    zip_writer_free_piece(piece);
+    return retval;
+} /* zip_writer_retire */
+
+
+static int zip_writer_queue(ZIPwriter *zw, ZIPwritePiece *piece)
+{
+    piece->next = NULL;
+    __PHYSFS_platformGrabMutex(zw->lock);
+    if (zw->tail == NULL)
+        zw->head = piece;
+    else
+        zw->tail->next = piece;
+    zw->tail = piece;
+    zw->queued++;
+    __PHYSFS_platformReleaseMutex(zw->lock);
+
+    if ((zw->numworkers > 0) && (piece->state == ZIP_PIECE_PENDING))
+        __PHYSFS_platformPostSemaphore(zw->workready);
+
+    while (zw->queued > zw->maxqueued)
+        BAIL_IF_ERRPASS(!zip_writer_retire(zw), 0);
+
+    return 1;
+} /* zip_writer_queue */
+
+
+static void zip_writer_destroy(ZIPwriter *zw)
+{
+    int i;
+
+    while (zw->head != NULL)
+    {
+        if (zw->errcode == PHYSFS_ERR_OK)
+            zw->errcode = PHYSFS_ERR_OTHER_ERROR;  /* just throw it away. */
+        zip_writer_retire(zw);
+    } /* while */
+
+    if (zw->numworkers > 0)
+    {
+        __PHYSFS_platformGrabMutex(zw->lock);
+        zw->quit = 1;
+        __PHYSFS_platformReleaseMutex(zw->lock);
+        for (i = 0; i < zw->numworkers; i++)
+            __PHYSFS_platformPostSemaphore(zw->workready);
+        for (i = 0; i < zw->numworkers; i++)
+            __PHYSFS_platformWaitThread(zw->workers[i]);
+    } /* if */
+
+    if (zw->workers) allocator.Free(zw->workers);
+    if (zw->piecedone) __PHYSFS_platformDestroySemaphore(zw->piecedone);
+    if (zw->workready) __PHYSFS_platformDestroySemaphore(zw->workready);
+    if (zw->lock) __PHYSFS_platformDestroyMutex(zw->lock);
+    if (zw->deflater) allocator.Free(zw->deflater);
+    if (zw->central) allocator.Free(zw->central);
+    __PHYSFS_DirTreeDeinit(&zw->tree);
+    allocator.Free(zw);
+} /* zip_writer_destroy */
+
+
+void *__PHYSFS_zipWriterCreate(PHYSFS_File *out, int threads,
+                               const PHYSFS_uint32 alignment)
+{
+    ZIPwriter *zw;
+    const PHYSFS_sint64 pos = PHYSFS_tell(out);
+
+    BAIL_IF_ERRPASS(pos < 0, NULL);
+    zw = (ZIPwriter *) allocator.Malloc(sizeof (ZIPwriter));
+    BAIL_IF(!zw, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(zw, '\0', sizeof (*zw));
+    zw->out = out;
+    zw->pos = (PHYSFS_uint64) pos;
+    zw->alignment = alignment;
+
+    if (!__PHYSFS_DirTreeInit(&zw->tree, sizeof (__PHYSFS_DirTreeEntry)))
+    {
+        allocator.Free(zw);
+        return NULL;
+    } /* if */
+
+    zw->lock = __PHYSFS_platformCreateMutex();
+    GOTO_IF_ERRPASS(!zw->lock, createZipWriter_failed);
+
+    if (threads < 1)
+        threads = 1;
+
+    /* keep a few pieces per thread in flight, so nobody's waiting on I/O. */
+    zw->maxqueued = ((PHYSFS_uint32) threads) * 2;
+
+    /* if we can't get helpers, we'll just do all the work here. */
+    if (threads > 1)
+    {
+        zw->workready = __PHYSFS_platformCreateSemaphore();
+        zw->piecedone = __PHYSFS_platformCreateSemaphore();
+        if ((zw->workready != NULL) && (zw->piecedone != NULL))
+            zw->workers = (void **) allocator.Malloc(sizeof (void *) * (threads - 1));
+
+        while ((zw->workers != NULL) && (zw->numworkers < threads - 1))
+        {
+            void *thread = __PHYSFS_platformCreateThread(zip_writer_thread, zw);
+            if (thread == NULL)
+                break;
+            zw->workers[zw->numworkers++] = thread;
+        } /* while */
+    } /* if */
+
+    return zw;
+
+createZipWriter_failed:
+    zip_writer_destroy(zw);
+    return NULL;
+} /* __PHYSFS_zipWriterCreate */
+
+
+int __PHYSFS_zipWriterAdd(void *opaque, char *name, const void *buf,
+                          PHYSFS_File *in, const PHYSFS_uint64 len,
+                          const PHYSFS_sint64 modtime, int level)
+{
+    ZIPwriter *zw = (ZIPwriter *) opaque;
+    const PHYSFS_uint8 *src = (const PHYSFS_uint8 *) buf;
+    const size_t namelen = strlen(name);
+    PHYSFS_uint64 remaining = len;
+    ZIPwriteEntry *entry;
+    ZIPwritePiece *piece = NULL;
+    int entryqueued = 0;  /* its final piece is queued, and will free it. */
+
+    BAIL_IF(zw->errcode, zw->errcode, 0);
+    BAIL_IF(namelen > 0xFFFF, PHYSFS_ERR_BAD_FILENAME, 0);
+    BAIL_IF_ERRPASS(!zip_writer_add_name(zw, name), 0);
+
+    /* from here on, the archive is in an unknown state if something fails. */
+
+    entry = (ZIPwriteEntry *) allocator.Malloc(sizeof (ZIPwriteEntry) + namelen + 1);
+    GOTO_IF(!entry, PHYSFS_ERR_OUT_OF_MEMORY, zipWriterAdd_failed);
+    memset(entry, '\0', sizeof (*entry));
+    entry->name = (char *) (entry + 1);
+    memcpy(entry->name, name, namelen + 1);
+    entry->namelen = (PHYSFS_uint16) namelen;
+    entry->level = (len == 0) ? 0 : level;
+    entry->compression_method = (entry->level > 0) ? 8 : 0;
+    entry->zip64 = (len >= ZIP_WRITER_ZIP64_LIMIT);
+    entry->version_needed = entry->zip64 ? 45 : 20;
+    entry->dos_mod_time = zip_writer_dos_time(modtime);
+    entry->uncompressed_size = len;
+
+    zw->historylen = 0;
+
+    do
+    {
+        const PHYSFS_uint32 piecelen = (PHYSFS_uint32)
+              ((remaining < ZIP_WRITER_PIECE) ? remaining : ZIP_WRITER_PIECE);
+        const PHYSFS_uint32 dictlen = (entry->level > 0) ? zw->historylen : 0;
+        ZIPwritePiece *queued;
+        PHYSFS_uint8 *data;
+
+        piece = (ZIPwritePiece *) allocator.Malloc(sizeof (ZIPwritePiece));
+        GOTO_IF(!piece, PHYSFS_ERR_OUT_OF_MEMORY, zipWriterAdd_failed);
+        memset(piece, '\0', sizeof (*piece));
+        piece->buf = (PHYSFS_uint8 *) allocator.Malloc(dictlen + piecelen + 1);
+        GOTO_IF(!piece->buf, PHYSFS_ERR_OUT_OF_MEMORY, zipWriterAdd_failed);
+
+        data = piece->buf + dictlen;
+        memcpy(piece->buf, zw->history, dictlen);
+        if (src != NULL)
+            memcpy(data, src + (len - remaining), piecelen);
+        else if (piecelen > 0)
+        {
+            const PHYSFS_sint64 br = PHYSFS_readBytes(in, data, piecelen);
+            GOTO_IF_ERRPASS(br < 0, zipWriterAdd_failed);
+            GOTO_IF(br != (PHYSFS_sint64) piecelen, PHYSFS_ERR_PAST_EOF,
+                    zipWriterAdd_failed);  /* it got shorter? */
+        } /* else if */
+
+        entry->crc = __PHYSFS_zipCrc32(entry->crc, data, piecelen);
+
+        piece->entry = entry;
+        piece->dictlen = dictlen;
+        piece->len = piecelen;
+        piece->first = (remaining == len);
+        remaining -= piecelen;
+        piece->final = piece->freeentry = (remaining == 0);
+        piece->state = (entry->level > 0) ? ZIP_PIECE_PENDING : ZIP_PIECE_DONE;
+
+        if ((remaining > 0) && (entry->level > 0))
+        {
+            const PHYSFS_uint32 total = dictlen + piecelen;
+            const PHYSFS_uint32 keep = (total < ZIP_DEFLATE_WINDOW) ? total : ZIP_DEFLATE_WINDOW;
+            memcpy(zw->history, piece->buf + (total - keep), keep);
+            zw->historylen = keep;
+        } /* if */
+
+        entryqueued = piece->final;
+        queued = piece;
+        piece = NULL;  /* the queue owns it now. */
+        GOTO_IF_ERRPASS(!zip_writer_queue(zw, queued), zipWriterAdd_failed);
+    } while (remaining > 0);
+
+    return 1;
+
+zipWriterAdd_failed:
+    if (piece != NULL)
+    {
+        if (piece->buf)
+            allocator.Free(piece->buf);
+        allocator.Free(piece);
+    } /* if */
+
+    /*
+     * If the entry's final piece got queued, that piece frees it. Otherwise,
+     *  if any of its pieces are still queued, the newest one has to.
+     */
+    if ((entry != NULL) && (!entryqueued))
+    {
+        if ((zw->tail != NULL) && (zw->tail->entry == entry))
+            zw->tail->freeentry = 1;
+        else
+            allocator.Free(entry);
+    } /* if */
+
+    zip_writer_fail(zw);
+    return 0;
+} /* __PHYSFS_zipWriterAdd */
+
+
+int __PHYSFS_zipWriterClose(void *opaque)
+{
+    ZIPwriter *zw = (ZIPwriter *) opaque;
+    PHYSFS_uint8 buf[56 + 20 + 22];
+    PHYSFS_uint8 *ptr = buf;
+    PHYSFS_uint64 central_ofs;
+    int retval = 0;
+
+    while ((zw->head != NULL) && (zip_writer_retire(zw))) { /* spin. */ }
+    GOTO_IF(zw->errcode, zw->errcode, zipWriterClose_done);
+
+    central_ofs = zw->pos;
+    GOTO_IF_ERRPASS(!zip_writer_write(zw, zw->central, zw->centrallen),
+                    zipWriterClose_done);
+
+    if ((zw->entry_count >= 0xFFFF) || (central_ofs >= 0xFFFFFFFF) ||
+        (zw->centrallen >= 0xFFFFFFFF))
+    {
+        const PHYSFS_uint64 eocd64_ofs = zw->pos;
+        zip_writer_poke32(ptr, ZIP64_END_OF_CENTRAL_DIR_SIG);
+        zip_writer_poke64(ptr + 4, 44);  /* size of the rest of this. */
+        zip_writer_poke16(ptr + 12, ZIP_WRITER_MADE_BY);
+        zip_writer_poke16(ptr + 14, 45);
+        zip_writer_poke32(ptr + 16, 0);  /* this disk. */
+        zip_writer_poke32(ptr + 20, 0);  /* central dir's disk. */
+        zip_writer_poke64(ptr + 24, zw->entry_count);
+        zip_writer_poke64(ptr + 32, zw->entry_count);
+        zip_writer_poke64(ptr + 40, zw->centrallen);
+        zip_writer_poke64(ptr + 48, central_ofs);
+        ptr += 56;
+
+        zip_writer_poke32(ptr, ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIG);
+        zip_writer_poke32(ptr + 4, 0);  /* the zip64 record's disk. */
+        zip_writer_poke64(ptr + 8, eocd64_ofs);
+        zip_writer_poke32(ptr + 16, 1);  /* total disks. */
+        ptr += 20;
+    } /* if */
+
+    zip_writer_poke32(ptr, ZIP_END_OF_CENTRAL_DIR_SIG);
+    zip_writer_poke16(ptr + 4, 0);  /* this disk. */
+    zip_writer_poke16(ptr + 6, 0);  /* central dir's disk. */
+    zip_writer_poke16(ptr + 8, (zw->entry_count >= 0xFFFF) ? 0xFFFF : (PHYSFS_uint32) zw->entry_count);
+    zip_writer_poke16(ptr + 10, (zw->entry_count >= 0xFFFF) ? 0xFFFF : (PHYSFS_uint32) zw->entry_count);
+    zip_writer_poke32(ptr + 12, zip_writer_clamp32(zw->centrallen));
+    zip_writer_poke32(ptr + 16, zip_writer_clamp32(central_ofs));
+    zip_writer_poke16(ptr + 20, 0);  /* comment length. */
+    ptr += 22;
+
+    GOTO_IF_ERRPASS(!zip_writer_write(zw, buf, (size_t) (ptr - buf)),
+                    zipWriterClose_done);
+    retval = 1;
+
+zipWriterClose_done:
+    if (!PHYSFS_close(zw->out))
+        retval = 0;
+    zip_writer_destroy(zw);
+    return retval;
+} /* __PHYSFS_zipWriterClose */
+
+#endif  /* defined PHYSFS_SUPPORTS_ZIP */
+
+/* end of physfs_zipwriter.c ... */
+
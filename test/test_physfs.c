@@ -36,6 +36,11 @@
 
 static FILE *history_file = NULL;
 static PHYSFS_uint32 do_buffer_size = 0;
+static int do_adaptive_buffer = 0;
+static PHYSFS_uint32 do_adaptive_min = 0;
+static PHYSFS_uint32 do_adaptive_max = 0;
+static PHYSFS_uint32 do_writebehind_size = 0;
+static PHYSFS_ZipWriter *zip_writer = NULL;
 
 static void output_versions(void)
 {
@@ -103,6 +108,13 @@ static int cmd_init(char *args)
 
 static int cmd_deinit(char *args)
 {
+    if (zip_writer != NULL)
+    {
+        printf("Closing the open zip writer first.\n");
+        PHYSFS_closeZipWriter(zip_writer);
+        zip_writer = NULL;
+    } /* if */
+
     if (PHYSFS_deinit())
         printf("Successful.\n");
     else
@@ -441,6 +453,42 @@ static int cmd_setwritedir(char *args)
 } /* cmd_setwritedir */
 
 
+static int cmd_setindexcachedir(char *args)
+{
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    /* an empty string turns the cache off. */
+    if (PHYSFS_setIndexCacheDir((*args) ? args : NULL))
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_setindexcachedir */
+
+
+static int cmd_setarchivemapping(char *args)
+{
+    int num;
+
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    num = atoi(args);
+    PHYSFS_setArchiveMapping(num);
+    printf("New archive mounts will %sbe mapped into memory.\n",
+           PHYSFS_getArchiveMapping() ? "" : "not ");
+    return 1;
+} /* cmd_setarchivemapping */
+
+
 static int cmd_permitsyms(char *args)
 {
     int num;
@@ -458,6 +506,269 @@ static int cmd_permitsyms(char *args)
 } /* cmd_permitsyms */
 
 
+static int cmd_setsymlinkcheckcache(char *args)
+{
+    int num;
+
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    num = atoi(args);
+    PHYSFS_setSymlinkCheckCache(num);
+    if (PHYSFS_getSymlinkCheckCache() == 0)
+        printf("Symlink checks are no longer cached.\n");
+    else if (PHYSFS_getSymlinkCheckCache() < 0)
+        printf("Symlink checks are now cached until unmount.\n");
+    else
+        printf("Symlink checks are now cached for %d seconds.\n", num);
+
+    return 1;
+} /* cmd_setsymlinkcheckcache */
+
+
+static int cmd_setdirectoryindexing(char *args)
+{
+    int num;
+
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    num = atoi(args);
+    PHYSFS_setDirectoryIndexing(num);
+    printf("Directories mounted from now on will %sbe indexed.\n",
+           PHYSFS_getDirectoryIndexing() ? "" : "not ");
+    return 1;
+} /* cmd_setdirectoryindexing */
+
+
+static int cmd_setdecoderpoolsize(char *args)
+{
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    if (PHYSFS_setDecoderPoolSize(atoi(args)))
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_setdecoderpoolsize */
+
+
+static int cmd_getdecoderpoolsize(char *args)
+{
+    printf("Decoder pool size is (%d).\n", PHYSFS_getDecoderPoolSize());
+    return 1;
+} /* cmd_getdecoderpoolsize */
+
+
+static int cmd_setsolidcachelimit(char *args)
+{
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    PHYSFS_setSolidCacheLimit(((PHYSFS_uint64) atoi(args)) << 20);
+    printf("Successful.\n");
+    return 1;
+} /* cmd_setsolidcachelimit */
+
+
+static int cmd_getsolidcachelimit(char *args)
+{
+    const PHYSFS_uint64 limit = PHYSFS_getSolidCacheLimit();
+    printf("Solid cache limit is (%d) megabytes.\n", (int) (limit >> 20));
+    return 1;
+} /* cmd_getsolidcachelimit */
+
+
+static int cmd_setchecksumverification(char *args)
+{
+    int num;
+
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    num = atoi(args);
+    PHYSFS_setChecksumVerification(num);
+    printf("Checksum verification is now %s.\n",
+           PHYSFS_getChecksumVerification() ? "on" : "off");
+    return 1;
+} /* cmd_setchecksumverification */
+
+
+static int cmd_verifyarchive(char *args)
+{
+    char *ptr;
+
+    if (*args == '\"')
+    {
+        args++;
+        ptr = strchr(args, '\"');
+        if (ptr == NULL)
+        {
+            printf("missing string terminator in argument.\n");
+            return 1;
+        } /* if */
+        *(ptr) = '\0';
+    } /* if */
+    else
+    {
+        ptr = strchr(args, ' ');
+        *ptr = '\0';
+    } /* else */
+
+    if (PHYSFS_verifyArchive(args, atoi(ptr + 1)))
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_verifyarchive */
+
+
+static int cmd_setdecoderdictionary(char *args)
+{
+    PHYSFS_File *f = NULL;
+    PHYSFS_sint64 len = 0;
+    char *buf = NULL;
+    char *dictname;
+    char *ptr;
+    int rc;
+
+    if (*args == '\"')
+    {
+        args++;
+        ptr = strchr(args, '\"');
+        if (ptr == NULL)
+        {
+            printf("missing string terminator in argument.\n");
+            return 1;
+        } /* if */
+        *(ptr) = '\0';
+    } /* if */
+    else
+    {
+        ptr = strchr(args, ' ');
+        *ptr = '\0';
+    } /* else */
+
+    dictname = ptr + 1;
+    if (*dictname == '\"')
+    {
+        dictname++;
+        ptr = strchr(dictname, '\"');
+        if (ptr == NULL)
+        {
+            printf("missing string terminator in argument.\n");
+            return 1;
+        } /* if */
+        *(ptr) = '\0';
+    } /* if */
+
+    /* an empty string drops the dictionary. */
+    if (*dictname)
+    {
+        f = PHYSFS_openRead(dictname);
+        if (f == NULL)
+        {
+            printf("failed to open '%s'. Reason: [%s].\n", dictname,
+                   PHYSFS_getLastError());
+            return 1;
+        } /* if */
+
+        len = PHYSFS_fileLength(f);
+        buf = (len > 0) ? (char *) malloc((size_t) len) : NULL;
+        if ((buf == NULL) || (PHYSFS_readBytes(f, buf, len) != len))
+        {
+            printf("failed to read '%s'. Reason: [%s].\n", dictname,
+                   PHYSFS_getLastError());
+            PHYSFS_close(f);
+            free(buf);
+            return 1;
+        } /* if */
+        PHYSFS_close(f);
+    } /* if */
+
+    rc = PHYSFS_setDecoderDictionary(args, buf, (PHYSFS_uint64) len);
+    free(buf);  /* PhysicsFS made its own copy. */
+
+    if (rc)
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_setdecoderdictionary */
+
+
+static int cmd_setresolveonmount(char *args)
+{
+    int num;
+
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    num = atoi(args);
+    PHYSFS_setResolveOnMount(num);
+    printf("Archives mounted from now on will %sbe resolved up front.\n",
+           PHYSFS_getResolveOnMount() ? "" : "not ");
+    return 1;
+} /* cmd_setresolveonmount */
+
+
+static int cmd_setlazymounting(char *args)
+{
+    int num;
+
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    num = atoi(args);
+    PHYSFS_setLazyMounting(num);
+    printf("Archives mounted from now on will %sbe mounted lazily.\n",
+           PHYSFS_getLazyMounting() ? "" : "not ");
+    return 1;
+} /* cmd_setlazymounting */
+
+
+static int cmd_resolvearchive(char *args)
+{
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    if (PHYSFS_resolveArchive(args))
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_resolvearchive */
+
+
 static int cmd_setbuffer(char *args)
 {
     if (*args == '\"')
@@ -482,6 +793,35 @@ static int cmd_setbuffer(char *args)
 } /* cmd_setbuffer */
 
 
+static int cmd_setadaptivebuffer(char *args)
+{
+    char *ptr = strchr(args, ' ');
+
+    if (ptr == NULL)
+    {
+        printf("usage: setadaptivebuffer <minSize> <maxSize>\n");
+        return 1;
+    } /* if */
+
+    do_adaptive_min = (unsigned int) atoi(args);
+    do_adaptive_max = (unsigned int) atoi(ptr + 1);
+    do_adaptive_buffer = 1;
+    if (do_adaptive_max)
+    {
+        printf("Further cats will set an adaptive buffer of (%lu) to (%lu).\n",
+                (unsigned long) do_adaptive_min,
+                (unsigned long) do_adaptive_max);
+    } /* if */
+
+    else
+    {
+        printf("Further cats will turn off default buffering.\n");
+    } /* else */
+
+    return 1;
+} /* cmd_setadaptivebuffer */
+
+
 static int cmd_stressbuffer(char *args)
 {
     int num;
@@ -682,6 +1022,30 @@ static int cmd_stressbuffer(char *args)
 } /* cmd_stressbuffer */
 
 
+static int cmd_setwritebehind(char *args)
+{
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    do_writebehind_size = (unsigned int) atoi(args);
+    if (do_writebehind_size)
+    {
+        printf("Further writes will use (%lu) byte write-behind chunks.\n",
+                (unsigned long) do_writebehind_size);
+    } /* if */
+
+    else
+    {
+        printf("Further writes will NOT use write-behind.\n");
+    } /* else */
+
+    return 1;
+} /* cmd_setwritebehind */
+
+
 static int cmd_setsaneconfig(char *args)
 {
     char *org;
@@ -844,6 +1208,17 @@ static int cmd_cat(char *args)
             } /* if */
         } /* if */
 
+        else if (do_adaptive_buffer)
+        {
+            if (!PHYSFS_setAdaptiveBuffer(f, do_adaptive_min, do_adaptive_max))
+            {
+                printf("failed to set adaptive buffer. Reason: [%s].\n",
+                        PHYSFS_getLastError());
+                PHYSFS_close(f);
+                return 1;
+            } /* if */
+        } /* else if */
+
         while (1)
         {
             char buffer[128];
@@ -871,6 +1246,53 @@ static int cmd_cat(char *args)
     return 1;
 } /* cmd_cat */
 
+
+static int cmd_sendtofd(char *args)
+{
+    PHYSFS_File *f;
+
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    f = PHYSFS_openRead(args);
+    if (f == NULL)
+        printf("failed to open. Reason: [%s].\n", PHYSFS_getLastError());
+    else
+    {
+        const PHYSFS_sint64 len = PHYSFS_fileLength(f);
+        PHYSFS_sint64 total = 0;
+        PHYSFS_sint64 rc = 0;
+
+        fflush(stdout);  /* don't let stdio's buffer land after our data. */
+        while ((len >= 0) && (total < len))
+        {
+            rc = PHYSFS_sendToFd(f, fileno(stdout), (PHYSFS_uint64) total,
+                                 (PHYSFS_uint64) (len - total));
+            if (rc <= 0)
+                break;
+            total += rc;
+        } /* while */
+
+        printf("\n\n");
+        if ((len < 0) || (rc < 0))
+        {
+            printf(" (Error condition in sending. Reason: [%s])\n\n",
+                   PHYSFS_getLastError());
+        } /* if */
+        else
+        {
+            printf(" (Sent (cast to int) %d of %d bytes.)\n\n",
+                   (int) total, (int) len);
+        } /* else */
+        PHYSFS_close(f);
+    } /* else */
+
+    return 1;
+} /* cmd_sendtofd */
+
 static int cmd_cat2(char *args)
 {
     PHYSFS_File *f1 = NULL;
@@ -1128,6 +1550,17 @@ static int cmd_append(char *args)
             } /* if */
         } /* if */
 
+        if (do_writebehind_size)
+        {
+            if (!PHYSFS_setWriteBehind(f, do_writebehind_size, 0))
+            {
+                printf("failed to set write-behind. Reason: [%s].\n",
+                        PHYSFS_getLastError());
+                PHYSFS_close(f);
+                return 1;
+            } /* if */
+        } /* if */
+
         bw = strlen(WRITESTR);
         rc = PHYSFS_writeBytes(f, WRITESTR, bw);
         if (rc != bw)
@@ -1176,6 +1609,17 @@ static int cmd_write(char *args)
             } /* if */
         } /* if */
 
+        if (do_writebehind_size)
+        {
+            if (!PHYSFS_setWriteBehind(f, do_writebehind_size, 0))
+            {
+                printf("failed to set write-behind. Reason: [%s].\n",
+                        PHYSFS_getLastError());
+                PHYSFS_close(f);
+                return 1;
+            } /* if */
+        } /* if */
+
         bw = strlen(WRITESTR);
         rc = PHYSFS_writeBytes(f, WRITESTR, bw);
         if (rc != bw)
@@ -1195,6 +1639,129 @@ static int cmd_write(char *args)
 } /* cmd_write */
 
 
+/* Cut the first, maybe quoted, argument off (args); returns the rest. */
+static char *split_first_arg(char *args)
+{
+    char *ptr;
+
+    if (*args == '\"')
+    {
+        ptr = strchr(args + 1, '\"');
+        if (ptr == NULL)
+        {
+            printf("missing string terminator in argument.\n");
+            return NULL;
+        } /* if */
+        *(ptr++) = '\0';
+        memmove(args, args + 1, strlen(args));  /* drop the open quote. */
+    } /* if */
+    else
+    {
+        ptr = strchr(args, ' ');
+    } /* else */
+
+    if ((ptr == NULL) || (*ptr != ' '))
+    {
+        printf("missing argument.\n");
+        return NULL;
+    } /* if */
+
+    *(ptr++) = '\0';
+    while (*ptr == ' ')
+        ptr++;
+    return ptr;
+} /* split_first_arg */
+
+
+static int cmd_openzipwriter(char *args)
+{
+    char *threads = split_first_arg(args);
+    char *alignment = threads ? split_first_arg(threads) : NULL;
+
+    if (alignment == NULL)
+        return 1;
+    else if (zip_writer != NULL)
+    {
+        printf("A zip writer is already open; close it first.\n");
+        return 1;
+    } /* else if */
+
+    zip_writer = PHYSFS_openZipWriter(args, atoi(threads),
+                                      (PHYSFS_uint32) atoi(alignment));
+    if (zip_writer != NULL)
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_openzipwriter */
+
+
+static int cmd_addzipentry(char *args)
+{
+    char *level = split_first_arg(args);
+
+    if (level == NULL)
+        return 1;
+    else if (zip_writer == NULL)
+    {
+        printf("No zip writer is open.\n");
+        return 1;
+    } /* else if */
+
+    if (PHYSFS_addZipEntry(zip_writer, args, WRITESTR, strlen(WRITESTR),
+                           -1, atoi(level)))
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_addzipentry */
+
+
+static int cmd_addzipentryfromfile(char *args)
+{
+    char *srcname = split_first_arg(args);
+    char *level = srcname ? split_first_arg(srcname) : NULL;
+
+    if (level == NULL)
+        return 1;
+    else if (zip_writer == NULL)
+    {
+        printf("No zip writer is open.\n");
+        return 1;
+    } /* else if */
+
+    if (PHYSFS_addZipEntryFromFile(zip_writer, args, srcname, atoi(level)))
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_addzipentryfromfile */
+
+
+static int cmd_closezipwriter(char *args)
+{
+    int rc;
+
+    if (zip_writer == NULL)
+    {
+        printf("No zip writer is open.\n");
+        return 1;
+    } /* if */
+
+    rc = PHYSFS_closeZipWriter(zip_writer);
+    zip_writer = NULL;  /* it's gone either way. */
+    if (rc)
+        printf("Successful.\n");
+    else
+        printf("Failure. reason: %s.\n", PHYSFS_getLastError());
+
+    return 1;
+} /* cmd_closezipwriter */
+
+
 static char* modTimeToStr(PHYSFS_sint64 modtime, char *modstr, size_t strsize)
 {
     if (modtime < 0)
@@ -1322,6 +1889,20 @@ static const command_info commands[] =
     { "getwritedir",    cmd_getwritedir,    0, NULL                         },
     { "setwritedir",    cmd_setwritedir,    1, "<newWriteDir>"              },
     { "permitsymlinks", cmd_permitsyms,     1, "<1or0>"                     },
+    { "setsymlinkcheckcache", cmd_setsymlinkcheckcache, 1, "<ttlSeconds>" },
+    { "setdirectoryindexing", cmd_setdirectoryindexing, 1, "<1or0>"       },
+    { "setdecoderpoolsize", cmd_setdecoderpoolsize, 1, "<count>"          },
+    { "getdecoderpoolsize", cmd_getdecoderpoolsize, 0, NULL               },
+    { "setsolidcachelimit", cmd_setsolidcachelimit, 1, "<megabytes>"      },
+    { "getsolidcachelimit", cmd_getsolidcachelimit, 0, NULL               },
+    { "setchecksumverification", cmd_setchecksumverification, 1, "<1or0>" },
+    { "verifyarchive",  cmd_verifyarchive,  2, "<archiveLocation> <threads>" },
+    { "setdecoderdictionary", cmd_setdecoderdictionary, 2, "<archiveLocation> <dictFileOrEmptyString>" },
+    { "setresolveonmount", cmd_setresolveonmount, 1, "<1or0>"             },
+    { "resolvearchive", cmd_resolvearchive, 1, "<archiveLocation>"          },
+    { "setlazymounting", cmd_setlazymounting, 1, "<1or0>"                 },
+    { "setindexcachedir", cmd_setindexcachedir, 1, "<dirOrEmptyString>"   },
+    { "setarchivemapping", cmd_setarchivemapping, 1, "<1or0>"             },
     { "setsaneconfig",  cmd_setsaneconfig,  5, "<org> <appName> <arcExt> <includeCdRoms> <archivesFirst>" },
     { "mkdir",          cmd_mkdir,          1, "<dirToMk>"                  },
     { "delete",         cmd_delete,         1, "<dirToDelete>"              },
@@ -1330,14 +1911,21 @@ static const command_info commands[] =
     { "isdir",          cmd_isdir,          1, "<fileToCheck>"              },
     { "issymlink",      cmd_issymlink,      1, "<fileToCheck>"              },
     { "cat",            cmd_cat,            1, "<fileToCat>"                },
+    { "sendtofd",       cmd_sendtofd,       1, "<fileToSendToStdout>"       },
     { "cat2",           cmd_cat2,           2, "<fileToCat1> <fileToCat2>"  },
     { "filelength",     cmd_filelength,     1, "<fileToCheck>"              },
     { "stat",           cmd_stat,           1, "<fileToStat>"               },
     { "append",         cmd_append,         1, "<fileToAppend>"             },
     { "write",          cmd_write,          1, "<fileToCreateOrTrash>"      },
+    { "openzipwriter",  cmd_openzipwriter,  3, "<zipToCreate> <threads> <alignment>" },
+    { "addzipentry",    cmd_addzipentry,    2, "<nameInZip> <level>"        },
+    { "addzipentryfromfile", cmd_addzipentryfromfile, 3, "<nameInZip> <fileToAdd> <level>" },
+    { "closezipwriter", cmd_closezipwriter, 0, NULL                         },
     { "getlastmodtime", cmd_getlastmodtime, 1, "<fileToExamine>"            },
     { "setbuffer",      cmd_setbuffer,      1, "<bufferSize>"               },
     { "stressbuffer",   cmd_stressbuffer,   1, "<bufferSize>"               },
+    { "setadaptivebuffer", cmd_setadaptivebuffer, 2, "<minSize> <maxSize>"  },
+    { "setwritebehind", cmd_setwritebehind, 1, "<chunkSize>"                },
     { "crc32",          cmd_crc32,          1, "<fileToHash>"               },
     { "getmountpoint",  cmd_getmountpoint,  1, "<dir>"                      },
     { NULL,             NULL,              -1, NULL                         }
@@ -1585,6 +2173,9 @@ int main(int argc, char **argv)
             free(buf);
     } while (rc);
 
+    if (zip_writer != NULL)
+        PHYSFS_closeZipWriter(zip_writer);
+
     if (!PHYSFS_deinit())
         printf("PHYSFS_deinit() failed!\n  reason: %s.\n", PHYSFS_getLastError());
 
@@ -0,0 +1,305 @@
+/**
+ * Round-trip test for PHYSFS_openZipWriter() and friends.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ * This builds a few .zip files in the directory named on the command line,
+ *  with every compression level, a handful of threads, and data that
+ *  compresses well, badly and not at all, in sizes that take one piece or
+ *  several. Then it mounts each one and checks that every file reads back
+ *  exactly as it went in. Exits with zero if everything matched.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "physfs.h"
+
+#define TEST_SRCFILE "test_zipwriter.src"
+
+typedef enum
+{
+    DATA_EMPTY,
+    DATA_TEXT,      /* repeats a lot, with matches across pieces. */
+    DATA_SKEWED,    /* random, but from a small alphabet. */
+    DATA_RANDOM,    /* doesn't compress at all. */
+    DATA_RUNS       /* long runs of one byte. */
+} DataType;
+
+typedef struct
+{
+    const char *name;
+    DataType type;
+    PHYSFS_uint32 len;
+    int level;
+    int fromfile;  /* add with PHYSFS_addZipEntryFromFile(). */
+} TestEntry;
+
+static const TestEntry entries[] = {
+    { "empty.txt", DATA_EMPTY, 0, 6, 0 },
+    { "tiny.txt", DATA_TEXT, 5, 9, 0 },
+    { "store/text.txt", DATA_TEXT, 100000, 0, 0 },
+    { "l1/text.txt", DATA_TEXT, 2500000, 1, 0 },
+    { "l6/text.txt", DATA_TEXT, 2500000, 6, 0 },
+    { "l9/text.txt", DATA_TEXT, 2500000, 9, 0 },
+    { "default/text.txt", DATA_TEXT, 300000, -1, 0 },
+    { "l1/skewed.bin", DATA_SKEWED, 1500000, 1, 0 },
+    { "l9/skewed.bin", DATA_SKEWED, 1500000, 9, 0 },
+    { "l6/random.bin", DATA_RANDOM, 3000000, 6, 0 },
+    { "l6/small-random.bin", DATA_RANDOM, 1000, 6, 0 },
+    { "l6/runs.bin", DATA_RUNS, 2100000, 6, 0 },
+    { "file/text.txt", DATA_TEXT, 1300000, 9, 1 },
+    { "file/random.bin", DATA_RANDOM, 1100000, 0, 1 }
+};
+
+#define TOTAL_ENTRIES (sizeof (entries) / sizeof (entries[0]))
+
+
+static void make_data(const TestEntry *entry, PHYSFS_uint8 *buf)
+{
+    static const char *words[] = {
+        "the ", "cat ", "sat ", "on ", "mat ", "and ", "a ", "dog ",
+        "ate ", "my ", "homework, ", "again.\n"
+    };
+    PHYSFS_uint32 seed = (PHYSFS_uint32) entry->len;
+    PHYSFS_uint32 i = 0;
+
+    while (i < entry->len)
+    {
+        seed = (seed * 1103515245) + 12345;
+
+        if (entry->type == DATA_TEXT)
+        {
+            const char *str = words[(seed >> 16) % 12];
+            while ((*str) && (i < entry->len))
+                buf[i++] = (PHYSFS_uint8) *(str++);
+        } /* if */
+
+        else if (entry->type == DATA_SKEWED)
+            buf[i++] = (PHYSFS_uint8) ('a' + ((seed >> 16) % 7));
+
+        else if (entry->type == DATA_RANDOM)
+            buf[i++] = (PHYSFS_uint8) (seed >> 16);
+
+        else  /* DATA_RUNS */
+        {
+            PHYSFS_uint32 run = ((seed >> 16) % 5000) + 1;
+            const PHYSFS_uint8 val = (PHYSFS_uint8) (seed >> 8);
+            while ((run--) && (i < entry->len))
+                buf[i++] = val;
+        } /* else */
+    } /* while */
+} /* make_data */
+
+
+static int write_srcfile(const PHYSFS_uint8 *buf, const PHYSFS_uint32 len)
+{
+    PHYSFS_File *f = PHYSFS_openWrite(TEST_SRCFILE);
+    int rc;
+
+    if (f == NULL)
+        return 0;
+
+    rc = (PHYSFS_writeBytes(f, buf, len) == (PHYSFS_sint64) len);
+    return PHYSFS_close(f) && rc;
+} /* write_srcfile */
+
+
+static int build_zip(const char *zipname, const int threads,
+                     PHYSFS_uint8 **bufs)
+{
+    PHYSFS_ZipWriter *zw = PHYSFS_openZipWriter(zipname, threads, 0);
+    size_t i;
+
+    if (zw == NULL)
+    {
+        printf("openZipWriter(%s) failed: %s\n", zipname,
+               PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 0;
+    } /* if */
+
+    for (i = 0; i < TOTAL_ENTRIES; i++)
+    {
+        const TestEntry *entry = &entries[i];
+        int rc;
+
+        if (!entry->fromfile)
+        {
+            rc = PHYSFS_addZipEntry(zw, entry->name, bufs[i], entry->len,
+                                    -1, entry->level);
+        } /* if */
+        else
+        {
+            rc = write_srcfile(bufs[i], entry->len) &&
+                 PHYSFS_addZipEntryFromFile(zw, entry->name, TEST_SRCFILE,
+                                            entry->level);
+        } /* else */
+
+        if (!rc)
+        {
+            printf("adding %s to %s failed: %s\n", entry->name, zipname,
+                   PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            PHYSFS_closeZipWriter(zw);
+            return 0;
+        } /* if */
+    } /* for */
+
+    if (!PHYSFS_closeZipWriter(zw))
+    {
+        printf("closeZipWriter(%s) failed: %s\n", zipname,
+               PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 0;
+    } /* if */
+
+    return 1;
+} /* build_zip */
+
+
+static int check_entry(const char *zipname, const TestEntry *entry,
+                       const PHYSFS_uint8 *expected, PHYSFS_uint8 *buf)
+{
+    char path[256];
+    PHYSFS_File *f;
+    PHYSFS_sint64 br;
+
+    sprintf(path, "zw/%s", entry->name);
+    f = PHYSFS_openRead(path);
+    if (f == NULL)
+    {
+        printf("%s: can't open %s: %s\n", zipname, entry->name,
+               PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 0;
+    } /* if */
+
+    /* read one byte past the end, to be sure there's nothing extra. */
+    br = PHYSFS_readBytes(f, buf, ((PHYSFS_uint64) entry->len) + 1);
+    PHYSFS_close(f);
+
+    if (br != (PHYSFS_sint64) entry->len)
+    {
+        printf("%s: %s read back (%d) of (%d) bytes.\n", zipname,
+               entry->name, (int) br, (int) entry->len);
+        return 0;
+    } /* if */
+    else if (memcmp(buf, expected, entry->len) != 0)
+    {
+        printf("%s: %s read back wrong.\n", zipname, entry->name);
+        return 0;
+    } /* else if */
+
+    return 1;
+} /* check_entry */
+
+
+static int check_zip(const char *dir, const char *zipname,
+                     PHYSFS_uint8 **bufs, PHYSFS_uint8 *readbuf)
+{
+    const char *dirsep = PHYSFS_getDirSeparator();
+    char *realname;
+    int retval = 1;
+    size_t i;
+
+    realname = (char *) malloc(strlen(dir) + strlen(dirsep) +
+                               strlen(zipname) + 1);
+    if (realname == NULL)
+    {
+        printf("out of memory.\n");
+        return 0;
+    } /* if */
+    sprintf(realname, "%s%s%s", dir, dirsep, zipname);
+
+    if (!PHYSFS_mount(realname, "zw", 0))
+    {
+        printf("mounting %s failed: %s\n", realname,
+               PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        free(realname);
+        return 0;
+    } /* if */
+
+    for (i = 0; i < TOTAL_ENTRIES; i++)
+    {
+        if (!check_entry(zipname, &entries[i], bufs[i], readbuf))
+            retval = 0;
+    } /* for */
+
+    PHYSFS_unmount(realname);
+    free(realname);
+    return retval;
+} /* check_zip */
+
+
+int main(int argc, char **argv)
+{
+    static const int threads[] = { 1, 2, 4 };
+    PHYSFS_uint8 *bufs[TOTAL_ENTRIES];
+    PHYSFS_uint8 *readbuf = NULL;
+    PHYSFS_uint32 biggest = 0;
+    int failed = 0;
+    size_t i;
+
+    if (argc != 2)
+    {
+        printf("USAGE: %s <scratchDir>\n", argv[0]);
+        return 2;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        printf("PHYSFS_init() failed: %s\n",
+               PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    /* PHYSFS_addZipEntryFromFile() reads its source through the search path. */
+    if ((!PHYSFS_setWriteDir(argv[1])) || (!PHYSFS_mount(argv[1], NULL, 1)))
+    {
+        printf("can't use %s: %s\n", argv[1],
+               PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        PHYSFS_deinit();
+        return 1;
+    } /* if */
+
+    for (i = 0; i < TOTAL_ENTRIES; i++)
+    {
+        bufs[i] = (PHYSFS_uint8 *) malloc(entries[i].len + 1);
+        if (bufs[i] == NULL)
+        {
+            printf("out of memory.\n");
+            return 1;
+        } /* if */
+        make_data(&entries[i], bufs[i]);
+        if (entries[i].len > biggest)
+            biggest = entries[i].len;
+    } /* for */
+
+    readbuf = (PHYSFS_uint8 *) malloc(biggest + 1);
+    if (readbuf == NULL)
+    {
+        printf("out of memory.\n");
+        return 1;
+    } /* if */
+
+    for (i = 0; i < sizeof (threads) / sizeof (threads[0]); i++)
+    {
+        char zipname[64];
+        sprintf(zipname, "test_zipwriter-%d.zip", threads[i]);
+
+        if ((!build_zip(zipname, threads[i], bufs)) ||
+            (!check_zip(argv[1], zipname, bufs, readbuf)))
+            failed = 1;
+        else
+            printf("%s: all %d files match.\n", zipname, (int) TOTAL_ENTRIES);
+    } /* for */
+
+    for (i = 0; i < TOTAL_ENTRIES; i++)
+        free(bufs[i]);
+    free(readbuf);
+
+    PHYSFS_delete(TEST_SRCFILE);
+
+    PHYSFS_deinit();
+    return failed;
+} /* main */